@@ -0,0 +1,203 @@
+/**
+ * Copyright (C) 2017 Genome Research Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @file arena.c
+ * @author Keith James <kdj@sanger.ac.uk>
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+
+#include <jansson.h>
+
+#include "config.h"
+#include "arena.h"
+
+// Every allocation is preceded by a header recording the arena it
+// came from, or NULL if it came from the heap, so that the free hook
+// can tell them apart. The header is padded to keep the allocation
+// suitably aligned for any type.
+typedef union alloc_header {
+    json_arena_t *arena;
+    long double align_ld;
+    void *align_ptr;
+    long long align_ll;
+} alloc_header_t;
+
+typedef struct arena_block {
+    struct arena_block *next;
+    size_t used;
+    alloc_header_t data[];
+} arena_block_t;
+
+struct json_arena {
+    /** The block from which allocations are currently made */
+    arena_block_t *head;
+    /** Blocks retained for reuse after a reset */
+    arena_block_t *spare;
+    size_t num_spare;
+};
+
+#define BLOCK_CAPACITY (JSON_ARENA_BLOCK_SIZE - sizeof (arena_block_t))
+
+static pthread_once_t arena_once = PTHREAD_ONCE_INIT;
+static int arenas_enabled = 0;
+static __thread json_arena_t *current_arena = NULL;
+
+static void *heap_alloc(size_t size) {
+    alloc_header_t *header = malloc(sizeof (alloc_header_t) + size);
+    if (!header) return NULL;
+
+    header->arena = NULL;
+
+    return header + 1;
+}
+
+static arena_block_t *take_block(json_arena_t *arena) {
+    arena_block_t *block = arena->spare;
+
+    if (block) {
+        arena->spare = block->next;
+        arena->num_spare--;
+    }
+    else {
+        block = malloc(JSON_ARENA_BLOCK_SIZE);
+        if (!block) return NULL;
+    }
+
+    block->used = 0;
+    block->next = arena->head;
+    arena->head = block;
+
+    return block;
+}
+
+static void *arena_malloc(size_t size) {
+    json_arena_t *arena = current_arena;
+
+    if (!arena || size > JSON_ARENA_MAX_ALLOC_SIZE) return heap_alloc(size);
+
+    // The number of header-sized units needed, including the header
+    size_t units = 1 + (size + sizeof (alloc_header_t) - 1) /
+        sizeof (alloc_header_t);
+    size_t nbytes = units * sizeof (alloc_header_t);
+
+    arena_block_t *block = arena->head;
+    if (!block || BLOCK_CAPACITY - block->used < nbytes) {
+        block = take_block(arena);
+        if (!block) return heap_alloc(size);
+    }
+
+    alloc_header_t *header = block->data + block->used / sizeof (alloc_header_t);
+    block->used += nbytes;
+    header->arena = arena;
+
+    return header + 1;
+}
+
+static void arena_free(void *ptr) {
+    if (!ptr) return;
+
+    alloc_header_t *header = (alloc_header_t *) ptr - 1;
+
+    // Arena memory is reclaimed only when its arena is reset
+    if (!header->arena) free(header);
+}
+
+static void install_hooks(void) {
+    json_set_alloc_funcs(arena_malloc, arena_free);
+    arenas_enabled = 1;
+}
+
+void enable_json_arenas(void) {
+    pthread_once(&arena_once, install_hooks);
+}
+
+int json_arenas_enabled(void) {
+    return arenas_enabled;
+}
+
+json_arena_t *make_json_arena(void) {
+    if (!arenas_enabled) return NULL;
+
+    return calloc(1, sizeof (json_arena_t));
+}
+
+json_arena_t *use_json_arena(json_arena_t *arena) {
+    json_arena_t *previous = current_arena;
+    current_arena = arena;
+
+    return previous;
+}
+
+void reset_json_arena(json_arena_t *arena) {
+    if (!arena) return;
+
+    arena_block_t *block = arena->head;
+    while (block) {
+        arena_block_t *next = block->next;
+
+        if (arena->num_spare < JSON_ARENA_RETAINED_BLOCKS) {
+            block->next  = arena->spare;
+            arena->spare = block;
+            arena->num_spare++;
+        }
+        else {
+            free(block);
+        }
+
+        block = next;
+    }
+
+    arena->head = NULL;
+}
+
+void free_json_arena(json_arena_t *arena) {
+    if (!arena) return;
+
+    reset_json_arena(arena);
+
+    arena_block_t *block = arena->spare;
+    while (block) {
+        arena_block_t *next = block->next;
+        free(block);
+        block = next;
+    }
+
+    if (current_arena == arena) current_arena = NULL;
+
+    free(arena);
+}
+
+size_t json_arena_used(const json_arena_t *arena) {
+    size_t used = 0;
+    if (!arena) return used;
+
+    for (arena_block_t *block = arena->head; block; block = block->next) {
+        used += block->used;
+    }
+
+    return used;
+}
+
+void free_json_mem(void *ptr) {
+    if (arenas_enabled) {
+        arena_free(ptr);
+    }
+    else {
+        free(ptr);
+    }
+}
@@ -0,0 +1,103 @@
+/**
+ * Copyright (C) 2017 Genome Research Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @file arena.h
+ * @author Keith James <kdj@sanger.ac.uk>
+ */
+
+#ifndef _BATON_ARENA_H
+#define _BATON_ARENA_H
+
+#include <stddef.h>
+
+#include "config.h"
+
+/** The size of each block of memory allocated by an arena */
+#define JSON_ARENA_BLOCK_SIZE      (64 * 1024)
+/** Allocations larger than this are made from the heap, not an arena */
+#define JSON_ARENA_MAX_ALLOC_SIZE  (16 * 1024)
+/** The number of blocks an arena keeps for reuse when it is reset */
+#define JSON_ARENA_RETAINED_BLOCKS 16
+
+/**
+ *  @struct json_arena
+ *  @brief A region of memory for the JSON values of one input item,
+ *  released all at once.
+ */
+typedef struct json_arena json_arena_t;
+
+/**
+ * Install the arena allocator as jansson's memory allocator. Until an
+ * arena is put into use, allocations are made from the heap as usual.
+ * This must be called before any JSON value is created, because values
+ * created earlier cannot be freed by the arena allocator. It may be
+ * called more than once.
+ */
+void enable_json_arenas(void);
+
+/**
+ * Return true if the arena allocator is installed.
+ */
+int json_arenas_enabled(void);
+
+/**
+ * Make a new, empty arena.
+ *
+ * @return A new arena, which must be freed by the caller, or NULL if
+ *         arenas are not enabled.
+ */
+json_arena_t *make_json_arena(void);
+
+/**
+ * Set the arena from which JSON values created by the calling thread
+ * are allocated. Values allocated from an arena may be freed by any
+ * thread, but their memory is only reclaimed when the arena is reset.
+ *
+ * @param[in] arena  An arena, or NULL to allocate from the heap.
+ *
+ * @return The arena previously in use by the calling thread.
+ */
+json_arena_t *use_json_arena(json_arena_t *arena);
+
+/**
+ * Reclaim all the memory allocated from an arena. No JSON value
+ * allocated from the arena may be used afterwards.
+ *
+ * @param[in] arena  An arena. Optional.
+ */
+void reset_json_arena(json_arena_t *arena);
+
+void free_json_arena(json_arena_t *arena);
+
+/**
+ * Return the number of bytes allocated from an arena since it was
+ * last reset, including the headers of the allocations.
+ *
+ * @param[in] arena  An arena. Optional.
+ *
+ * @return The number of bytes, or 0 if there is no arena.
+ */
+size_t json_arena_used(const json_arena_t *arena);
+
+/**
+ * Free memory allocated by jansson on behalf of the caller, such as
+ * the string returned by json_dumps.
+ *
+ * @param[in] ptr  The memory to free.
+ */
+void free_json_mem(void *ptr);
+
+#endif // _BATON_ARENA_H
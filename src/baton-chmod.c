@@ -18,6 +18,7 @@
  * @author Keith James <kdj@sanger.ac.uk>
  */
 
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <getopt.h>
@@ -39,6 +40,7 @@ int main(int argc, char *argv[]) {
     int exit_status = 0;
     char *json_file = NULL;
     FILE *input     = NULL;
+    size_t num_transfers = TREE_DEFAULT_TRANSFERS;
 
     while (1) {
         static struct option long_options[] = {
@@ -53,11 +55,12 @@ int main(int argc, char *argv[]) {
             {"version",    no_argument, &version_flag,    1},
             // Indexed options
             {"file",      required_argument, NULL, 'f'},
+            {"transfers", required_argument, NULL, 'T'},
             {0, 0, 0, 0}
         };
 
         int option_index = 0;
-        int c = getopt_long_only(argc, argv, "f:",
+        int c = getopt_long_only(argc, argv, "f:T:",
                                  long_options, &option_index);
 
         /* Detect the end of the options. */
@@ -68,6 +71,11 @@ int main(int argc, char *argv[]) {
                 json_file = optarg;
                 break;
 
+            case 'T':
+                num_transfers = parse_size(optarg);
+                if (errno != 0) num_transfers = TREE_DEFAULT_TRANSFERS;
+                break;
+
             case '?':
                 // getopt_long already printed an error message
                 break;
@@ -85,8 +93,8 @@ int main(int argc, char *argv[]) {
         "Synopsis\n"
         "\n"
         "    baton-chmod [--file <json file>] [--recurse] [--silent]\n"
-        "                [--unbuffered] [--unsafe] [--verbose]\n"
-        "                [--version]\n"
+        "                [--transfers <n>] [--unbuffered] [--unsafe]\n"
+        "                [--verbose] [--version]\n"
         "\n"
         "Description\n"
         "    Set permissions on collections and data objects\n"
@@ -97,7 +105,10 @@ int main(int argc, char *argv[]) {
         "    --recurse     Modify collection permissions recursively.\n"
         "                  Optional, defaults to false.\n"
         "    --silent      Silence error messages.\n"
-        "    --unbuffered  Flush print operations for each JSON object.\n"
+        "    --transfers   The number of permission changes to send at\n"
+        "                  once, each on its own connection. Optional,\n"
+        "                  defaults to 4.\n"
+        "    --unbuffered  Flush output promptly, in batches of objects.\n"
         "    --unsafe      Permit unsafe relative iRODS paths.\n"
         "    --verbose     Print verbose messages to STDERR.\n"
         "    --version     Print the version number and exit.\n";
@@ -121,9 +132,18 @@ int main(int argc, char *argv[]) {
     if (silent_flag)  set_log_threshold(FATAL);
 
     declare_client_name(argv[0]);
+    enable_json_arenas();
     input = maybe_stdin(json_file);
 
-    operation_args_t args = { .flags = flags };
+    if (num_transfers > TREE_MAX_TRANSFERS) {
+        logmsg(WARN, "Requested number of transfers %zu exceeds "
+               "maximum of %d. Setting number of transfers to %d",
+               num_transfers, TREE_MAX_TRANSFERS, TREE_MAX_TRANSFERS);
+        num_transfers = TREE_MAX_TRANSFERS;
+    }
+
+    operation_args_t args = { .flags         = flags,
+                              .num_transfers = num_transfers };
 
     int status = do_operation(input, baton_json_chmod_op, &args);
     if (input != stdin) fclose(input);
@@ -0,0 +1,154 @@
+/**
+ * Copyright (C) 2017 Genome Research Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @author Keith James <kdj@sanger.ac.uk>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <getopt.h>
+
+#include "config.h"
+#include "baton.h"
+
+static int debug_flag   = 0;
+static int help_flag    = 0;
+static int silent_flag  = 0;
+static int verbose_flag = 0;
+static int version_flag = 0;
+
+int main(int argc, char *argv[]) {
+    int exit_status   = 0;
+    char *json_file   = NULL;
+    char *socket_path = NULL;
+    FILE *input       = NULL;
+
+    while (1) {
+        static struct option long_options[] = {
+            // Flag options
+            {"debug",   no_argument, &debug_flag,   1},
+            {"help",    no_argument, &help_flag,    1},
+            {"silent",  no_argument, &silent_flag,  1},
+            {"verbose", no_argument, &verbose_flag, 1},
+            {"version", no_argument, &version_flag, 1},
+            // Indexed options
+            {"file",    required_argument, NULL, 'f'},
+            {"socket",  required_argument, NULL, 's'},
+            {0, 0, 0, 0}
+        };
+
+        int option_index = 0;
+        int c = getopt_long_only(argc, argv, "f:s:",
+                                 long_options, &option_index);
+
+        /* Detect the end of the options. */
+        if (c == -1) break;
+
+        switch (c) {
+            case 'f':
+                json_file = optarg;
+                break;
+
+            case 's':
+                socket_path = optarg;
+                break;
+
+            case '?':
+                // getopt_long already printed an error message
+                break;
+
+            default:
+                // Ignore
+                break;
+        }
+    }
+
+    const char *help =
+        "Name\n"
+        "    baton-client\n"
+        "\n"
+        "Synopsis\n"
+        "\n"
+        "    baton-client [--file <JSON file>] [--silent]\n"
+        "                 [--socket <path>] [--verbose] [--version]\n"
+        "\n"
+        "Description\n"
+        "    Sends JSON documents describing remote operations to a\n"
+        "    running baton-server and prints the results. The input,\n"
+        "    output and exit status are the same as those of baton-do.\n"
+        ""
+        "    --file        The JSON file describing the operations.\n"
+        "                  Optional, defaults to STDIN.\n"
+        "    --silent      Silence error messages.\n"
+        "    --socket      The path of the server socket. Optional,\n"
+        "                  defaults to $BATON_SOCKET, or\n"
+        "                  baton-server.sock in $XDG_RUNTIME_DIR.\n"
+        "    --verbose     Print verbose messages to STDERR.\n"
+        "    --version     Print the version number and exit.\n";
+
+    if (help_flag) {
+        printf("%s\n",help);
+        exit(0);
+    }
+
+    if (version_flag) {
+        printf("%s\n", VERSION);
+        exit(0);
+    }
+
+    if (debug_flag)   set_log_threshold(DEBUG);
+    if (verbose_flag) set_log_threshold(NOTICE);
+    if (silent_flag)  set_log_threshold(FATAL);
+
+    char default_path[MAX_NAME_LEN];
+    if (!socket_path) {
+        if (server_socket_path(default_path, sizeof default_path) != 0) {
+            logmsg(ERROR, "The default socket path is too long");
+            exit(1);
+        }
+        socket_path = default_path;
+    }
+
+    input = maybe_stdin(json_file);
+    if (!input) exit(1);
+
+    baton_error_t error;
+    int sock = connect_server(socket_path, &error);
+    if (sock < 0) {
+        logmsg(ERROR, "%s", error.message);
+        exit(5);
+    }
+
+    size_t num_failed = 0;
+    relay_server(sock, fileno(input), STDOUT_FILENO, &num_failed, &error);
+    if (error.code != 0) {
+        logmsg(ERROR, "%s", error.message);
+        exit_status = 5;
+    }
+
+    // As baton-do, which exits with an error if any document failed
+    if (num_failed > 0) {
+        logmsg(WARN, "The server reported %zu failed operations",
+               num_failed);
+        exit_status = 5;
+    }
+
+    close(sock);
+    if (input != stdin) fclose(input);
+
+    exit(exit_status);
+}
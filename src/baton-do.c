@@ -17,6 +17,7 @@
  * @author Keith James <kdj@sanger.ac.uk>
  */
 
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <getopt.h>
@@ -24,16 +25,24 @@
 #include "config.h"
 #include "baton.h"
 
+static int adaptive_flag      = 0;
 static int debug_flag         = 0;
+static int direct_io_flag     = 0;
 static int help_flag          = 0;
+static int mmap_flag          = 0;
+static int ordered_flag       = 0;
+static int select_replica_flag = 0;
 static int silent_flag        = 0;
 static int single_server_flag = 0;
+static int stats_flag         = 0;
 static int unbuffered_flag    = 0;
 static int unsafe_flag        = 0;
 static int verbose_flag       = 0;
 static int version_flag       = 0;
 
 static size_t default_buffer_size = 1024 * 64 * 16 * 2;
+static size_t default_num_workers = 1;
+static size_t max_num_workers     = 64;
 
 int main(int argc, char *argv[]) {
     option_flags flags = 0;
@@ -41,26 +50,48 @@ int main(int argc, char *argv[]) {
     char *zone_name = NULL;
     char *json_file = NULL;
     FILE *input     = NULL;
+    char *verify_policy = NULL;
+    char *sync_index    = NULL;
+    char *preferred_resources = NULL;
+    size_t num_workers = default_num_workers;
+    size_t page_size   = 0;
+    size_t num_streams = 1;
+    size_t num_transfers = TREE_DEFAULT_TRANSFERS;
+    size_t num_retries   = 0;
 
     while (1) {
         static struct option long_options[] = {
             // Flag options
+            {"adaptive",      no_argument, &adaptive_flag,      1},
+            {"select-replica", no_argument, &select_replica_flag, 1},
             {"debug",         no_argument, &debug_flag,         1},
+            {"direct-io",     no_argument, &direct_io_flag,     1},
             {"help",          no_argument, &help_flag,          1},
+            {"mmap",          no_argument, &mmap_flag,          1},
+            {"ordered",       no_argument, &ordered_flag,       1},
             {"silent",        no_argument, &silent_flag,        1},
             {"single-server", no_argument, &single_server_flag, 1},
+            {"stats",         no_argument, &stats_flag,         1},
             {"unbuffered",    no_argument, &unbuffered_flag,    1},
             {"unsafe",        no_argument, &unsafe_flag,        1},
             {"verbose",       no_argument, &verbose_flag,       1},
             {"version",       no_argument, &version_flag,       1},
             // Indexed options
             {"file",          required_argument, NULL, 'f'},
+            {"page-size",     required_argument, NULL, 'p'},
+            {"parallel",      required_argument, NULL, 'P'},
+            {"prefer-resources", required_argument, NULL, 'r'},
+            {"retries",       required_argument, NULL, 'R'},
+            {"sync-index",    required_argument, NULL, 'I'},
+            {"transfers",     required_argument, NULL, 'T'},
+            {"verify",        required_argument, NULL, 'V'},
+            {"workers",       required_argument, NULL, 'w'},
             {"zone",          required_argument, NULL, 'z'},
             {0, 0, 0, 0}
         };
 
         int option_index = 0;
-        int c = getopt_long_only(argc, argv, "f:z:",
+        int c = getopt_long_only(argc, argv, "f:I:p:P:r:R:T:V:w:z:",
                                  long_options, &option_index);
 
         /* Detect the end of the options. */
@@ -71,10 +102,47 @@ int main(int argc, char *argv[]) {
                 json_file = optarg;
                 break;
 
+            case 'p':
+                page_size = parse_size(optarg);
+                if (errno != 0) page_size = 0;
+                break;
+
+            case 'I':
+                sync_index = optarg;
+                break;
+
+            case 'P':
+                num_streams = parse_size(optarg);
+                if (errno != 0) num_streams = 1;
+                break;
+
+            case 'w':
+                num_workers = parse_size(optarg);
+                if (errno != 0) num_workers = default_num_workers;
+                break;
+
             case 'z':
                 zone_name = optarg;
                 break;
 
+            case 'r':
+                preferred_resources = optarg;
+                break;
+
+            case 'R':
+                num_retries = parse_size(optarg);
+                if (errno != 0) num_retries = 0;
+                break;
+
+            case 'T':
+                num_transfers = parse_size(optarg);
+                if (errno != 0) num_transfers = TREE_DEFAULT_TRANSFERS;
+                break;
+
+            case 'V':
+                verify_policy = optarg;
+                break;
+
             case '?':
                 // getopt_long already printed an error message
                 break;
@@ -91,21 +159,68 @@ int main(int argc, char *argv[]) {
         "\n"
         "Synopsis\n"
         "\n"
-        "    baton-do [--file <JSON file>] [--silent]\n"
-        "             [--unbuffered] [--verbose] [--version]\n"
+        "    baton-do [--adaptive] [--direct-io] [--file <JSON file>]\n"
+        "             [--mmap] [--ordered]\n"
+        "             [--page-size <n>] [--parallel <n>] [--silent]\n"
+        "             [--prefer-resources <names>]\n"
+        "             [--retries <n>] [--select-replica] [--stats]\n"
+        "             [--sync-index <file>]\n"
+        "             [--transfers <n>] [--unbuffered]\n"
+        "             [--verbose]\n"
+        "             [--verify <policy>] [--version]\n"
+        "             [--workers <n>]\n"
         "\n"
         "Description\n"
         "    Performs remote operations as described in the JSON\n"
         "    input file.\n"
         ""
+        "    --adaptive      Adapt the query page size to the speed of\n"
+        "                    the server, up to its maximum.\n"
+        "    --direct-io     Write local files with O_DIRECT, bypassing the\n"
+        "                    page cache, where the file system allows.\n"
         "    --file          The JSON file describing the operations.\n"
         "                    Optional, defaults to STDIN.\n"
+        "    --mmap          Read local files for 'write' operations by\n"
+        "                    mapping them into memory.\n"
+        "    --ordered       Print results in the same order as their\n"
+        "                    inputs when using multiple workers.\n"
+        "    --page-size     The number of query results to fetch per\n"
+        "                    request. Optional, defaults to 10.\n"
+        "    --parallel      The number of connections used by each get\n"
+        "                    with --save, or write, of a large data\n"
+        "                    object, each one transferring a separate\n"
+        "                    byte range. Optional, defaults to 1.\n"
+        "    --prefer-resources\n"
+        "                    A comma-separated list of resources or\n"
+        "                    locations from which to read, in order of\n"
+        "                    preference. Implies --select-replica.\n"
+        "    --retries       The number of times to reconnect and resume\n"
+        "                    a get with --save, or write, after its\n"
+        "                    connection fails. Optional, defaults to 0.\n"
+        "    --select-replica\n"
+        "                    Read from the valid replicate that has been\n"
+        "                    fastest to read, trying the others if it\n"
+        "                    cannot be opened.\n"
         "    --silent        Silence error messages.\n"
         "    --single-server Only connect to a single iRODS server\n"
-        "    --unbuffered    Flush print operations for each JSON object.\n"
+        "    --stats         Print statistics of iRODS requests as JSON\n"
+        "                    to STDERR on exit.\n"
+        "    --sync-index    A file in which the MD5 of local files is\n"
+        "                    kept for operations with the sync argument.\n"
+        "                    Optional.\n"
+        "    --transfers     The number of files transferred at once by\n"
+        "                    each recursive put or get, each over its\n"
+        "                    own connection. Optional, defaults to 4.\n"
+        "    --unbuffered    Flush output promptly, in batches of objects.\n"
 
         "    --verbose       Print verbose messages to STDERR.\n"
+        "    --verify        Checksum validation policy, one of 'always',\n"
+        "                    'catalog' or 'never'. Optional, defaults to\n"
+        "                    'always'.\n"
         "    --version       Print the version number and exit.\n"
+        "    --workers       The number of operations to run concurrently,\n"
+        "                    each on its own connection. Optional,\n"
+        "                    defaults to 1.\n"
         "    --zone          The zone to operate within. Optional.\n";
 
     if (help_flag) {
@@ -118,6 +233,8 @@ int main(int argc, char *argv[]) {
         exit(0);
     }
 
+    if (adaptive_flag)      flags = flags | ADAPTIVE_PAGE_SIZE;
+    if (ordered_flag)       flags = flags | PRESERVE_ORDER;
     if (single_server_flag) flags = flags | SINGLE_SERVER;
     if (unbuffered_flag)    flags = flags | FLUSH;
     if (unsafe_flag)        flags = flags | UNSAFE_RESOLVE;
@@ -126,16 +243,85 @@ int main(int argc, char *argv[]) {
     if (verbose_flag) set_log_threshold(NOTICE);
     if (silent_flag)  set_log_threshold(FATAL);
 
+    if (num_workers < 1) {
+        num_workers = default_num_workers;
+    }
+    if (num_workers > max_num_workers) {
+        logmsg(WARN, "Requested number of workers %zu exceeds maximum of "
+               "%zu. Setting number of workers to %zu",
+               num_workers, max_num_workers, max_num_workers);
+        num_workers = max_num_workers;
+    }
+
+    if (verify_policy) {
+        checksum_validation policy;
+        if (parse_checksum_validation(verify_policy, &policy) != 0) {
+            logmsg(ERROR, "Invalid --verify policy '%s'; expected one of "
+                   "'%s', '%s' or '%s'", verify_policy, VALIDATE_ALWAYS_NAME,
+                   VALIDATE_CATALOG_NAME, VALIDATE_NEVER_NAME);
+            exit(1);
+        }
+        set_checksum_validation(policy);
+    }
+
+    if (select_replica_flag || preferred_resources) {
+        if (set_replica_selection(1, preferred_resources) != 0) {
+            logmsg(WARN, "Using only the first %d names given by "
+                   "--prefer-resources", REPLICA_MAX_PREFERENCES);
+        }
+    }
+
+    if (direct_io_flag || mmap_flag) {
+        set_local_io((direct_io_flag ? LOCAL_IO_DIRECT : 0) |
+                     (mmap_flag      ? LOCAL_IO_MMAP   : 0));
+    }
+
+    if (num_streams > PARALLEL_MAX_STREAMS) {
+        logmsg(WARN, "Requested number of parallel streams %zu exceeds "
+               "maximum of %d. Setting number of streams to %d",
+               num_streams, PARALLEL_MAX_STREAMS, PARALLEL_MAX_STREAMS);
+        num_streams = PARALLEL_MAX_STREAMS;
+    }
+    set_parallel_transfer(num_streams, 0);
+
+    if (num_retries > RESUME_MAX_RETRIES) {
+        logmsg(WARN, "Requested number of retries %zu exceeds "
+               "maximum of %d. Setting number of retries to %d",
+               num_retries, RESUME_MAX_RETRIES, RESUME_MAX_RETRIES);
+        num_retries = RESUME_MAX_RETRIES;
+    }
+    set_transfer_retries(num_retries, 0);
+
+    if (num_transfers > TREE_MAX_TRANSFERS) {
+        logmsg(WARN, "Requested number of transfers %zu exceeds "
+               "maximum of %d. Setting number of transfers to %d",
+               num_transfers, TREE_MAX_TRANSFERS, TREE_MAX_TRANSFERS);
+        num_transfers = TREE_MAX_TRANSFERS;
+    }
+
+    if (sync_index && set_sync_index_file(sync_index) != 0) {
+        logmsg(WARN, "Ignoring the contents of sync index '%s'", sync_index);
+    }
+
     declare_client_name(argv[0]);
+    enable_json_arenas();
     input = maybe_stdin(json_file);
 
     operation_args_t args = { .flags       = flags,
                               .buffer_size = default_buffer_size,
-                              .zone_name   = zone_name };
+                              .zone_name   = zone_name,
+                              .num_workers = num_workers,
+                              .page_size   = page_size,
+                              .num_transfers = num_transfers };
+
+    if (stats_flag) enable_rpc_stats();
 
     int status = do_operation(input, baton_json_dispatch_op, &args);
     if (input != stdin) fclose(input);
 
+    save_sync_index();
+    if (stats_flag) print_rpc_stats(stderr);
+
     if (status != 0) exit_status = 5;
 
     exit(exit_status);
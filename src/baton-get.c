@@ -27,12 +27,19 @@
 
 static int acl_flag        = 0;
 static int avu_flag        = 0;
+static int base64_flag     = 0;
 static int debug_flag      = 0;
+static int direct_io_flag  = 0;
 static int help_flag       = 0;
 static int raw_flag        = 0;
+static int recurse_flag    = 0;
 static int save_flag       = 0;
+static int select_replica_flag = 0;
 static int silent_flag     = 0;
 static int size_flag       = 0;
+static int stats_flag      = 0;
+static int stream_flag     = 0;
+static int sync_flag       = 0;
 static int timestamp_flag  = 0;
 static int unbuffered_flag = 0;
 static int unsafe_flag     = 0;
@@ -47,19 +54,32 @@ int main(int argc, char *argv[]) {
     int exit_status = 0;
     char *json_file = NULL;
     FILE *input     = NULL;
+    char *verify_policy = NULL;
+    char *sync_index    = NULL;
+    char *preferred_resources = NULL;
     size_t buffer_size = default_buffer_size;
+    size_t num_streams = 1;
+    size_t num_transfers = TREE_DEFAULT_TRANSFERS;
+    size_t num_retries   = 0;
 
     while (1) {
         static struct option long_options[] = {
             // Flag options
             {"acl",         no_argument, &acl_flag,        1},
             {"avu",         no_argument, &avu_flag,        1},
+            {"base64",      no_argument, &base64_flag,     1},
             {"debug",       no_argument, &debug_flag,      1},
+            {"direct-io",   no_argument, &direct_io_flag,  1},
             {"help",        no_argument, &help_flag,       1},
             {"raw",         no_argument, &raw_flag,        1},
+            {"recurse",     no_argument, &recurse_flag,    1},
             {"save",        no_argument, &save_flag,       1},
+            {"select-replica", no_argument, &select_replica_flag, 1},
             {"silent",      no_argument, &silent_flag,     1},
             {"size",        no_argument, &size_flag,       1},
+            {"stats",       no_argument, &stats_flag,      1},
+            {"stream",      no_argument, &stream_flag,     1},
+            {"sync",        no_argument, &sync_flag,       1},
             {"timestamp",   no_argument, &timestamp_flag,  1},
             {"unbuffered",  no_argument, &unbuffered_flag, 1},
             {"unsafe",      no_argument, &unsafe_flag,     1},
@@ -68,11 +88,17 @@ int main(int argc, char *argv[]) {
             // Indexed options
             {"file",        required_argument, NULL, 'f'},
             {"buffer-size", required_argument, NULL, 'b'},
+            {"parallel",    required_argument, NULL, 'P'},
+            {"prefer-resources", required_argument, NULL, 'r'},
+            {"retries",     required_argument, NULL, 'R'},
+            {"sync-index",  required_argument, NULL, 'I'},
+            {"transfers",   required_argument, NULL, 'T'},
+            {"verify",      required_argument, NULL, 'V'},
             {0, 0, 0, 0}
         };
 
         int option_index = 0;
-        int c = getopt_long_only(argc, argv, "b:f:",
+        int c = getopt_long_only(argc, argv, "b:f:I:P:r:R:T:V:",
                                  long_options, &option_index);
 
         /* Detect the end of the options. */
@@ -88,6 +114,33 @@ int main(int argc, char *argv[]) {
                 json_file = optarg;
                 break;
 
+            case 'I':
+                sync_index = optarg;
+                break;
+
+            case 'P':
+                num_streams = parse_size(optarg);
+                if (errno != 0) num_streams = 1;
+                break;
+
+            case 'r':
+                preferred_resources = optarg;
+                break;
+
+            case 'R':
+                num_retries = parse_size(optarg);
+                if (errno != 0) num_retries = 0;
+                break;
+
+            case 'T':
+                num_transfers = parse_size(optarg);
+                if (errno != 0) num_transfers = TREE_DEFAULT_TRANSFERS;
+                break;
+
+            case 'V':
+                verify_policy = optarg;
+                break;
+
             case '?':
                 // getopt_long already printed an error message
                 break;
@@ -100,9 +153,13 @@ int main(int argc, char *argv[]) {
 
     if (acl_flag)        flags = flags | PRINT_ACL;
     if (avu_flag)        flags = flags | PRINT_AVU;
+    if (base64_flag)     flags = flags | PRINT_BASE64 | STREAM_RESULTS;
     if (raw_flag)        flags = flags | PRINT_RAW;
+    if (recurse_flag)    flags = flags | RECURSIVE;
     if (save_flag)       flags = flags | SAVE_FILES;
     if (size_flag)       flags = flags | PRINT_SIZE;
+    if (stream_flag)     flags = flags | STREAM_RESULTS;
+    if (sync_flag)       flags = flags | SYNC;
     if (timestamp_flag)  flags = flags | PRINT_TIMESTAMP;
     if (unbuffered_flag) flags = flags | FLUSH;
     if (unsafe_flag)     flags = flags | UNSAFE_RESOLVE;
@@ -113,10 +170,16 @@ int main(int argc, char *argv[]) {
         "\n"
         "Synopsis\n"
         "\n"
-        "    baton-get [--acl] [--avu] [--file <JSON file>]\n"
-        "              [--raw] [--save] [--silent] [--size]\n"
+        "    baton-get [--acl] [--avu] [--base64] [--direct-io]\n"
+        "              [--file <JSON file>]\n"
+        "              [--parallel <n>] [--prefer-resources <names>]\n"
+        "              [--raw] [--recurse] [--retries <n>] [--save]\n"
+        "              [--select-replica]\n"
+        "              [--silent] [--size] [--stats] [--stream]\n"
+        "              [--sync]\n"
+        "              [--sync-index <file>] [--transfers <n>]\n"
         "              [--timestamp] [--unbuffered] [--unsafe]\n"
-        "              [--verbose] [--version]\n"
+        "              [--verbose] [--verify <policy>] [--version]\n"
         "\n"
         "Description\n"
         "    Gets the contents of data objects described in a JSON\n"
@@ -124,19 +187,56 @@ int main(int argc, char *argv[]) {
         ""
         "    --acl         Print access control lists in output.\n"
         "    --avu         Print AVU lists in output.\n"
+        "    --base64      Print data object content encoded as base64,\n"
+        "                  which need not be UTF-8. Implies --stream.\n"
         "    --buffer-size Set the transfer buffer size.\n"
+        "    --direct-io   With --save, write local files with O_DIRECT,\n"
+        "                  bypassing the page cache, where the file\n"
+        "                  system allows.\n"
         "    --file        The JSON file describing the data objects.\n"
         "                  Optional, defaults to STDIN.\n"
+        "    --parallel    The number of connections used to get each\n"
+        "                  large data object with --save, each one\n"
+        "                  reading a separate byte range. Optional,\n"
+        "                  defaults to 1.\n"
+        "    --prefer-resources\n"
+        "                  A comma-separated list of resources or\n"
+        "                  locations from which to read, in order of\n"
+        "                  preference. Implies --select-replica.\n"
         "    --raw         Print data object content without any JSON\n"
         "                  wrapping.\n"
+        "    --recurse     Get collections recursively into the local\n"
+        "                  directories given with --save.\n"
+        "    --retries     The number of times to reconnect and resume\n"
+        "                  a get after its connection fails. Optional,\n"
+        "                  defaults to 0.\n"
         "    --save        Save data object content to individual files,\n"
         "                  without any JSON wrapping i.e. implies --raw.\n"
+        "    --select-replica\n"
+        "                  Read from the valid replicate that has been\n"
+        "                  fastest to read, trying the others if it\n"
+        "                  cannot be opened.\n"
         "    --silent      Silence error messages.\n"
         "    --size        Print data object sizes in output.\n"
+        "    --stats       Print statistics of iRODS requests as JSON\n"
+        "                  to STDERR on exit.\n"
+        "    --stream      Print each data object's JSON and content as\n"
+        "                  they are read, without holding the content\n"
+        "                  in memory.\n"
+        "    --sync        With --save, skip data objects whose local\n"
+        "                  files have the same size and MD5.\n"
+        "    --sync-index  A file in which the MD5 of local files is\n"
+        "                  kept for --sync. Optional.\n"
         "    --timestamp   Print timestamps in output.\n"
-        "    --unbuffered  Flush print operations for each JSON object.\n"
+        "    --transfers   The number of files to get at once with\n"
+        "                  --recurse, each over its own connection.\n"
+        "                  Optional, defaults to 4.\n"
+        "    --unbuffered  Flush output promptly, in batches of objects.\n"
         "    --unsafe      Permit unsafe relative iRODS paths.\n"
         "    --verbose     Print verbose messages to STDERR.\n"
+        "    --verify      Checksum validation policy, one of 'always',\n"
+        "                  'catalog' or 'never'. Optional, defaults to\n"
+        "                  'always'.\n"
         "    --version     Print the version number and exit.\n";
 
     if (help_flag) {
@@ -161,7 +261,55 @@ int main(int argc, char *argv[]) {
         if (timestamp_flag) logmsg(WARN, msg, "--timestamp");
     }
 
+    if (verify_policy) {
+        checksum_validation policy;
+        if (parse_checksum_validation(verify_policy, &policy) != 0) {
+            logmsg(ERROR, "Invalid --verify policy '%s'; expected one of "
+                   "'%s', '%s' or '%s'", verify_policy, VALIDATE_ALWAYS_NAME,
+                   VALIDATE_CATALOG_NAME, VALIDATE_NEVER_NAME);
+            exit(1);
+        }
+        set_checksum_validation(policy);
+    }
+
+    if (select_replica_flag || preferred_resources) {
+        if (set_replica_selection(1, preferred_resources) != 0) {
+            logmsg(WARN, "Using only the first %d names given by "
+                   "--prefer-resources", REPLICA_MAX_PREFERENCES);
+        }
+    }
+
+    if (direct_io_flag) set_local_io(LOCAL_IO_DIRECT);
+
+    if (num_streams > PARALLEL_MAX_STREAMS) {
+        logmsg(WARN, "Requested number of parallel streams %zu exceeds "
+               "maximum of %d. Setting number of streams to %d",
+               num_streams, PARALLEL_MAX_STREAMS, PARALLEL_MAX_STREAMS);
+        num_streams = PARALLEL_MAX_STREAMS;
+    }
+    set_parallel_transfer(num_streams, 0);
+
+    if (num_retries > RESUME_MAX_RETRIES) {
+        logmsg(WARN, "Requested number of retries %zu exceeds "
+               "maximum of %d. Setting number of retries to %d",
+               num_retries, RESUME_MAX_RETRIES, RESUME_MAX_RETRIES);
+        num_retries = RESUME_MAX_RETRIES;
+    }
+    set_transfer_retries(num_retries, 0);
+
+    if (num_transfers > TREE_MAX_TRANSFERS) {
+        logmsg(WARN, "Requested number of transfers %zu exceeds "
+               "maximum of %d. Setting number of transfers to %d",
+               num_transfers, TREE_MAX_TRANSFERS, TREE_MAX_TRANSFERS);
+        num_transfers = TREE_MAX_TRANSFERS;
+    }
+
+    if (sync_index && set_sync_index_file(sync_index) != 0) {
+        logmsg(WARN, "Ignoring the contents of sync index '%s'", sync_index);
+    }
+
     declare_client_name(argv[0]);
+    enable_json_arenas();
     input = maybe_stdin(json_file);
 
     if (buffer_size > max_buffer_size) {
@@ -186,12 +334,18 @@ int main(int argc, char *argv[]) {
 
     logmsg(DEBUG, "Using a transfer buffer size of %zu bytes", buffer_size);
 
-    operation_args_t args = { .flags       = flags,
-                              .buffer_size = buffer_size };
+    operation_args_t args = { .flags         = flags,
+                              .buffer_size   = buffer_size,
+                              .num_transfers = num_transfers };
+
+    if (stats_flag) enable_rpc_stats();
 
     int status = do_operation(input, baton_json_get_op, &args);
     if (input != stdin) fclose(input);
 
+    save_sync_index();
+    if (stats_flag) print_rpc_stats(stderr);
+
     if (status != 0) exit_status = 5;
 
     exit(exit_status);
@@ -31,9 +31,11 @@ static int checksum_flag   = 0;
 static int contents_flag   = 0;
 static int debug_flag      = 0;
 static int help_flag       = 0;
+static int recurse_flag    = 0;
 static int replicate_flag  = 0;
 static int silent_flag     = 0;
 static int size_flag       = 0;
+static int stream_flag     = 0;
 static int timestamp_flag  = 0;
 static int unbuffered_flag = 0;
 static int unsafe_flag     = 0;
@@ -55,9 +57,11 @@ int main(int argc, char *argv[]) {
             {"contents",   no_argument, &contents_flag,   1},
             {"debug",      no_argument, &debug_flag,      1},
             {"help",       no_argument, &help_flag,       1},
+            {"recurse",    no_argument, &recurse_flag,    1},
             {"replicate",  no_argument, &replicate_flag,  1},
             {"silent",     no_argument, &silent_flag,     1},
             {"size",       no_argument, &size_flag,       1},
+            {"stream",     no_argument, &stream_flag,     1},
             {"timestamp",  no_argument, &timestamp_flag,  1},
             {"unbuffered", no_argument, &unbuffered_flag, 1},
             {"unsafe",     no_argument, &unsafe_flag,     1},
@@ -94,8 +98,10 @@ int main(int argc, char *argv[]) {
     if (avu_flag)       flags = flags | PRINT_AVU;
     if (checksum_flag)  flags = flags | PRINT_CHECKSUM;
     if (contents_flag)  flags = flags | PRINT_CONTENTS;
+    if (recurse_flag)   flags = flags | RECURSIVE;
     if (replicate_flag) flags = flags | PRINT_REPLICATE;
     if (size_flag)      flags = flags | PRINT_SIZE;
+    if (stream_flag)    flags = flags | STREAM_RESULTS;
     if (timestamp_flag) flags = flags | PRINT_TIMESTAMP;
     if (unsafe_flag)    flags = flags | UNSAFE_RESOLVE;
 
@@ -106,8 +112,8 @@ int main(int argc, char *argv[]) {
         "Synopsis\n"
         "\n"
         "    baton-list [--acl] [--avu] [--checksum] [--contents]\n"
-        "               [--file <JSON file>]\n"
-        "               [--replicate] [--silent] [--size]\n"
+        "               [--file <JSON file>] [--recurse]\n"
+        "               [--replicate] [--silent] [--size] [--stream]\n"
         "               [--timestamp] [--unbuffered] [--unsafe]\n"
         "               [--verbose] [--version]\n"
         "\n"
@@ -121,11 +127,16 @@ int main(int argc, char *argv[]) {
         "    --contents    Print collection contents in output.\n"
         "    --file        The JSON file describing the data objects and\n"
         "                  collections. Optional, defaults to STDIN.\n"
+        "    --recurse     Print the contents of collections at any\n"
+        "                  depth, with --contents.\n"
         "    --replicate   Print data object replicates.\n"
         "    --silent      Silence warning messages.\n"
         "    --size        Print data object sizes in output.\n"
+        "    --stream      Print each entry of a collection listed with\n"
+        "                  --contents --recurse separately, as soon as\n"
+        "                  it is found.\n"
         "    --timestamp   Print timestamps in output.\n"
-        "    --unbuffered  Flush print operations for each JSON object.\n"
+        "    --unbuffered  Flush output promptly, in batches of objects.\n"
         "    --unsafe      Permit unsafe relative iRODS paths.\n"
         "    --verbose     Print verbose messages to STDERR.\n"
         "    --version     Print the version number and exit.\n";
@@ -148,6 +159,7 @@ int main(int argc, char *argv[]) {
     if (silent_flag)  set_log_threshold(FATAL);
 
     declare_client_name(argv[0]);
+    enable_json_arenas();
     input = maybe_stdin(json_file);
 
     operation_args_t args = { .flags = flags };
@@ -110,7 +110,7 @@ int main(int argc, char *argv[]) {
         "    --operation   Operation to perform. One of [add, rem].\n"
         "                  Required.\n"
         "    --silent      Silence error messages.\n"
-        "    --unbuffered  Flush print operations for each JSON object.\n"
+        "    --unbuffered  Flush output promptly, in batches of objects.\n"
         "    --unsafe      Permit unsafe relative iRODS paths.\n"
         "    --verbose     Print verbose messages to STDERR.\n"
         "    --version     Print the version number and exit.\n";
@@ -133,6 +133,7 @@ int main(int argc, char *argv[]) {
     if (silent_flag)  set_log_threshold(FATAL);
 
     declare_client_name(argv[0]);
+    enable_json_arenas();
     input = maybe_stdin(json_file);
 
     operation_args_t args = { .flags = flags };
@@ -19,6 +19,7 @@
  */
 
 #include <assert.h>
+#include <errno.h>
 #include <getopt.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -27,6 +28,8 @@
 #include "baton.h"
 
 static int acl_flag        = 0;
+static int adaptive_flag   = 0;
+static int all_zones_flag  = 0;
 static int avu_flag        = 0;
 static int checksum_flag   = 0;
 static int coll_flag       = 0;
@@ -36,6 +39,7 @@ static int obj_flag        = 0;
 static int replicate_flag  = 0;
 static int silent_flag     = 0;
 static int size_flag       = 0;
+static int stream_flag     = 0;
 static int timestamp_flag  = 0;
 static int unbuffered_flag = 0;
 static int unsafe_flag     = 0;
@@ -48,11 +52,14 @@ int main(int argc, char *argv[]) {
     char *zone_name = NULL;
     char *json_file = NULL;
     FILE *input     = NULL;
+    size_t page_size = 0;
 
     while (1) {
         static struct option long_options[] = {
             // Flag options
             {"acl",        no_argument, &acl_flag,        1},
+            {"adaptive",   no_argument, &adaptive_flag,   1},
+            {"all-zones",  no_argument, &all_zones_flag,  1},
             {"avu",        no_argument, &avu_flag,        1},
             {"checksum",   no_argument, &checksum_flag,   1},
             {"coll",       no_argument, &coll_flag,       1},
@@ -62,6 +69,7 @@ int main(int argc, char *argv[]) {
             {"replicate",  no_argument, &replicate_flag,  1},
             {"silent",     no_argument, &silent_flag,     1},
             {"size",       no_argument, &size_flag,       1},
+            {"stream",     no_argument, &stream_flag,     1},
             {"timestamp",  no_argument, &timestamp_flag,  1},
             {"unbuffered", no_argument, &unbuffered_flag, 1},
             {"unsafe",     no_argument, &unsafe_flag,     1},
@@ -69,12 +77,13 @@ int main(int argc, char *argv[]) {
             {"version",    no_argument, &version_flag,    1},
             // Indexed options
             {"file",      required_argument, NULL, 'f'},
+            {"page-size", required_argument, NULL, 'p'},
             {"zone",      required_argument, NULL, 'z'},
             {0, 0, 0, 0}
         };
 
         int option_index = 0;
-        int c = getopt_long_only(argc, argv, "f:z:",
+        int c = getopt_long_only(argc, argv, "f:p:z:",
                                  long_options, &option_index);
 
         /* Detect the end of the options. */
@@ -85,6 +94,11 @@ int main(int argc, char *argv[]) {
                 json_file = optarg;
                 break;
 
+            case 'p':
+                page_size = parse_size(optarg);
+                if (errno != 0) page_size = 0;
+                break;
+
             case 'z':
                 zone_name = optarg;
                 break;
@@ -106,8 +120,11 @@ int main(int argc, char *argv[]) {
         flags = flags ^ SEARCH_COLLECTIONS;
     }
 
+    if (adaptive_flag)   flags = flags | ADAPTIVE_PAGE_SIZE;
+    if (all_zones_flag)  flags = flags | SEARCH_ALL_ZONES;
     if (unsafe_flag)     flags = flags | UNSAFE_RESOLVE;
     if (unbuffered_flag) flags = flags | FLUSH;
+    if (stream_flag)     flags = flags | STREAM_RESULTS;
 
     if (acl_flag)        flags = flags | PRINT_ACL;
     if (avu_flag)        flags = flags | PRINT_AVU;
@@ -122,31 +139,43 @@ int main(int argc, char *argv[]) {
         "\n"
         "Synopsis\n"
         "\n"
-        "    baton-metaquery [--acl] [--avu] [--checksum] [--coll]\n"
-        "                    [--file <JSON file>]\n"
-        "                    [--obj ] [--replicate] [--silent] [--size]\n"
-        "                    [--timestamp] [--unbuffered] [--unsafe]\n"
-        "                    [--verbose] [--version] [--zone <name>]\n"
+        "    baton-metaquery [--acl] [--adaptive] [--all-zones] [--avu]\n"
+        "                    [--checksum] [--coll] [--file <JSON file>]\n"
+        "                    [--obj ] [--page-size <n>] [--replicate]\n"
+        "                    [--silent] [--size]\n"
+        "                    [--stream] [--timestamp] [--unbuffered]\n"
+        "                    [--unsafe]\n"
+        "                    [--verbose] [--version] [--zone <name>[,<name>]]\n"
         "\n"
         "Description\n"
         "    Finds items in iRODS by AVU, given a query constructed\n"
         "from a JSON input file.\n"
         "\n"
         "    --acl         Print access control lists in output.\n"
+        "    --adaptive    Adapt the query page size to the speed of the\n"
+        "                  server, up to its maximum.\n"
+        "    --all-zones   Search the local zone and all federated zones\n"
+        "                  concurrently.\n"
         "    --avu         Print AVU lists in output.\n"
         "    --checksum    Print data object checksums in output.\n"
         "    --coll        Limit search to collection metadata only.\n"
         "    --file        The JSON file describing the query. Optional,\n"
         "                  defaults to STDIN.\n"
         "    --obj         Limit search to data object metadata only.\n"
+        "    --page-size   The number of results to fetch per request.\n"
+        "                  Optional, defaults to 10.\n"
         "    --replicate   Report data object replicates.\n"
         "    --silent      Silence error messages.\n"
+        "    --stream      Print each result as it arrives, as a separate\n"
+        "                  JSON object, rather than an array of all\n"
+        "                  results.\n"
         "    --timestamp   Print timestamps in output.\n"
-        "    --unbuffered  Flush print operations for each JSON object.\n"
+        "    --unbuffered  Flush output promptly, in batches of objects.\n"
         "    --unsafe      Permit unsafe relative iRODS paths.\n"
         "    --verbose     Print verbose messages to STDERR.\n"
         "    --version     Print the version number and exit.\n"
-        "    --zone        The zone to search. Optional.\n";
+        "    --zone        The zone to search, or a comma-separated list\n"
+        "                  of zones to search concurrently. Optional.\n";
 
     if (help_flag) {
         printf("%s\n",help);
@@ -163,10 +192,12 @@ int main(int argc, char *argv[]) {
     if (silent_flag)  set_log_threshold(FATAL);
 
     declare_client_name(argv[0]);
+    enable_json_arenas();
     input = maybe_stdin(json_file);
 
     operation_args_t args = { .flags     = flags,
-                              .zone_name = zone_name };
+                              .zone_name = zone_name,
+                              .page_size = page_size };
 
     int status = do_operation(input, baton_json_metaquery_op, &args);
     if (input != stdin) fclose(input);
@@ -95,7 +95,7 @@ int main(int argc, char *argv[]) {
         "    --file        The JSON file describing the data objects.\n"
         "                  Optional, defaults to STDIN.\n"
         "    --silent      Silence error messages.\n"
-        "    --unbuffered  Flush print operations for each JSON object.\n"
+        "    --unbuffered  Flush output promptly, in batches of objects.\n"
         "    --unsafe      Permit unsafe relative iRODS paths.\n"
         "    --verbose     Print verbose messages to STDERR.\n"
         "    --version     Print the version number and exit.\n";
@@ -128,19 +128,26 @@ int main(int argc, char *argv[]) {
 int do_supersede_metadata(FILE *input, option_flags oflags) {
     int item_count  = 0;
     int error_count = 0;
+    json_reader_t *reader = NULL;
 
     rodsEnv env;
     rcComm_t *conn = rods_login(&env);
     if (!conn) goto error;
 
-    while (!feof(input)) {
-        size_t flags = JSON_DISABLE_EOF_CHECK | JSON_REJECT_DUPLICATES;
-        json_error_t load_error;
-        json_t *target = json_loadf(input, flags, &load_error);
+    baton_error_t input_error;
+    reader = make_json_reader(input, &input_error);
+    if (input_error.code != 0) {
+        logmsg(ERROR, "Failed to open input: error %d %s",
+               input_error.code, input_error.message);
+        goto error;
+    }
+
+    while (!json_reader_eof(reader)) {
+        baton_error_t load_error;
+        json_t *target = read_json_item(reader, &load_error);
         if (!target) {
-            if (!feof(input)) {
-                logmsg(ERROR, "JSON error at line %d, column %d: %s",
-                       load_error.line, load_error.column, load_error.text);
+            if (load_error.code != 0) {
+                logmsg(ERROR, "%s", load_error.message);
             }
 
             continue;
@@ -184,28 +191,16 @@ int do_supersede_metadata(FILE *input, option_flags oflags) {
                         error_count++;
                     }
                     else {
-                        baton_error_t rem_error;
                         // Remove any current AVUs that are not equal
-                        // to target AVUs. Stops on first error.
-                        maybe_modify_json_metadata(conn, &rods_path,
-                                                   META_REM,
-                                                   current_avus, avus,
-                                                   &rem_error);
-                        if (add_error_report(target, &rem_error)) {
+                        // to target AVUs and add any target AVUs that
+                        // are not equal to current AVUs, in one batch
+                        baton_error_t mod_error;
+                        supersede_json_metadata(conn, &rods_path,
+                                                current_avus, avus,
+                                                &mod_error);
+                        if (add_error_report(target, &mod_error)) {
                             error_count++;
                         }
-                        else {
-                            // Add any target AVUs that are not equal to
-                            // current AVUs. Stops on first error.
-                            baton_error_t add_error;
-                            maybe_modify_json_metadata(conn, &rods_path,
-                                                       META_ADD,
-                                                       avus, current_avus,
-                                                       &add_error);
-                            if (add_error_report(target, &add_error)) {
-                                error_count++;
-                            }
-                        }
                     }
 
                     json_decref(current_avus);
@@ -215,13 +210,17 @@ int do_supersede_metadata(FILE *input, option_flags oflags) {
             }
 
             print_json(target);
-            if (unbuffered_flag) fflush(stdout);
+            if (unbuffered_flag) {
+                maybe_flush_json_output(json_reader_ready(reader));
+            }
 
             json_decref(target);
             if (path) free(path);
         }
     } // while
 
+    flush_json_output();
+    free_json_reader(reader);
     rcDisconnect(conn);
 
     if (error_count > 0) {
@@ -236,6 +235,7 @@ int do_supersede_metadata(FILE *input, option_flags oflags) {
     return error_count;
 
 error:
+    if (reader) free_json_reader(reader);
     if (conn) rcDisconnect(conn);
 
     logmsg(ERROR, "Processed %d items with %d errors", item_count, error_count);
@@ -27,8 +27,11 @@
 static int checksum_flag      = 0;
 static int debug_flag         = 0;
 static int help_flag          = 0;
+static int recurse_flag       = 0;
 static int silent_flag        = 0;
 static int single_server_flag = 0;
+static int stats_flag         = 0;
+static int sync_flag          = 0;
 static int unbuffered_flag    = 0;
 static int unsafe_flag        = 0;
 static int verbose_flag       = 0;
@@ -43,7 +46,12 @@ int main(int argc, char *argv[]) {
     char *zone_name = NULL;
     char *json_file = NULL;
     FILE *input     = NULL;
+    char *verify_policy = NULL;
+    char *sync_index    = NULL;
     size_t buffer_size = default_buffer_size;
+    size_t num_streams = 1;
+    size_t num_transfers = TREE_DEFAULT_TRANSFERS;
+    size_t num_retries   = 0;
 
     while (1) {
         static struct option long_options[] = {
@@ -51,8 +59,11 @@ int main(int argc, char *argv[]) {
             {"checksum",      no_argument, &checksum_flag,      1},
             {"debug",         no_argument, &debug_flag,         1},
             {"help",          no_argument, &help_flag,          1},
+            {"recurse",       no_argument, &recurse_flag,       1},
             {"silent",        no_argument, &silent_flag,        1},
             {"single-server", no_argument, &single_server_flag, 1},
+            {"stats",         no_argument, &stats_flag,         1},
+            {"sync",          no_argument, &sync_flag,          1},
             {"unbuffered",    no_argument, &unbuffered_flag,    1},
             {"unsafe",        no_argument, &unsafe_flag,        1},
             {"verbose",       no_argument, &verbose_flag,       1},
@@ -60,11 +71,16 @@ int main(int argc, char *argv[]) {
             // Indexed options
             {"file",          required_argument, NULL, 'f'},
             {"buffer-size",   required_argument, NULL, 'b'},
+            {"parallel",      required_argument, NULL, 'P'},
+            {"retries",       required_argument, NULL, 'R'},
+            {"sync-index",    required_argument, NULL, 'I'},
+            {"transfers",     required_argument, NULL, 'T'},
+            {"verify",        required_argument, NULL, 'V'},
             {0, 0, 0, 0}
         };
 
         int option_index = 0;
-        int c = getopt_long_only(argc, argv, "b:f:",
+        int c = getopt_long_only(argc, argv, "b:f:I:P:R:T:V:",
                                  long_options, &option_index);
 
         /* Detect the end of the options. */
@@ -80,6 +96,29 @@ int main(int argc, char *argv[]) {
                 json_file = optarg;
                 break;
 
+            case 'I':
+                sync_index = optarg;
+                break;
+
+            case 'P':
+                num_streams = parse_size(optarg);
+                if (errno != 0) num_streams = 1;
+                break;
+
+            case 'R':
+                num_retries = parse_size(optarg);
+                if (errno != 0) num_retries = 0;
+                break;
+
+            case 'T':
+                num_transfers = parse_size(optarg);
+                if (errno != 0) num_transfers = TREE_DEFAULT_TRANSFERS;
+                break;
+
+            case 'V':
+                verify_policy = optarg;
+                break;
+
             case '?':
                 // getopt_long already printed an error message
                 break;
@@ -91,7 +130,9 @@ int main(int argc, char *argv[]) {
     }
 
     if (checksum_flag)      flags = flags | CALCULATE_CHECKSUM;
+    if (recurse_flag)       flags = flags | RECURSIVE;
     if (single_server_flag) flags = flags | SINGLE_SERVER;
+    if (sync_flag)          flags = flags | SYNC;
     if (unsafe_flag)        flags = flags | UNSAFE_RESOLVE;
     if (unbuffered_flag)    flags = flags | FLUSH;
 
@@ -101,9 +142,11 @@ int main(int argc, char *argv[]) {
         "\n"
         "Synopsis\n"
         "\n"
-        "    baton-put [--file <JSON file>] [--silent]\n"
+        "    baton-put [--file <JSON file>] [--parallel <n>] [--recurse]\n"
+        "              [--retries <n>] [--silent] [--stats] [--sync]\n"
+        "              [--sync-index <file>] [--transfers <n>]\n"
         "              [--unbuffered] [--unsafe]\n"
-        "              [--verbose] [--version]\n"
+        "              [--verbose] [--verify <policy>] [--version]\n"
         "\n"
         "Description\n"
         "    Puts the contents of files into data objects described in a\n"
@@ -113,11 +156,32 @@ int main(int argc, char *argv[]) {
         "    --checksum      Calculate a checksum on the server side.\n"
         "    --file          The JSON file describing the data objects.\n"
         "                    Optional, defaults to STDIN.\n"
+        "    --parallel      The number of connections used to write each\n"
+        "                    large file with --single-server, each one\n"
+        "                    sending a separate byte range. Optional,\n"
+        "                    defaults to 1.\n"
+        "    --recurse       Put local directories recursively into\n"
+        "                    collections.\n"
+        "    --retries       The number of times to reconnect and resume\n"
+        "                    a write with --single-server after its\n"
+        "                    connection fails. Optional, defaults to 0.\n"
         "    --silent        Silence error messages.\n"
         "    --single-server Only connect to a single iRODS server\n"
-        "    --unbuffered    Flush print operations for each JSON object.\n"
+        "    --stats         Print statistics of iRODS requests as JSON\n"
+        "                    to STDERR on exit.\n"
+        "    --sync          Skip files whose data objects have the same\n"
+        "                    size and MD5.\n"
+        "    --sync-index    A file in which the MD5 of local files is\n"
+        "                    kept for --sync. Optional.\n"
+        "    --transfers     The number of files to put at once with\n"
+        "                    --recurse, each over its own connection.\n"
+        "                    Optional, defaults to 4.\n"
+        "    --unbuffered    Flush output promptly, in batches of objects.\n"
         "    --unsafe        Permit unsafe relative iRODS paths.\n"
         "    --verbose       Print verbose messages to STDERR.\n"
+        "    --verify        Checksum validation policy, one of 'always',\n"
+        "                    'catalog' or 'never'. Optional, defaults to\n"
+        "                    'always'.\n"
         "    --version       Print the version number and exit.\n";
 
     if (help_flag) {
@@ -134,12 +198,54 @@ int main(int argc, char *argv[]) {
     if (verbose_flag) set_log_threshold(NOTICE);
     if (silent_flag)  set_log_threshold(FATAL);
 
+    if (verify_policy) {
+        checksum_validation policy;
+        if (parse_checksum_validation(verify_policy, &policy) != 0) {
+            logmsg(ERROR, "Invalid --verify policy '%s'; expected one of "
+                   "'%s', '%s' or '%s'", verify_policy, VALIDATE_ALWAYS_NAME,
+                   VALIDATE_CATALOG_NAME, VALIDATE_NEVER_NAME);
+            exit(1);
+        }
+        set_checksum_validation(policy);
+    }
+
+    if (num_streams > PARALLEL_MAX_STREAMS) {
+        logmsg(WARN, "Requested number of parallel streams %zu exceeds "
+               "maximum of %d. Setting number of streams to %d",
+               num_streams, PARALLEL_MAX_STREAMS, PARALLEL_MAX_STREAMS);
+        num_streams = PARALLEL_MAX_STREAMS;
+    }
+    set_parallel_transfer(num_streams, 0);
+
+    if (num_retries > RESUME_MAX_RETRIES) {
+        logmsg(WARN, "Requested number of retries %zu exceeds "
+               "maximum of %d. Setting number of retries to %d",
+               num_retries, RESUME_MAX_RETRIES, RESUME_MAX_RETRIES);
+        num_retries = RESUME_MAX_RETRIES;
+    }
+    set_transfer_retries(num_retries, 0);
+
+    if (num_transfers > TREE_MAX_TRANSFERS) {
+        logmsg(WARN, "Requested number of transfers %zu exceeds "
+               "maximum of %d. Setting number of transfers to %d",
+               num_transfers, TREE_MAX_TRANSFERS, TREE_MAX_TRANSFERS);
+        num_transfers = TREE_MAX_TRANSFERS;
+    }
+
+    if (sync_index && set_sync_index_file(sync_index) != 0) {
+        logmsg(WARN, "Ignoring the contents of sync index '%s'", sync_index);
+    }
+
     declare_client_name(argv[0]);
+    enable_json_arenas();
     input = maybe_stdin(json_file);
 
-    operation_args_t args = { .flags       = flags,
-                              .buffer_size = default_buffer_size,
-                              .zone_name   = zone_name };
+    operation_args_t args = { .flags         = flags,
+                              .buffer_size   = default_buffer_size,
+                              .zone_name     = zone_name,
+                              .num_transfers = num_transfers };
+
+    if (stats_flag) enable_rpc_stats();
 
     int status;
     if (flags & SINGLE_SERVER) {
@@ -174,6 +280,9 @@ int main(int argc, char *argv[]) {
 
     if (input != stdin) fclose(input);
 
+    save_sync_index();
+    if (stats_flag) print_rpc_stats(stderr);
+
     if (status != 0)    exit_status = 5;
 
     exit(exit_status);
@@ -0,0 +1,263 @@
+/**
+ * Copyright (C) 2017 Genome Research Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @author Keith James <kdj@sanger.ac.uk>
+ */
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+#include "config.h"
+#include "baton.h"
+
+static int adaptive_flag      = 0;
+static int debug_flag         = 0;
+static int direct_io_flag     = 0;
+static int help_flag          = 0;
+static int mmap_flag          = 0;
+static int select_replica_flag = 0;
+static int silent_flag        = 0;
+static int single_server_flag = 0;
+static int unsafe_flag        = 0;
+static int verbose_flag       = 0;
+static int version_flag       = 0;
+
+static size_t default_buffer_size = 1024 * 64 * 16 * 2;
+
+static void handle_signal(int signum) {
+    (void) signum;
+    stop_server();
+}
+
+int main(int argc, char *argv[]) {
+    option_flags flags = 0;
+    int exit_status    = 0;
+    char *zone_name     = NULL;
+    char *socket_path   = NULL;
+    char *verify_policy = NULL;
+    char *preferred_resources = NULL;
+    size_t num_workers = SERVER_DEFAULT_WORKERS;
+    size_t page_size   = 0;
+
+    while (1) {
+        static struct option long_options[] = {
+            // Flag options
+            {"adaptive",      no_argument, &adaptive_flag,      1},
+            {"debug",         no_argument, &debug_flag,         1},
+            {"direct-io",     no_argument, &direct_io_flag,     1},
+            {"help",          no_argument, &help_flag,          1},
+            {"mmap",          no_argument, &mmap_flag,          1},
+            {"select-replica", no_argument, &select_replica_flag, 1},
+            {"silent",        no_argument, &silent_flag,        1},
+            {"single-server", no_argument, &single_server_flag, 1},
+            {"unsafe",        no_argument, &unsafe_flag,        1},
+            {"verbose",       no_argument, &verbose_flag,       1},
+            {"version",       no_argument, &version_flag,       1},
+            // Indexed options
+            {"page-size",     required_argument, NULL, 'p'},
+            {"prefer-resources", required_argument, NULL, 'r'},
+            {"socket",        required_argument, NULL, 's'},
+            {"verify",        required_argument, NULL, 'V'},
+            {"workers",       required_argument, NULL, 'w'},
+            {"zone",          required_argument, NULL, 'z'},
+            {0, 0, 0, 0}
+        };
+
+        int option_index = 0;
+        int c = getopt_long_only(argc, argv, "p:r:s:V:w:z:",
+                                 long_options, &option_index);
+
+        /* Detect the end of the options. */
+        if (c == -1) break;
+
+        switch (c) {
+            case 'p':
+                page_size = parse_size(optarg);
+                if (errno != 0) page_size = 0;
+                break;
+
+            case 'r':
+                preferred_resources = optarg;
+                break;
+
+            case 's':
+                socket_path = optarg;
+                break;
+
+            case 'V':
+                verify_policy = optarg;
+                break;
+
+            case 'w':
+                num_workers = parse_size(optarg);
+                if (errno != 0) num_workers = SERVER_DEFAULT_WORKERS;
+                break;
+
+            case 'z':
+                zone_name = optarg;
+                break;
+
+            case '?':
+                // getopt_long already printed an error message
+                break;
+
+            default:
+                // Ignore
+                break;
+        }
+    }
+
+    const char *help =
+        "Name\n"
+        "    baton-server\n"
+        "\n"
+        "Synopsis\n"
+        "\n"
+        "    baton-server [--adaptive] [--direct-io] [--mmap]\n"
+        "                 [--page-size <n>]\n"
+        "                 [--prefer-resources <names>]\n"
+        "                 [--select-replica] [--silent]\n"
+        "                 [--single-server] [--socket <path>]\n"
+        "                 [--unsafe] [--verbose] [--verify <policy>]\n"
+        "                 [--version] [--workers <n>] [--zone <name>]\n"
+        "\n"
+        "Description\n"
+        "    Performs remote operations described by JSON documents\n"
+        "    sent by clients such as baton-client to a Unix domain\n"
+        "    socket, over iRODS connections kept open between clients.\n"
+        "    Stops on SIGINT or SIGTERM.\n"
+        ""
+        "    --adaptive      Adapt the query page size to the speed of\n"
+        "                    the server, up to its maximum.\n"
+        "    --direct-io     Write local files with O_DIRECT, bypassing the\n"
+        "                    page cache, where the file system allows.\n"
+        "    --mmap          Read local files for 'write' operations by\n"
+        "                    mapping them into memory.\n"
+        "    --page-size     The number of query results to fetch per\n"
+        "                    request. Optional, defaults to 10.\n"
+        "    --prefer-resources\n"
+        "                    A comma-separated list of resources or\n"
+        "                    locations from which to read, in order of\n"
+        "                    preference. Implies --select-replica.\n"
+        "    --select-replica\n"
+        "                    Read from the valid replicate that has been\n"
+        "                    fastest to read, trying the others if it\n"
+        "                    cannot be opened.\n"
+        "    --silent        Silence error messages.\n"
+        "    --single-server Only connect to a single iRODS server\n"
+        "    --socket        The path of the socket. Optional, defaults\n"
+        "                    to $BATON_SOCKET, or baton-server.sock in\n"
+        "                    $XDG_RUNTIME_DIR.\n"
+        "    --unsafe        Permit unsafe relative iRODS paths.\n"
+        "    --verbose       Print verbose messages to STDERR.\n"
+        "    --verify        Checksum validation policy, one of 'always',\n"
+        "                    'catalog' or 'never'. Optional, defaults to\n"
+        "                    'always'.\n"
+        "    --version       Print the version number and exit.\n"
+        "    --workers       The number of clients to serve at once,\n"
+        "                    each on its own connection. Optional,\n"
+        "                    defaults to 4.\n"
+        "    --zone          The zone to operate within. Optional.\n";
+
+    if (help_flag) {
+        printf("%s\n",help);
+        exit(0);
+    }
+
+    if (version_flag) {
+        printf("%s\n", VERSION);
+        exit(0);
+    }
+
+    if (adaptive_flag)      flags = flags | ADAPTIVE_PAGE_SIZE;
+    if (single_server_flag) flags = flags | SINGLE_SERVER;
+    if (unsafe_flag)        flags = flags | UNSAFE_RESOLVE;
+
+    if (debug_flag)   set_log_threshold(DEBUG);
+    if (verbose_flag) set_log_threshold(NOTICE);
+    if (silent_flag)  set_log_threshold(FATAL);
+
+    if (num_workers < 1) {
+        num_workers = SERVER_DEFAULT_WORKERS;
+    }
+    if (num_workers > SERVER_MAX_WORKERS) {
+        logmsg(WARN, "Requested number of workers %zu exceeds maximum of "
+               "%d. Setting number of workers to %d",
+               num_workers, SERVER_MAX_WORKERS, SERVER_MAX_WORKERS);
+        num_workers = SERVER_MAX_WORKERS;
+    }
+
+    if (verify_policy) {
+        checksum_validation policy;
+        if (parse_checksum_validation(verify_policy, &policy) != 0) {
+            logmsg(ERROR, "Invalid --verify policy '%s'; expected one of "
+                   "'%s', '%s' or '%s'", verify_policy, VALIDATE_ALWAYS_NAME,
+                   VALIDATE_CATALOG_NAME, VALIDATE_NEVER_NAME);
+            exit(1);
+        }
+        set_checksum_validation(policy);
+    }
+
+    if (select_replica_flag || preferred_resources) {
+        if (set_replica_selection(1, preferred_resources) != 0) {
+            logmsg(WARN, "Using only the first %d names given by "
+                   "--prefer-resources", REPLICA_MAX_PREFERENCES);
+        }
+    }
+
+    if (direct_io_flag || mmap_flag) {
+        set_local_io((direct_io_flag ? LOCAL_IO_DIRECT : 0) |
+                     (mmap_flag      ? LOCAL_IO_MMAP   : 0));
+    }
+
+    char default_path[MAX_NAME_LEN];
+    if (!socket_path) {
+        if (server_socket_path(default_path, sizeof default_path) != 0) {
+            logmsg(ERROR, "The default socket path is too long");
+            exit(1);
+        }
+        socket_path = default_path;
+    }
+
+    // A client that disconnects early must not stop the server
+    signal(SIGPIPE, SIG_IGN);
+
+    struct sigaction action;
+    memset(&action, 0, sizeof action);
+    action.sa_handler = handle_signal;
+    action.sa_flags   = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT,  &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    declare_client_name(argv[0]);
+
+    operation_args_t args = { .flags       = flags,
+                              .buffer_size = default_buffer_size,
+                              .zone_name   = zone_name,
+                              .num_workers = num_workers,
+                              .page_size   = page_size };
+
+    baton_error_t error;
+    serve_operations(socket_path, baton_json_dispatch_op, &args, &error);
+    if (error.code != 0) exit_status = 5;
+
+    exit(exit_status);
+}
@@ -29,6 +29,7 @@
 
 static int debug_flag      = 0;
 static int help_flag       = 0;
+static int stream_flag     = 0;
 static int unbuffered_flag = 0;
 static int verbose_flag    = 0;
 static int version_flag    = 0;
@@ -39,6 +40,7 @@ int main(int argc, char *argv[]) {
     int exit_status = 0;
     char *zone_name = NULL;
     char *json_file = NULL;
+    char *cache_file = NULL;
     FILE *input     = NULL;
 
     while (1) {
@@ -46,23 +48,29 @@ int main(int argc, char *argv[]) {
             // Flag options
             {"debug",      no_argument, &debug_flag,      1},
             {"help",       no_argument, &help_flag,       1},
+            {"stream",     no_argument, &stream_flag,     1},
             {"unbuffered", no_argument, &unbuffered_flag, 1},
             {"verbose",    no_argument, &verbose_flag,    1},
             {"version",    no_argument, &version_flag,    1},
             // Indexed options
+            {"alias-cache", required_argument, NULL, 'a'},
             {"file",      required_argument, NULL, 'f'},
             {"zone",      required_argument, NULL, 'z'},
             {0, 0, 0, 0}
         };
 
         int option_index = 0;
-        int c = getopt_long_only(argc, argv, "f:z:", long_options,
+        int c = getopt_long_only(argc, argv, "a:f:z:", long_options,
                                  &option_index);
 
         /* Detect the end of the options. */
         if (c == -1) break;
 
         switch (c) {
+            case 'a':
+                cache_file = optarg;
+                break;
+
             case 'f':
                 json_file = optarg;
                 break;
@@ -89,17 +97,25 @@ int main(int argc, char *argv[]) {
         puts("Synopsis");
         puts("");
         puts("    baton-specificquery");
+        puts("                    [--alias-cache <file>]");
         puts("                    [--file <JSON file>]");
-        puts("                    [--unbuffered] [--verbose] [--version]");
+        puts("                    [--stream] [--unbuffered] [--verbose]");
+        puts("                    [--version]");
         puts("                    [--zone <name>]");
         puts("");
         puts("Description");
         puts("    Runs a specific SQL query (must have been installed by");
         puts("`iadmin asq`) specified in a JSON input file.");
         puts("");
+        puts("    --alias-cache A file in which the SQL of query aliases is kept");
+        puts("                  between runs, to avoid fetching it from the");
+        puts("                  server. Optional.");
         puts("    --file        The JSON file describing the query. Optional,");
         puts("                  defaults to STDIN.");
-        puts("    --unbuffered  Flush print operations for each JSON object.");
+        puts("    --stream      Print each result as it arrives, as a separate");
+        puts("                  JSON object, rather than an array of all");
+        puts("                  results.");
+        puts("    --unbuffered  Flush output promptly, in batches of objects.");
         puts("    --verbose     Print verbose messages to STDERR.");
         puts("    --version     Print the version number and exit.");
         puts("    --zone        The zone to search. Optional.\n");
@@ -116,6 +132,10 @@ int main(int argc, char *argv[]) {
     if (debug_flag)   set_log_threshold(DEBUG);
     if (verbose_flag) set_log_threshold(NOTICE);
 
+    if (cache_file && set_specific_cache_file(cache_file) != 0) {
+        logmsg(WARN, "Ignoring the contents of alias cache '%s'", cache_file);
+    }
+
     declare_client_name(argv[0]);
     input = maybe_stdin(json_file);
     int status = do_search_specific(input, zone_name);
@@ -127,19 +147,26 @@ int main(int argc, char *argv[]) {
 int do_search_specific(FILE *input, char *zone_name) {
     int item_count  = 0;
     int error_count = 0;
+    json_reader_t *reader = NULL;
 
     rodsEnv env;
     rcComm_t *conn = rods_login(&env);
     if (!conn) goto error;
 
-    while (!feof(input)) {
-        size_t jflags = JSON_DISABLE_EOF_CHECK | JSON_REJECT_DUPLICATES;
-        json_error_t load_error;
-        json_t *target = json_loadf(input, jflags, &load_error);
+    baton_error_t input_error;
+    reader = make_json_reader(input, &input_error);
+    if (input_error.code != 0) {
+        logmsg(ERROR, "Failed to open input: error %d %s",
+               input_error.code, input_error.message);
+        goto error;
+    }
+
+    while (!json_reader_eof(reader)) {
+        baton_error_t load_error;
+        json_t *target = read_json_item(reader, &load_error);
         if (!target) {
-            if (!feof(input)) {
-                logmsg(ERROR, "JSON error at line %d, column %d: %s",
-                       load_error.line, load_error.column, load_error.text);
+            if (load_error.code != 0) {
+                logmsg(ERROR, "%s", load_error.message);
             }
 
             continue;
@@ -157,22 +184,34 @@ int do_search_specific(FILE *input, char *zone_name) {
         json_t *results = NULL;
 
         baton_error_t search_error;
-        results = search_specific(conn, target, zone_name, &search_error);
+        if (stream_flag) {
+            operation_args_t args = { .flags = unbuffered_flag ? FLUSH : 0 };
+            search_specific_stream(conn, target, zone_name,
+                                   print_json_results, &args, &search_error);
+        }
+        else {
+            results = search_specific(conn, target, zone_name, &search_error);
+        }
+
         if (search_error.code != 0) {
             error_count++;
             add_error_value(target, &search_error);
             print_json(target);
         }
-        else {
+        else if (results) {
             print_json(results);
         }
 
-        if (unbuffered_flag) fflush(stdout);
+        if (unbuffered_flag) {
+            maybe_flush_json_output(json_reader_ready(reader));
+        }
 
         if (results) json_decref(results);
         if (target) json_decref(target);
     } // while
 
+    flush_json_output();
+    free_json_reader(reader);
     rcDisconnect(conn);
 
     logmsg(DEBUG, "Processed %d items with %d errors", item_count, error_count);
@@ -180,6 +219,7 @@ int do_search_specific(FILE *input, char *zone_name) {
     return 0;
 
 error:
+    if (reader) free_json_reader(reader);
     if (conn) rcDisconnect(conn);
 
     logmsg(ERROR, "Processed %d items with %d errors", item_count, error_count);
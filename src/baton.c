@@ -22,6 +22,7 @@
 
 #include <errno.h>
 #include <libgen.h>
+#include <pthread.h>
 #include <signal.h>
 #include <stdarg.h>
 #include <stdio.h>
@@ -31,6 +32,14 @@
 #include "config.h"
 #include "baton.h"
 
+#if IRODS_VERSION_INTEGER && IRODS_VERSION_INTEGER >= 4002008
+#include <atomic_apply_metadata_operations.h>
+
+// Set when the server is found not to support atomic metadata
+// operations, so that they are not attempted again
+static int atomic_metadata_unsupported = 0;
+#endif
+
 static const char *metadata_op_name(metadata_op op) {
     const char *name;
 
@@ -141,6 +150,7 @@ rcComm_t *rods_login(rodsEnv *env) {
         goto error;
     }
 
+    double rpc = rpc_start();
     conn = rods_connect(env);
     if (!conn) {
         logmsg(ERROR, "Failed to connect to %s:%d zone '%s' as '%s'",
@@ -155,6 +165,7 @@ rcComm_t *rods_login(rodsEnv *env) {
 #else
     status = clientLogin(conn);
 #endif
+    rpc_end(RPC_LOGIN, rpc, 0);
 
     if (status < 0) {
         logmsg(ERROR, "Failed to log in to iRODS");
@@ -169,6 +180,77 @@ error:
     return NULL;
 }
 
+// Spare connections for each thread, made when they are first needed
+// to run searches and transfers concurrently and kept for the life of
+// the thread
+typedef struct spare_conns {
+    rcComm_t *conns[MAX_SPARE_CONNS];
+} spare_conns_t;
+
+static pthread_key_t spare_conn_key;
+static pthread_once_t spare_conn_once = PTHREAD_ONCE_INIT;
+
+static void disconnect_spare_conns(void *data) {
+    spare_conns_t *spares = data;
+
+    for (size_t i = 0; i < MAX_SPARE_CONNS; i++) {
+        if (spares->conns[i]) {
+            rcDisconnect(replace_connection(spares->conns[i]));
+        }
+    }
+
+    free(spares);
+}
+
+static void make_spare_conn_key(void) {
+    pthread_key_create(&spare_conn_key, disconnect_spare_conns);
+}
+
+rcComm_t *get_spare_connection(size_t index) {
+    pthread_once(&spare_conn_once, make_spare_conn_key);
+
+    if (index >= MAX_SPARE_CONNS) return NULL;
+
+    spare_conns_t *spares = pthread_getspecific(spare_conn_key);
+    if (!spares) {
+        spares = calloc(1, sizeof (spare_conns_t));
+        if (!spares) return NULL;
+
+        pthread_setspecific(spare_conn_key, spares);
+    }
+
+    if (spares->conns[index]) {
+        // Take up any connection made to resume a transfer on it
+        spares->conns[index] = replace_connection(spares->conns[index]);
+    }
+    else {
+        rodsEnv env;
+        spares->conns[index] = rods_login(&env);
+    }
+
+    return spares->conns[index];
+}
+
+void drop_spare_connection(size_t index) {
+    pthread_once(&spare_conn_once, make_spare_conn_key);
+
+    spare_conns_t *spares = pthread_getspecific(spare_conn_key);
+    if (spares && index < MAX_SPARE_CONNS && spares->conns[index]) {
+        rcDisconnect(replace_connection(spares->conns[index]));
+        spares->conns[index] = NULL;
+    }
+}
+
+void free_spare_connection(void) {
+    pthread_once(&spare_conn_once, make_spare_conn_key);
+
+    spare_conns_t *spares = pthread_getspecific(spare_conn_key);
+    if (spares) {
+        pthread_setspecific(spare_conn_key, NULL);
+        disconnect_spare_conns(spares);
+    }
+}
+
 int init_rods_path(rodsPath_t *rods_path, char *inpath) {
     if (!rods_path) return USER__NULL_INPUT_ERR;
 
@@ -201,6 +283,9 @@ int resolve_rods_path(rcComm_t *conn, rodsEnv *env, rodsPath_t *rods_path,
         }
     }
 
+    // Consecutive operations on the same target resolve it once
+    if (load_target_path(inpath, rods_path)) return rods_path->objState;
+
     int status = init_rods_path(rods_path, inpath);
     if (status < 0) {
         set_baton_error(error, status,
@@ -215,7 +300,7 @@ int resolve_rods_path(rcComm_t *conn, rodsEnv *env, rodsPath_t *rods_path,
         goto error;
     }
 
-    status = getRodsObjType(conn, rods_path);
+    status = get_cached_rods_obj_type(conn, rods_path);
     if (status < 0) {
         char *err_subname;
         const char *err_name = rodsErrorName(status, &err_subname);
@@ -225,6 +310,8 @@ int resolve_rods_path(rcComm_t *conn, rodsEnv *env, rodsPath_t *rods_path,
         goto error;
     }
 
+    store_target_path(inpath, rods_path);
+
     return status;
 
 error:
@@ -250,7 +337,7 @@ int set_rods_path(rcComm_t *conn, rodsPath_t *rods_path, char *path,
         goto error;
     }
 
-    status = getRodsObjType(conn, rods_path);
+    status = get_cached_rods_obj_type(conn, rods_path);
     if (status < 0) {
         char *err_subname;
         const char *err_name = rodsErrorName(status, &err_subname);
@@ -326,6 +413,9 @@ int move_rods_path(rcComm_t *conn, rodsPath_t *rods_path, char *new_path,
     }
 
     status = rcDataObjRename(conn, &obj_rename_in);
+    invalidate_stat_cache(src);
+    invalidate_stat_cache(dest);
+
     if (status < 0) {
         char *err_subname;
         const char *err_name = rodsErrorName(status, &err_subname);
@@ -390,12 +480,221 @@ error:
     return error->code;
 }
 
+static json_t *add_search_attrs(rcComm_t *conn, json_t *results,
+                                option_flags flags, baton_error_t *error) {
+    if (flags & PRINT_ACL) {
+        results = add_acl_json_array(conn, results, error);
+        if (error->code != 0) goto error;
+    }
+    if (flags & PRINT_AVU) {
+        results = add_avus_json_array(conn, results, error);
+        if (error->code != 0) goto error;
+    }
+    if (flags & PRINT_CHECKSUM) {
+        results = add_checksum_json_array(conn, results, error);
+        if (error->code != 0) goto error;
+    }
+    if (flags & PRINT_TIMESTAMP) {
+        results = add_tps_json_array(conn, results, error);
+        if (error->code != 0) goto error;
+    }
+    if (flags & PRINT_REPLICATE) {
+        results = add_repl_json_array(conn, results, error);
+        if (error->code != 0) goto error;
+    }
+
+    return results;
+
+error:
+    return NULL;
+}
+
+typedef struct search_sink {
+    rcComm_t *conn;
+    option_flags flags;
+    query_sink_cb sink;
+    void *sink_data;
+} search_sink_t;
+
+static int add_search_attrs_sink(json_t *results, void *sink_data,
+                                 baton_error_t *error) {
+    search_sink_t *search = sink_data;
+
+    init_baton_error(error);
+
+    add_search_attrs(search->conn, results, search->flags, error);
+    if (error->code != 0) goto error;
+
+    search->sink(results, search->sink_data, error);
+
+error:
+    return error->code;
+}
+
+static json_t *search_metadata_sequentially(rcComm_t *conn, json_t *query,
+                                            char *zone_name,
+                                            option_flags flags,
+                                            baton_error_t *error) {
+    // Per-item details are added once, across all the results, rather
+    // than page by page, so that they are fetched in the largest batches
+    option_flags print_flags = PRINT_ACL | PRINT_AVU | PRINT_CHECKSUM |
+                               PRINT_TIMESTAMP | PRINT_REPLICATE;
+
+    init_baton_error(error);
+
+    json_t *results = json_array();
+    if (!results) {
+        set_baton_error(error, -1, "Failed to allocate a new JSON array");
+        goto error;
+    }
+
+    search_metadata_stream(conn, query, zone_name, flags & ~print_flags,
+                           extend_json_results, results, error);
+    if (error->code != 0) goto error;
+
+    results = add_search_attrs(conn, results, flags, error);
+    if (error->code != 0) goto error;
+
+    return results;
+
+error:
+    logmsg(ERROR, error->message);
+
+    if (results) json_decref(results);
+
+    return NULL;
+}
+
+typedef struct search_task {
+    rcComm_t *conn;
+    json_t *query;
+    char *zone_name;
+    option_flags flags;
+    rpc_stats_t *stats;
+    size_t page_size;
+    int adaptive;
+    json_t *results;
+    baton_error_t error;
+} search_task_t;
+
+static void *run_search_task(void *arg) {
+    search_task_t *task = arg;
+
+    use_rpc_stats(task->stats);
+    set_query_page_size(task->page_size, task->adaptive);
+    task->results = search_metadata_sequentially(task->conn, task->query,
+                                                 task->zone_name, task->flags,
+                                                 &task->error);
+
+    return NULL;
+}
+
+// Search for collections on a spare connection in a new thread, while
+// searching for data objects on this one. The collections precede the
+// data objects in the results, as they do in a sequential search.
+static json_t *search_metadata_concurrently(rcComm_t *conn, json_t *query,
+                                            char *zone_name,
+                                            option_flags flags,
+                                            baton_error_t *error) {
+    json_t *results = NULL;
+    json_t *objects = NULL;
+    int started     = 0;
+    pthread_t thread;
+
+    init_baton_error(error);
+
+    rcComm_t *spare_conn = get_spare_connection(0);
+    if (!spare_conn) {
+        logmsg(NOTICE, "Failed to connect for a concurrent search; "
+               "searching sequentially");
+        return search_metadata_sequentially(conn, query, zone_name, flags,
+                                            error);
+    }
+
+    // The query is copied because jansson reference counts are not
+    // safe to update from more than one thread
+    search_task_t task = { .conn      = spare_conn,
+                           .query     = json_deep_copy(query),
+                           .zone_name = zone_name,
+                           .flags     = flags & ~SEARCH_OBJECTS,
+                           .stats     = get_rpc_stats(),
+                           .page_size = get_query_page_size(),
+                           .adaptive  = get_query_page_adaptive() };
+    init_baton_error(&task.error);
+
+    if (!task.query) {
+        set_baton_error(error, -1, "Failed to copy the JSON query");
+        goto error;
+    }
+
+    int status = pthread_create(&thread, NULL, run_search_task, &task);
+    if (status != 0) {
+        set_baton_error(error, status, "Failed to start a search thread: "
+                        "error %d %s", status, strerror(status));
+        goto error;
+    }
+    started = 1;
+
+    baton_error_t obj_error;
+    objects = search_metadata_sequentially(conn, query, zone_name,
+                                           flags & ~SEARCH_COLLECTIONS,
+                                           &obj_error);
+
+    pthread_join(thread, NULL);
+    started = 0;
+    json_decref(task.query);
+    task.query = NULL;
+
+    if (task.error.code != 0) {
+        drop_spare_connection(0);
+        set_baton_error(error, task.error.code, "%s", task.error.message);
+        goto error;
+    }
+    if (obj_error.code != 0) {
+        set_baton_error(error, obj_error.code, "%s", obj_error.message);
+        goto error;
+    }
+
+    results = task.results;
+    task.results = NULL;
+
+    if (json_array_extend(results, objects) != 0) {
+        set_baton_error(error, -1, "Failed to merge search results");
+        goto error;
+    }
+    json_decref(objects);
+
+    return results;
+
+error:
+    if (started)      pthread_join(thread, NULL);
+    if (task.query)   json_decref(task.query);
+    if (task.results) json_decref(task.results);
+    if (objects)      json_decref(objects);
+    if (results)      json_decref(results);
+
+    return NULL;
+}
+
 json_t *search_metadata(rcComm_t *conn, json_t *query, char *zone_name,
                         option_flags flags, baton_error_t *error) {
-    json_t *results      = NULL;
-    json_t *collections  = NULL;
-    json_t *data_objects = NULL;
-    int status;
+    // Collections and data objects are independent searches, each
+    // followed by its own enrichment passes, so both may run at once
+    if ((flags & SEARCH_COLLECTIONS) && (flags & SEARCH_OBJECTS)) {
+        return search_metadata_concurrently(conn, query, zone_name, flags,
+                                            error);
+    }
+
+    return search_metadata_sequentially(conn, query, zone_name, flags, error);
+}
+
+int search_metadata_stream(rcComm_t *conn, json_t *query, char *zone_name,
+                           option_flags flags, query_sink_cb sink,
+                           void *sink_data, baton_error_t *error) {
+    search_sink_t search = { .conn      = conn,
+                             .flags     = flags,
+                             .sink      = sink,
+                             .sink_data = sink_data };
 
     query_format_in_t *col_format = &(query_format_in_t)
         { .num_columns = 1,
@@ -429,77 +728,318 @@ json_t *search_metadata(rcComm_t *conn, json_t *query, char *zone_name,
     query = map_access_args(query, error);
     if (error->code != 0) goto error;
 
-    results = json_array();
-    if (!results) {
-        set_baton_error(error, -1, "Failed to allocate a new JSON array");
-        goto error;
-    }
-
     if (flags & SEARCH_COLLECTIONS) {
         logmsg(DEBUG, "Searching for collections ...");
-        collections = do_search(conn, zone_name, query, col_format,
-                                prepare_col_avu_search, prepare_col_acl_search,
-                                prepare_col_cre_search, prepare_col_mod_search,
-                                error);
+        do_search_stream(conn, zone_name, query, col_format,
+                         prepare_col_avu_search, prepare_col_acl_search,
+                         prepare_col_cre_search, prepare_col_mod_search,
+                         add_search_attrs_sink, &search, error);
         if (error->code != 0) goto error;
-
-        status = json_array_extend(results, collections);
-        if (status != 0) {
-            set_baton_error(error, status, "Failed to add collection results");
-            goto error;
-        }
-
-        json_decref(collections);
     }
 
     if (flags & SEARCH_OBJECTS) {
         logmsg(DEBUG, "Searching for data objects ...");
-        data_objects = do_search(conn, zone_name, query, obj_format,
-                                 prepare_obj_avu_search, prepare_obj_acl_search,
-                                 prepare_obj_cre_search, prepare_obj_mod_search,
-                                 error);
+        do_search_stream(conn, zone_name, query, obj_format,
+                         prepare_obj_avu_search, prepare_obj_acl_search,
+                         prepare_obj_cre_search, prepare_obj_mod_search,
+                         add_search_attrs_sink, &search, error);
         if (error->code != 0) goto error;
+    }
 
-        status = json_array_extend(results, data_objects);
-        if (status != 0) {
-            set_baton_error(error, status, "Failed to add data object results");
+    return error->code;
+
+error:
+    logmsg(ERROR, error->message);
+
+    return error->code;
+}
+
+typedef struct zone_sink {
+    pthread_mutex_t lock;
+    query_sink_cb sink;
+    void *sink_data;
+} zone_sink_t;
+
+typedef struct zone_search {
+    rcComm_t *conn;
+    json_t *query;
+    char zone_name[NAME_LEN];
+    option_flags flags;
+    rpc_stats_t *stats;
+    size_t page_size;
+    int adaptive;
+    /** Shared by all the zones when streaming, otherwise NULL */
+    zone_sink_t *sink;
+    json_t *results;
+    baton_error_t error;
+} zone_search_t;
+
+static int zone_sink(json_t *results, void *sink_data, baton_error_t *error) {
+    zone_sink_t *shared = sink_data;
+
+    pthread_mutex_lock(&shared->lock);
+    shared->sink(results, shared->sink_data, error);
+    pthread_mutex_unlock(&shared->lock);
+
+    return error->code;
+}
+
+static void *run_zone_search(void *arg) {
+    zone_search_t *search = arg;
+
+    use_rpc_stats(search->stats);
+    set_query_page_size(search->page_size, search->adaptive);
+
+    // The zones already run concurrently, so each one searches for
+    // collections and data objects in turn, on its one connection
+    if (search->sink) {
+        search_metadata_stream(search->conn, search->query,
+                               search->zone_name, search->flags, zone_sink,
+                               search->sink, &search->error);
+    }
+    else {
+        search->results =
+            search_metadata_sequentially(search->conn, search->query,
+                                         search->zone_name, search->flags,
+                                         &search->error);
+    }
+
+    return NULL;
+}
+
+// Fill in the name of each zone to search, returning the number of
+// zones
+static size_t parse_search_zones(rcComm_t *conn, const char *zone_names,
+                                 zone_search_t *searches,
+                                 baton_error_t *error) {
+    size_t num_zones = 0;
+    char *names      = NULL;
+    json_t *zones    = NULL;
+
+    init_baton_error(error);
+
+    if (zone_names) {
+        names = strdup(zone_names);
+        if (!names) {
+            set_baton_error(error, errno, "Failed to allocate memory: "
+                            "error %d %s", errno, strerror(errno));
             goto error;
         }
 
-        json_decref(data_objects);
-    }
+        char *saveptr = NULL;
+        for (char *name = strtok_r(names, ZONE_LIST_SEPARATOR, &saveptr);
+             name; name = strtok_r(NULL, ZONE_LIST_SEPARATOR, &saveptr)) {
+            if (num_zones == MAX_SEARCH_ZONES) {
+                set_baton_error(error, -1, "Failed to search more than %d "
+                                "zones at once", MAX_SEARCH_ZONES);
+                goto error;
+            }
 
-    if (flags & PRINT_ACL) {
-        results = add_acl_json_array(conn, results, error);
-        if (error->code != 0) goto error;
+            check_str_arg("zone_name", name, NAME_LEN, error);
+            if (error->code != 0) goto error;
+
+            snprintf(searches[num_zones++].zone_name, NAME_LEN, "%s", name);
+        }
+
+        free(names);
+        names = NULL;
     }
-    if (flags & PRINT_AVU) {
-        results = add_avus_json_array(conn, results, error);
+    else {
+        zones = list_zones(conn, error);
         if (error->code != 0) goto error;
+
+        for (size_t i = 0; i < json_array_size(zones); i++) {
+            if (num_zones == MAX_SEARCH_ZONES) {
+                set_baton_error(error, -1, "Failed to search more than %d "
+                                "zones at once", MAX_SEARCH_ZONES);
+                goto error;
+            }
+
+            json_t *zone = json_object_get(json_array_get(zones, i),
+                                           JSON_ZONE_KEY);
+            if (!json_is_string(zone)) continue;
+
+            snprintf(searches[num_zones++].zone_name, NAME_LEN, "%s",
+                     json_string_value(zone));
+        }
+
+        json_decref(zones);
+        zones = NULL;
     }
-    if (flags & PRINT_CHECKSUM) {
-        results = add_checksum_json_array(conn, results, error);
-        if (error->code != 0) goto error;
+
+    if (num_zones == 0) {
+        set_baton_error(error, -1, "Found no zones to search in '%s'",
+                        zone_names ? zone_names : "");
+        goto error;
     }
-    if (flags & PRINT_TIMESTAMP) {
-        results = add_tps_json_array(conn, results, error);
-        if (error->code != 0) goto error;
+
+    return num_zones;
+
+error:
+    if (names) free(names);
+    if (zones) json_decref(zones);
+
+    return 0;
+}
+
+// Search each zone in its own thread. Zone 0 uses the caller's
+// connection and each other zone uses a spare connection.
+static json_t *fan_out_zone_search(rcComm_t *conn, json_t *query,
+                                   const char *zone_names, option_flags flags,
+                                   zone_sink_t *sink, baton_error_t *error) {
+    zone_search_t searches[MAX_SEARCH_ZONES];
+    pthread_t threads[MAX_SEARCH_ZONES];
+    int started[MAX_SEARCH_ZONES];
+    json_t *results = NULL;
+
+    init_baton_error(error);
+    memset(searches, 0, sizeof searches);
+    memset(started, 0, sizeof started);
+
+    size_t num_zones = parse_search_zones(conn, zone_names, searches, error);
+    if (error->code != 0) goto error;
+
+    logmsg(DEBUG, "Searching %zu zones concurrently", num_zones);
+
+    for (size_t i = 0; i < num_zones; i++) {
+        zone_search_t *search = &searches[i];
+        init_baton_error(&search->error);
+
+        search->flags     = flags;
+        search->stats     = get_rpc_stats();
+        search->page_size = get_query_page_size();
+        search->adaptive  = get_query_page_adaptive();
+        search->sink      = sink;
+
+        // Each thread has its own copy of the query because jansson
+        // reference counts are not safe to update from more than one
+        // thread
+        search->query = json_deep_copy(query);
+        if (!search->query) {
+            set_baton_error(&search->error, -1,
+                            "Failed to copy the JSON query");
+            continue;
+        }
+
+        search->conn = i == 0 ? conn : get_spare_connection(i - 1);
+        if (!search->conn) {
+            set_baton_error(&search->error, -1, "Failed to connect");
+            continue;
+        }
+
+        int status = pthread_create(&threads[i], NULL, run_zone_search,
+                                    search);
+        if (status != 0) {
+            set_baton_error(&search->error, status, "Failed to start a "
+                            "search thread: error %d %s",
+                            status, strerror(status));
+            continue;
+        }
+        started[i] = 1;
     }
-    if (flags & PRINT_REPLICATE) {
-        results = add_repl_json_array(conn, results, error);
-        if (error->code != 0) goto error;
+
+    size_t num_failed = 0;
+    char message[MAX_ERROR_MESSAGE_LEN] = "";
+    size_t len = 0;
+
+    for (size_t i = 0; i < num_zones; i++) {
+        zone_search_t *search = &searches[i];
+        if (started[i]) pthread_join(threads[i], NULL);
+        json_decref(search->query);
+
+        if (search->error.code != 0) {
+            logmsg(ERROR, "Failed to search zone '%s': error %d %s",
+                   search->zone_name, search->error.code,
+                   search->error.message);
+
+            if (len < sizeof message) {
+                int n = snprintf(message + len, sizeof message - len,
+                                 "%s'%s': %s", num_failed > 0 ? "; " : "",
+                                 search->zone_name, search->error.message);
+                if (n > 0) len += n;
+            }
+
+            if (num_failed == 0) error->code = search->error.code;
+            num_failed++;
+
+            if (i > 0) drop_spare_connection(i - 1);
+        }
+    }
+
+    // The results of the zones searched are kept, with an error naming
+    // each of the zones whose search failed
+    if (!sink) {
+        results = json_array();
+        if (!results) {
+            set_baton_error(error, -1, "Failed to allocate a new JSON array");
+            goto error;
+        }
+
+        for (size_t i = 0; i < num_zones; i++) {
+            if (!searches[i].results || searches[i].error.code != 0) {
+                continue;
+            }
+
+            if (json_array_extend(results, searches[i].results) != 0) {
+                set_baton_error(error, -1, "Failed to merge search results");
+                goto error;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < num_zones; i++) {
+        if (searches[i].results) json_decref(searches[i].results);
+    }
+
+    if (num_failed > 0) {
+        set_baton_error(error, error->code, "Failed to search %zu of %zu "
+                        "zones: %s", num_failed, num_zones, message);
     }
 
     return results;
 
+error:
+    for (size_t i = 0; i < MAX_SEARCH_ZONES; i++) {
+        if (searches[i].results) json_decref(searches[i].results);
+    }
+    if (results) json_decref(results);
+
+    return NULL;
+}
+
+json_t *search_metadata_zones(rcComm_t *conn, json_t *query,
+                              const char *zone_names, option_flags flags,
+                              baton_error_t *error) {
+    json_t *results = fan_out_zone_search(conn, query, zone_names, flags,
+                                          NULL, error);
+    if (error->code != 0) goto error;
+
+    return results;
+
 error:
     logmsg(ERROR, error->message);
 
-    if (results)      json_decref(results);
-    if (collections)  json_decref(collections);
-    if (data_objects) json_decref(data_objects);
+    return results;
+}
 
-    return NULL;
+int search_metadata_zones_stream(rcComm_t *conn, json_t *query,
+                                 const char *zone_names, option_flags flags,
+                                 query_sink_cb sink, void *sink_data,
+                                 baton_error_t *error) {
+    zone_sink_t shared = { .sink      = sink,
+                           .sink_data = sink_data };
+    pthread_mutex_init(&shared.lock, NULL);
+
+    fan_out_zone_search(conn, query, zone_names, flags, &shared, error);
+    pthread_mutex_destroy(&shared.lock);
+    if (error->code != 0) goto error;
+
+    return error->code;
+
+error:
+    logmsg(ERROR, error->message);
+
+    return error->code;
 }
 
 json_t *search_specific(rcComm_t *conn, json_t *query, char *zone_name,
@@ -529,6 +1069,29 @@ error:
     return NULL;
 }
 
+int search_specific_stream(rcComm_t *conn, json_t *query, char *zone_name,
+                           query_sink_cb sink, void *sink_data,
+                           baton_error_t *error) {
+    init_baton_error(error);
+
+    if (zone_name) {
+        check_str_arg("zone_name", zone_name, NAME_LEN, error);
+        if (error->code != 0) goto error;
+    }
+
+    logmsg(TRACE, "Running specific query ...");
+    do_specific_stream(conn, zone_name, query, prepare_specific_query,
+                       prepare_specific_labels, sink, sink_data, error);
+    if (error->code != 0) goto error;
+
+    return error->code;
+
+error:
+    logmsg(ERROR, error->message);
+
+    return error->code;
+}
+
 int modify_permissions(rcComm_t *conn, rodsPath_t *rods_path,
                        recursive_op recurse, char *owner_specifier,
                        char *access_level, baton_error_t *error) {
@@ -577,6 +1140,7 @@ int modify_permissions(rcComm_t *conn, rodsPath_t *rods_path,
     }
 
     status = rcModAccessControl(conn, &mod_perms_in);
+    forget_target(rods_path->outPath, TARGET_ACL, recurse == RECURSE);
     if (status < 0) {
         set_baton_error(error, status, "Failed to modify permissions "
                         "of '%s' to '%s' for '%s'",
@@ -692,7 +1256,10 @@ int modify_metadata(rcComm_t *conn, rodsPath_t *rods_path,
     modAVUMetadataInp_t anon_args;
     map_mod_args(&anon_args, &named_args);
 
+    double rpc = rpc_start();
     int status = rcModAVUMetadata(conn, &anon_args);
+    rpc_end(RPC_MOD_AVU_METADATA, rpc, 0);
+    forget_target(rods_path->outPath, TARGET_AVU, 0);
     if (status < 0) {
         char *err_subname;
         const char *err_name = rodsErrorName(status, &err_subname);
@@ -718,35 +1285,260 @@ error:
     return error->code;
 }
 
+#if IRODS_VERSION_INTEGER && IRODS_VERSION_INTEGER >= 4002008
+static int add_atomic_metadata_ops(json_t *ops, const char *op_name,
+                                   json_t *avus, baton_error_t *error) {
+    for (size_t i = 0; i < json_array_size(avus); i++) {
+        json_t *avu = json_array_get(avus, i);
+
+        const char *attr = get_avu_attribute(avu, error);
+        if (error->code != 0) goto error;
+
+        const char *value = get_avu_value(avu, error);
+        if (error->code != 0) goto error;
+
+        const char *units = get_avu_units(avu, error);
+        if (error->code != 0) goto error;
+
+        json_t *op = json_pack("{s:s, s:s, s:s}",
+                               "operation", op_name,
+                               "attribute", attr,
+                               "value",     value);
+        if (!op) {
+            set_baton_error(error, -1, "Failed to pack a metadata operation "
+                            "on attribute '%s'", attr);
+            goto error;
+        }
+
+        if (units && units[0] != '\0') {
+            json_object_set_new(op, "units", json_string(units));
+        }
+
+        json_array_append_new(ops, op);
+    }
+
+    return error->code;
+
+error:
+    return error->code;
+}
+
+// Apply all the metadata operations in one request. Returns
+// SYS_UNMATCHED_API_NUM, without setting the error, if the server
+// does not support atomic operations.
+static int apply_atomic_metadata(rcComm_t *conn, rodsPath_t *rods_path,
+                                 const char *entity_type,
+                                 json_t *rem_avus, json_t *add_avus,
+                                 baton_error_t *error) {
+    json_t *input    = NULL;
+    char *input_str  = NULL;
+    char *output_str = NULL;
+
+    json_t *ops = json_array();
+    if (!ops) {
+        set_baton_error(error, -1, "Failed to allocate a new JSON array");
+        goto error;
+    }
+
+    add_atomic_metadata_ops(ops, "remove", rem_avus, error);
+    if (error->code != 0) goto error;
+
+    add_atomic_metadata_ops(ops, "add", add_avus, error);
+    if (error->code != 0) goto error;
+
+    size_t num_ops = json_array_size(ops);
+
+    input = json_pack("{s:s, s:s, s:o}",
+                      "entity_name", rods_path->outPath,
+                      "entity_type", entity_type,
+                      "operations",  ops);
+    ops = NULL; // Stolen by input
+    if (!input) {
+        set_baton_error(error, -1, "Failed to pack metadata operations "
+                        "for '%s'", rods_path->outPath);
+        goto error;
+    }
+
+    input_str = json_dumps(input, JSON_COMPACT);
+    if (!input_str) {
+        set_baton_error(error, -1, "Failed to serialise metadata "
+                        "operations for '%s'", rods_path->outPath);
+        goto error;
+    }
+
+    logmsg(DEBUG, "Applying %zu metadata operations to '%s'",
+           num_ops, rods_path->outPath);
+
+    double rpc = rpc_start();
+    int status = rc_atomic_apply_metadata_operations(conn, input_str,
+                                                     &output_str);
+    rpc_end(RPC_MOD_AVU_METADATA, rpc, 0);
+    forget_target(rods_path->outPath, TARGET_AVU, 0);
+    if (status == SYS_UNMATCHED_API_NUM) {
+        logmsg(NOTICE, "The server does not support atomic metadata "
+               "operations; applying them one at a time");
+        atomic_metadata_unsupported = 1;
+    }
+    else if (status < 0) {
+        char *err_subname;
+        const char *err_name = rodsErrorName(status, &err_subname);
+        set_baton_error(error, status,
+                        "Failed to apply %zu metadata operations to '%s': "
+                        "error %d %s %s", num_ops, rods_path->outPath,
+                        status, err_name, output_str ? output_str : "");
+        goto error;
+    }
+
+    json_decref(input);
+    free_json_mem(input_str);
+    if (output_str) free(output_str);
+
+    return status;
+
+error:
+    if (conn->rError) {
+        logmsg(ERROR, error->message);
+        log_rods_errstack(ERROR, conn->rError);
+    }
+    else {
+        logmsg(ERROR, error->message);
+    }
+
+    if (ops)        json_decref(ops);
+    if (input)      json_decref(input);
+    if (input_str)  free_json_mem(input_str);
+    if (output_str) free(output_str);
+
+    return error->code;
+}
+#endif
+
+int apply_json_metadata(rcComm_t *conn, rodsPath_t *rods_path,
+                        json_t *rem_avus, json_t *add_avus,
+                        baton_error_t *error) {
+    const char *entity_type;
+
+    init_baton_error(error);
+
+    size_t num_ops = json_array_size(rem_avus) + json_array_size(add_avus);
+    if (num_ops == 0) {
+        logmsg(TRACE, "No metadata operations to apply to '%s'",
+               rods_path->outPath);
+        return error->code;
+    }
+
+    if (rods_path->objState == NOT_EXIST_ST) {
+        set_baton_error(error, USER_FILE_DOES_NOT_EXIST,
+                        "Path '%s' does not exist "
+                        "(or lacks access permission)", rods_path->outPath);
+        goto error;
+    }
+
+    switch (rods_path->objType) {
+        case DATA_OBJ_T:
+            entity_type = "data_object";
+            break;
+
+        case COLL_OBJ_T:
+            entity_type = "collection";
+            break;
+
+        default:
+            set_baton_error(error, USER_INPUT_PATH_ERR,
+                            "Failed to set metadata on '%s' as it is "
+                            "neither data object nor collection",
+                            rods_path->outPath);
+            goto error;
+    }
+
+#if IRODS_VERSION_INTEGER && IRODS_VERSION_INTEGER >= 4002008
+    // A single operation gains nothing from the atomic API
+    if (num_ops > 1 && !atomic_metadata_unsupported) {
+        int status = apply_atomic_metadata(conn, rods_path, entity_type,
+                                           rem_avus, add_avus, error);
+        if (error->code != 0)                goto error;
+        if (status != SYS_UNMATCHED_API_NUM) return error->code;
+    }
+#else
+    (void) entity_type;
+#endif
+
+    // Removals are made before additions, as atomically
+    for (size_t i = 0; i < json_array_size(rem_avus); i++) {
+        json_t *avu = json_array_get(rem_avus, i);
+        modify_json_metadata(conn, rods_path, META_REM, avu, error);
+        if (error->code != 0) goto error;
+    }
+
+    for (size_t i = 0; i < json_array_size(add_avus); i++) {
+        json_t *avu = json_array_get(add_avus, i);
+        modify_json_metadata(conn, rods_path, META_ADD, avu, error);
+        if (error->code != 0) goto error;
+    }
+
+    return error->code;
+
+error:
+    return error->code;
+}
+
 int maybe_modify_json_metadata(rcComm_t *conn, rodsPath_t *rods_path,
                                metadata_op operation,
                                json_t *candidate_avus, json_t *reference_avus,
                                baton_error_t *error) {
-    const char *op_name = metadata_op_name(operation);
+    init_baton_error(error);
+
+    json_t *delta = avu_difference(candidate_avus, reference_avus, error);
+    if (error->code != 0) goto error;
+
+    logmsg(TRACE, "Performing '%s' operation on %zu of %zu AVUs",
+           metadata_op_name(operation), json_array_size(delta),
+           json_array_size(candidate_avus));
+
+    if (operation == META_REM) {
+        apply_json_metadata(conn, rods_path, delta, NULL, error);
+    }
+    else {
+        apply_json_metadata(conn, rods_path, NULL, delta, error);
+    }
+
+    json_decref(delta);
+
+    return error->code;
+
+error:
+    return error->code;
+}
+
+int supersede_json_metadata(rcComm_t *conn, rodsPath_t *rods_path,
+                            json_t *current_avus, json_t *target_avus,
+                            baton_error_t *error) {
+    json_t *rem_avus = NULL;
+    json_t *add_avus = NULL;
 
     init_baton_error(error);
 
-    for (size_t i = 0; i < json_array_size(candidate_avus); i++) {
-        json_t *candidate_avu = json_array_get(candidate_avus, i);
-        char *str = json_dumps(candidate_avu, JSON_DECODE_ANY);
+    rem_avus = avu_difference(current_avus, target_avus, error);
+    if (error->code != 0) goto error;
 
-        if (contains_avu(reference_avus, candidate_avu)) {
-            logmsg(TRACE, "Skipping '%s' operation on AVU %s", op_name, str);
-        }
-        else {
-            logmsg(TRACE, "Performing '%s' operation on AVU %s", op_name, str);
-            modify_json_metadata(conn, rods_path, operation, candidate_avu,
-                                 error);
-        }
+    add_avus = avu_difference(target_avus, current_avus, error);
+    if (error->code != 0) goto error;
 
-        free(str);
+    logmsg(DEBUG, "Superseding metadata on '%s': removing %zu AVUs, "
+           "adding %zu AVUs", rods_path->outPath, json_array_size(rem_avus),
+           json_array_size(add_avus));
 
-        if (error->code != 0) goto error;
-    }
+    apply_json_metadata(conn, rods_path, rem_avus, add_avus, error);
+
+    json_decref(rem_avus);
+    json_decref(add_avus);
 
     return error->code;
 
 error:
+    if (rem_avus) json_decref(rem_avus);
+    if (add_avus) json_decref(add_avus);
+
     return error->code;
 }
 
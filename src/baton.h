@@ -26,14 +26,35 @@
 #include <rodsClient.h>
 
 #include "config.h"
+#include "arena.h"
+#include "chmod.h"
 #include "json_query.h"
+#include "json_reader.h"
 #include "list.h"
+#include "local_io.h"
 #include "log.h"
 #include "read.h"
+#include "replica.h"
+#include "server.h"
+#include "specific_cache.h"
+#include "stat_cache.h"
+#include "stats.h"
+#include "sync.h"
+#include "target_cache.h"
+#include "transfer.h"
+#include "tree.h"
+#include "utf8.h"
 #include "write.h"
 
 #define MAX_CLIENT_NAME_LEN   512
 
+/** The maximum number of zones searched at once by a federated search */
+#define MAX_SEARCH_ZONES       32
+/** The maximum number of spare connections kept by each thread */
+#define MAX_SPARE_CONNS        MAX_SEARCH_ZONES
+/** The separator of zone names in a list of zones to search */
+#define ZONE_LIST_SEPARATOR    ","
+
 #define META_ADD_NAME "add"
 #define META_REM_NAME "rm"
 
@@ -89,6 +110,34 @@ int declare_client_name(const char *name);
  */
 rcComm_t *rods_login(rodsEnv *env);
 
+/**
+ * Return one of the calling thread's spare connections, which may be
+ * used by other threads that it starts to work concurrently. The
+ * connection is made on first use and kept until the calling thread
+ * exits or calls @ref free_spare_connection.
+ *
+ * @param[in] index  The index of the connection, less than
+ *                   MAX_SPARE_CONNS.
+ *
+ * @return An open connection to the iRODS server or NULL on error.
+ */
+rcComm_t *get_spare_connection(size_t index);
+
+/**
+ * Disconnect one of the calling thread's spare connections, which may
+ * be broken, so that a new one is made when it is next needed.
+ *
+ * @param[in] index  The index of the connection.
+ */
+void drop_spare_connection(size_t index);
+
+/**
+ * Disconnect the spare connections that the calling thread may have
+ * opened to run searches concurrently. A thread's spare connections
+ * are otherwise disconnected when the thread exits.
+ */
+void free_spare_connection(void);
+
 /**
  * Initialise an iRODS path by copying a string into its inPath.
  *
@@ -156,6 +205,28 @@ int resolve_collection(json_t *object, rcComm_t *conn, rodsEnv *env,
 json_t *search_metadata(rcComm_t *conn, json_t *query, char *zone_name,
                         option_flags flags, baton_error_t *error);
 
+/**
+ * Search metadata as @ref search_metadata does, passing each page of
+ * results to a callback as soon as it arrives from the server. Any
+ * details requested by the flags (AVUs, ACLs, checksums etc.) are added
+ * to each page before it is passed on. Only one page of results is held
+ * in memory at a time.
+ *
+ * @param[in]  conn         An open iRODS connection.
+ * @param[in]  query        A JSON query specification.
+ * @param[in]  zone_name    An iRODS zone name. Optional, NULL means the current
+ *                          zone.
+ * @param[in]  flags        Search behaviour options.
+ * @param[in]  sink         Callback to receive each page of results.
+ * @param[in]  sink_data    Data passed to the callback.
+ * @param[out] error        An error report struct.
+ *
+ * @return 0 on success, error code on failure.
+ */
+int search_metadata_stream(rcComm_t *conn, json_t *query, char *zone_name,
+                           option_flags flags, query_sink_cb sink,
+                           void *sink_data, baton_error_t *error);
+
 /**
  * Perform a specific query (SQL must have been installed on iRODS server by an
  * administrator using `iadmin asq`).
@@ -173,6 +244,72 @@ json_t *search_metadata(rcComm_t *conn, json_t *query, char *zone_name,
 json_t *search_specific(rcComm_t *conn, json_t *query, char *zone_name,
                         baton_error_t *error);
 
+/**
+ * Search metadata as @ref search_metadata does, in several zones at
+ * once. Each zone is searched in its own thread, on its own connection.
+ * The results are merged in the order of the zones.
+ *
+ * @param[in]  conn         An open iRODS connection.
+ * @param[in]  query        A JSON query specification.
+ * @param[in]  zone_names   A list of zone names, separated by
+ *                          ZONE_LIST_SEPARATOR. Optional, NULL means
+ *                          the local zone and all zones federated
+ *                          with it.
+ * @param[in]  flags        Search behaviour options.
+ * @param[out] error        An error report struct, naming each of the
+ *                          zones whose search failed.
+ *
+ * @return A newly constructed JSON array of JSON result objects. If the
+ * search of some zones failed, the results of the others are returned
+ * and the error is also set.
+ */
+json_t *search_metadata_zones(rcComm_t *conn, json_t *query,
+                              const char *zone_names, option_flags flags,
+                              baton_error_t *error);
+
+/**
+ * Search metadata in several zones as @ref search_metadata_zones does,
+ * passing each page of results to a callback as soon as it arrives
+ * from any zone. The callback is never called by more than one thread
+ * at a time.
+ *
+ * @param[in]  conn         An open iRODS connection.
+ * @param[in]  query        A JSON query specification.
+ * @param[in]  zone_names   A list of zone names, separated by
+ *                          ZONE_LIST_SEPARATOR. Optional, NULL means
+ *                          the local zone and all zones federated
+ *                          with it.
+ * @param[in]  flags        Search behaviour options.
+ * @param[in]  sink         Callback to receive each page of results.
+ * @param[in]  sink_data    Data passed to the callback.
+ * @param[out] error        An error report struct, naming each of the
+ *                          zones whose search failed.
+ *
+ * @return 0 on success, error code on failure.
+ */
+int search_metadata_zones_stream(rcComm_t *conn, json_t *query,
+                                 const char *zone_names, option_flags flags,
+                                 query_sink_cb sink, void *sink_data,
+                                 baton_error_t *error);
+
+/**
+ * Perform a specific query as @ref search_specific does, passing each
+ * page of results to a callback as soon as it arrives from the server.
+ *
+ * @param[in]  conn         An open iRODS connection.
+ * @param[in]  query        A JSON query specification.
+ * @param[in]  zone_name    An iRODS zone name. Optional, NULL means the current
+ *                          zone.
+ * @param[in]  sink         Callback to receive each page of results.
+ * @param[in]  sink_data    Data passed to the callback.
+ * @param[out] error        An error report struct.
+ *
+ * @return 0 on success, error code on failure.
+ */
+int search_specific_stream(rcComm_t *conn, json_t *query, char *zone_name,
+                           query_sink_cb sink, void *sink_data,
+                           baton_error_t *error);
+
 /**
  * Modify the access control list of a resolved iRODS path.
  *
@@ -262,4 +399,42 @@ int maybe_modify_json_metadata(rcComm_t *conn, rodsPath_t *rods_path,
                                json_t *candidate_avus, json_t *reference_avus,
                                baton_error_t *error);
 
+/**
+ * Apply a batch of metadata operations to a resolved iRODS path,
+ * removing AVUs and then adding AVUs. Where both client and server
+ * support atomic metadata operations (iRODS 4.2.8 and later) they are
+ * sent in a single request and are applied all together or not at all.
+ * Otherwise each AVU is modified in turn, stopping at the first error.
+ *
+ * @param[in]  conn        An open iRODS connection.
+ * @param[in]  rods_path   A resolved iRODS path.
+ * @param[in]  rem_avus    A JSON array of JSON AVUs to remove. Optional.
+ * @param[in]  add_avus    A JSON array of JSON AVUs to add. Optional.
+ * @param[out] error       An error report struct.
+ *
+ * @return 0 on success, iRODS error code on failure.
+ * @ref modify_json_metadata
+ */
+int apply_json_metadata(rcComm_t *conn, rodsPath_t *rods_path,
+                        json_t *rem_avus, json_t *add_avus,
+                        baton_error_t *error);
+
+/**
+ * Supersede the metadata on a resolved iRODS path, removing any current
+ * AVUs that are not target AVUs and adding any target AVUs that are not
+ * current AVUs, as one batch.
+ *
+ * @param[in]  conn          An open iRODS connection.
+ * @param[in]  rods_path     A resolved iRODS path.
+ * @param[in]  current_avus  A JSON array of the AVUs on the path.
+ * @param[in]  target_avus   A JSON array of the AVUs required.
+ * @param[out] error         An error report struct.
+ *
+ * @return 0 on success, iRODS error code on failure.
+ * @ref apply_json_metadata
+ */
+int supersede_json_metadata(rcComm_t *conn, rodsPath_t *rods_path,
+                            json_t *current_avus, json_t *target_avus,
+                            baton_error_t *error);
+
 #endif // _BATON_H
@@ -0,0 +1,747 @@
+/**
+ * Copyright (C) 2017 Genome Research Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @file chmod.c
+ * @author Keith James <kdj@sanger.ac.uk>
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "config.h"
+#include "baton.h"
+#include "chmod.h"
+
+// The property of a planned path holding the access levels it has now,
+// keyed by owner#zone, alongside those wanted under JSON_ACCESS_KEY
+#define CHMOD_CURRENT_KEY "current"
+
+typedef struct chmod_change {
+    /** The collection or data object path */
+    char *path;
+    /** The owner, as user#zone */
+    char owner_specifier[LONG_NAME_LEN];
+    /** The access level to set */
+    char level[NAME_LEN];
+    /** The planned path, for reporting */
+    json_t *item;
+    /** The access entry, for reporting */
+    json_t *entry;
+    /** The result of the change */
+    baton_error_t error;
+} chmod_change_t;
+
+typedef struct chmod_changes {
+    chmod_change_t *changes;
+    size_t num_changes;
+    size_t capacity;
+} chmod_changes_t;
+
+typedef struct chmod_plan {
+    /** Each path mapped to its wanted and current access levels */
+    json_t *pending;
+    /** The access entries of the target being planned, by owner#zone */
+    json_t *wanted;
+} chmod_plan_t;
+
+typedef struct chmod_transfer {
+    /** Protects next */
+    pthread_mutex_t lock;
+    chmod_change_t *changes;
+    size_t num_changes;
+    /** The index of the next change to send */
+    size_t next;
+} chmod_transfer_t;
+
+typedef struct chmod_worker {
+    rcComm_t *conn;
+    chmod_transfer_t *transfer;
+    /** The statistics of the caller, to which requests are added */
+    rpc_stats_t *stats;
+    /** True if the connection of this worker failed */
+    int lost_connection;
+} chmod_worker_t;
+
+static double chmod_clock(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Return the canonical name of an access level, or NULL if it is not
+// one
+static const char *access_level_name(const char *level) {
+    const char *levels[] = { ACCESS_LEVEL_NULL, ACCESS_LEVEL_OWN,
+                             ACCESS_LEVEL_READ, ACCESS_LEVEL_WRITE };
+
+    for (size_t i = 0; i < sizeof levels / sizeof levels[0]; i++) {
+        if (level && str_equals_ignore_case(level, levels[i], MAX_STR_LEN)) {
+            return levels[i];
+        }
+    }
+
+    return NULL;
+}
+
+static void access_key(json_t *entry, char *key, size_t len) {
+    const char *owner =
+        json_string_value(json_object_get(entry, JSON_OWNER_KEY));
+    const char *zone =
+        json_string_value(json_object_get(entry, JSON_ZONE_KEY));
+
+    snprintf(key, len, "%s#%s", owner ? owner : "", zone ? zone : "");
+}
+
+static int make_path(char *dest, const char *coll_name, const char *data_name,
+                     baton_error_t *error) {
+    int len;
+    if (data_name) {
+        size_t coll_len = strnlen(coll_name, MAX_NAME_LEN);
+        int sep = coll_len > 0 && coll_name[coll_len - 1] == '/';
+        len = snprintf(dest, MAX_NAME_LEN, "%s%s%s", coll_name,
+                       sep ? "" : "/", data_name);
+    }
+    else {
+        len = snprintf(dest, MAX_NAME_LEN, "%s", coll_name);
+    }
+
+    if (len < 0 || len >= MAX_NAME_LEN) {
+        set_baton_error(error, USER_PATH_EXCEEDS_MAX,
+                        "Path '%s/%s' is too long (exceeds %d)", coll_name,
+                        data_name ? data_name : "", MAX_NAME_LEN);
+    }
+
+    return error->code;
+}
+
+// Return a new access entry with an explicit zone and the canonical
+// name of its level
+static json_t *make_access_entry(json_t *access, const char *path,
+                                 const char *default_zone,
+                                 baton_error_t *error) {
+    char owner_specifier[LONG_NAME_LEN];
+    char user_name[NAME_LEN];
+    char zone_name[NAME_LEN];
+
+    if (!json_is_object(access)) {
+        set_baton_error(error, CAT_INVALID_ARGUMENT, "Invalid permissions "
+                        "for '%s': not a JSON object", path);
+        goto error;
+    }
+
+    const char *owner = get_access_owner(access, error);
+    if (error->code != 0) goto error;
+    const char *zone = get_access_zone(access, error);
+    if (error->code != 0) goto error;
+    const char *level = get_access_level(access, error);
+    if (error->code != 0) goto error;
+
+    if (zone) {
+        snprintf(owner_specifier, sizeof owner_specifier, "%s#%s",
+                 owner, zone);
+    }
+    else {
+        snprintf(owner_specifier, sizeof owner_specifier, "%s", owner);
+    }
+
+    if (parseUserName(owner_specifier, user_name, zone_name) != 0) {
+        set_baton_error(error, CAT_INVALID_ARGUMENT,
+                        "Failed to chmod '%s' because of an invalid "
+                        "owner format '%s'", path, owner_specifier);
+        goto error;
+    }
+
+    const char *name = access_level_name(level);
+    if (!name) {
+        set_baton_error(error, CAT_INVALID_ARGUMENT,
+                        "Invalid permission level: expected one of "
+                        "[%s, %s, %s, %s]",
+                        ACCESS_LEVEL_NULL, ACCESS_LEVEL_OWN,
+                        ACCESS_LEVEL_READ, ACCESS_LEVEL_WRITE);
+        goto error;
+    }
+
+    json_t *entry = json_pack("{s:s, s:s, s:s}", JSON_OWNER_KEY, user_name,
+                              JSON_ZONE_KEY,
+                              strlen(zone_name) > 0 ? zone_name : default_zone,
+                              JSON_LEVEL_KEY, name);
+    if (!entry) {
+        set_baton_error(error, -1, "Failed to pack permissions for '%s'",
+                        path);
+        goto error;
+    }
+
+    return entry;
+
+error:
+    return NULL;
+}
+
+// Return the access entries of a target by owner#zone, so that the
+// last given for an owner replaces any before
+static json_t *wanted_access(json_t *target, const char *path,
+                             const char *default_zone, baton_error_t *error) {
+    json_t *wanted = NULL;
+
+    json_t *perms = json_object_get(target, JSON_ACCESS_KEY);
+    if (!json_is_array(perms)) {
+        set_baton_error(error, -1, "Permissions data for %s is not in "
+                        "a JSON array", path);
+        goto error;
+    }
+
+    wanted = json_object();
+    if (!wanted) {
+        set_baton_error(error, -1, "Failed to allocate a new JSON object");
+        goto error;
+    }
+
+    size_t i;
+    json_t *perm;
+    json_array_foreach(perms, i, perm) {
+        json_t *entry = make_access_entry(perm, path, default_zone, error);
+        if (error->code != 0) goto error;
+
+        char key[MAX_NAME_LEN];
+        access_key(entry, key, sizeof key);
+        json_object_set_new(wanted, key, entry);
+    }
+
+    return wanted;
+
+error:
+    if (wanted) json_decref(wanted);
+
+    return NULL;
+}
+
+// Add the wanted access entries to a path, replacing those for the
+// same owners given by earlier targets
+static int want_path(chmod_plan_t *plan, const char *path,
+                     const char *coll_name, const char *data_name,
+                     baton_error_t *error) {
+    json_t *item = json_object_get(plan->pending, path);
+    if (!item) {
+        item = json_pack("{s:s, s:{}, s:{}}", JSON_COLLECTION_KEY, coll_name,
+                         JSON_ACCESS_KEY, CHMOD_CURRENT_KEY);
+        if (item && data_name) {
+            json_object_set_new(item, JSON_DATA_OBJECT_KEY,
+                                json_string(data_name));
+        }
+        if (!item || json_object_set_new(plan->pending, path, item) != 0) {
+            set_baton_error(error, -1, "Failed to plan permissions for '%s'",
+                            path);
+            goto error;
+        }
+    }
+
+    // Each path has its own copy of the entries, which are reported
+    // individually
+    json_t *copy = json_deep_copy(plan->wanted);
+    if (!copy ||
+        json_object_update(json_object_get(item, JSON_ACCESS_KEY),
+                           copy) != 0) {
+        set_baton_error(error, -1, "Failed to plan permissions for '%s'",
+                        path);
+        if (copy) json_decref(copy);
+        goto error;
+    }
+    json_decref(copy);
+
+    return error->code;
+
+error:
+    return error->code;
+}
+
+// Record an access entry that a planned path has now. Paths not
+// planned are ignored.
+static void record_current(chmod_plan_t *plan, const char *path,
+                           json_t *entry) {
+    json_t *item = json_object_get(plan->pending, path);
+    if (!item) return;
+
+    char key[MAX_NAME_LEN];
+    access_key(entry, key, sizeof key);
+
+    json_object_set(json_object_get(item, CHMOD_CURRENT_KEY), key,
+                    json_object_get(entry, JSON_LEVEL_KEY));
+}
+
+// A query_sink_cb which plans the wanted permissions for each
+// collection and data object in a page of a tree listing
+static int want_tree_page(json_t *results, void *sink_data,
+                          baton_error_t *error) {
+    chmod_plan_t *plan = sink_data;
+
+    init_baton_error(error);
+
+    size_t i;
+    json_t *entry;
+    json_array_foreach(results, i, entry) {
+        const char *coll_name = get_collection_value(entry, error);
+        if (error->code != 0) goto error;
+
+        const char *data_name = NULL;
+        if (represents_data_object(entry)) {
+            data_name = get_data_object_value(entry, error);
+            if (error->code != 0) goto error;
+        }
+
+        char path[MAX_NAME_LEN];
+        make_path(path, coll_name, data_name, error);
+        if (error->code != 0) goto error;
+
+        want_path(plan, path, coll_name, data_name, error);
+        if (error->code != 0) goto error;
+    }
+
+    return error->code;
+
+error:
+    return error->code;
+}
+
+// A query_sink_cb which records the current permissions in a page of a
+// tree ACL listing
+static int record_tree_page(json_t *results, void *sink_data,
+                            baton_error_t *error) {
+    chmod_plan_t *plan = sink_data;
+
+    init_baton_error(error);
+
+    size_t i;
+    json_t *entry;
+    json_array_foreach(results, i, entry) {
+        const char *coll_name = get_collection_value(entry, error);
+        if (error->code != 0) goto error;
+
+        const char *data_name = NULL;
+        if (represents_data_object(entry)) {
+            data_name = get_data_object_value(entry, error);
+            if (error->code != 0) goto error;
+        }
+
+        char path[MAX_NAME_LEN];
+        make_path(path, coll_name, data_name, error);
+        if (error->code != 0) goto error;
+
+        record_current(plan, path, entry);
+    }
+
+    return error->code;
+
+error:
+    return error->code;
+}
+
+// Plan the permissions of one target, and of everything beneath it if
+// it is to be done recursively. The current permissions are recorded
+// for every path that the target plans, so that the order of targets
+// does not matter.
+static int plan_target(rodsEnv *env, rcComm_t *conn, chmod_plan_t *plan,
+                       json_t *target, option_flags flags,
+                       baton_error_t *error) {
+    json_t *acl = NULL;
+    char *path  = NULL;
+
+    rodsPath_t rods_path;
+    memset(&rods_path, 0, sizeof rods_path);
+
+    path = json_to_path(target, error);
+    if (error->code != 0) goto error;
+
+    plan->wanted = wanted_access(target, path, env->rodsZone, error);
+    if (error->code != 0) goto error;
+
+    resolve_rods_path(conn, env, &rods_path, path, flags, error);
+    if (error->code != 0) goto error;
+
+    const char *root = rods_path.outPath;
+
+    if ((flags & RECURSIVE) && rods_path.objType == COLL_OBJ_T) {
+        want_path(plan, root, root, NULL, error);
+        if (error->code != 0) goto error;
+
+        list_collection_tree_stream(conn, &rods_path, 0, want_tree_page,
+                                    plan, error);
+        if (error->code != 0) goto error;
+
+        list_permissions_tree_stream(conn, &rods_path, record_tree_page,
+                                     plan, error);
+        if (error->code != 0) goto error;
+    }
+    else {
+        char coll_name[MAX_NAME_LEN];
+        char *data_name = NULL;
+        snprintf(coll_name, sizeof coll_name, "%s", root);
+        if (rods_path.objType == DATA_OBJ_T) {
+            data_name = strrchr(coll_name, '/');
+            if (data_name) *data_name++ = '\0';
+        }
+
+        want_path(plan, root, coll_name, data_name, error);
+        if (error->code != 0) goto error;
+
+        acl = list_permissions(conn, &rods_path, error);
+        if (error->code != 0) goto error;
+
+        size_t i;
+        json_t *entry;
+        json_array_foreach(acl, i, entry) {
+            record_current(plan, root, entry);
+        }
+    }
+
+    if (acl)                   json_decref(acl);
+    if (plan->wanted)          json_decref(plan->wanted);
+    if (rods_path.rodsObjStat) free(rods_path.rodsObjStat);
+    if (path)                  free(path);
+    plan->wanted = NULL;
+
+    return error->code;
+
+error:
+    if (acl)                   json_decref(acl);
+    if (plan->wanted)          json_decref(plan->wanted);
+    if (rods_path.rodsObjStat) free(rods_path.rodsObjStat);
+    if (path)                  free(path);
+    plan->wanted = NULL;
+
+    return error->code;
+}
+
+static int add_change(chmod_changes_t *changes, const char *path,
+                      json_t *item, json_t *entry, baton_error_t *error) {
+    if (changes->num_changes == changes->capacity) {
+        size_t capacity = changes->capacity ? changes->capacity * 2 : 64;
+        chmod_change_t *tmp = realloc(changes->changes,
+                                      capacity * sizeof (chmod_change_t));
+        if (!tmp) goto error;
+
+        changes->changes  = tmp;
+        changes->capacity = capacity;
+    }
+
+    chmod_change_t *change = &changes->changes[changes->num_changes];
+    memset(change, 0, sizeof (chmod_change_t));
+
+    change->path = strdup(path);
+    if (!change->path) goto error;
+
+    const char *owner =
+        json_string_value(json_object_get(entry, JSON_OWNER_KEY));
+    const char *zone =
+        json_string_value(json_object_get(entry, JSON_ZONE_KEY));
+    const char *level =
+        json_string_value(json_object_get(entry, JSON_LEVEL_KEY));
+
+    snprintf(change->owner_specifier, sizeof change->owner_specifier,
+             "%s#%s", owner, zone);
+    snprintf(change->level, sizeof change->level, "%s", level);
+    change->item  = item;
+    change->entry = entry;
+    init_baton_error(&change->error);
+    changes->num_changes++;
+
+    return 0;
+
+error:
+    set_baton_error(error, errno, "Failed to allocate memory: error %d %s",
+                    errno, strerror(errno));
+
+    return error->code;
+}
+
+static void free_chmod_changes(chmod_changes_t *changes) {
+    for (size_t i = 0; i < changes->num_changes; i++) {
+        free(changes->changes[i].path);
+    }
+
+    if (changes->changes) free(changes->changes);
+}
+
+// Return true if a wanted access entry differs from the current
+// permissions of its path. Setting null for an owner who has no
+// permission at all is no change.
+static int needs_change(json_t *item, const char *key, json_t *entry) {
+    const char *level =
+        json_string_value(json_object_get(entry, JSON_LEVEL_KEY));
+    const char *current = json_string_value
+        (json_object_get(json_object_get(item, CHMOD_CURRENT_KEY), key));
+
+    if (!current) return !str_equals(level, ACCESS_LEVEL_NULL, MAX_STR_LEN);
+
+    return !str_equals_ignore_case(level, current, MAX_STR_LEN);
+}
+
+static int collect_changes(chmod_plan_t *plan, chmod_changes_t *changes,
+                           size_t *num_unchanged, baton_error_t *error) {
+    const char *path;
+    json_t *item;
+    json_object_foreach(plan->pending, path, item) {
+        const char *key;
+        json_t *entry;
+        json_object_foreach(json_object_get(item, JSON_ACCESS_KEY),
+                            key, entry) {
+            if (!needs_change(item, key, entry)) {
+                (*num_unchanged)++;
+                continue;
+            }
+
+            add_change(changes, path, item, entry, error);
+            if (error->code != 0) goto error;
+        }
+    }
+
+    return error->code;
+
+error:
+    return error->code;
+}
+
+static void *run_chmod_worker(void *arg) {
+    chmod_worker_t *worker = arg;
+    chmod_transfer_t *transfer = worker->transfer;
+
+    // Requests are counted towards the operation that sent the changes
+    use_rpc_stats(worker->stats);
+
+    rodsPath_t rods_path;
+    memset(&rods_path, 0, sizeof rods_path);
+
+    while (1) {
+        pthread_mutex_lock(&transfer->lock);
+        size_t i = transfer->next++;
+        pthread_mutex_unlock(&transfer->lock);
+
+        if (i >= transfer->num_changes) break;
+
+        chmod_change_t *change = &transfer->changes[i];
+        snprintf(rods_path.outPath, MAX_NAME_LEN, "%s", change->path);
+
+        // Recursion has already been expanded into the changes, so
+        // the server is asked to change only this path
+        modify_permissions(worker->conn, &rods_path, NO_RECURSE,
+                           change->owner_specifier, change->level,
+                           &change->error);
+        if (is_connection_error(change->error.code)) {
+            worker->lost_connection = 1;
+        }
+    }
+
+    return NULL;
+}
+
+// Send the changes in threads, the first using the caller's
+// connection and each other using a spare connection
+static void send_changes(rcComm_t *conn, chmod_transfer_t *transfer,
+                         size_t num_transfers) {
+    chmod_worker_t workers[TREE_MAX_TRANSFERS];
+    pthread_t threads[TREE_MAX_TRANSFERS];
+    size_t num_started = 0;
+
+    if (num_transfers < 1) num_transfers = TREE_DEFAULT_TRANSFERS;
+    if (num_transfers > TREE_MAX_TRANSFERS) {
+        num_transfers = TREE_MAX_TRANSFERS;
+    }
+    if (num_transfers > transfer->num_changes) {
+        num_transfers = transfer->num_changes;
+    }
+
+    memset(workers, 0, sizeof workers);
+    for (size_t i = 0; i < TREE_MAX_TRANSFERS; i++) {
+        workers[i].stats = get_rpc_stats();
+    }
+
+    for (size_t i = 0; i < num_transfers; i++) {
+        workers[i].transfer = transfer;
+        workers[i].conn = i == 0 ? conn : get_spare_connection(i - 1);
+        if (!workers[i].conn) {
+            logmsg(WARN, "Failed to connect for permission changes %zu; "
+                   "continuing with %zu", i, num_started);
+            break;
+        }
+
+        int status = pthread_create(&threads[i], NULL, run_chmod_worker,
+                                    &workers[i]);
+        if (status != 0) {
+            logmsg(WARN, "Failed to start permission thread %zu: "
+                   "error %d %s", i, status, strerror(status));
+            break;
+        }
+        num_started++;
+    }
+
+    logmsg(DEBUG, "Sending %zu permission changes with %zu threads",
+           transfer->num_changes, num_started);
+
+    // With no threads, the caller sends every change itself
+    if (num_started == 0) {
+        workers[0].transfer = transfer;
+        workers[0].conn     = conn;
+        run_chmod_worker(&workers[0]);
+    }
+
+    for (size_t i = 0; i < num_started; i++) {
+        pthread_join(threads[i], NULL);
+        // A spare connection is only replaced if it failed, not
+        // because a change was refused
+        if (i > 0 && workers[i].lost_connection) {
+            drop_spare_connection(i - 1);
+        }
+    }
+}
+
+// Report the permissions changed and left unchanged, and each change
+// that failed as a target that could be given again
+static json_t *make_chmod_report(chmod_changes_t *changes,
+                                 size_t num_unchanged, double elapsed,
+                                 baton_error_t *error) {
+    json_t *failed = json_array();
+    if (!failed) {
+        set_baton_error(error, -1, "Failed to allocate a new JSON array");
+        goto error;
+    }
+
+    size_t num_changed = 0;
+    size_t num_failed  = 0;
+    baton_error_t *first = NULL;
+
+    for (size_t i = 0; i < changes->num_changes; i++) {
+        chmod_change_t *change = &changes->changes[i];
+        if (change->error.code == 0) {
+            num_changed++;
+            continue;
+        }
+
+        if (!first) first = &change->error;
+        num_failed++;
+
+        json_t *item = json_pack("{s:O, s:[O], s:o}",
+                                 JSON_COLLECTION_KEY,
+                                 json_object_get(change->item,
+                                                 JSON_COLLECTION_KEY),
+                                 JSON_ACCESS_KEY, change->entry,
+                                 JSON_ERROR_KEY,
+                                 error_to_json(&change->error));
+        json_t *data_name = json_object_get(change->item,
+                                            JSON_DATA_OBJECT_KEY);
+        if (item && data_name) {
+            json_object_set(item, JSON_DATA_OBJECT_KEY, data_name);
+        }
+
+        if (!item || json_array_append_new(failed, item) != 0) {
+            set_baton_error(error, -1, "Failed to report permissions of "
+                            "'%s'", change->path);
+            goto error;
+        }
+    }
+
+    json_t *report =
+        json_pack("{s:I, s:I, s:f, s:o}",
+                  JSON_CHMOD_CHANGED_KEY,   (json_int_t) num_changed,
+                  JSON_CHMOD_UNCHANGED_KEY, (json_int_t) num_unchanged,
+                  JSON_CHMOD_SECONDS_KEY,   elapsed,
+                  JSON_CHMOD_FAILED_KEY,    failed);
+    failed = NULL;
+    if (!report) {
+        set_baton_error(error, -1, "Failed to pack the permissions report");
+        goto error;
+    }
+
+    if (first) {
+        set_baton_error(error, first->code, "Failed to change %zu of %zu "
+                        "permissions; first error: %s", num_failed,
+                        changes->num_changes, first->message);
+    }
+
+    return report;
+
+error:
+    if (failed) json_decref(failed);
+
+    return NULL;
+}
+
+json_t *apply_permissions(rodsEnv *env, rcComm_t *conn, json_t *targets,
+                          option_flags flags, size_t num_transfers,
+                          baton_error_t *error) {
+    chmod_plan_t plan       = { NULL, NULL };
+    chmod_changes_t changes = { NULL, 0, 0 };
+    json_t *report = NULL;
+    double start = chmod_clock();
+
+    init_baton_error(error);
+
+    if (!json_is_array(targets)) {
+        set_baton_error(error, CAT_INVALID_ARGUMENT,
+                        "Invalid permissions targets: not a JSON array");
+        goto error;
+    }
+
+    plan.pending = json_object();
+    if (!plan.pending) {
+        set_baton_error(error, -1, "Failed to allocate a new JSON object");
+        goto error;
+    }
+
+    // Every target is planned, and so validated, before any change is
+    // made
+    size_t i;
+    json_t *target;
+    json_array_foreach(targets, i, target) {
+        plan_target(env, conn, &plan, target, flags, error);
+        if (error->code != 0) goto error;
+    }
+
+    size_t num_unchanged = 0;
+    collect_changes(&plan, &changes, &num_unchanged, error);
+    if (error->code != 0) goto error;
+
+    logmsg(DEBUG, "Changing %zu permissions on %zu paths; %zu already "
+           "match", changes.num_changes, json_object_size(plan.pending),
+           num_unchanged);
+
+    chmod_transfer_t transfer = { .changes     = changes.changes,
+                                  .num_changes = changes.num_changes,
+                                  .next        = 0 };
+
+    pthread_mutex_init(&transfer.lock, NULL);
+    send_changes(conn, &transfer, num_transfers);
+    pthread_mutex_destroy(&transfer.lock);
+
+    report = make_chmod_report(&changes, num_unchanged,
+                               chmod_clock() - start, error);
+
+    free_chmod_changes(&changes);
+    json_decref(plan.pending);
+
+    return report;
+
+error:
+    logmsg(ERROR, "Failed to apply permissions: error %d %s",
+           error->code, error->message);
+
+    free_chmod_changes(&changes);
+    if (plan.pending) json_decref(plan.pending);
+
+    return NULL;
+}
@@ -0,0 +1,69 @@
+/**
+ * Copyright (C) 2017 Genome Research Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @file chmod.h
+ * @author Keith James <kdj@sanger.ac.uk>
+ */
+
+#ifndef _BATON_CHMOD_H
+#define _BATON_CHMOD_H
+
+#include <jansson.h>
+
+#include <rodsClient.h>
+
+#include "config.h"
+#include "error.h"
+#include "operations.h"
+
+#define JSON_CHMOD_CHANGED_KEY   "changed"
+#define JSON_CHMOD_UNCHANGED_KEY "unchanged"
+#define JSON_CHMOD_SECONDS_KEY   "seconds"
+#define JSON_CHMOD_FAILED_KEY    "failed"
+
+/**
+ * Apply access control lists to many collections and data objects at
+ * once. The current permissions of each target, and of everything
+ * beneath it if it is a collection and RECURSIVE is set, are found
+ * with a few paged queries rather than one per path. Permissions that
+ * already match are dropped, as are repeats: where more than one is
+ * given for the same path and owner, the last is applied. The rest
+ * are applied one path at a time, without server-side recursion,
+ * concurrently, each thread having its own connection.
+ *
+ * @param[in]  env            A populated iRODS environment.
+ * @param[in]  conn           An open iRODS connection.
+ * @param[in]  targets        A JSON array of collections and data
+ *                            objects, each with an access array.
+ * @param[in]  flags          RECURSIVE to apply the permissions of
+ *                            collections to everything beneath them,
+ *                            UNSAFE_RESOLVE to permit relative paths.
+ *                            Optional.
+ * @param[in]  num_transfers  The number of changes to send at once, at
+ *                            most TREE_MAX_TRANSFERS, or 0 for
+ *                            TREE_DEFAULT_TRANSFERS.
+ * @param[out] error          An error report struct.
+ *
+ * @return A newly constructed JSON object reporting the number of
+ * permissions changed and left unchanged, the time taken and any
+ * changes that failed, each as a target with its error. The report is
+ * returned even if some changes failed, when the error is also set.
+ */
+json_t *apply_permissions(rodsEnv *env, rcComm_t *conn, json_t *targets,
+                          option_flags flags, size_t num_transfers,
+                          baton_error_t *error);
+
+#endif // _BATON_CHMOD_H
@@ -22,6 +22,7 @@
 
 #include <errno.h>
 #include <libgen.h>
+#include <pthread.h>
 #include <string.h>
 #include <stdlib.h>
 #include <time.h>
@@ -31,10 +32,38 @@
 #include <rodsClient.h>
 
 #include "config.h"
+#include "arena.h"
 #include "json.h"
 #include "log.h"
+#include "query.h"
 #include "utilities.h"
 
+// JSON printed to stdout is collected here until flushed, so that many
+// small documents may be written at once
+typedef struct json_output {
+    pthread_mutex_t lock;
+    char *buffer;
+    size_t len;
+    size_t capacity;
+    /** The number of items printed since the last flush */
+    size_t pending;
+    /** The time of the last flush, in seconds */
+    double flushed_at;
+    size_t max_items;
+    unsigned int max_msecs;
+    int registered;
+} json_output_t;
+
+static json_output_t json_output = { .lock       = PTHREAD_MUTEX_INITIALIZER,
+                                     .buffer     = NULL,
+                                     .len        = 0,
+                                     .capacity   = 0,
+                                     .pending    = 0,
+                                     .flushed_at = 0,
+                                     .max_items  = JSON_OUTPUT_FLUSH_ITEMS,
+                                     .max_msecs  = JSON_OUTPUT_FLUSH_MSECS,
+                                     .registered = 0 };
+
 static json_t *get_json_value(json_t *object, const char *name,
                               const char *key, const char *short_key,
                               baton_error_t *error) {
@@ -594,6 +623,30 @@ int has_op_path(json_t *operation_args) {
     return json_object_get(operation_args, JSON_OP_PATH) != NULL;
 }
 
+int has_op_page_size(json_t *operation_args) {
+    return json_object_get(operation_args, JSON_OP_PAGE_SIZE) != NULL;
+}
+
+int has_op_offset(json_t *operation_args) {
+    return json_object_get(operation_args, JSON_OP_OFFSET) != NULL;
+}
+
+int has_op_limit(json_t *operation_args) {
+    return json_object_get(operation_args, JSON_OP_LIMIT) != NULL;
+}
+
+int has_op_cursor(json_t *operation_args) {
+    return json_object_get(operation_args, JSON_OP_CURSOR) != NULL;
+}
+
+int has_op_transfers(json_t *operation_args) {
+    return json_object_get(operation_args, JSON_OP_TRANSFERS) != NULL;
+}
+
+int op_adaptive_p(json_t *operation_args) {
+    return json_is_true(json_object_get(operation_args, JSON_OP_ADAPTIVE));
+}
+
 int op_acl_p(json_t *operation_args) {
     return json_is_true(json_object_get(operation_args, JSON_OP_ACL));
 }
@@ -650,10 +703,18 @@ int op_size_p(json_t *operation_args) {
     return json_is_true(json_object_get(operation_args, JSON_OP_SIZE));
 }
 
+int op_sync_p(json_t *operation_args) {
+    return json_is_true(json_object_get(operation_args, JSON_OP_SYNC));
+}
+
 int op_timestamp_p(json_t *operation_args) {
     return json_is_true(json_object_get(operation_args, JSON_OP_TIMESTAMP));
 }
 
+int op_timing_p(json_t *operation_args) {
+    return json_is_true(json_object_get(operation_args, JSON_OP_TIMING));
+}
+
 const char *get_op(json_t *operation_args, baton_error_t *error) {
     init_baton_error(error);
 
@@ -668,6 +729,81 @@ const char *get_op_path(json_t *operation_args, baton_error_t *error) {
                             JSON_OP_PATH, NULL, error);
 }
 
+size_t get_op_page_size(json_t *operation_args, baton_error_t *error) {
+    init_baton_error(error);
+
+    json_t *value = json_object_get(operation_args, JSON_OP_PAGE_SIZE);
+    if (!json_is_integer(value) || json_integer_value(value) < 1) {
+        set_baton_error(error, CAT_INVALID_ARGUMENT,
+                        "Invalid operation %s: not a positive JSON integer",
+                        JSON_OP_PAGE_SIZE);
+        goto error;
+    }
+
+    return json_integer_value(value);
+
+error:
+    return 0;
+}
+
+size_t get_op_offset(json_t *operation_args, baton_error_t *error) {
+    init_baton_error(error);
+
+    json_t *value = json_object_get(operation_args, JSON_OP_OFFSET);
+    if (!json_is_integer(value) || json_integer_value(value) < 0) {
+        set_baton_error(error, CAT_INVALID_ARGUMENT,
+                        "Invalid operation %s: not a non-negative JSON "
+                        "integer", JSON_OP_OFFSET);
+        goto error;
+    }
+
+    return json_integer_value(value);
+
+error:
+    return 0;
+}
+
+size_t get_op_limit(json_t *operation_args, baton_error_t *error) {
+    init_baton_error(error);
+
+    json_t *value = json_object_get(operation_args, JSON_OP_LIMIT);
+    if (!json_is_integer(value) || json_integer_value(value) < 1) {
+        set_baton_error(error, CAT_INVALID_ARGUMENT,
+                        "Invalid operation %s: not a positive JSON integer",
+                        JSON_OP_LIMIT);
+        goto error;
+    }
+
+    return json_integer_value(value);
+
+error:
+    return 0;
+}
+
+const char *get_op_cursor(json_t *operation_args, baton_error_t *error) {
+    init_baton_error(error);
+
+    return get_string_value(operation_args, "operation cursor",
+                            JSON_OP_CURSOR, NULL, error);
+}
+
+size_t get_op_transfers(json_t *operation_args, baton_error_t *error) {
+    init_baton_error(error);
+
+    json_t *value = json_object_get(operation_args, JSON_OP_TRANSFERS);
+    if (!json_is_integer(value) || json_integer_value(value) < 1) {
+        set_baton_error(error, CAT_INVALID_ARGUMENT,
+                        "Invalid operation %s: not a positive JSON integer",
+                        JSON_OP_TRANSFERS);
+        goto error;
+    }
+
+    return json_integer_value(value);
+
+error:
+    return 0;
+}
+
 int has_collection(json_t *object) {
     baton_error_t error;
 
@@ -714,6 +850,241 @@ int contains_avu(json_t *avus, json_t *avu) {
     return has_avu;
 }
 
+// One AVU in a set, keyed by its attribute, value and units joined by
+// NUL bytes
+typedef struct avu_key {
+    char *key;
+    size_t len;
+    size_t hash;
+} avu_key_t;
+
+struct avu_set {
+    avu_key_t *slots;
+    /** The number of slots, a power of 2 */
+    size_t capacity;
+    size_t size;
+};
+
+// Make the canonical key of an AVU, in which absent and empty units are
+// equivalent. Returns NULL if the AVU is malformed.
+static char *make_avu_key(json_t *avu, size_t *len) {
+    baton_error_t error;
+
+    const char *attr = get_avu_attribute(avu, &error);
+    if (error.code != 0) return NULL;
+
+    const char *value = get_avu_value(avu, &error);
+    if (error.code != 0) return NULL;
+
+    const char *units = get_avu_units(avu, &error);
+    if (error.code != 0) return NULL;
+    if (!units) units = "";
+
+    size_t alen = strnlen(attr,  MAX_STR_LEN);
+    size_t vlen = strnlen(value, MAX_STR_LEN);
+    size_t ulen = strnlen(units, MAX_STR_LEN);
+
+    *len = alen + vlen + ulen + 2;
+
+    char *key = malloc(*len);
+    if (!key) return NULL;
+
+    memcpy(key, attr, alen);
+    key[alen] = '\0';
+    memcpy(key + alen + 1, value, vlen);
+    key[alen + vlen + 1] = '\0';
+    memcpy(key + alen + vlen + 2, units, ulen);
+
+    return key;
+}
+
+// FNV-1a
+static size_t hash_avu_key(const char *key, size_t len) {
+    size_t hash = 2166136261u;
+
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (unsigned char) key[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+// Return the slot holding the key, or the empty slot where it belongs
+static avu_key_t *find_avu_slot(avu_set_t *set, const char *key, size_t len,
+                                size_t hash) {
+    size_t mask = set->capacity - 1;
+
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        avu_key_t *slot = &set->slots[i];
+
+        if (!slot->key) return slot;
+        if (slot->hash == hash && slot->len == len &&
+            memcmp(slot->key, key, len) == 0) return slot;
+    }
+}
+
+// Add a key to a set, taking ownership of it and growing the set to
+// keep its load factor at or below 0.5. Returns 1 if the key was added,
+// 0 if it was present already, or -1 on failure to allocate.
+static int add_avu_key(avu_set_t *set, char *key, size_t len) {
+    if ((set->size + 1) * 2 > set->capacity) {
+        size_t capacity = set->capacity * 2;
+        avu_key_t *slots = calloc(capacity, sizeof (avu_key_t));
+        if (!slots) {
+            free(key);
+            return -1;
+        }
+
+        avu_key_t *old_slots = set->slots;
+        size_t old_capacity  = set->capacity;
+        set->slots    = slots;
+        set->capacity = capacity;
+
+        for (size_t i = 0; i < old_capacity; i++) {
+            avu_key_t *old = &old_slots[i];
+            if (old->key) *find_avu_slot(set, old->key, old->len,
+                                         old->hash) = *old;
+        }
+
+        free(old_slots);
+    }
+
+    size_t hash = hash_avu_key(key, len);
+    avu_key_t *slot = find_avu_slot(set, key, len, hash);
+    if (slot->key) {
+        free(key);
+        return 0;
+    }
+
+    slot->key  = key;
+    slot->len  = len;
+    slot->hash = hash;
+    set->size++;
+
+    return 1;
+}
+
+avu_set_t *make_avu_set(json_t *avus, baton_error_t *error) {
+    avu_set_t *set = NULL;
+
+    init_baton_error(error);
+
+    if (avus && !json_is_array(avus)) {
+        set_baton_error(error, -1, "Invalid AVUs: not a JSON array");
+        goto error;
+    }
+
+    set = calloc(1, sizeof (avu_set_t));
+    if (!set) goto alloc_error;
+
+    size_t num_avus = json_array_size(avus);
+    set->capacity = 16;
+    while (set->capacity < num_avus * 2) set->capacity *= 2;
+
+    set->slots = calloc(set->capacity, sizeof (avu_key_t));
+    if (!set->slots) goto alloc_error;
+
+    for (size_t i = 0; i < num_avus; i++) {
+        size_t len;
+        char *key = make_avu_key(json_array_get(avus, i), &len);
+
+        // A malformed AVU cannot be matched by any other
+        if (!key) continue;
+        if (add_avu_key(set, key, len) < 0) goto alloc_error;
+    }
+
+    return set;
+
+alloc_error:
+    set_baton_error(error, errno, "Failed to allocate memory: error %d %s",
+                    errno, strerror(errno));
+
+error:
+    if (set) free_avu_set(set);
+
+    return NULL;
+}
+
+int avu_set_contains(avu_set_t *set, json_t *avu) {
+    size_t len;
+    char *key = make_avu_key(avu, &len);
+    if (!key) return 0;
+
+    avu_key_t *slot = find_avu_slot(set, key, len, hash_avu_key(key, len));
+    free(key);
+
+    return slot->key != NULL;
+}
+
+void free_avu_set(avu_set_t *set) {
+    if (!set) return;
+
+    if (set->slots) {
+        for (size_t i = 0; i < set->capacity; i++) {
+            if (set->slots[i].key) free(set->slots[i].key);
+        }
+        free(set->slots);
+    }
+
+    free(set);
+}
+
+json_t *avu_difference(json_t *candidate_avus, json_t *reference_avus,
+                       baton_error_t *error) {
+    avu_set_t *reference = NULL;
+    avu_set_t *seen      = NULL;
+    json_t *delta        = NULL;
+
+    reference = make_avu_set(reference_avus, error);
+    if (error->code != 0) goto error;
+
+    seen = make_avu_set(NULL, error);
+    if (error->code != 0) goto error;
+
+    delta = json_array();
+    if (!delta) {
+        set_baton_error(error, -1, "Failed to allocate a new JSON array");
+        goto error;
+    }
+
+    for (size_t i = 0; i < json_array_size(candidate_avus); i++) {
+        json_t *avu = json_array_get(candidate_avus, i);
+        if (avu_set_contains(reference, avu)) continue;
+
+        size_t len;
+        char *key = make_avu_key(avu, &len);
+
+        // Malformed AVUs are passed on, to be reported when applied
+        if (!key) {
+            json_array_append(delta, avu);
+            continue;
+        }
+
+        int added = add_avu_key(seen, key, len);
+        if (added < 0) {
+            set_baton_error(error, errno, "Failed to allocate memory: "
+                            "error %d %s", errno, strerror(errno));
+            goto error;
+        }
+
+        // Skip repeats of a candidate already in the delta
+        if (added) json_array_append(delta, avu);
+    }
+
+    free_avu_set(reference);
+    free_avu_set(seen);
+
+    return delta;
+
+error:
+    if (reference) free_avu_set(reference);
+    if (seen)      free_avu_set(seen);
+    if (delta)     json_decref(delta);
+
+    return NULL;
+}
+
 int represents_collection(json_t *object) {
     return (has_json_str_value(object, JSON_COLLECTION_KEY,
                                JSON_COLLECTION_SHORT_KEY) &&
@@ -1159,17 +1530,185 @@ error:
     return NULL;
 }
 
+// Write out the output buffer. The output lock must be held.
+static void write_output(void) {
+    if (json_output.len > 0) {
+        fwrite(json_output.buffer, 1, json_output.len, stdout);
+        json_output.len = 0;
+    }
+}
+
+// Write out the output buffer and flush stdout. The output lock must
+// be held.
+static void flush_output(void) {
+    write_output();
+    fflush(stdout);
+
+    json_output.pending    = 0;
+    json_output.flushed_at = query_clock();
+}
+
+static int append_output(const char *buffer, size_t size, void *data) {
+    json_output_t *output = data;
+
+    if (output->len + size > output->capacity) {
+        size_t capacity = output->capacity ? output->capacity :
+            JSON_OUTPUT_BUFFER_SIZE;
+        while (capacity < output->len + size) capacity *= 2;
+
+        char *tmp = realloc(output->buffer, capacity);
+        if (!tmp) return -1;
+
+        output->buffer   = tmp;
+        output->capacity = capacity;
+    }
+
+    memcpy(output->buffer + output->len, buffer, size);
+    output->len += size;
+
+    return 0;
+}
+
+static void flush_json_output_at_exit(void) {
+    flush_json_output();
+
+    pthread_mutex_lock(&json_output.lock);
+    free(json_output.buffer);
+    json_output.buffer   = NULL;
+    json_output.capacity = 0;
+    pthread_mutex_unlock(&json_output.lock);
+}
+
+void set_json_output_flush_policy(size_t max_items, unsigned int max_msecs) {
+    pthread_mutex_lock(&json_output.lock);
+    json_output.max_items = max_items;
+    json_output.max_msecs = max_msecs;
+    pthread_mutex_unlock(&json_output.lock);
+}
+
+void flush_json_output(void) {
+    pthread_mutex_lock(&json_output.lock);
+    flush_output();
+    pthread_mutex_unlock(&json_output.lock);
+}
+
+void maybe_flush_json_output(int input_ready) {
+    pthread_mutex_lock(&json_output.lock);
+
+    json_output.pending++;
+
+    // Flush if the caller may be waiting for this output before sending
+    // more input
+    int flush = !input_ready;
+    if (json_output.max_items > 0 &&
+        json_output.pending >= json_output.max_items) {
+        flush = 1;
+    }
+    if (json_output.max_msecs > 0 &&
+        (query_clock() - json_output.flushed_at) * 1000 >=
+        json_output.max_msecs) {
+        flush = 1;
+    }
+
+    if (flush) flush_output();
+
+    pthread_mutex_unlock(&json_output.lock);
+}
+
 void print_json_stream(json_t *json, FILE *stream) {
+    if (stream == stdout) {
+        print_json(json);
+        return;
+    }
+
     char *json_str = json_dumps(json, JSON_INDENT(0));
     if (json_str) {
         fprintf(stream, "%s\n", json_str);
-        free(json_str);
+        free_json_mem(json_str);
     }
 
     return;
 }
+
+void print_json_text(const char *text, size_t len) {
+    pthread_mutex_lock(&json_output.lock);
+
+    if (!json_output.registered) {
+        atexit(flush_json_output_at_exit);
+        json_output.registered = 1;
+        json_output.flushed_at = query_clock();
+    }
+
+    if (append_output(text, len, &json_output) != 0) {
+        logmsg(ERROR, "Failed to allocate memory for JSON output");
+    }
+    else if (json_output.len >= JSON_OUTPUT_BUFFER_SIZE) {
+        write_output();
+    }
+
+    pthread_mutex_unlock(&json_output.lock);
+}
+
+size_t json_escape_chunk(const char *input, size_t len, char *output) {
+    static const char hex[] = "0123456789abcdef";
+    size_t num_written = 0;
+
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = (unsigned char) input[i];
+        char escape = 0;
+
+        switch (c) {
+            case '"':  escape = '"';  break;
+            case '\\': escape = '\\'; break;
+            case '\b': escape = 'b';  break;
+            case '\f': escape = 'f';  break;
+            case '\n': escape = 'n';  break;
+            case '\r': escape = 'r';  break;
+            case '\t': escape = 't';  break;
+            default: break;
+        }
+
+        if (escape) {
+            output[num_written++] = '\\';
+            output[num_written++] = escape;
+        }
+        else if (c < 0x20) {
+            output[num_written++] = '\\';
+            output[num_written++] = 'u';
+            output[num_written++] = '0';
+            output[num_written++] = '0';
+            output[num_written++] = hex[c >> 4];
+            output[num_written++] = hex[c & 0xf];
+        }
+        else {
+            output[num_written++] = (char) c;
+        }
+    }
+
+    return num_written;
+}
+
 void print_json(json_t *json) {
-    print_json_stream(json, stdout);
+    pthread_mutex_lock(&json_output.lock);
+
+    if (!json_output.registered) {
+        atexit(flush_json_output_at_exit);
+        json_output.registered = 1;
+        json_output.flushed_at = query_clock();
+    }
+
+    size_t len = json_output.len;
+    if (json_dump_callback(json, append_output, &json_output,
+                           JSON_INDENT(0)) != 0 ||
+        append_output("\n", 1, &json_output) != 0) {
+        logmsg(ERROR, "Failed to allocate memory for JSON output");
+        json_output.len = len;
+    }
+    else if (json_output.len >= JSON_OUTPUT_BUFFER_SIZE) {
+        write_output();
+    }
+
+    pthread_mutex_unlock(&json_output.lock);
 
     return;
 }
@@ -28,6 +28,9 @@
 #include "config.h"
 #include "error.h"
 
+/** The maximum length of one byte escaped for a JSON string */
+#define JSON_ESCAPED_MAX_LEN 6
+
 // Error reporting
 #define JSON_ERROR_KEY             "error"
 #define JSON_ERROR_CODE_KEY        "code"
@@ -44,8 +47,11 @@
 #define JSON_DATA_OBJECT_KEY       "data_object"
 #define JSON_DATA_OBJECT_SHORT_KEY "obj"
 #define JSON_DATA_KEY              "data"
+#define JSON_ENCODING_KEY          "encoding"
+#define JSON_BASE64_ENCODING       "base64"
 
 #define JSON_CONTENTS_KEY          "contents"
+#define JSON_CURSOR_KEY            "cursor"
 #define JSON_SIZE_KEY              "size"
 #define JSON_CHECKSUM_KEY          "checksum"
 #define JSON_TIMESTAMPS_KEY        "timestamps"
@@ -96,6 +102,7 @@
 // baton operations
 #define JSON_TARGET_KEY            "target"
 #define JSON_RESULT_KEY            "result"
+#define JSON_TIMING_KEY            "timing"
 #define JSON_OP_KEY                "operation"
 #define JSON_OP_SHORT_KEY          "op"
 
@@ -125,12 +132,27 @@
 #define JSON_OP_SAVE               "save"
 #define JSON_OP_SINGLE_SERVER      "single-server"
 #define JSON_OP_SIZE               "size"
+#define JSON_OP_SYNC               "sync"
 #define JSON_OP_TIMESTAMP          "timestamp"
+#define JSON_OP_TIMING             "timing"
 #define JSON_OP_PATH               "path"
+#define JSON_OP_PAGE_SIZE          "page-size"
+#define JSON_OP_ADAPTIVE           "adaptive"
+#define JSON_OP_OFFSET             "offset"
+#define JSON_OP_LIMIT              "limit"
+#define JSON_OP_CURSOR             "cursor"
+#define JSON_OP_TRANSFERS          "transfers"
 
 #define VALID_REPLICATE   "1"
 #define INVALID_REPLICATE "0"
 
+// Printed JSON is written once this many bytes have been collected
+#define JSON_OUTPUT_BUFFER_SIZE  (64 * 1024)
+// The default number of items after which output is flushed
+#define JSON_OUTPUT_FLUSH_ITEMS  64
+// The default interval in milliseconds after which output is flushed
+#define JSON_OUTPUT_FLUSH_MSECS  100
+
 /**
  * Add a new property containing error information to a JSON object.
  *
@@ -198,6 +220,10 @@ const char* get_query_collection(json_t *object, baton_error_t *error);
 
 const char *get_collection_value(json_t *object, baton_error_t *error);
 
+const char *get_data_object_value(json_t *object, baton_error_t *error);
+
+const char *get_directory_value(json_t *object, baton_error_t *error);
+
 const char *get_created_timestamp(json_t *object, baton_error_t *error);
 
 const char *get_modified_timestamp(json_t *object, baton_error_t *error);
@@ -252,6 +278,63 @@ int has_operation_target(json_t *envelope);
 
 int has_op_path(json_t *operation_args);
 
+/**
+ * Return the query page size from operation arguments.
+ *
+ * @param[in]  operation_args  The operation arguments.
+ * @param[out] error           An error report struct.
+ *
+ * @return The page size, which is a positive integer.
+ */
+size_t get_op_page_size(json_t *operation_args, baton_error_t *error);
+
+int has_op_page_size(json_t *operation_args);
+
+/**
+ * Return the number of leading collection contents to skip from
+ * operation arguments.
+ *
+ * @param[in]  operation_args  The operation arguments.
+ * @param[out] error           An error report struct.
+ *
+ * @return The offset, which is a non-negative integer.
+ */
+size_t get_op_offset(json_t *operation_args, baton_error_t *error);
+
+int has_op_offset(json_t *operation_args);
+
+/**
+ * Return the maximum number of collection contents to list from
+ * operation arguments.
+ *
+ * @param[in]  operation_args  The operation arguments.
+ * @param[out] error           An error report struct.
+ *
+ * @return The limit, which is a positive integer.
+ */
+size_t get_op_limit(json_t *operation_args, baton_error_t *error);
+
+int has_op_limit(json_t *operation_args);
+
+const char *get_op_cursor(json_t *operation_args, baton_error_t *error);
+
+int has_op_cursor(json_t *operation_args);
+
+/**
+ * Return the number of files to transfer at once when putting or
+ * getting a tree from operation arguments.
+ *
+ * @param[in]  operation_args  The operation arguments.
+ * @param[out] error           An error report struct.
+ *
+ * @return The number of transfers, which is a positive integer.
+ */
+size_t get_op_transfers(json_t *operation_args, baton_error_t *error);
+
+int has_op_transfers(json_t *operation_args);
+
+int op_adaptive_p(json_t *operation_args);
+
 int op_acl_p(json_t *operation_args);
 
 int op_avu_p(json_t *operation_args);
@@ -280,8 +363,12 @@ int op_single_server_p(json_t *operation_args);
 
 int op_size_p(json_t *operation_args);
 
+int op_sync_p(json_t *operation_args);
+
 int op_timestamp_p(json_t *operation_args);
 
+int op_timing_p(json_t *operation_args);
+
 int has_collection(json_t *object);
 
 int has_acl(json_t *object);
@@ -294,6 +381,40 @@ int has_modified_timestamp(json_t *object);
 
 int contains_avu(json_t *avus, json_t *avu);
 
+/**
+ * A hash set of AVUs, compared by attribute, value and units, where
+ * absent and empty units are equal.
+ */
+typedef struct avu_set avu_set_t;
+
+/**
+ * Make a set of AVUs. Malformed AVUs are not added.
+ *
+ * @param[in]  avus   A JSON array of JSON AVUs, or NULL for an empty set.
+ * @param[out] error  An error report struct.
+ *
+ * @return A new set, which must be freed by the caller.
+ */
+avu_set_t *make_avu_set(json_t *avus, baton_error_t *error);
+
+int avu_set_contains(avu_set_t *set, json_t *avu);
+
+void free_avu_set(avu_set_t *set);
+
+/**
+ * Return the candidate AVUs that are not reference AVUs, in their
+ * original order and without repeats, in time linear in the number of
+ * AVUs.
+ *
+ * @param[in]  candidate_avus  A JSON array of JSON AVUs.
+ * @param[in]  reference_avus  A JSON array of JSON AVUs.
+ * @param[out] error           An error report struct.
+ *
+ * @return A new JSON array, which must be freed by the caller.
+ */
+json_t *avu_difference(json_t *candidate_avus, json_t *reference_avus,
+                       baton_error_t *error);
+
 int represents_collection(json_t *object);
 
 int represents_data_object(json_t *object);
@@ -343,8 +464,64 @@ char *json_to_local_path(json_t *object, baton_error_t *error);
 
 char *make_in_op_value(json_t *avu, baton_error_t *error);
 
+/**
+ * Set when JSON printed to stdout is flushed by
+ * maybe_flush_json_output.
+ *
+ * @param[in] max_items  Flush after this many items. 0 for no limit.
+ * @param[in] max_msecs  Flush when an item is completed this many
+ *                       milliseconds or more after the last flush. 0 for
+ *                       no limit.
+ */
+void set_json_output_flush_policy(size_t max_items, unsigned int max_msecs);
+
+/**
+ * Write all the JSON printed to stdout and flush it.
+ */
+void flush_json_output(void);
+
+/**
+ * Record that an item of output is complete and flush the JSON printed
+ * to stdout if the flush policy requires it, or if the input has no
+ * more data ready to read.
+ *
+ * @param[in] input_ready  True if more input is ready to be read.
+ */
+void maybe_flush_json_output(int input_ready);
+
 void print_json_stream(json_t *json, FILE *stream);
 
+/**
+ * Print text to stdout through the buffer used by print_json, so that
+ * a document may be printed in parts, in order with other JSON. The
+ * buffer is written whenever it becomes full, so the memory used is
+ * bounded however long the document.
+ *
+ * @param[in] text  The text to print.
+ * @param[in] len   The length of the text.
+ */
+void print_json_text(const char *text, size_t len);
+
+/**
+ * Escape bytes for the body of a JSON string, without quotes. The bytes
+ * must be valid UTF-8, although a sequence may be split between chunks.
+ *
+ * @param[in]  input   The bytes to escape.
+ * @param[in]  len     The number of bytes.
+ * @param[out] output  A buffer for the escaped bytes, having room for
+ *                     JSON_ESCAPED_MAX_LEN bytes for each input byte.
+ *
+ * @return The number of bytes written to output.
+ */
+size_t json_escape_chunk(const char *input, size_t len, char *output);
+
+/**
+ * Print JSON to stdout. The JSON is collected in a buffer, which is
+ * written when it becomes full, when it is flushed and when the
+ * program exits.
+ *
+ * @param[in] json  The JSON to print.
+ */
 void print_json(json_t *json);
 
 #endif // _BATON_JSON_H
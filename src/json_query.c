@@ -30,6 +30,7 @@
 #include "json_query.h"
 #include "log.h"
 #include "query.h"
+#include "stats.h"
 #include "utilities.h"
 
 static int is_zone_hint(const char *path) {
@@ -148,7 +149,8 @@ static json_t *list_resource(rcComm_t *conn, const char *resc_name,
 
     init_baton_error(error);
 
-    query_in = make_query_input(SEARCH_MAX_ROWS, obj_format.num_columns,
+    query_in = make_query_input(get_query_page_size(),
+                                obj_format.num_columns,
                                 obj_format.columns);
     query_in = prepare_resc_list(query_in, resc_name, zone_name);
 
@@ -239,17 +241,17 @@ error:
     return NULL;
 }
 
-json_t *do_search(rcComm_t *conn, char *zone_name, json_t *query,
-                  query_format_in_t *format,
-                  prepare_avu_search_cb prepare_avu,
-                  prepare_acl_search_cb prepare_acl,
-                  prepare_tps_search_cb prepare_cre,
-                  prepare_tps_search_cb prepare_mod,
-                  baton_error_t *error) {
+static genQueryInp_t *make_search_query(rcComm_t *conn, char *zone_name,
+                                        json_t *query,
+                                        query_format_in_t *format,
+                                        prepare_avu_search_cb prepare_avu,
+                                        prepare_acl_search_cb prepare_acl,
+                                        prepare_tps_search_cb prepare_cre,
+                                        prepare_tps_search_cb prepare_mod,
+                                        baton_error_t *error) {
     genQueryInp_t *query_in = NULL;
     char *zone_hint         = zone_name;
     char *root_path         = NULL;
-    json_t *items           = NULL;
     json_t *avus;
 
     init_baton_error(error);
@@ -260,7 +262,8 @@ json_t *do_search(rcComm_t *conn, char *zone_name, json_t *query,
         if (error->code != 0) goto error;
     }
 
-    query_in = make_query_input(SEARCH_MAX_ROWS, format->num_columns,
+    query_in = make_query_input(get_query_page_size(),
+                                format->num_columns,
                                 format->columns);
 
     if (root_path) {
@@ -322,33 +325,92 @@ json_t *do_search(rcComm_t *conn, char *zone_name, json_t *query,
         addKeyVal(&query_in->condInput, ZONE_KW, zone_hint);
     }
 
+    // The zone hint may point into root_path, but addKeyVal copies it
+    if (root_path) free(root_path);
+
+    return query_in;
+
+error:
+    if (root_path) free(root_path);
+    if (query_in)  free_query_input(query_in);
+
+    return NULL;
+}
+
+json_t *do_search(rcComm_t *conn, char *zone_name, json_t *query,
+                  query_format_in_t *format,
+                  prepare_avu_search_cb prepare_avu,
+                  prepare_acl_search_cb prepare_acl,
+                  prepare_tps_search_cb prepare_cre,
+                  prepare_tps_search_cb prepare_mod,
+                  baton_error_t *error) {
+    json_t *items = NULL;
+
+    init_baton_error(error);
+
+    genQueryInp_t *query_in = make_search_query(conn, zone_name, query, format,
+                                                prepare_avu, prepare_acl,
+                                                prepare_cre, prepare_mod,
+                                                error);
+    if (error->code != 0) goto error;
+
     items = do_query(conn, query_in, format->labels, error);
     if (error->code != 0) goto error;
 
-    if (root_path) free(root_path);
     free_query_input(query_in);
     logmsg(TRACE, "Found %d matching items", json_array_size(items));
 
     return items;
 
 error:
-    if (root_path) free(root_path);
-    if (query_in)  free_query_input(query_in);
-    if (items)     json_decref(items);
+    if (query_in) free_query_input(query_in);
+    if (items)    json_decref(items);
 
     return NULL;
 }
 
-json_t *do_specific(rcComm_t *conn, char *zone_name, json_t *query,
-                    prepare_specific_query_cb prepare_squery,
-                    prepare_specific_labels_cb prepare_labels,
-                    baton_error_t *error) {
-    json_t *items             = NULL;
+int do_search_stream(rcComm_t *conn, char *zone_name, json_t *query,
+                     query_format_in_t *format,
+                     prepare_avu_search_cb prepare_avu,
+                     prepare_acl_search_cb prepare_acl,
+                     prepare_tps_search_cb prepare_cre,
+                     prepare_tps_search_cb prepare_mod,
+                     query_sink_cb sink, void *sink_data,
+                     baton_error_t *error) {
+    init_baton_error(error);
+
+    genQueryInp_t *query_in = make_search_query(conn, zone_name, query, format,
+                                                prepare_avu, prepare_acl,
+                                                prepare_cre, prepare_mod,
+                                                error);
+    if (error->code != 0) goto error;
+
+    do_query_stream(conn, query_in, format->labels, sink, sink_data, error);
+    if (error->code != 0) goto error;
+
+    free_query_input(query_in);
+
+    return error->code;
+
+error:
+    if (query_in) free_query_input(query_in);
+
+    return error->code;
+}
+
+static specificQueryInp_t *make_specific_query(rcComm_t *conn,
+                                               char *zone_name, json_t *query,
+                                               prepare_specific_query_cb prepare_squery,
+                                               prepare_specific_labels_cb prepare_labels,
+                                               query_format_in_t **format,
+                                               baton_error_t *error) {
     json_t *specific;
-    query_format_in_t *format = NULL;
 
     specificQueryInp_t *squery_in = calloc(1, sizeof (specificQueryInp_t));
-    if (!squery_in) goto error;
+    if (!squery_in) {
+        set_baton_error(error, -1, "Failed to allocate memory: error %d", -1);
+        goto error;
+    }
 
     // specific is mandatory for specific query
     specific = get_specific(query, error);
@@ -358,7 +420,8 @@ json_t *do_specific(rcComm_t *conn, char *zone_name, json_t *query,
                                             prepare_squery, error);
     if (error->code != 0) goto error;
 
-    format = prepare_json_specific_labels(conn, specific, prepare_labels, error);
+    *format = prepare_json_specific_labels(conn, specific, prepare_labels,
+                                           error);
     if (error->code != 0) goto error;
 
     if (zone_name) {
@@ -366,6 +429,30 @@ json_t *do_specific(rcComm_t *conn, char *zone_name, json_t *query,
         addKeyVal(&squery_in->condInput, ZONE_KW, zone_name);
     }
 
+    return squery_in;
+
+error:
+    if (squery_in) free_squery_input(squery_in);
+    if (*format)   free_specific_labels(*format);
+    *format = NULL;
+
+    return NULL;
+}
+
+json_t *do_specific(rcComm_t *conn, char *zone_name, json_t *query,
+                    prepare_specific_query_cb prepare_squery,
+                    prepare_specific_labels_cb prepare_labels,
+                    baton_error_t *error) {
+    json_t *items             = NULL;
+    query_format_in_t *format = NULL;
+
+    init_baton_error(error);
+
+    specificQueryInp_t *squery_in =
+        make_specific_query(conn, zone_name, query, prepare_squery,
+                            prepare_labels, &format, error);
+    if (error->code != 0) goto error;
+
     items = do_squery(conn, squery_in, format, error);
     if (error->code != 0) goto error;
 
@@ -383,26 +470,55 @@ error:
     return NULL;
 }
 
-json_t *do_query(rcComm_t *conn, genQueryInp_t *query_in,
-                 const char *labels[], baton_error_t *error) {
-    genQueryOut_t *query_out = NULL;
-    size_t chunk_num  = 0;
-    int continue_flag = 0;
+int do_specific_stream(rcComm_t *conn, char *zone_name, json_t *query,
+                       prepare_specific_query_cb prepare_squery,
+                       prepare_specific_labels_cb prepare_labels,
+                       query_sink_cb sink, void *sink_data,
+                       baton_error_t *error) {
+    query_format_in_t *format = NULL;
 
     init_baton_error(error);
 
-    json_t *results = json_array();
-    if (!results) {
-        set_baton_error(error, -1, "Failed to allocate a new JSON array");
-        goto error;
-    }
+    specificQueryInp_t *squery_in =
+        make_specific_query(conn, zone_name, query, prepare_squery,
+                            prepare_labels, &format, error);
+    if (error->code != 0) goto error;
+
+    do_squery_stream(conn, squery_in, format, sink, sink_data, error);
+    if (error->code != 0) goto error;
+
+    free_squery_input(squery_in);
+    free_specific_labels(format);
+
+    return error->code;
+
+error:
+    if (squery_in)  free_squery_input(squery_in);
+    if (format)     free_specific_labels(format);
+
+    return error->code;
+}
+
+int do_query_stream(rcComm_t *conn, genQueryInp_t *query_in,
+                    const char *labels[], query_sink_cb sink, void *sink_data,
+                    baton_error_t *error) {
+    genQueryOut_t *query_out = NULL;
+    size_t chunk_num   = 0;
+    size_t num_results = 0;
+    int continue_flag  = 0;
+
+    init_baton_error(error);
 
     logmsg(DEBUG, "Running query ...");
 
     while (chunk_num == 0 || continue_flag > 0) {
         logmsg(DEBUG, "Attempting to get chunk %d of query", chunk_num);
 
+        double start = query_clock();
+        double rpc = rpc_start();
         int status = rcGenQuery(conn, query_in, &query_out);
+        rpc_end(RPC_GEN_QUERY, rpc, 0);
+        double elapsed = query_clock() - start;
 
         if (status == 0) {
             logmsg(DEBUG, "Successfully fetched chunk %d of query", chunk_num);
@@ -419,9 +535,17 @@ json_t *do_query(rcComm_t *conn, genQueryInp_t *query_in,
 
             // Cargo-cult from iRODS clients; not sure this is useful
             query_in->continueInx = query_out->continueInx;
-
+            int max_rows = adapt_query_page_size(query_in->maxRows,
+                                                 query_out->rowCnt, elapsed);
+            query_in->maxRows = max_rows;
+
+            // Each page is freed once it has been handled, so it is
+            // allocated from the heap rather than from the arena of the
+            // item, which would keep every page until the item ends
+            json_arena_t *arena = use_json_arena(NULL);
             json_t *chunk = make_json_objects(query_out, labels);
             if (!chunk) {
+                use_json_arena(arena);
                 set_baton_error(error, -1,
                                 "Failed to convert query result to JSON: "
                                 "in chunk %d error %d", chunk_num, -1);
@@ -431,18 +555,20 @@ json_t *do_query(rcComm_t *conn, genQueryInp_t *query_in,
             logmsg(TRACE, "Converted query result to JSON: in chunk %d of %d",
                    chunk_num, json_array_size(chunk));
             chunk_num++;
+            num_results += json_array_size(chunk);
 
-            status = json_array_extend(results, chunk);
+            free_query_output(query_out);
+            query_out = NULL;
+
+            sink(chunk, sink_data, error);
             json_decref(chunk);
+            use_json_arena(arena);
 
-            if (status != 0) {
-                set_baton_error(error, status,
-                                "Failed to add JSON query result to total: "
-                                "in chunk %d error %d", chunk_num, status);
+            if (error->code != 0) {
+                logmsg(ERROR, "Failed to handle JSON query result: "
+                       "in chunk %d error %d", chunk_num, error->code);
                 goto error;
             }
-
-            free_query_output(query_out);
         }
         else if (status == CAT_NO_ROWS_FOUND && chunk_num > 0) {
             // Oddly CAT_NO_ROWS_FOUND is also returned at the end of a
@@ -456,6 +582,18 @@ json_t *do_query(rcComm_t *conn, genQueryInp_t *query_in,
             logmsg(TRACE, "Query returned no results");
             break;
         }
+        else if (chunk_num == 0 && is_page_size_error(status) &&
+                 backoff_query_page_size(query_in->maxRows) > 0) {
+            // Nothing has been returned yet, so a query whose pages may
+            // have been too large is retried with smaller ones
+            logmsg(WARN, "Retrying query with a smaller page size after "
+                   "error %d", status);
+            if (query_out) {
+                free_query_output(query_out);
+                query_out = NULL;
+            }
+            query_in->maxRows = backoff_query_page_size(query_in->maxRows);
+        }
         else {
             char *err_subname;
             const char *err_name = rodsErrorName(status, &err_subname);
@@ -466,10 +604,10 @@ json_t *do_query(rcComm_t *conn, genQueryInp_t *query_in,
         }
     }
 
-    logmsg(DEBUG, "Obtained a total of %d JSON results in %d chunks",
-           chunk_num, json_array_size(results));
+    logmsg(DEBUG, "Obtained a total of %zu JSON results in %zu chunks",
+           num_results, chunk_num);
 
-    return results;
+    return error->code;
 
 error:
     if (conn->rError) {
@@ -481,21 +619,56 @@ error:
     }
 
     if (query_out) free_query_output(query_out);
-    if (results)   json_decref(results);
+
+    return error->code;
+}
+
+int extend_json_results(json_t *results, void *sink_data,
+                        baton_error_t *error) {
+    json_t *total = sink_data;
+
+    init_baton_error(error);
+
+    int status = json_array_extend(total, results);
+    if (status != 0) {
+        set_baton_error(error, status,
+                        "Failed to add JSON query result to total: "
+                        "error %d", status);
+    }
+
+    return error->code;
+}
+
+json_t *do_query(rcComm_t *conn, genQueryInp_t *query_in,
+                 const char *labels[], baton_error_t *error) {
+    init_baton_error(error);
+
+    json_t *results = json_array();
+    if (!results) {
+        set_baton_error(error, -1, "Failed to allocate a new JSON array");
+        goto error;
+    }
+
+    do_query_stream(conn, query_in, labels, extend_json_results, results,
+                    error);
+    if (error->code != 0) goto error;
+
+    return results;
+
+error:
+    if (results) json_decref(results);
 
     return NULL;
 }
 
-json_t *do_squery(rcComm_t *conn, specificQueryInp_t *squery_in,
-                  query_format_in_t *format,
-                  baton_error_t *error) {
+json_t *do_query_range(rcComm_t *conn, genQueryInp_t *query_in,
+                       const char *labels[], size_t *skip, size_t limit,
+                       baton_error_t *error) {
     genQueryOut_t *query_out = NULL;
-    size_t chunk_num  = 0;
-    int continue_flag = 0;
+    size_t chunk_num = 0;
+    int page_size    = query_in->maxRows;
 
-    const char *err_name;
-    char *err_subname;
-    int status;
+    init_baton_error(error);
 
     json_t *results = json_array();
     if (!results) {
@@ -503,12 +676,146 @@ json_t *do_squery(rcComm_t *conn, specificQueryInp_t *squery_in,
         goto error;
     }
 
+    while (json_array_size(results) < limit) {
+        // Fetch no more rows than are wanted, including those skipped
+        size_t wanted = *skip + limit - json_array_size(results);
+        query_in->maxRows = wanted < (size_t) page_size ?
+            (int) wanted : page_size;
+
+        double rpc = rpc_start();
+        int status = rcGenQuery(conn, query_in, &query_out);
+        rpc_end(RPC_GEN_QUERY, rpc, 0);
+
+        if (status == CAT_NO_ROWS_FOUND) {
+            logmsg(TRACE, "Query returned no more results");
+            query_in->continueInx = 0;
+            break;
+        }
+        else if (status != 0) {
+            char *err_subname;
+            const char *err_name = rodsErrorName(status, &err_subname);
+            set_baton_error(error, status,
+                            "Failed to fetch query result: in chunk %d "
+                            "error %d %s", chunk_num, status, err_name);
+            goto error;
+        }
+
+        if (!query_out) {
+            set_baton_error(error, -1, "Query result unexpectedly NULL "
+                            "in chunk %d error %d", chunk_num, -1);
+            goto error;
+        }
+
+        query_in->continueInx = query_out->continueInx;
+
+        json_t *chunk = make_json_objects(query_out, labels);
+        free_query_output(query_out);
+        query_out = NULL;
+
+        if (!chunk) {
+            set_baton_error(error, -1, "Failed to convert query result to "
+                            "JSON: in chunk %d error %d", chunk_num, -1);
+            goto error;
+        }
+        chunk_num++;
+
+        size_t i;
+        json_t *row;
+        json_array_foreach(chunk, i, row) {
+            if (*skip > 0) {
+                (*skip)--;
+            }
+            else if (json_array_size(results) < limit) {
+                json_array_append(results, row);
+            }
+        }
+        json_decref(chunk);
+
+        if (query_in->continueInx == 0) break;
+    }
+
+    // Release the rest of the results held by the server
+    if (query_in->continueInx > 0) {
+        logmsg(TRACE, "Closing query after %zu chunks", chunk_num);
+
+        query_in->maxRows = 0;
+        double rpc = rpc_start();
+        int status = rcGenQuery(conn, query_in, &query_out);
+        rpc_end(RPC_GEN_QUERY, rpc, 0);
+        if (status != 0 && status != CAT_NO_ROWS_FOUND) {
+            logmsg(WARN, "Failed to close query: error %d", status);
+        }
+        if (query_out) free_query_output(query_out);
+        query_in->continueInx = 0;
+    }
+
+    query_in->maxRows = page_size;
+
+    logmsg(DEBUG, "Obtained %zu JSON results in %zu chunks",
+           json_array_size(results), chunk_num);
+
+    return results;
+
+error:
+    if (conn->rError) {
+        logmsg(ERROR, error->message);
+        log_rods_errstack(ERROR, conn->rError);
+    }
+    else {
+        logmsg(ERROR, error->message);
+    }
+
+    query_in->maxRows = page_size;
+    if (query_out) free_query_output(query_out);
+    if (results)   json_decref(results);
+
+    return NULL;
+}
+
+json_t *do_prepared_query(rcComm_t *conn, const query_shape_t *shape,
+                          size_t max_rows, const char *values[],
+                          const char *zone_hint, baton_error_t *error) {
+    prepared_query_t *query = get_prepared_query(shape, error);
+    if (error->code != 0) goto error;
+
+    genQueryInp_t *query_in = bind_prepared_query(query, max_rows, values,
+                                                  zone_hint, error);
+    if (error->code != 0) goto error;
+
+    if (zone_hint) logmsg(DEBUG, "Using zone hint '%s'", zone_hint);
+
+    return do_query(conn, query_in, (const char **) shape->format.labels,
+                    error);
+
+error:
+    return NULL;
+}
+
+int do_squery_stream(rcComm_t *conn, specificQueryInp_t *squery_in,
+                     query_format_in_t *format,
+                     query_sink_cb sink, void *sink_data,
+                     baton_error_t *error) {
+    genQueryOut_t *query_out = NULL;
+    size_t chunk_num   = 0;
+    size_t num_results = 0;
+    int continue_flag  = 0;
+
+    const char *err_name;
+    char *err_subname;
+    int status;
+
+    init_baton_error(error);
+
     logmsg(DEBUG, "Running specific query ...");
 
     while (chunk_num == 0 || continue_flag > 0) {
         logmsg(DEBUG, "Attempting to get chunk %d of query", chunk_num);
 
+        double start = query_clock();
+        double rpc = rpc_start();
         status = rcSpecificQuery(conn, squery_in, &query_out);
+        rpc_end(RPC_SPECIFIC_QUERY, rpc, 0);
+        double elapsed = query_clock() - start;
 
         if (status == 0) {
             logmsg(DEBUG, "Successfully fetched chunk %d of query", chunk_num);
@@ -518,9 +825,15 @@ json_t *do_squery(rcComm_t *conn, specificQueryInp_t *squery_in,
 
             // Cargo-cult from iRODS clients; not sure this is useful
             squery_in->continueInx = query_out->continueInx;
+            int max_rows = adapt_query_page_size(squery_in->maxRows,
+                                                 query_out->rowCnt, elapsed);
+            squery_in->maxRows = max_rows;
 
+            // Allocated from the heap, as in do_query_stream
+            json_arena_t *arena = use_json_arena(NULL);
             json_t *chunk = make_json_objects(query_out, format->labels);
             if (!chunk) {
+                use_json_arena(arena);
                 set_baton_error(error, -1,
                                 "Failed to convert query result to JSON: "
                                 "in chunk %d error %d", chunk_num, -1);
@@ -530,18 +843,20 @@ json_t *do_squery(rcComm_t *conn, specificQueryInp_t *squery_in,
             logmsg(TRACE, "Converted query result to JSON: in chunk %d of %d",
                    chunk_num, json_array_size(chunk));
             chunk_num++;
+            num_results += json_array_size(chunk);
 
-            status = json_array_extend(results, chunk);
+            free_query_output(query_out);
+            query_out = NULL;
+
+            sink(chunk, sink_data, error);
             json_decref(chunk);
+            use_json_arena(arena);
 
-            if (status != 0) {
-                set_baton_error(error, status,
-                                "Failed to add JSON query result to total: "
-                                "in chunk %d error %d", chunk_num, status);
+            if (error->code != 0) {
+                logmsg(ERROR, "Failed to handle JSON query result: "
+                       "in chunk %d error %d", chunk_num, error->code);
                 goto error;
             }
-
-            if (query_out) free_query_output(query_out);
         }
         else if (status == CAT_NO_ROWS_FOUND && chunk_num > 0) {
             // Oddly CAT_NO_ROWS_FOUND is also returned at the end of a
@@ -555,6 +870,18 @@ json_t *do_squery(rcComm_t *conn, specificQueryInp_t *squery_in,
             logmsg(TRACE, "Query returned no results");
             break;
         }
+        else if (chunk_num == 0 && is_page_size_error(status) &&
+                 backoff_query_page_size(squery_in->maxRows) > 0) {
+            // Nothing has been returned yet, so a query whose pages may
+            // have been too large is retried with smaller ones
+            logmsg(WARN, "Retrying query with a smaller page size after "
+                   "error %d", status);
+            if (query_out) {
+                free_query_output(query_out);
+                query_out = NULL;
+            }
+            squery_in->maxRows = backoff_query_page_size(squery_in->maxRows);
+        }
         else {
             err_name = rodsErrorName(status, &err_subname);
             set_baton_error(error, status,
@@ -565,10 +892,10 @@ json_t *do_squery(rcComm_t *conn, specificQueryInp_t *squery_in,
         }
     }
 
-    logmsg(DEBUG, "Obtained a total of %d JSON results in %d chunks",
-           chunk_num, json_array_size(results));
+    logmsg(DEBUG, "Obtained a total of %zu JSON results in %zu chunks",
+           num_results, chunk_num);
 
-    return results;
+    return error->code;
 
 error:
     if (conn->rError) {
@@ -580,7 +907,29 @@ error:
     }
 
     if (query_out) free_query_output(query_out);
-    if (results)   json_decref(results);
+
+    return error->code;
+}
+
+json_t *do_squery(rcComm_t *conn, specificQueryInp_t *squery_in,
+                  query_format_in_t *format,
+                  baton_error_t *error) {
+    init_baton_error(error);
+
+    json_t *results = json_array();
+    if (!results) {
+        set_baton_error(error, -1, "Failed to allocate a new JSON array");
+        goto error;
+    }
+
+    do_squery_stream(conn, squery_in, format, extend_json_results, results,
+                     error);
+    if (error->code != 0) goto error;
+
+    return results;
+
+error:
+    if (results) json_decref(results);
 
     return NULL;
 }
@@ -1133,8 +1482,184 @@ error:
     return NULL;
 }
 
+// Add AVUs to a batch of JSON path objects using a single paged
+// query. The batch must contain either data objects, all in the
+// collection coll_name, or collections, in which case coll_name must
+// be NULL.
+static json_t *add_avus_json_batch(rcComm_t *conn, const char *coll_name,
+                                   json_t *batch, baton_error_t *error) {
+    genQueryInp_t *query_in = NULL;
+    json_t *results         = NULL;
+    json_t *avus_by_name    = NULL;
+    char *name_list         = NULL;
+    const char *names[BULK_MAX_PATHS];
+
+    query_format_in_t obj_format =
+        { .num_columns  = 4,
+          .columns      = { COL_DATA_NAME, COL_META_DATA_ATTR_NAME,
+                            COL_META_DATA_ATTR_VALUE,
+                            COL_META_DATA_ATTR_UNITS },
+          .labels       = { JSON_DATA_OBJECT_KEY, JSON_ATTRIBUTE_KEY,
+                            JSON_VALUE_KEY, JSON_UNITS_KEY } };
+
+    query_format_in_t col_format =
+        { .num_columns  = 4,
+          .columns      = { COL_COLL_NAME, COL_META_COLL_ATTR_NAME,
+                            COL_META_COLL_ATTR_VALUE,
+                            COL_META_COLL_ATTR_UNITS },
+          .labels       = { JSON_COLLECTION_KEY, JSON_ATTRIBUTE_KEY,
+                            JSON_VALUE_KEY, JSON_UNITS_KEY } };
+
+    query_format_in_t *format = coll_name ? &obj_format : &col_format;
+    const char *name_key = format->labels[0];
+
+    init_baton_error(error);
+
+    size_t num_names = json_array_size(batch);
+    for (size_t i = 0; i < num_names; i++) {
+        json_t *item = json_array_get(batch, i);
+        names[i] = coll_name ? get_data_object_value(item, error) :
+                               get_collection_value(item, error);
+        if (error->code != 0) goto error;
+    }
+
+    name_list = make_in_op_list(names, num_names);
+    if (!name_list) {
+        set_baton_error(error, -1, "Failed to allocate memory for a "
+                        "list of %zu paths", num_names);
+        goto error;
+    }
+
+    query_in = make_query_input(BULK_MAX_ROWS, format->num_columns,
+                                format->columns);
+    if (!query_in) {
+        set_baton_error(error, -1, "Failed to allocate memory for a query");
+        goto error;
+    }
+
+    if (coll_name) {
+        prepare_obj_avu_bulk_list(query_in, coll_name, name_list);
+    }
+    else {
+        prepare_col_avu_bulk_list(query_in, name_list);
+    }
+
+    results = do_query(conn, query_in, format->labels, error);
+    if (error->code != 0) goto error;
+
+    logmsg(DEBUG, "Obtained %zu AVUs for %zu paths in a single query",
+           json_array_size(results), num_names);
+
+    // Index the AVUs by the name of the path they belong to
+    avus_by_name = json_object();
+    if (!avus_by_name) {
+        set_baton_error(error, -1, "Failed to allocate a new JSON object");
+        goto error;
+    }
+
+    size_t i;
+    json_t *row;
+    json_array_foreach(results, i, row) {
+        const char *name = json_string_value(json_object_get(row, name_key));
+        if (!name) continue;
+
+        json_t *avus = json_object_get(avus_by_name, name);
+        if (!avus) {
+            avus = json_array();
+            if (!avus) {
+                set_baton_error(error, -1, "Failed to allocate a new "
+                                "JSON array");
+                goto error;
+            }
+
+            json_object_set_new(avus_by_name, name, avus);
+        }
+
+        json_array_append(avus, row);
+        json_object_del(row, name_key); // Also frees name
+    }
+
+    for (size_t j = 0; j < num_names; j++) {
+        json_t *item = json_array_get(batch, j);
+        json_t *avus = json_object_get(avus_by_name, names[j]);
+        avus = avus ? json_incref(avus) : json_array();
+
+        add_metadata(item, avus, error);
+        if (error->code != 0) goto error;
+    }
+
+    free_query_input(query_in);
+    free(name_list);
+    json_decref(results);
+    json_decref(avus_by_name);
+
+    return batch;
+
+error:
+    if (query_in)     free_query_input(query_in);
+    if (name_list)    free(name_list);
+    if (results)      json_decref(results);
+    if (avus_by_name) json_decref(avus_by_name);
+
+    return NULL;
+}
+
+// Add AVUs to JSON path objects, in batches which fit within the
+// bulk query limits.
+static json_t *add_avus_json_batches(rcComm_t *conn, const char *coll_name,
+                                     json_t *items, baton_error_t *error) {
+    json_t *batch = json_array();
+    size_t batch_len = 0;
+
+    init_baton_error(error);
+
+    if (!batch) {
+        set_baton_error(error, -1, "Failed to allocate a new JSON array");
+        goto error;
+    }
+
+    size_t num_items = json_array_size(items);
+    for (size_t i = 0; i < num_items; i++) {
+        json_t *item = json_array_get(items, i);
+        const char *name = coll_name ? get_data_object_value(item, error) :
+                                       get_collection_value(item, error);
+        if (error->code != 0) goto error;
+
+        size_t len = strnlen(name, MAX_STR_LEN) + 4;
+        if (json_array_size(batch) > 0 &&
+            (json_array_size(batch) == BULK_MAX_PATHS ||
+             batch_len + len > BULK_MAX_PATHS_LEN)) {
+            add_avus_json_batch(conn, coll_name, batch, error);
+            if (error->code != 0) goto error;
+
+            json_array_clear(batch);
+            batch_len = 0;
+        }
+
+        json_array_append(batch, item);
+        batch_len += len;
+    }
+
+    if (json_array_size(batch) > 0) {
+        add_avus_json_batch(conn, coll_name, batch, error);
+        if (error->code != 0) goto error;
+    }
+
+    json_decref(batch);
+
+    return items;
+
+error:
+    if (batch) json_decref(batch);
+
+    return NULL;
+}
+
 json_t *add_avus_json_array(rcComm_t *conn, json_t *array,
                             baton_error_t *error) {
+    json_t *colls        = NULL;
+    json_t *objs_by_coll = NULL;
+
     init_baton_error(error);
 
     if (!json_is_array(array)) {
@@ -1143,16 +1668,77 @@ json_t *add_avus_json_array(rcComm_t *conn, json_t *array,
         goto error;
     }
 
+    // Rather than query each item in turn, group data objects by
+    // collection and query their AVUs in bulk. Any item whose path
+    // can't be used in a bulk query falls back to a query of its own.
+    colls        = json_array();
+    objs_by_coll = json_object();
+    if (!colls || !objs_by_coll) {
+        set_baton_error(error, -1, "Failed to allocate memory for "
+                        "grouping paths");
+        goto error;
+    }
+
     size_t i;
     json_t *item;
     json_array_foreach(array, i, item) {
-        add_avus_json_object(conn, item, error);
+        const char *coll_name = NULL;
+        const char *data_name = NULL;
+
+        if (json_is_object(item)) {
+            baton_error_t path_error;
+            coll_name = get_collection_value(item, &path_error);
+            if (represents_data_object(item)) {
+                data_name = get_data_object_value(item, &path_error);
+            }
+        }
+
+        if (!coll_name || strchr(coll_name, '\'') ||
+            (data_name && strchr(data_name, '\''))) {
+            add_avus_json_object(conn, item, error);
+            if (error->code != 0) goto error;
+        }
+        else if (data_name) {
+            json_t *objs = json_object_get(objs_by_coll, coll_name);
+            if (!objs) {
+                objs = json_array();
+                if (!objs) {
+                    set_baton_error(error, -1, "Failed to allocate a new "
+                                    "JSON array");
+                    goto error;
+                }
+
+                json_object_set_new(objs_by_coll, coll_name, objs);
+            }
+
+            json_array_append(objs, item);
+        }
+        else {
+            json_array_append(colls, item);
+        }
+    }
+
+    if (json_array_size(colls) > 0) {
+        add_avus_json_batches(conn, NULL, colls, error);
+        if (error->code != 0) goto error;
+    }
+
+    const char *coll_name;
+    json_t *objs;
+    json_object_foreach(objs_by_coll, coll_name, objs) {
+        add_avus_json_batches(conn, coll_name, objs, error);
         if (error->code != 0) goto error;
     }
 
+    json_decref(colls);
+    json_decref(objs_by_coll);
+
     return array;
 
 error:
+    if (colls)        json_decref(colls);
+    if (objs_by_coll) json_decref(objs_by_coll);
+
     return NULL;
 }
 
@@ -1296,6 +1882,12 @@ error:
 
 json_t *revmap_replicate_results(rcComm_t *conn, json_t *results,
                                  baton_error_t *error) {
+    return revmap_replicate_results_cached(conn, results, NULL, error);
+}
+
+json_t *revmap_replicate_results_cached(rcComm_t *conn, json_t *results,
+                                        json_t *resources,
+                                        baton_error_t *error) {
     json_t *mapped  = json_array();
 
     init_baton_error(error);
@@ -1324,17 +1916,34 @@ json_t *revmap_replicate_results(rcComm_t *conn, json_t *results,
         char *zone_name = parse_zone_name(collection);
         const char *resource = resource_hierarchy_leaf(hierarchy);
 
-        json_t *resource_info =
-            list_resource(conn, resource, zone_name, error);
+        json_t *resource_info = NULL;
+        const char *zone_key  = zone_name ? zone_name : "";
+        size_t key_len = strlen(resource) + strlen(zone_key) + 2;
+        char resource_key[key_len];
+        snprintf(resource_key, key_len, "%s#%s", resource, zone_key);
+
+        if (resources) {
+            resource_info = json_object_get(resources, resource_key);
+            if (resource_info) json_incref(resource_info);
+        }
+
+        if (!resource_info) {
+            resource_info = list_resource(conn, resource, zone_name, error);
+        }
 
         if (zone_name) free(zone_name);
         if (error->code != 0) goto error;
 
+        if (resources) {
+            json_object_set(resources, resource_key, resource_info);
+        }
+
         // Get a hostname aka location from the resource
         json_t *loc = json_object_get(resource_info, JSON_LOCATION_KEY);
         const char *location = json_string_value(loc);
 #else
         conn = conn; // Silence unused parameter warning
+        resources = resources;
 
         json_t *resc = json_object_get(result, JSON_RESOURCE_KEY);
         json_t *loc  = json_object_get(result, JSON_LOCATION_KEY);
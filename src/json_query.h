@@ -30,6 +30,22 @@
 #include "query.h"
 #include "utilities.h"
 
+/**
+ * Callback to receive query results incrementally, as each page of
+ * results arrives from the server.
+ *
+ * @param[in]     results    A JSON array of the result rows in one page.
+ *                           The callback must take its own reference to
+ *                           any rows it keeps.
+ * @param[in]     sink_data  Caller-supplied data passed to each call.
+ * @param[in,out] error      An error report struct. Setting an error stops
+ *                           the query.
+ *
+ * @return 0 on success, error code on failure.
+ */
+typedef int (*query_sink_cb) (json_t *results, void *sink_data,
+                              baton_error_t *error);
+
 /**
  * Log the current JSON error state through the underlying logging
  * mechanism.
@@ -80,6 +96,39 @@ json_t *do_search(rcComm_t *conn, char *zone_name, json_t *query,
                   prepare_tps_search_cb prepare_mod,
                   baton_error_t *error);
 
+/**
+ * Execute a general query as @ref do_search does, passing each page of
+ * results to a callback as it arrives, rather than accumulating them in
+ * memory.
+ *
+ * @param[in]  conn          An open iRODS connection.
+ * @param[in]  zone          The zone in which to search.
+ * @param[in]  query         The search query formulated as JSON.
+ * @param[in]  format        Query format parameters indicating which columns
+ *                           to return.
+ * @param[in]  prepare_avu   Callback to add any AVU-fetching clauses to the
+ *                           query.
+ * @param[in]  prepare_acl   Callback to add any ACL-fetching clauses to the
+ *                           query.
+ * @param[in]  prepare_cre   Callback to add any creation timestamp clauses
+ *                           to the query.
+ * @param[in]  prepare_mod   Callback to add any modification timestamp clauses
+ *                           to the query.
+ * @param[in]  sink          Callback to receive each page of results.
+ * @param[in]  sink_data     Data passed to the callback.
+ * @param[in,out] error      An error report struct.
+ *
+ * @return 0 on success, error code on failure.
+ */
+int do_search_stream(rcComm_t *conn, char *zone_name, json_t *query,
+                     query_format_in_t *format,
+                     prepare_avu_search_cb prepare_avu,
+                     prepare_acl_search_cb prepare_acl,
+                     prepare_tps_search_cb prepare_cre,
+                     prepare_tps_search_cb prepare_mod,
+                     query_sink_cb sink, void *sink_data,
+                     baton_error_t *error);
+
 /**
  * Execute a specific query and obtain results as a JSON array of objects.
  * Columns in the query are mapped to JSON object properties specified
@@ -99,6 +148,26 @@ json_t *do_specific(rcComm_t *conn, char *zone_name, json_t *query,
                     prepare_specific_labels_cb prepare_labels,
                     baton_error_t *error);
 
+/**
+ * Execute a specific query as @ref do_specific does, passing each page
+ * of results to a callback as it arrives.
+ *
+ * @param[in]  conn          An open iRODS connection.
+ * @param[in]  zone_name     The zone in which to search (can be NULL for
+ *                           default zone).
+ * @param[in]  query         The search query formulated as JSON.
+ * @param[in]  sink          Callback to receive each page of results.
+ * @param[in]  sink_data     Data passed to the callback.
+ * @param[in,out] error      An error report struct.
+ *
+ * @return 0 on success, error code on failure.
+ */
+int do_specific_stream(rcComm_t *conn, char *zone_name, json_t *query,
+                       prepare_specific_query_cb prepare_squery,
+                       prepare_specific_labels_cb prepare_labels,
+                       query_sink_cb sink, void *sink_data,
+                       baton_error_t *error);
+
 /**
  * Execute a general query and obtain results as a JSON array of objects.
  * Columns in the query are mapped to JSON object properties specified
@@ -116,6 +185,81 @@ json_t *do_specific(rcComm_t *conn, char *zone_name, json_t *query,
 json_t *do_query(rcComm_t *conn, genQueryInp_t *query_in,
                  const char *labels[], baton_error_t *error);
 
+/**
+ * Execute a general query and obtain at most a limited number of
+ * results as a JSON array of objects, after discarding a number of
+ * leading results. Results are fetched a page at a time and the query
+ * is closed on the server once enough have been obtained, so only the
+ * results returned are held in memory.
+ *
+ * @param[in]     conn       An open iRODS connection.
+ * @param[in]     query_in   A populated query input.
+ * @param[in]     labels     An array of as many labels as there were
+ *                           columns selected in the query.
+ * @param[in,out] skip       The number of results to discard, which is
+ *                           reduced by the number discarded.
+ * @param[in]     limit      The maximum number of results to return.
+ * @param[in,out] error      An error report struct.
+ *
+ * @return A newly constructed JSON array of objects, one per result row. The
+ * caller must free this after use.
+ */
+json_t *do_query_range(rcComm_t *conn, genQueryInp_t *query_in,
+                       const char *labels[], size_t *skip, size_t limit,
+                       baton_error_t *error);
+
+/**
+ * Execute the calling thread's prepared query of a given shape, with
+ * new values bound to its conditions, and obtain results as a JSON
+ * array of objects labelled as described by the shape.
+ *
+ * @param[in]  conn          An open iRODS connection.
+ * @param[in]  shape         The query shape.
+ * @param[in]  max_rows      The number of rows per page.
+ * @param[in]  values        One value for each condition to bind.
+ * @param[in]  zone_hint     A path in the zone to query. Optional.
+ * @param[in,out] error      An error report struct.
+ *
+ * @return A newly constructed JSON array of objects, one per result row. The
+ * caller must free this after use.
+ */
+json_t *do_prepared_query(rcComm_t *conn, const query_shape_t *shape,
+                          size_t max_rows, const char *values[],
+                          const char *zone_hint, baton_error_t *error);
+
+/**
+ * Execute a general query, passing each page of results to a callback
+ * as a JSON array of objects. Columns in the query are mapped to JSON
+ * object properties specified by the labels argument. Only one page of
+ * results is held in memory at a time.
+ *
+ * @param[in]  conn          An open iRODS connection.
+ * @param[in]  query_in      A populated query input.
+ * @param[in]  labels        An array of as many labels as there were columns
+ *                           selected in the query.
+ * @param[in]  sink          Callback to receive each page of results.
+ * @param[in]  sink_data     Data passed to the callback.
+ * @param[in,out] error      An error report struct.
+ *
+ * @return 0 on success, error code on failure.
+ */
+int do_query_stream(rcComm_t *conn, genQueryInp_t *query_in,
+                    const char *labels[], query_sink_cb sink, void *sink_data,
+                    baton_error_t *error);
+
+/**
+ * A @ref query_sink_cb which appends each page of results to the JSON
+ * array passed as its sink_data.
+ *
+ * @param[in]     results    A JSON array of result rows.
+ * @param[in]     sink_data  The JSON array to extend.
+ * @param[in,out] error      An error report struct.
+ *
+ * @return 0 on success, error code on failure.
+ */
+int extend_json_results(json_t *results, void *sink_data,
+                        baton_error_t *error);
+
 /**
  * Execute a specific query and obtain results as a JSON array of objects.
  * Columns in the query are mapped to JSON object properties specified
@@ -134,6 +278,24 @@ json_t *do_squery(rcComm_t *conn, specificQueryInp_t *squery_in,
                   query_format_in_t *format,
                   baton_error_t *error);
 
+/**
+ * Execute a specific query, passing each page of results to a callback
+ * as a JSON array of objects.
+ *
+ * @param[in]  conn          An open iRODS connection.
+ * @param[in]  squery_in     A populated query input.
+ * @param[in]  format        The query format, including labels.
+ * @param[in]  sink          Callback to receive each page of results.
+ * @param[in]  sink_data     Data passed to the callback.
+ * @param[in,out] error      An error report struct.
+ *
+ * @return 0 on success, error code on failure.
+ */
+int do_squery_stream(rcComm_t *conn, specificQueryInp_t *squery_in,
+                     query_format_in_t *format,
+                     query_sink_cb sink, void *sink_data,
+                     baton_error_t *error);
+
 /**
  * Construct a JSON array of objects from a query output. Columns in the
  * query are mapped to JSON object properties specified by the labels
@@ -270,4 +432,21 @@ json_t *revmap_access_result(json_t *access, baton_error_t *error);
 json_t *revmap_replicate_results(rcComm_t *conn, json_t *results,
                                  baton_error_t *error);
 
+/**
+ * Map replicate query results as @ref revmap_replicate_results does,
+ * caching the details of each resource encountered so that they are
+ * looked up only once.
+ *
+ * @param[in]      conn       An open iRODS connection.
+ * @param[in]      results    Replicate query results.
+ * @param[in,out]  resources  A JSON object in which to cache resource
+ *                            details between calls. May be NULL.
+ * @param[in,out]  error      An error report struct.
+ *
+ * @return A newly constructed JSON array of replicates.
+ */
+json_t *revmap_replicate_results_cached(rcComm_t *conn, json_t *results,
+                                        json_t *resources,
+                                        baton_error_t *error);
+
 #endif  // _BATON_JSON_QUERY_H
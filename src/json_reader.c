@@ -0,0 +1,360 @@
+/**
+ * Copyright (C) 2017 Genome Research Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @file json_reader.c
+ * @author Keith James <kdj@sanger.ac.uk>
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "json_reader.h"
+#include "log.h"
+
+struct json_reader {
+    FILE *input;
+    int fd;
+    /** True if the input position is restored when the reader is freed */
+    int seekable;
+    /** The input offset of the first byte of data */
+    off_t base;
+    /** The input, either mapped or read in blocks */
+    char *data;
+    size_t len;
+    size_t capacity;
+    int mapped;
+    /** The offset in data of the first byte not yet returned */
+    size_t pos;
+    /** The offset in data of the next byte to scan */
+    size_t scan;
+    /** True when the scan has reached the start of a value */
+    int started;
+    /** The offset in data of the start of the value being scanned */
+    size_t start;
+    /** The current line number and that of the start of the value */
+    int line;
+    int start_line;
+    /** The scan state within the value */
+    int container;
+    int depth;
+    int in_string;
+    int escape;
+    int eof;
+    /** Guards ready, which is read by json_reader_ready */
+    pthread_mutex_t lock;
+    /** True if there is input remaining in data */
+    int ready;
+};
+
+static int is_json_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+// Skip whitespace preceding the next value and note whether any input
+// remains in the buffer
+static void skip_space(json_reader_t *reader) {
+    while (reader->scan < reader->len &&
+           is_json_space(reader->data[reader->scan])) {
+        if (reader->data[reader->scan] == '\n') reader->line++;
+        reader->scan++;
+    }
+
+    reader->pos = reader->scan;
+
+    pthread_mutex_lock(&reader->lock);
+    reader->ready = reader->scan < reader->len;
+    pthread_mutex_unlock(&reader->lock);
+}
+
+// Scan for the end of the next value, returning its length in bytes, or
+// 0 if the value is incomplete. The scan stops where it is and is
+// resumed when more input arrives. Values are delimited by matching
+// brackets, ignoring those within strings, or by whitespace when they
+// are not objects or arrays. They are not otherwise validated here.
+static size_t scan_value(json_reader_t *reader) {
+    int found = 0;
+
+    while (!found && reader->scan < reader->len) {
+        char c = reader->data[reader->scan];
+
+        if (!reader->started) {
+            if (is_json_space(c)) {
+                if (c == '\n') reader->line++;
+                reader->scan++;
+                continue;
+            }
+
+            reader->started    = 1;
+            reader->start      = reader->scan;
+            reader->start_line = reader->line;
+            reader->container  = c == '{' || c == '[';
+            reader->depth      = reader->container;
+            reader->in_string  = c == '"';
+            reader->escape     = 0;
+            reader->scan++;
+            continue;
+        }
+
+        if (!reader->in_string && !reader->container &&
+            (is_json_space(c) || c == '{' || c == '[' || c == '"')) {
+            // The end of a bare value, which is left for the next scan
+            found = 1;
+            continue;
+        }
+
+        if (c == '\n') reader->line++;
+        reader->scan++;
+
+        if (reader->in_string) {
+            if (reader->escape) {
+                reader->escape = 0;
+            }
+            else if (c == '\\') {
+                reader->escape = 1;
+            }
+            else if (c == '"') {
+                reader->in_string = 0;
+                found = !reader->container;
+            }
+        }
+        else if (reader->container) {
+            if (c == '{' || c == '[') {
+                reader->depth++;
+            }
+            else if (c == '}' || c == ']') {
+                reader->depth--;
+                found = reader->depth == 0;
+            }
+            else if (c == '"') {
+                reader->in_string = 1;
+            }
+        }
+    }
+
+    return found ? reader->scan - reader->start : 0;
+}
+
+// Read more input into the buffer, first discarding what has been
+// consumed
+static int fill_buffer(json_reader_t *reader, baton_error_t *error) {
+    if (reader->mapped) {
+        reader->eof = 1;
+        return 0;
+    }
+
+    size_t discard = reader->started ? reader->start : reader->pos;
+    if (discard > 0) {
+        memmove(reader->data, reader->data + discard, reader->len - discard);
+        reader->base  += discard;
+        reader->len   -= discard;
+        reader->pos   -= discard;
+        reader->scan  -= discard;
+        if (reader->started) reader->start -= discard;
+    }
+
+    if (reader->len == reader->capacity) {
+        size_t capacity = reader->capacity * 2;
+        char *tmp = realloc(reader->data, capacity);
+        if (!tmp) {
+            set_baton_error(error, errno, "Failed to allocate memory: "
+                            "error %d %s", errno, strerror(errno));
+            goto error;
+        }
+
+        reader->data     = tmp;
+        reader->capacity = capacity;
+    }
+
+    ssize_t nr;
+    do {
+        nr = read(reader->fd, reader->data + reader->len,
+                  reader->capacity - reader->len);
+    } while (nr < 0 && errno == EINTR);
+
+    if (nr < 0) {
+        set_baton_error(error, errno, "Failed to read input: error %d %s",
+                        errno, strerror(errno));
+        goto error;
+    }
+
+    if (nr == 0) {
+        reader->eof = 1;
+    }
+    else {
+        reader->len += nr;
+    }
+
+    return 0;
+
+error:
+    reader->eof = 1;
+
+    return error->code;
+}
+
+json_reader_t *make_json_reader(FILE *input, baton_error_t *error) {
+    json_reader_t *reader = NULL;
+
+    init_baton_error(error);
+
+    if (!input) {
+        set_baton_error(error, -1, "Invalid input stream");
+        goto error;
+    }
+
+    reader = calloc(1, sizeof (json_reader_t));
+    if (!reader) {
+        set_baton_error(error, errno, "Failed to allocate memory: "
+                        "error %d %s", errno, strerror(errno));
+        goto error;
+    }
+
+    reader->input = input;
+    reader->fd    = fileno(input);
+    reader->line  = 1;
+    pthread_mutex_init(&reader->lock, NULL);
+
+    // Start where any earlier reading through the stream left off
+    struct stat st;
+    off_t offset = ftello(input);
+    if (offset >= 0 && fstat(reader->fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        reader->seekable = 1;
+
+        if (st.st_size > offset) {
+            void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE,
+                             reader->fd, 0);
+            if (map != MAP_FAILED) {
+                posix_madvise(map, st.st_size, POSIX_MADV_SEQUENTIAL);
+
+                reader->data   = map;
+                reader->len    = st.st_size;
+                reader->mapped = 1;
+                reader->pos    = offset;
+                reader->scan   = offset;
+
+                logmsg(DEBUG, "Mapped %zu bytes of input",
+                       (size_t) (st.st_size - offset));
+                return reader;
+            }
+
+            logmsg(DEBUG, "Failed to map input, reading it instead: "
+                   "error %d %s", errno, strerror(errno));
+        }
+
+        lseek(reader->fd, offset, SEEK_SET);
+        reader->base = offset;
+    }
+
+    reader->data = malloc(JSON_READER_BLOCK_SIZE);
+    if (!reader->data) {
+        set_baton_error(error, errno, "Failed to allocate memory: "
+                        "error %d %s", errno, strerror(errno));
+        goto error;
+    }
+    reader->capacity = JSON_READER_BLOCK_SIZE;
+
+    return reader;
+
+error:
+    if (reader) free_json_reader(reader);
+
+    return NULL;
+}
+
+json_t *read_json_item(json_reader_t *reader, baton_error_t *error) {
+    init_baton_error(error);
+
+    size_t len;
+    while ((len = scan_value(reader)) == 0) {
+        if (reader->eof) {
+            // Any incomplete value at the end is passed to the parser
+            // to report
+            if (!reader->started) return NULL;
+            len = reader->len - reader->start;
+            reader->scan = reader->len;
+            break;
+        }
+
+        if (fill_buffer(reader, error) != 0) return NULL;
+    }
+
+    const char *value = reader->data + reader->start;
+    int start_line    = reader->start_line;
+    reader->started   = 0;
+
+    json_error_t load_error;
+    json_t *item = json_loadb(value, len, JSON_REJECT_DUPLICATES,
+                              &load_error);
+    skip_space(reader);
+
+    if (!item) {
+        set_baton_error(error, -1, "JSON error at line %d, column %d: %s",
+                        start_line + load_error.line - 1, load_error.column,
+                        load_error.text);
+    }
+
+    return item;
+}
+
+int json_reader_eof(json_reader_t *reader) {
+    if (!reader->eof && reader->pos == reader->len && !reader->started) {
+        // Peek ahead for anything more than whitespace
+        baton_error_t error;
+        while (!reader->eof && reader->pos == reader->len) {
+            fill_buffer(reader, &error);
+            skip_space(reader);
+        }
+    }
+
+    return reader->eof && reader->pos == reader->len;
+}
+
+int json_reader_ready(json_reader_t *reader) {
+    pthread_mutex_lock(&reader->lock);
+    int ready = reader->ready;
+    pthread_mutex_unlock(&reader->lock);
+
+    if (ready || reader->mapped) return ready;
+
+    struct pollfd pfd = { .fd = reader->fd, .events = POLLIN };
+
+    return poll(&pfd, 1, 0) > 0;
+}
+
+void free_json_reader(json_reader_t *reader) {
+    if (!reader) return;
+
+    if (reader->seekable) {
+        fseeko(reader->input, reader->base + (off_t) reader->pos, SEEK_SET);
+    }
+
+    if (reader->mapped) {
+        munmap(reader->data, reader->len);
+    }
+    else if (reader->data) {
+        free(reader->data);
+    }
+
+    pthread_mutex_destroy(&reader->lock);
+    free(reader);
+}
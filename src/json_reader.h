@@ -0,0 +1,98 @@
+/**
+ * Copyright (C) 2017 Genome Research Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @file json_reader.h
+ * @author Keith James <kdj@sanger.ac.uk>
+ */
+
+#ifndef _BATON_JSON_READER_H
+#define _BATON_JSON_READER_H
+
+#include <stdio.h>
+
+#include <jansson.h>
+
+#include "config.h"
+#include "error.h"
+
+/** The number of bytes read from a stream at one time */
+#define JSON_READER_BLOCK_SIZE (64 * 1024)
+
+/**
+ *  @struct json_reader
+ *  @brief Reads a stream of JSON values, each parsed from memory.
+ */
+typedef struct json_reader json_reader_t;
+
+/**
+ * Make a reader for a stream of JSON values, separated by optional
+ * whitespace, starting at the current position of the input. A regular
+ * file is mapped into memory; any other input is read in blocks of
+ * JSON_READER_BLOCK_SIZE bytes, without waiting for a block to fill, so
+ * that each value is available as soon as it has arrived.
+ *
+ * The input must not be read by other means while the reader is in
+ * use.
+ *
+ * @param[in]  input  The input stream.
+ * @param[out] error  An error report struct.
+ *
+ * @return A new reader, which must be freed by the caller.
+ */
+json_reader_t *make_json_reader(FILE *input, baton_error_t *error);
+
+/**
+ * Read the next JSON value. Values that cannot be parsed are reported
+ * as errors and skipped, so reading may continue afterwards.
+ *
+ * @param[in]  reader  A reader.
+ * @param[out] error   An error report struct.
+ *
+ * @return A new JSON value, or NULL at the end of the input or on
+ *         error.
+ */
+json_t *read_json_item(json_reader_t *reader, baton_error_t *error);
+
+/**
+ * Return true when the input is at its end and all its values have
+ * been read.
+ *
+ * @param[in] reader  A reader.
+ *
+ * @return 1 at the end of the input, 0 otherwise.
+ */
+int json_reader_eof(json_reader_t *reader);
+
+/**
+ * Return true if there is more input ready to be read without
+ * waiting. This may be called by any thread while the reader is in
+ * use.
+ *
+ * @param[in] reader  A reader.
+ *
+ * @return 1 if input is ready, 0 otherwise.
+ */
+int json_reader_ready(json_reader_t *reader);
+
+/**
+ * Free a reader. If the input is seekable, its position is left
+ * immediately after the last value read.
+ *
+ * @param[in] reader  A reader.
+ */
+void free_json_reader(json_reader_t *reader);
+
+#endif // _BATON_JSON_READER_H
@@ -19,39 +19,226 @@
  * @author Keith James <kdj@sanger.ac.uk>
  */
 
+#include <libgen.h>
+
 #include "list.h"
 #include "read.h"
+#include "target_cache.h"
+
+// The shapes of the queries run for each path listed. Conditions
+// without values are bound to the path, or its components, each time
+// a query is run.
+
+static const query_shape_t obj_list_shape =
+    { .format    = { .latest      = 1,
+                     .num_columns = 2,
+                     .columns     = { COL_COLL_NAME, COL_DATA_NAME },
+                     .labels      = { JSON_COLLECTION_KEY,
+                                      JSON_DATA_OBJECT_KEY } },
+      .num_conds = 2,
+      .conds     = { { COL_COLL_NAME, SEARCH_OP_EQUALS, NULL },
+                     { COL_DATA_NAME, SEARCH_OP_EQUALS, NULL } } };
+
+static const query_shape_t obj_size_list_shape =
+    { .format    = { .latest      = 1,
+                     .num_columns = 3,
+                     .columns     = { COL_COLL_NAME, COL_DATA_NAME,
+                                      COL_DATA_SIZE },
+                     .labels      = { JSON_COLLECTION_KEY,
+                                      JSON_DATA_OBJECT_KEY,
+                                      JSON_SIZE_KEY } },
+      .num_conds = 2,
+      .conds     = { { COL_COLL_NAME, SEARCH_OP_EQUALS, NULL },
+                     { COL_DATA_NAME, SEARCH_OP_EQUALS, NULL } } };
+
+static const query_shape_t zone_shape =
+    { .format    = { .num_columns = 1,
+                     .columns     = { COL_ZONE_NAME },
+                     .labels      = { JSON_ZONE_KEY } },
+      .num_conds = 0 };
+
+static const query_shape_t obj_acl_shape =
+    { .format    = { .num_columns = 3,
+                     .columns     = { COL_USER_NAME, COL_USER_ZONE,
+                                      COL_DATA_ACCESS_NAME },
+                     .labels      = { JSON_OWNER_KEY, JSON_ZONE_KEY,
+                                      JSON_LEVEL_KEY } },
+      .num_conds = 2,
+      .conds     = { { COL_DATA_ACCESS_DATA_ID, SEARCH_OP_EQUALS, NULL },
+                     { COL_DATA_TOKEN_NAMESPACE, SEARCH_OP_EQUALS,
+                       ACCESS_NAMESPACE } } };
+
+static const query_shape_t col_acl_shape =
+    { .format    = { .num_columns = 3,
+                     .columns     = { COL_COLL_USER_NAME, COL_COLL_USER_ZONE,
+                                      COL_COLL_ACCESS_NAME },
+                     .labels      = { JSON_OWNER_KEY, JSON_ZONE_KEY,
+                                      JSON_LEVEL_KEY } },
+      .num_conds = 2,
+      .conds     = { { COL_COLL_NAME, SEARCH_OP_EQUALS, NULL },
+                     { COL_COLL_TOKEN_NAMESPACE, SEARCH_OP_EQUALS,
+                       ACCESS_NAMESPACE } } };
+
+#if IRODS_VERSION_INTEGER && IRODS_VERSION_INTEGER >= 4001008
+static const query_shape_t obj_repl_shape =
+    { .format    = { .num_columns = 5,
+                     .columns     = { COL_D_REPL_STATUS,
+                                      COL_DATA_REPL_NUM,
+                                      COL_D_DATA_CHECKSUM,
+                                      COL_COLL_NAME, COL_D_RESC_HIER },
+                     .labels      = { JSON_REPLICATE_STATUS_KEY,
+                                      JSON_REPLICATE_NUMBER_KEY,
+                                      JSON_CHECKSUM_KEY,
+                                      JSON_COLLECTION_KEY,
+                                      JSON_RESOURCE_HIER_KEY } },
+      .num_conds = 2,
+      .conds     = { { COL_COLL_NAME, SEARCH_OP_EQUALS, NULL },
+                     { COL_DATA_NAME, SEARCH_OP_EQUALS, NULL } } };
+#else
+static const query_shape_t obj_repl_shape =
+    { .format    = { .num_columns = 5,
+                     .columns     = { COL_D_REPL_STATUS,
+                                      COL_DATA_REPL_NUM,
+                                      COL_D_DATA_CHECKSUM,
+                                      COL_D_RESC_NAME, COL_R_LOC },
+                     .labels      = { JSON_REPLICATE_STATUS_KEY,
+                                      JSON_REPLICATE_NUMBER_KEY,
+                                      JSON_CHECKSUM_KEY,
+                                      JSON_RESOURCE_KEY,
+                                      JSON_LOCATION_KEY } },
+      .num_conds = 2,
+      .conds     = { { COL_COLL_NAME, SEARCH_OP_EQUALS, NULL },
+                     { COL_DATA_NAME, SEARCH_OP_EQUALS, NULL } } };
+#endif
+
+static const query_shape_t obj_tps_shape =
+    { .format    = { .latest      = 1,
+                     .num_columns = 3,
+                     .columns     = { COL_D_CREATE_TIME, COL_D_MODIFY_TIME,
+                                      COL_DATA_REPL_NUM },
+                     .labels      = { JSON_CREATED_KEY, JSON_MODIFIED_KEY,
+                                      JSON_REPLICATE_KEY } },
+      .num_conds = 2,
+      .conds     = { { COL_COLL_NAME, SEARCH_OP_EQUALS, NULL },
+                     { COL_DATA_NAME, SEARCH_OP_EQUALS, NULL } } };
+
+static const query_shape_t col_tps_shape =
+    { .format    = { .num_columns = 2,
+                     .columns     = { COL_COLL_CREATE_TIME,
+                                      COL_COLL_MODIFY_TIME },
+                     .labels      = { JSON_CREATED_KEY, JSON_MODIFIED_KEY } },
+      .num_conds = 1,
+      .conds     = { { COL_COLL_NAME, SEARCH_OP_EQUALS, NULL } } };
+
+#if IRODS_VERSION_INTEGER && IRODS_VERSION_INTEGER >= 4001008
+#define OBJ_ATTRS_FORMAT                                                \
+    { .num_columns = 9,                                                 \
+      .columns     = { COL_DATA_NAME,                                   \
+                       COL_D_REPL_STATUS, COL_DATA_REPL_NUM,            \
+                       COL_D_DATA_CHECKSUM, COL_DATA_SIZE,              \
+                       COL_D_CREATE_TIME, COL_D_MODIFY_TIME,            \
+                       COL_COLL_NAME, COL_D_RESC_HIER },                \
+      .labels      = { JSON_DATA_OBJECT_KEY,                            \
+                       JSON_REPLICATE_STATUS_KEY, JSON_REPLICATE_NUMBER_KEY, \
+                       JSON_CHECKSUM_KEY, JSON_SIZE_KEY,                \
+                       JSON_CREATED_KEY, JSON_MODIFIED_KEY,             \
+                       JSON_COLLECTION_KEY, JSON_RESOURCE_HIER_KEY } }
+#else
+#define OBJ_ATTRS_FORMAT                                                \
+    { .num_columns = 9,                                                 \
+      .columns     = { COL_DATA_NAME,                                   \
+                       COL_D_REPL_STATUS, COL_DATA_REPL_NUM,            \
+                       COL_D_DATA_CHECKSUM, COL_DATA_SIZE,              \
+                       COL_D_CREATE_TIME, COL_D_MODIFY_TIME,            \
+                       COL_D_RESC_NAME, COL_R_LOC },                    \
+      .labels      = { JSON_DATA_OBJECT_KEY,                            \
+                       JSON_REPLICATE_STATUS_KEY, JSON_REPLICATE_NUMBER_KEY, \
+                       JSON_CHECKSUM_KEY, JSON_SIZE_KEY,                \
+                       JSON_CREATED_KEY, JSON_MODIFIED_KEY,             \
+                       JSON_RESOURCE_KEY, JSON_LOCATION_KEY } }
+#endif
+
+static const query_shape_t coll_obj_attrs_shape =
+    { .format    = OBJ_ATTRS_FORMAT,
+      .num_conds = 1,
+      .conds     = { { COL_COLL_NAME, SEARCH_OP_EQUALS, NULL } } };
+
+static const query_shape_t obj_attrs_shape =
+    { .format    = OBJ_ATTRS_FORMAT,
+      .num_conds = 2,
+      .conds     = { { COL_COLL_NAME, SEARCH_OP_EQUALS, NULL },
+                     { COL_DATA_NAME, SEARCH_OP_EQUALS, NULL } } };
+
+#define OBJ_AVU_FORMAT                                                  \
+    { .latest      = 1,                                                 \
+      .num_columns = 3,                                                 \
+      .columns     = { COL_META_DATA_ATTR_NAME, COL_META_DATA_ATTR_VALUE, \
+                       COL_META_DATA_ATTR_UNITS },                      \
+      .labels      = { JSON_ATTRIBUTE_KEY, JSON_VALUE_KEY,              \
+                       JSON_UNITS_KEY } }
+
+#define COL_AVU_FORMAT                                                  \
+    { .num_columns = 3,                                                 \
+      .columns     = { COL_META_COLL_ATTR_NAME, COL_META_COLL_ATTR_VALUE, \
+                       COL_META_COLL_ATTR_UNITS },                      \
+      .labels      = { JSON_ATTRIBUTE_KEY, JSON_VALUE_KEY,              \
+                       JSON_UNITS_KEY } }
+
+static const query_shape_t obj_avu_shape =
+    { .format    = OBJ_AVU_FORMAT,
+      .num_conds = 2,
+      .conds     = { { COL_COLL_NAME, SEARCH_OP_EQUALS, NULL },
+                     { COL_DATA_NAME, SEARCH_OP_EQUALS, NULL } } };
+
+static const query_shape_t obj_avu_attr_shape =
+    { .format    = OBJ_AVU_FORMAT,
+      .num_conds = 3,
+      .conds     = { { COL_COLL_NAME, SEARCH_OP_EQUALS, NULL },
+                     { COL_DATA_NAME, SEARCH_OP_EQUALS, NULL },
+                     { COL_META_DATA_ATTR_NAME, SEARCH_OP_EQUALS, NULL } } };
+
+static const query_shape_t col_avu_shape =
+    { .format    = COL_AVU_FORMAT,
+      .num_conds = 1,
+      .conds     = { { COL_COLL_NAME, SEARCH_OP_EQUALS, NULL } } };
+
+static const query_shape_t col_avu_attr_shape =
+    { .format    = COL_AVU_FORMAT,
+      .num_conds = 2,
+      .conds     = { { COL_COLL_NAME, SEARCH_OP_EQUALS, NULL },
+                     { COL_META_COLL_ATTR_NAME, SEARCH_OP_EQUALS, NULL } } };
+
+// Split a data object path into collection and data object names, in
+// buffers of MAX_NAME_LEN
+static void split_obj_path(const char *path, char *coll_name,
+                           char *data_name) {
+    char path1[MAX_NAME_LEN];
+    char path2[MAX_NAME_LEN];
+
+    snprintf(path1, sizeof path1, "%s", path);
+    snprintf(path2, sizeof path2, "%s", path);
+
+    snprintf(coll_name, MAX_NAME_LEN, "%s", dirname(path1));
+    snprintf(data_name, MAX_NAME_LEN, "%s", basename(path2));
+}
 
 static json_t *list_data_object(rcComm_t *conn, rodsPath_t *rods_path,
                                 option_flags flags, baton_error_t *error) {
-    genQueryInp_t *query_in = NULL;
-    json_t         *results = NULL;
+    json_t *results = NULL;
     json_t *data_object;
     json_t *str_size;
     size_t num_size;
 
-    query_format_in_t *obj_format;
-
-    if (flags & PRINT_SIZE) {
-        obj_format = &(query_format_in_t)
-            { .num_columns = 3,
-              .columns     = { COL_COLL_NAME, COL_DATA_NAME,
-                               COL_DATA_SIZE },
-              .labels      = { JSON_COLLECTION_KEY, JSON_DATA_OBJECT_KEY,
-                               JSON_SIZE_KEY } };
-    }
-    else {
-        obj_format = &(query_format_in_t)
-            { .num_columns = 2,
-              .columns     = { COL_COLL_NAME, COL_DATA_NAME },
-              .labels      = { JSON_COLLECTION_KEY, JSON_DATA_OBJECT_KEY } };
-    }
+    const query_shape_t *shape =
+        (flags & PRINT_SIZE) ? &obj_size_list_shape : &obj_list_shape;
 
-    query_in = make_query_input(SEARCH_MAX_ROWS, obj_format->num_columns,
-                                obj_format->columns);
-    query_in = prepare_obj_list(query_in, rods_path, NULL);
+    char coll_name[MAX_NAME_LEN];
+    char data_name[MAX_NAME_LEN];
+    split_obj_path(rods_path->outPath, coll_name, data_name);
 
-    results = do_query(conn, query_in, obj_format->labels, error);
+    results = do_prepared_query(conn, shape, get_query_page_size(),
+                                (const char *[]) { coll_name, data_name },
+                                NULL, error);
     if (error->code != 0) goto error;
 
     if (json_array_size(results) != 1) {
@@ -71,12 +258,9 @@ static json_t *list_data_object(rcComm_t *conn, rodsPath_t *rods_path,
         json_object_set_new(data_object, JSON_SIZE_KEY, json_integer(num_size));
     }
 
-    if (query_in) free_query_input(query_in);
-
     return data_object;
 
 error:
-    if (query_in) free_query_input(query_in);
     if (results)  json_decref(results);
 
     return NULL;
@@ -177,6 +361,832 @@ error:
     return NULL;
 }
 
+// Return true if more than one of the data object attributes that
+// may be obtained by a single query of the catalog was requested.
+static int use_obj_attrs(option_flags flags) {
+    int num_flags = 0;
+    if (flags & PRINT_CHECKSUM)  num_flags++;
+    if (flags & PRINT_TIMESTAMP) num_flags++;
+    if (flags & PRINT_REPLICATE) num_flags++;
+
+    return num_flags > 1;
+}
+
+static json_t *add_obj_attrs_json_object(rcComm_t *conn, json_t *object,
+                                         json_t *attrs, json_t *resources,
+                                         option_flags flags,
+                                         baton_error_t *error) {
+    json_t *timestamps = NULL;
+
+    init_baton_error(error);
+
+    if (flags & PRINT_CHECKSUM) {
+        // Use the checksum of the first good replicate, or fall back
+        // to asking the server, which may calculate one
+        const char *checksum = NULL;
+        size_t i;
+        json_t *attr;
+        json_array_foreach(attrs, i, attr) {
+            const char *status = json_string_value
+                (json_object_get(attr, JSON_REPLICATE_STATUS_KEY));
+            const char *value = json_string_value
+                (json_object_get(attr, JSON_CHECKSUM_KEY));
+
+            if (value && str_equals(status, VALID_REPLICATE, 1)) {
+                checksum = value;
+                break;
+            }
+        }
+
+        if (checksum) {
+            add_checksum(object, json_string(checksum), error);
+        }
+        else {
+            add_checksum_json_object(conn, object, error);
+        }
+        if (error->code != 0) goto error;
+    }
+
+    if (flags & PRINT_TIMESTAMP) {
+        // As for list_timestamps, report timestamps of good replicates
+        timestamps = json_array();
+        if (!timestamps) {
+            set_baton_error(error, -1, "Failed to allocate a new JSON array");
+            goto error;
+        }
+
+        size_t i;
+        json_t *attr;
+        json_array_foreach(attrs, i, attr) {
+            const char *status = json_string_value
+                (json_object_get(attr, JSON_REPLICATE_STATUS_KEY));
+            if (!str_equals(status, VALID_REPLICATE, 1)) continue;
+
+            const char *repl_num = json_string_value
+                (json_object_get(attr, JSON_REPLICATE_NUMBER_KEY));
+            const char *created = get_created_timestamp(attr, error);
+            if (error->code != 0) goto error;
+            const char *modified = get_modified_timestamp(attr, error);
+            if (error->code != 0) goto error;
+
+            json_t *iso_created =
+                make_timestamp(JSON_CREATED_KEY, created, ISO8601_FORMAT,
+                               repl_num, error);
+            if (error->code != 0) goto error;
+            json_array_append_new(timestamps, iso_created);
+
+            json_t *iso_modified =
+                make_timestamp(JSON_MODIFIED_KEY, modified, ISO8601_FORMAT,
+                               repl_num, error);
+            if (error->code != 0) goto error;
+            json_array_append_new(timestamps, iso_modified);
+        }
+
+        json_object_set_new(object, JSON_TIMESTAMPS_KEY, timestamps);
+        timestamps = NULL;
+    }
+
+    if (flags & PRINT_REPLICATE) {
+        json_t *replicates =
+            revmap_replicate_results_cached(conn, attrs, resources, error);
+        if (error->code != 0) goto error;
+
+        add_replicates(object, replicates, error);
+        if (error->code != 0) goto error;
+    }
+
+    if ((flags & PRINT_SIZE) && !json_object_get(object, JSON_SIZE_KEY)) {
+        json_t *attr = json_array_get(attrs, 0);
+        const char *size = json_string_value
+            (json_object_get(attr, JSON_SIZE_KEY));
+        if (size) {
+            json_object_set_new(object, JSON_SIZE_KEY,
+                                json_integer(atol(size)));
+        }
+    }
+
+    return object;
+
+error:
+    if (timestamps) json_decref(timestamps);
+
+    return NULL;
+}
+
+// Add the checksums, timestamps and replicates of the data objects in
+// an array, all of which must be in the collection coll_name, using
+// a single query of the catalog. Collections in the array are
+// ignored. If the array contains a single data object, only that
+// data object is queried.
+static json_t *add_obj_attrs_json_array(rcComm_t *conn, const char *coll_name,
+                                        json_t *array, option_flags flags,
+                                        baton_error_t *error) {
+    json_t *attrs        = NULL;
+    json_t *attrs_by_obj = NULL;
+    json_t *resources    = NULL;
+
+    init_baton_error(error);
+
+    const char *data_name = NULL;
+    if (json_array_size(array) == 1) {
+        data_name = get_data_object_value(json_array_get(array, 0), error);
+        if (error->code != 0) goto error;
+    }
+
+    attrs = list_obj_attrs(conn, coll_name, data_name, error);
+    if (error->code != 0) goto error;
+
+    attrs_by_obj = json_object();
+    resources    = json_object();
+    if (!attrs_by_obj || !resources) {
+        set_baton_error(error, -1, "Failed to allocate a new JSON object");
+        goto error;
+    }
+
+    size_t i;
+    json_t *attr;
+    json_array_foreach(attrs, i, attr) {
+        const char *name = json_string_value
+            (json_object_get(attr, JSON_DATA_OBJECT_KEY));
+        if (!name) continue;
+
+        json_t *obj_attrs = json_object_get(attrs_by_obj, name);
+        if (!obj_attrs) {
+            obj_attrs = json_array();
+            json_object_set_new(attrs_by_obj, name, obj_attrs);
+        }
+
+        json_array_append(obj_attrs, attr);
+    }
+
+    json_t *item;
+    json_array_foreach(array, i, item) {
+        if (!represents_data_object(item)) continue;
+
+        const char *name = get_data_object_value(item, error);
+        if (error->code != 0) goto error;
+
+        json_t *obj_attrs = json_object_get(attrs_by_obj, name);
+        if (obj_attrs) {
+            add_obj_attrs_json_object(conn, item, obj_attrs, resources, flags,
+                                      error);
+            if (error->code != 0) goto error;
+        }
+        else {
+            // Not found in the catalog; the per-item path reports why
+            if (flags & PRINT_CHECKSUM) {
+                add_checksum_json_object(conn, item, error);
+                if (error->code != 0) goto error;
+            }
+            if (flags & PRINT_TIMESTAMP) {
+                add_tps_json_object(conn, item, error);
+                if (error->code != 0) goto error;
+            }
+            if (flags & PRINT_REPLICATE) {
+                add_repl_json_object(conn, item, error);
+                if (error->code != 0) goto error;
+            }
+        }
+    }
+
+    json_decref(attrs);
+    json_decref(attrs_by_obj);
+    json_decref(resources);
+
+    return array;
+
+error:
+    if (attrs)        json_decref(attrs);
+    if (attrs_by_obj) json_decref(attrs_by_obj);
+    if (resources)    json_decref(resources);
+
+    return NULL;
+}
+
+// Return the zone of an absolute path, which is its first component,
+// or NULL if it has none
+static const char *path_zone_hint(const char *path, char *zone_name) {
+    if (sscanf(path, "/%[^/]", zone_name) == 1) return zone_name;
+
+    return NULL;
+}
+
+typedef struct tree_sink {
+    /** The connection on which to enrich results */
+    rcComm_t *conn;
+    /** The collection at the root of the tree */
+    const char *root;
+    /** Result print options */
+    option_flags flags;
+    /** The callback receiving each enriched page */
+    query_sink_cb sink;
+    /** Data passed to the callback */
+    void *sink_data;
+} tree_sink_t;
+
+// Add data object attributes to a page of results from several
+// collections, using one query per collection in the page
+static json_t *add_obj_attrs_by_collection(rcComm_t *conn, json_t *array,
+                                           option_flags flags,
+                                           baton_error_t *error) {
+    json_t *groups = json_object();
+    if (!groups) {
+        set_baton_error(error, -1, "Failed to allocate a new JSON object");
+        goto error;
+    }
+
+    size_t i;
+    json_t *item;
+    json_array_foreach(array, i, item) {
+        if (!represents_data_object(item)) continue;
+
+        const char *coll_name = get_collection_value(item, error);
+        if (error->code != 0) goto error;
+
+        json_t *group = json_object_get(groups, coll_name);
+        if (!group) {
+            group = json_array();
+            json_object_set_new(groups, coll_name, group);
+        }
+
+        json_array_append(group, item);
+    }
+
+    const char *coll_name;
+    json_t *group;
+    json_object_foreach(groups, coll_name, group) {
+        add_obj_attrs_json_array(conn, coll_name, group, flags, error);
+        if (error->code != 0) goto error;
+    }
+
+    json_decref(groups);
+
+    return array;
+
+error:
+    if (groups) json_decref(groups);
+
+    return NULL;
+}
+
+// Replace the sizes in query results, which are strings, with integers
+static void convert_sizes(json_t *results) {
+    size_t i;
+    json_t *item;
+    json_array_foreach(results, i, item) {
+        json_t *str_size = json_object_get(item, JSON_SIZE_KEY);
+        if (json_is_string(str_size)) {
+            size_t num_size = atol(json_string_value(str_size));
+            json_object_set_new(item, JSON_SIZE_KEY, json_integer(num_size));
+        }
+    }
+}
+
+// Add the attributes requested in the print options to a page of
+// listed paths. If bulk is true, data object attributes are obtained
+// with one query for each collection, which lists all of its data
+// objects, otherwise with queries for each data object.
+static json_t *add_listing_attrs(rcComm_t *conn, json_t *results,
+                                 option_flags flags, int bulk,
+                                 baton_error_t *error) {
+    if (flags & PRINT_ACL) {
+        add_acl_json_array(conn, results, error);
+        if (error->code != 0) goto error;
+    }
+    if (flags & PRINT_AVU) {
+        add_avus_json_array(conn, results, error);
+        if (error->code != 0) goto error;
+    }
+    if (bulk && use_obj_attrs(flags)) {
+        add_obj_attrs_by_collection(conn, results, flags, error);
+        if (error->code != 0) goto error;
+    }
+    else {
+        if (flags & PRINT_CHECKSUM) {
+            add_checksum_json_array(conn, results, error);
+            if (error->code != 0) goto error;
+        }
+        if (flags & PRINT_TIMESTAMP) {
+            add_tps_json_array(conn, results, error);
+            if (error->code != 0) goto error;
+        }
+        if (flags & PRINT_REPLICATE) {
+            add_repl_json_array(conn, results, error);
+            if (error->code != 0) goto error;
+        }
+    }
+
+    return results;
+
+error:
+    return NULL;
+}
+
+// A query_sink_cb which completes each page of a tree listing before
+// passing it on
+static int list_tree_page(json_t *results, void *sink_data,
+                          baton_error_t *error) {
+    tree_sink_t *tree = sink_data;
+
+    init_baton_error(error);
+
+    // The root is not part of its own listing, and neither are the
+    // siblings of the root matched by wildcards in its name
+    size_t i = 0;
+    while (i < json_array_size(results)) {
+        json_t *item = json_array_get(results, i);
+        const char *coll_name =
+            json_string_value(json_object_get(item, JSON_COLLECTION_KEY));
+        const char *beneath = path_beneath(coll_name, tree->root,
+                                           MAX_NAME_LEN);
+
+        if (!beneath || (!represents_data_object(item) && *beneath == '\0')) {
+            json_array_remove(results, i);
+            continue;
+        }
+
+        i++;
+    }
+
+    convert_sizes(results);
+
+    add_listing_attrs(tree->conn, results, tree->flags, 1, error);
+    if (error->code != 0) goto error;
+
+    if (json_array_size(results) > 0) {
+        tree->sink(results, tree->sink_data, error);
+    }
+
+    return error->code;
+
+error:
+    return error->code;
+}
+
+// Limit a tree query to paths beneath root if prefix is true,
+// otherwise to those directly in it. Any '_' or '%' in root is a LIKE
+// wildcard, so a prefix query may also match siblings of root; the
+// page callbacks must discard results that are not beneath it.
+static genQueryInp_t *add_tree_conds(genQueryInp_t *query_in,
+                                     const char *root, int prefix) {
+    if (prefix) {
+        // Match paths beneath root, not siblings that share root as a
+        // prefix of their names
+        char path[MAX_NAME_LEN];
+        size_t len = strnlen(root, MAX_NAME_LEN);
+        int sep = len > 0 && root[len - 1] == '/';
+        snprintf(path, sizeof path, "%s%s", root, sep ? "" : "/");
+
+        return prepare_path_search(query_in, path);
+    }
+
+    query_cond_t cn = { .column   = COL_COLL_NAME,
+                        .operator = SEARCH_OP_EQUALS,
+                        .value    = root };
+
+    return add_query_conds(query_in, 1, (query_cond_t []) { cn });
+}
+
+// Run one query of a tree listing. If prefix is true, the results are
+// those beneath root, otherwise those directly in it.
+static int list_tree_query(rcComm_t *conn, const char *root,
+                           const char *zone_hint, int prefix,
+                           const query_format_in_t *format,
+                           query_sink_cb sink, void *sink_data,
+                           baton_error_t *error) {
+    genQueryInp_t *query_in = make_query_input(get_query_page_size(),
+                                               format->num_columns,
+                                               format->columns);
+    query_in = add_tree_conds(query_in, root, prefix);
+
+    if (format->latest) limit_to_newest_repl(query_in);
+
+    if (zone_hint) addKeyVal(&query_in->condInput, ZONE_KW, zone_hint);
+
+    do_query_stream(conn, query_in, (const char **) format->labels,
+                    sink, sink_data, error);
+    if (error->code != 0) goto error;
+
+    free_query_input(query_in);
+
+    return error->code;
+
+error:
+    if (query_in) free_query_input(query_in);
+
+    return error->code;
+}
+
+int list_collection_tree_stream(rcComm_t *conn, rodsPath_t *rods_path,
+                                option_flags flags, query_sink_cb sink,
+                                void *sink_data, baton_error_t *error) {
+    init_baton_error(error);
+
+    if (rods_path->objType != COLL_OBJ_T) {
+        set_baton_error(error, USER_INPUT_PATH_ERR,
+                        "Failed to list the tree of '%s' as it is "
+                        "not a collection", rods_path->outPath);
+        goto error;
+    }
+
+    query_format_in_t coll_format =
+        { .num_columns = 1,
+          .columns     = { COL_COLL_NAME },
+          .labels      = { JSON_COLLECTION_KEY } };
+
+    query_format_in_t obj_format =
+        { .latest      = 1,
+          .num_columns = (flags & PRINT_SIZE) ? 3 : 2,
+          .columns     = { COL_COLL_NAME, COL_DATA_NAME, COL_DATA_SIZE },
+          .labels      = { JSON_COLLECTION_KEY, JSON_DATA_OBJECT_KEY,
+                           JSON_SIZE_KEY } };
+
+    char zone_name[MAX_NAME_LEN];
+    const char *root = rods_path->outPath;
+    const char *zone_hint = path_zone_hint(root, zone_name);
+
+    tree_sink_t tree = { .conn      = conn,
+                         .root      = root,
+                         .flags     = flags,
+                         .sink      = sink,
+                         .sink_data = sink_data };
+
+    logmsg(DEBUG, "Listing the tree of '%s'", root);
+
+    list_tree_query(conn, root, zone_hint, 1, &coll_format, list_tree_page,
+                    &tree, error);
+    if (error->code != 0) goto error;
+
+    list_tree_query(conn, root, zone_hint, 0, &obj_format, list_tree_page,
+                    &tree, error);
+    if (error->code != 0) goto error;
+
+    list_tree_query(conn, root, zone_hint, 1, &obj_format, list_tree_page,
+                    &tree, error);
+    if (error->code != 0) goto error;
+
+    return error->code;
+
+error:
+    logmsg(ERROR, "Failed to list the tree of '%s': error %d %s",
+           rods_path->outPath, error->code, error->message);
+
+    return error->code;
+}
+
+json_t *list_collection_tree(rcComm_t *conn, rodsPath_t *rods_path,
+                             option_flags flags, baton_error_t *error) {
+    json_t *results = json_array();
+    if (!results) {
+        set_baton_error(error, -1, "Failed to allocate a new JSON array");
+        goto error;
+    }
+
+    list_collection_tree_stream(conn, rods_path, flags, extend_json_results,
+                                results, error);
+    if (error->code != 0) goto error;
+
+    return results;
+
+error:
+    if (results) json_decref(results);
+
+    return NULL;
+}
+
+// A query_sink_cb which maps the access levels of each page of a tree
+// ACL listing before passing it on
+static int list_tree_acl_page(json_t *results, void *sink_data,
+                              baton_error_t *error) {
+    tree_sink_t *tree = sink_data;
+
+    // Siblings of the root matched by wildcards in its name are not
+    // part of its tree; their permissions must not be reported as its
+    size_t i = 0;
+    while (i < json_array_size(results)) {
+        const char *coll_name =
+            json_string_value(json_object_get(json_array_get(results, i),
+                                              JSON_COLLECTION_KEY));
+        if (!path_beneath(coll_name, tree->root, MAX_NAME_LEN)) {
+            json_array_remove(results, i);
+            continue;
+        }
+
+        i++;
+    }
+
+    revmap_access_result(results, error);
+    if (error->code != 0) goto error;
+
+    if (json_array_size(results) > 0) {
+        tree->sink(results, tree->sink_data, error);
+    }
+
+    return error->code;
+
+error:
+    return error->code;
+}
+
+// Run one query of a tree ACL listing, as list_tree_query, for access
+// permissions only
+static int list_tree_acl_query(rcComm_t *conn, const char *root,
+                               const char *zone_hint, int prefix,
+                               const query_format_in_t *format,
+                               int namespace_column, tree_sink_t *tree,
+                               baton_error_t *error) {
+    genQueryInp_t *query_in = make_query_input(get_query_page_size(),
+                                               format->num_columns,
+                                               format->columns);
+    query_cond_t ns = { .column   = namespace_column,
+                        .operator = SEARCH_OP_EQUALS,
+                        .value    = ACCESS_NAMESPACE };
+    query_in = add_query_conds(query_in, 1, (query_cond_t []) { ns });
+    query_in = add_tree_conds(query_in, root, prefix);
+
+    if (zone_hint) addKeyVal(&query_in->condInput, ZONE_KW, zone_hint);
+
+    do_query_stream(conn, query_in, (const char **) format->labels,
+                    list_tree_acl_page, tree, error);
+    if (error->code != 0) goto error;
+
+    free_query_input(query_in);
+
+    return error->code;
+
+error:
+    if (query_in) free_query_input(query_in);
+
+    return error->code;
+}
+
+int list_permissions_tree_stream(rcComm_t *conn, rodsPath_t *rods_path,
+                                 query_sink_cb sink, void *sink_data,
+                                 baton_error_t *error) {
+    init_baton_error(error);
+
+    if (rods_path->objType != COLL_OBJ_T) {
+        set_baton_error(error, USER_INPUT_PATH_ERR,
+                        "Failed to list the tree ACL of '%s' as it is "
+                        "not a collection", rods_path->outPath);
+        goto error;
+    }
+
+    query_format_in_t coll_format =
+        { .num_columns = 4,
+          .columns     = { COL_COLL_NAME, COL_COLL_USER_NAME,
+                           COL_COLL_USER_ZONE, COL_COLL_ACCESS_NAME },
+          .labels      = { JSON_COLLECTION_KEY, JSON_OWNER_KEY,
+                           JSON_ZONE_KEY, JSON_LEVEL_KEY } };
+
+    query_format_in_t obj_format =
+        { .num_columns = 5,
+          .columns     = { COL_COLL_NAME, COL_DATA_NAME, COL_USER_NAME,
+                           COL_USER_ZONE, COL_DATA_ACCESS_NAME },
+          .labels      = { JSON_COLLECTION_KEY, JSON_DATA_OBJECT_KEY,
+                           JSON_OWNER_KEY, JSON_ZONE_KEY, JSON_LEVEL_KEY } };
+
+    char zone_name[MAX_NAME_LEN];
+    const char *root = rods_path->outPath;
+    const char *zone_hint = path_zone_hint(root, zone_name);
+
+    tree_sink_t tree = { .conn      = conn,
+                         .root      = root,
+                         .flags     = 0,
+                         .sink      = sink,
+                         .sink_data = sink_data };
+
+    logmsg(DEBUG, "Listing the ACL of the tree of '%s'", root);
+
+    // The root collection, the data objects in it, then everything
+    // beneath it
+    list_tree_acl_query(conn, root, zone_hint, 0, &coll_format,
+                        COL_COLL_TOKEN_NAMESPACE, &tree, error);
+    if (error->code != 0) goto error;
+
+    list_tree_acl_query(conn, root, zone_hint, 0, &obj_format,
+                        COL_DATA_TOKEN_NAMESPACE, &tree, error);
+    if (error->code != 0) goto error;
+
+    list_tree_acl_query(conn, root, zone_hint, 1, &coll_format,
+                        COL_COLL_TOKEN_NAMESPACE, &tree, error);
+    if (error->code != 0) goto error;
+
+    list_tree_acl_query(conn, root, zone_hint, 1, &obj_format,
+                        COL_DATA_TOKEN_NAMESPACE, &tree, error);
+    if (error->code != 0) goto error;
+
+    return error->code;
+
+error:
+    logmsg(ERROR, "Failed to list the tree ACL of '%s': error %d %s",
+           rods_path->outPath, error->code, error->message);
+
+    return error->code;
+}
+
+// Return the next page of one kind of entry directly in a collection,
+// in name order, starting after a name, if there is one
+static json_t *list_page_query(rcComm_t *conn, const char *root,
+                               const char *zone_hint,
+                               const query_format_in_t *format,
+                               int parent_column, int name_column,
+                               const char *after, size_t *skip, size_t limit,
+                               baton_error_t *error) {
+    json_t *results = NULL;
+
+    genQueryInp_t *query_in = make_query_input(get_query_page_size(),
+                                               format->num_columns,
+                                               format->columns);
+
+    // Names continue to be ordered across calls, so that a name is a
+    // valid place to resume
+    for (size_t i = 0; i < format->num_columns; i++) {
+        if (format->columns[i] == name_column) {
+            query_in->selectInp.value[i] = ORDER_BY;
+        }
+    }
+
+    query_cond_t pn = { .column   = parent_column,
+                        .operator = SEARCH_OP_EQUALS,
+                        .value    = root };
+    query_cond_t an = { .column   = name_column,
+                        .operator = SEARCH_OP_STR_GT,
+                        .value    = after };
+
+    if (after) {
+        query_in = add_query_conds(query_in, 2, (query_cond_t []) { pn, an });
+    }
+    else {
+        query_in = add_query_conds(query_in, 1, (query_cond_t []) { pn });
+    }
+
+    if (format->latest) limit_to_newest_repl(query_in);
+
+    if (zone_hint) addKeyVal(&query_in->condInput, ZONE_KW, zone_hint);
+
+    results = do_query_range(conn, query_in, (const char **) format->labels,
+                             skip, limit, error);
+    if (error->code != 0) goto error;
+
+    free_query_input(query_in);
+
+    return results;
+
+error:
+    if (query_in) free_query_input(query_in);
+
+    return NULL;
+}
+
+json_t *list_collection_page(rcComm_t *conn, rodsPath_t *rods_path,
+                             option_flags flags, size_t offset, size_t limit,
+                             const char *cursor, baton_error_t *error) {
+    json_t *result   = NULL;
+    json_t *contents = NULL;
+    json_t *page     = NULL;
+
+    init_baton_error(error);
+
+    if (rods_path->objType != COLL_OBJ_T) {
+        set_baton_error(error, USER_INPUT_PATH_ERR,
+                        "Failed to list a page of '%s' as it is "
+                        "not a collection", rods_path->outPath);
+        goto error;
+    }
+
+    if (limit < 1) {
+        set_baton_error(error, CAT_INVALID_ARGUMENT,
+                        "Failed to list a page of '%s': the limit must be "
+                        "at least 1", rods_path->outPath);
+        goto error;
+    }
+
+    if (flags & RECURSIVE) {
+        set_baton_error(error, CAT_INVALID_ARGUMENT,
+                        "Failed to list a page of '%s': pages are not "
+                        "supported for recursive listings",
+                        rods_path->outPath);
+        goto error;
+    }
+
+    // Data objects are listed first, then collections, as by
+    // rclReadCollection. The cursor names the kind and the name of the
+    // last entry returned.
+    char kind = LIST_CURSOR_OBJ;
+    const char *after = NULL;
+    if (cursor) {
+        if (strnlen(cursor, MAX_NAME_LEN) < 3 || cursor[1] != ':' ||
+            (cursor[0] != LIST_CURSOR_OBJ && cursor[0] != LIST_CURSOR_COLL)) {
+            set_baton_error(error, CAT_INVALID_ARGUMENT,
+                            "Invalid listing cursor '%s'", cursor);
+            goto error;
+        }
+
+        kind  = cursor[0];
+        after = cursor + 2;
+    }
+
+    query_format_in_t obj_format =
+        { .latest      = 1,
+          .num_columns = (flags & PRINT_SIZE) ? 3 : 2,
+          .columns     = { COL_COLL_NAME, COL_DATA_NAME, COL_DATA_SIZE },
+          .labels      = { JSON_COLLECTION_KEY, JSON_DATA_OBJECT_KEY,
+                           JSON_SIZE_KEY } };
+
+    query_format_in_t coll_format =
+        { .num_columns = 1,
+          .columns     = { COL_COLL_NAME },
+          .labels      = { JSON_COLLECTION_KEY } };
+
+    char zone_name[MAX_NAME_LEN];
+    const char *root = rods_path->outPath;
+    const char *zone_hint = path_zone_hint(root, zone_name);
+
+    contents = json_array();
+    if (!contents) {
+        set_baton_error(error, -1, "Failed to allocate a new JSON array");
+        goto error;
+    }
+
+    size_t skip = offset;
+    if (kind == LIST_CURSOR_OBJ) {
+        page = list_page_query(conn, root, zone_hint, &obj_format,
+                               COL_COLL_NAME, COL_DATA_NAME, after,
+                               &skip, limit, error);
+        if (error->code != 0) goto error;
+
+        json_array_extend(contents, page);
+        json_decref(page);
+        page = NULL;
+
+        if (json_array_size(contents) < limit) {
+            kind  = LIST_CURSOR_COLL;
+            after = NULL;
+        }
+    }
+
+    if (kind == LIST_CURSOR_COLL) {
+        page = list_page_query(conn, root, zone_hint, &coll_format,
+                               COL_COLL_PARENT_NAME, COL_COLL_NAME, after,
+                               &skip, limit - json_array_size(contents),
+                               error);
+        if (error->code != 0) goto error;
+
+        json_array_extend(contents, page);
+        json_decref(page);
+        page = NULL;
+    }
+
+    convert_sizes(contents);
+
+    add_listing_attrs(conn, contents, flags, 0, error);
+    if (error->code != 0) goto error;
+
+    // A full page may be followed by more entries
+    char next[MAX_NAME_LEN + 2] = { 0 };
+    size_t num_entries = json_array_size(contents);
+    if (num_entries == limit) {
+        json_t *last = json_array_get(contents, num_entries - 1);
+        if (represents_data_object(last)) {
+            snprintf(next, sizeof next, "%c:%s", LIST_CURSOR_OBJ,
+                     get_data_object_value(last, error));
+        }
+        else {
+            snprintf(next, sizeof next, "%c:%s", LIST_CURSOR_COLL,
+                     get_collection_value(last, error));
+        }
+        if (error->code != 0) goto error;
+    }
+
+    logmsg(DEBUG, "Listed %zu entries of '%s' from cursor '%s'",
+           num_entries, root, cursor ? cursor : "");
+
+    result = list_path(conn, rods_path,
+                       flags & ~(PRINT_CONTENTS | RECURSIVE), error);
+    if (error->code != 0) goto error;
+
+    add_contents(result, contents, error);
+    contents = NULL;
+    if (error->code != 0) goto error;
+
+    if (num_entries == limit) {
+        json_object_set_new(result, JSON_CURSOR_KEY, json_string(next));
+    }
+
+    return result;
+
+error:
+    logmsg(ERROR, "Failed to list a page of '%s': error %d %s",
+           rods_path->outPath, error->code, error->message);
+
+    if (page)     json_decref(page);
+    if (contents) json_decref(contents);
+    if (result)   json_decref(result);
+
+    return NULL;
+}
+
 json_t *list_checksum(rcComm_t *conn, rodsPath_t *rods_path,
                       baton_error_t *error) {
     return checksum_data_obj(conn, rods_path, 0, error);
@@ -217,17 +1227,28 @@ json_t *list_path(rcComm_t *conn, rodsPath_t *rods_path, option_flags flags,
                 result = add_avus_json_object(conn, result, error);
                 if (error->code != 0) goto error;
             }
-            if (flags & PRINT_CHECKSUM) {
-                result = add_checksum_json_object(conn, result, error);
+            if (use_obj_attrs(flags)) {
+                const char *coll_name = get_collection_value(result, error);
                 if (error->code != 0) goto error;
-            }
-            if (flags & PRINT_TIMESTAMP) {
-                result = add_tps_json_object(conn, result, error);
+
+                json_t *tmp = json_pack("[O]", result);
+                add_obj_attrs_json_array(conn, coll_name, tmp, flags, error);
+                json_decref(tmp);
                 if (error->code != 0) goto error;
             }
-            if (flags & PRINT_REPLICATE) {
-              result = add_repl_json_object(conn, result, error);
-              if (error->code != 0) goto error;
+            else {
+                if (flags & PRINT_CHECKSUM) {
+                    result = add_checksum_json_object(conn, result, error);
+                    if (error->code != 0) goto error;
+                }
+                if (flags & PRINT_TIMESTAMP) {
+                    result = add_tps_json_object(conn, result, error);
+                    if (error->code != 0) goto error;
+                }
+                if (flags & PRINT_REPLICATE) {
+                  result = add_repl_json_object(conn, result, error);
+                  if (error->code != 0) goto error;
+                }
             }
 
             break;
@@ -253,6 +1274,18 @@ json_t *list_path(rcComm_t *conn, rodsPath_t *rods_path, option_flags flags,
             }
 
             if (flags & PRINT_CONTENTS) {
+                // Enriched as the tree is listed, page by page
+                if (flags & RECURSIVE) {
+                    json_t *contents = list_collection_tree(conn, rods_path,
+                                                            flags, error);
+                    if (error->code != 0) goto error;
+
+                    add_contents(result, contents, error);
+                    if (error->code != 0) goto error;
+
+                    break;
+                }
+
                 json_t *contents = list_collection(conn, rods_path, flags,
                                                    error);
                 if (error->code != 0) goto error;
@@ -265,17 +1298,27 @@ json_t *list_path(rcComm_t *conn, rodsPath_t *rods_path, option_flags flags,
                     contents = add_avus_json_array(conn, contents, error);
                     if (error->code != 0) goto error;
                 }
-                if (flags & PRINT_CHECKSUM) {
-                    contents = add_checksum_json_array(conn, contents, error);
-                    if (error->code != 0) goto error;
-                }
-                if (flags & PRINT_TIMESTAMP) {
-                    contents = add_tps_json_array(conn, contents, error);
+                if (use_obj_attrs(flags)) {
+                    contents = add_obj_attrs_json_array(conn,
+                                                        rods_path->outPath,
+                                                        contents, flags,
+                                                        error);
                     if (error->code != 0) goto error;
                 }
-                if (flags & PRINT_REPLICATE) {
-                    contents = add_repl_json_array(conn, contents, error);
-                    if (error->code != 0) goto error;
+                else {
+                    if (flags & PRINT_CHECKSUM) {
+                        contents = add_checksum_json_array(conn, contents,
+                                                           error);
+                        if (error->code != 0) goto error;
+                    }
+                    if (flags & PRINT_TIMESTAMP) {
+                        contents = add_tps_json_array(conn, contents, error);
+                        if (error->code != 0) goto error;
+                    }
+                    if (flags & PRINT_REPLICATE) {
+                        contents = add_repl_json_array(conn, contents, error);
+                        if (error->code != 0) goto error;
+                    }
                 }
 
                 add_contents(result, contents, error);
@@ -303,19 +1346,9 @@ error:
 
 json_t *list_permissions(rcComm_t *conn, rodsPath_t *rods_path,
                          baton_error_t *error) {
-    genQueryInp_t *query_in = NULL;
-    json_t *results         = NULL;
-
-    query_format_in_t obj_format =
-        { .num_columns = 3,
-          .columns     = { COL_USER_NAME, COL_USER_ZONE,
-                           COL_DATA_ACCESS_NAME },
-          .labels      = { JSON_OWNER_KEY, JSON_ZONE_KEY, JSON_LEVEL_KEY } };
-    query_format_in_t col_format =
-        { .num_columns = 3,
-          .columns     = { COL_COLL_USER_NAME, COL_COLL_USER_ZONE,
-                           COL_COLL_ACCESS_NAME },
-          .labels      = { JSON_OWNER_KEY, JSON_ZONE_KEY, JSON_LEVEL_KEY } };
+    const query_shape_t *shape = NULL;
+    const char *value          = NULL;
+    json_t *results            = NULL;
 
     init_baton_error(error);
 
@@ -330,17 +1363,15 @@ json_t *list_permissions(rcComm_t *conn, rodsPath_t *rods_path,
         case DATA_OBJ_T:
             logmsg(TRACE, "Identified '%s' as a data object",
                    rods_path->outPath);
-            query_in = make_query_input(SEARCH_MAX_ROWS, obj_format.num_columns,
-                                        obj_format.columns);
-            query_in = prepare_obj_acl_list(query_in, rods_path);
+            shape = &obj_acl_shape;
+            value = rods_path->dataId;
             break;
 
         case COLL_OBJ_T:
             logmsg(TRACE, "Identified '%s' as a collection",
                    rods_path->outPath);
-            query_in = make_query_input(SEARCH_MAX_ROWS, col_format.num_columns,
-                                        col_format.columns);
-            query_in = prepare_col_acl_list(query_in, rods_path);
+            shape = &col_acl_shape;
+            value = rods_path->outPath;
             break;
 
         default:
@@ -354,24 +1385,27 @@ json_t *list_permissions(rcComm_t *conn, rodsPath_t *rods_path,
     // We need to add a zone hint to return results from other zones.
     // Without it, we will only see ACLs in the current zone. The
     // iRODS path seems to work for this purpose
-    addKeyVal(&query_in->condInput, ZONE_KW, rods_path->outPath);
-    logmsg(DEBUG, "Using zone hint '%s'", rods_path->outPath);
-    results = do_query(conn, query_in, obj_format.labels, error);
+    results = load_target_result(rods_path->outPath, TARGET_ACL);
+    if (results) return results;
+
+    results = do_prepared_query(conn, shape, get_query_page_size(),
+                                (const char *[]) { value },
+                                rods_path->outPath, error);
     if (error->code != 0) goto error;
 
     logmsg(DEBUG, "Obtained ACL data on '%s'", rods_path->outPath);
-    free_query_input(query_in);
 
     results = revmap_access_result(results, error);
     if (error->code != 0) goto error;
 
+    store_target_result(rods_path->outPath, TARGET_ACL, results);
+
     return results;
 
 error:
     logmsg(ERROR, "Failed to list ACL on '%s': error %d %s",
            rods_path->outPath, error->code, error->message);
 
-    if (query_in) free_query_input(query_in);
     if (results)  json_decref(results);
 
     return NULL;
@@ -379,32 +1413,10 @@ error:
 
 json_t *list_replicates(rcComm_t *conn, rodsPath_t *rods_path,
                         baton_error_t *error) {
-    genQueryInp_t *query_in = NULL;
-    json_t *results         = NULL;
+    json_t *results = NULL;
 
-#if IRODS_VERSION_INTEGER && IRODS_VERSION_INTEGER >= 4001008
-    query_format_in_t obj_format =
-        { .num_columns = 5,
-          .columns     = { COL_D_REPL_STATUS,
-                           COL_DATA_REPL_NUM,
-                           COL_D_DATA_CHECKSUM,
-                           COL_COLL_NAME, COL_D_RESC_HIER },
-          .labels      = { JSON_REPLICATE_STATUS_KEY,
-                           JSON_REPLICATE_NUMBER_KEY,
-                           JSON_CHECKSUM_KEY,
-                           JSON_COLLECTION_KEY, JSON_RESOURCE_HIER_KEY } };
-#else
-    query_format_in_t obj_format =
-        { .num_columns = 5,
-          .columns     = { COL_D_REPL_STATUS,
-                           COL_DATA_REPL_NUM,
-                           COL_D_DATA_CHECKSUM,
-                           COL_D_RESC_NAME, COL_R_LOC },
-          .labels      = { JSON_REPLICATE_STATUS_KEY,
-                           JSON_REPLICATE_NUMBER_KEY,
-                           JSON_CHECKSUM_KEY,
-                           JSON_RESOURCE_KEY, JSON_LOCATION_KEY } };
-#endif
+    char coll_name[MAX_NAME_LEN];
+    char data_name[MAX_NAME_LEN];
 
     init_baton_error(error);
 
@@ -419,9 +1431,7 @@ json_t *list_replicates(rcComm_t *conn, rodsPath_t *rods_path,
         case DATA_OBJ_T:
             logmsg(TRACE, "Identified '%s' as a data object",
                    rods_path->outPath);
-            query_in = make_query_input(SEARCH_MAX_ROWS, obj_format.num_columns,
-                                        obj_format.columns);
-            query_in = prepare_obj_repl_list(query_in, rods_path);
+            split_obj_path(rods_path->outPath, coll_name, data_name);
             break;
 
         case COLL_OBJ_T:
@@ -430,7 +1440,7 @@ json_t *list_replicates(rcComm_t *conn, rodsPath_t *rods_path,
             set_baton_error(error, USER_INPUT_PATH_ERR,
                             "Failed to list replicates of '%s' as it is "
                             "a collection", rods_path->outPath);
-            break;
+            goto error;
 
         default:
             set_baton_error(error, USER_INPUT_PATH_ERR,
@@ -440,25 +1450,28 @@ json_t *list_replicates(rcComm_t *conn, rodsPath_t *rods_path,
             goto error;
     }
 
-    addKeyVal(&query_in->condInput, ZONE_KW, rods_path->outPath);
-    logmsg(DEBUG, "Using zone hint '%s'", rods_path->outPath);
-    results = do_query(conn, query_in, obj_format.labels, error);
+    json_t *mapped = load_target_result(rods_path->outPath, TARGET_REPLICATE);
+    if (mapped) return mapped;
+
+    results = do_prepared_query(conn, &obj_repl_shape, get_query_page_size(),
+                                (const char *[]) { coll_name, data_name },
+                                rods_path->outPath, error);
     if (error->code != 0) goto error;
 
-    json_t *mapped = revmap_replicate_results(conn, results, error);
+    mapped = revmap_replicate_results(conn, results, error);
     if (error->code != 0) goto error;
 
     logmsg(DEBUG, "Obtained replicates of '%s'", rods_path->outPath);
-    free_query_input(query_in);
     json_decref(results);
 
+    store_target_result(rods_path->outPath, TARGET_REPLICATE, mapped);
+
     return mapped;
 
 error:
     logmsg(ERROR, "Failed to list replicates of '%s': error %d %s",
            rods_path->outPath, error->code, error->message);
 
-    if (query_in) free_query_input(query_in);
     if (results)  json_decref(results);
 
     return NULL;
@@ -466,19 +1479,10 @@ error:
 
 json_t *list_timestamps(rcComm_t *conn, rodsPath_t *rods_path,
                         baton_error_t *error) {
-    genQueryInp_t *query_in = NULL;
-    json_t *results         = NULL;
+    json_t *results = NULL;
 
-    query_format_in_t obj_format =
-        { .num_columns = 3,
-          .columns     = { COL_D_CREATE_TIME, COL_D_MODIFY_TIME,
-                           COL_DATA_REPL_NUM },
-          .labels      = { JSON_CREATED_KEY, JSON_MODIFIED_KEY,
-                           JSON_REPLICATE_KEY } };
-    query_format_in_t col_format =
-        { .num_columns = 2,
-          .columns     = { COL_COLL_CREATE_TIME, COL_COLL_MODIFY_TIME },
-          .labels      = { JSON_CREATED_KEY, JSON_MODIFIED_KEY } };
+    char coll_name[MAX_NAME_LEN];
+    char data_name[MAX_NAME_LEN];
 
     init_baton_error(error);
 
@@ -489,21 +1493,28 @@ json_t *list_timestamps(rcComm_t *conn, rodsPath_t *rods_path,
         goto error;
     }
 
+    results = load_target_result(rods_path->outPath, TARGET_TIMESTAMP);
+    if (results) return results;
+
     switch (rods_path->objType) {
         case DATA_OBJ_T:
             logmsg(TRACE, "Identified '%s' as a data object",
                    rods_path->outPath);
-            query_in = make_query_input(SEARCH_MAX_ROWS, obj_format.num_columns,
-                                        obj_format.columns);
-            query_in = prepare_obj_list(query_in, rods_path, NULL);
+            split_obj_path(rods_path->outPath, coll_name, data_name);
+            results = do_prepared_query(conn, &obj_tps_shape,
+                                        get_query_page_size(),
+                                        (const char *[]) { coll_name,
+                                                           data_name },
+                                        rods_path->outPath, error);
             break;
 
         case COLL_OBJ_T:
             logmsg(TRACE, "Identified '%s' as a collection",
                    rods_path->outPath);
-            query_in = make_query_input(SEARCH_MAX_ROWS, col_format.num_columns,
-                                        col_format.columns);
-            query_in = prepare_col_tps_list(query_in, rods_path);
+            results = do_prepared_query(conn, &col_tps_shape,
+                                        get_query_page_size(),
+                                        (const char *[]) { rods_path->outPath },
+                                        rods_path->outPath, error);
             break;
 
         default:
@@ -514,13 +1525,11 @@ json_t *list_timestamps(rcComm_t *conn, rodsPath_t *rods_path,
             goto error;
     }
 
-    addKeyVal(&query_in->condInput, ZONE_KW, rods_path->outPath);
-    logmsg(DEBUG, "Using zone hint '%s'", rods_path->outPath);
-    results = do_query(conn, query_in, obj_format.labels, error);
     if (error->code != 0) goto error;
 
     logmsg(DEBUG, "Obtained timestamps of '%s'", rods_path->outPath);
-    free_query_input(query_in);
+
+    store_target_result(rods_path->outPath, TARGET_TIMESTAMP, results);
 
     return results;
 
@@ -528,30 +1537,50 @@ error:
     logmsg(ERROR, "Failed to list timestamps of '%s': error %d %s",
            rods_path->outPath, error->code, error->message);
 
-    if (query_in)   free_query_input(query_in);
     if (results)    json_decref(results);
 
     return NULL;
 }
 
+json_t *list_obj_attrs(rcComm_t *conn, const char *coll_name,
+                       const char *data_name, baton_error_t *error) {
+    json_t *results = NULL;
+
+    init_baton_error(error);
+
+    if (data_name) {
+        results = do_prepared_query(conn, &obj_attrs_shape, BULK_MAX_ROWS,
+                                    (const char *[]) { coll_name, data_name },
+                                    coll_name, error);
+    }
+    else {
+        results = do_prepared_query(conn, &coll_obj_attrs_shape,
+                                    BULK_MAX_ROWS,
+                                    (const char *[]) { coll_name },
+                                    coll_name, error);
+    }
+    if (error->code != 0) goto error;
+
+    logmsg(DEBUG, "Obtained %zu data object attributes in '%s'",
+           json_array_size(results), coll_name);
+
+    return results;
+
+error:
+    logmsg(ERROR, "Failed to list data object attributes in '%s': "
+           "error %d %s", coll_name, error->code, error->message);
+
+    if (results)  json_decref(results);
+
+    return NULL;
+}
+
 json_t *list_metadata(rcComm_t *conn, rodsPath_t *rods_path, char *attr_name,
                       baton_error_t *error) {
-    genQueryInp_t *query_in = NULL;
-    json_t *results         = NULL;
+    json_t *results = NULL;
 
-    query_format_in_t obj_format =
-        { .num_columns  = 3,
-          .columns      = { COL_META_DATA_ATTR_NAME, COL_META_DATA_ATTR_VALUE,
-                            COL_META_DATA_ATTR_UNITS },
-          .labels       = { JSON_ATTRIBUTE_KEY, JSON_VALUE_KEY,
-                            JSON_UNITS_KEY } };
-
-    query_format_in_t col_format =
-        { .num_columns  = 3,
-          .columns      = { COL_META_COLL_ATTR_NAME, COL_META_COLL_ATTR_VALUE,
-                            COL_META_COLL_ATTR_UNITS },
-          .labels       = { JSON_ATTRIBUTE_KEY, JSON_VALUE_KEY,
-                            JSON_UNITS_KEY } };
+    char coll_name[MAX_NAME_LEN];
+    char data_name[MAX_NAME_LEN];
 
     init_baton_error(error);
 
@@ -567,21 +1596,32 @@ json_t *list_metadata(rcComm_t *conn, rodsPath_t *rods_path, char *attr_name,
         goto error;
     }
 
+    // Only the whole of the metadata is kept for reuse
+    if (!attr_name) {
+        results = load_target_result(rods_path->outPath, TARGET_AVU);
+        if (results) return results;
+    }
+
     switch (rods_path->objType) {
         case DATA_OBJ_T:
             logmsg(TRACE, "Identified '%s' as a data object",
                    rods_path->outPath);
-            query_in = make_query_input(SEARCH_MAX_ROWS, obj_format.num_columns,
-                                        obj_format.columns);
-            query_in = prepare_obj_list(query_in, rods_path, attr_name);
+            split_obj_path(rods_path->outPath, coll_name, data_name);
+            results = do_prepared_query
+                (conn, attr_name ? &obj_avu_attr_shape : &obj_avu_shape,
+                 get_query_page_size(),
+                 (const char *[]) { coll_name, data_name, attr_name },
+                 NULL, error);
             break;
 
         case COLL_OBJ_T:
             logmsg(TRACE, "Identified '%s' as a collection",
                    rods_path->outPath);
-            query_in = make_query_input(SEARCH_MAX_ROWS, col_format.num_columns,
-                                        col_format.columns);
-            query_in = prepare_col_list(query_in, rods_path, attr_name);
+            results = do_prepared_query
+                (conn, attr_name ? &col_avu_attr_shape : &col_avu_shape,
+                 get_query_page_size(),
+                 (const char *[]) { rods_path->outPath, attr_name },
+                 NULL, error);
             break;
 
         default:
@@ -592,11 +1632,13 @@ json_t *list_metadata(rcComm_t *conn, rodsPath_t *rods_path, char *attr_name,
             goto error;
     }
 
-    results = do_query(conn, query_in, obj_format.labels, error);
     if (error->code != 0) goto error;
 
     logmsg(DEBUG, "Obtained metadata on '%s'", rods_path->outPath);
-    free_query_input(query_in);
+
+    if (!attr_name) {
+        store_target_result(rods_path->outPath, TARGET_AVU, results);
+    }
 
     return results;
 
@@ -604,8 +1646,29 @@ error:
     logmsg(ERROR, "Failed to list metadata on '%s': error %d %s",
            rods_path->outPath, error->code, error->message);
 
-    if (query_in) free_query_input(query_in);
     if (results)  json_decref(results);
 
     return NULL;
 }
+
+json_t *list_zones(rcComm_t *conn, baton_error_t *error) {
+    json_t *results = NULL;
+
+    init_baton_error(error);
+
+    results = do_prepared_query(conn, &zone_shape, get_query_page_size(),
+                                (const char *[]) { NULL }, NULL, error);
+    if (error->code != 0) goto error;
+
+    logmsg(DEBUG, "Found %zu zones", json_array_size(results));
+
+    return results;
+
+error:
+    logmsg(ERROR, "Failed to list zones: error %d %s",
+           error->code, error->message);
+
+    if (results) json_decref(results);
+
+    return NULL;
+}
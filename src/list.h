@@ -33,6 +33,13 @@
 #include "operations.h"
 #include "query.h"
 
+/** The number of collection entries in a page when no limit is given */
+#define LIST_DEFAULT_LIMIT 1000
+
+/** The kinds of entry named by a listing cursor */
+#define LIST_CURSOR_OBJ  'o'
+#define LIST_CURSOR_COLL 'c'
+
 json_t *list_checksum(rcComm_t *conn, rodsPath_t *rods_path,
                       baton_error_t *error);
 
@@ -41,7 +48,8 @@ json_t *list_checksum(rcComm_t *conn, rodsPath_t *rods_path,
  * path (data object or collection). In the case of a data object,
  * return the representation of that path. In the case of an
  * collection, return a JSON array containing zero or more JSON
- * representations of its contents.
+ * representations of its contents. If the RECURSIVE flag is set, the
+ * contents are those of the whole tree beneath the collection.
  *
  * @param[in]  conn         An open iRODS connection.
  * @param[in]  rodspath     An iRODS path.
@@ -54,6 +62,70 @@ json_t *list_checksum(rcComm_t *conn, rodsPath_t *rods_path,
 json_t *list_path(rcComm_t *conn, rodsPath_t *rods_path, option_flags flags,
                   baton_error_t *error);
 
+/**
+ * Return JSON representations of all the collections and data objects
+ * beneath a resolved iRODS collection, at any depth, using paged
+ * queries on the collection path rather than opening each
+ * collection. The collection itself is not included.
+ *
+ * @param[in]  conn         An open iRODS connection.
+ * @param[in]  rodspath     An iRODS path to a collection.
+ * @param[in]  option_flags Result print options.
+ * @param[out] error        An error report struct.
+ *
+ * @return A newly constructed JSON array of collections, followed by
+ * data objects, which must be freed by the caller.
+ */
+json_t *list_collection_tree(rcComm_t *conn, rodsPath_t *rods_path,
+                             option_flags flags, baton_error_t *error);
+
+/**
+ * List all the collections and data objects beneath a resolved iRODS
+ * collection, as @ref list_collection_tree, passing each page of
+ * results to a callback once the attributes requested in the print
+ * options have been added to it. Only one page is held in memory at a
+ * time.
+ *
+ * @param[in]  conn         An open iRODS connection.
+ * @param[in]  rodspath     An iRODS path to a collection.
+ * @param[in]  option_flags Result print options.
+ * @param[in]  sink         Callback to receive each page of results.
+ * @param[in]  sink_data    Data passed to the callback.
+ * @param[out] error        An error report struct.
+ *
+ * @return 0 on success, error code on failure.
+ */
+int list_collection_tree_stream(rcComm_t *conn, rodsPath_t *rods_path,
+                                option_flags flags, query_sink_cb sink,
+                                void *sink_data, baton_error_t *error);
+
+/**
+ * Return a JSON representation of a resolved iRODS collection, as
+ * @ref list_path with PRINT_CONTENTS, whose contents are a bounded
+ * page of the entries directly within it. Data objects are listed
+ * before collections, each in name order. If more entries may follow,
+ * the representation has a cursor property whose value may be passed
+ * to a later call to list the next page. The cursor is an opaque
+ * string, which remains valid while entries are added to or removed
+ * from the collection.
+ *
+ * @param[in]  conn         An open iRODS connection.
+ * @param[in]  rodspath     An iRODS path to a collection.
+ * @param[in]  option_flags Result print options.
+ * @param[in]  offset       The number of entries to skip, from the
+ *                          start of the collection or from the cursor.
+ * @param[in]  limit        The maximum number of entries to list.
+ * @param[in]  cursor       A cursor from a previous page. Optional, NULL
+ *                          means start from the first entry.
+ * @param[out] error        An error report struct.
+ *
+ * @return A new struct representing the collection and the page of its
+ * contents, which must be freed by the caller.
+ */
+json_t *list_collection_page(rcComm_t *conn, rodsPath_t *rods_path,
+                             option_flags flags, size_t offset, size_t limit,
+                             const char *cursor, baton_error_t *error);
+
 /**
  * Return a JSON representation of the access control list of a
  * resolved iRODS path (data object or collection).
@@ -68,6 +140,25 @@ json_t *list_path(rcComm_t *conn, rodsPath_t *rods_path, option_flags flags,
 json_t *list_permissions(rcComm_t *conn, rodsPath_t *rods_path,
                          baton_error_t *error);
 
+/**
+ * List the access control lists of a resolved iRODS collection and of
+ * all the collections and data objects beneath it, passing each page
+ * of results to a callback. Each result is an access control entry
+ * with the collection, and the data object if there is one, to which
+ * it applies. Only one page is held in memory at a time.
+ *
+ * @param[in]  conn         An open iRODS connection.
+ * @param[in]  rodspath     An iRODS path to a collection.
+ * @param[in]  sink         Callback to receive each page of results.
+ * @param[in]  sink_data    Data passed to the callback.
+ * @param[out] error        An error report struct.
+ *
+ * @return 0 on success, error code on failure.
+ */
+int list_permissions_tree_stream(rcComm_t *conn, rodsPath_t *rods_path,
+                                 query_sink_cb sink, void *sink_data,
+                                 baton_error_t *error);
+
 /**
  * Return a JSON representation of the replicates of a resolved iRODS
  * path (data object).
@@ -96,6 +187,26 @@ json_t *list_replicates(rcComm_t *conn, rodsPath_t *rods_path,
 json_t *list_timestamps(rcComm_t *conn, rodsPath_t *rods_path,
                         baton_error_t *error);
 
+/**
+ * Return the catalog attributes of all the replicates of the data
+ * objects in a collection, or of a single data object, using one
+ * paged query. Each result contains the data object name, replicate
+ * number and status, checksum, size, created and modified timestamps
+ * and resource.
+ *
+ * @param[in]  conn       An open iRODS connection.
+ * @param[in]  coll_name  The collection containing the data objects.
+ * @param[in]  data_name  A data object name. Optional, NULL means
+ *                        return attributes of all the data objects
+ *                        in the collection.
+ * @param[out] error      An error report struct.
+ *
+ * @return A newly constructed JSON array of JSON objects, one per
+ * replicate.
+ */
+json_t *list_obj_attrs(rcComm_t *conn, const char *coll_name,
+                       const char *data_name, baton_error_t *error);
+
 /**
  * List metadata of a specified data object or collection.
  *
@@ -110,4 +221,15 @@ json_t *list_timestamps(rcComm_t *conn, rodsPath_t *rods_path,
 json_t *list_metadata(rcComm_t *conn, rodsPath_t *rods_path, char *attr_name,
                       baton_error_t *error);
 
+/**
+ * List the local zone and any remote zones federated with it.
+ *
+ * @param[in]  conn   An open iRODS connection.
+ * @param[out] error  An error report struct.
+ *
+ * @return A newly constructed JSON array of JSON objects, each having a
+ * zone property.
+ */
+json_t *list_zones(rcComm_t *conn, baton_error_t *error);
+
 #endif // _BATON_LIST_H
@@ -0,0 +1,420 @@
+/**
+ * Copyright (C) 2017 Genome Research Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @file local_io.c
+ * @author Keith James <kdj@sanger.ac.uk>
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "local_io.h"
+#include "log.h"
+
+static int local_io_flags = 0;
+
+void set_local_io(int flags) {
+    local_io_flags = flags;
+}
+
+int get_local_io(void) {
+    return local_io_flags;
+}
+
+static local_file_t *new_local_file(const char *path, baton_error_t *error) {
+    local_file_t *file = calloc(1, sizeof (local_file_t));
+    if (!file) goto error;
+
+    file->path = strdup(path);
+    if (!file->path) goto error;
+
+    file->fd = -1;
+
+    return file;
+
+error:
+    set_baton_error(error, errno, "Failed to allocate memory: error %d %s",
+                    errno, strerror(errno));
+    if (file) free(file);
+
+    return NULL;
+}
+
+static int write_fully(int fd, const char *buffer, size_t len) {
+    size_t total = 0;
+
+    while (total < len) {
+        ssize_t n = write(fd, buffer + total, len - total);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        total += n;
+    }
+
+    return 0;
+}
+
+static ssize_t read_fully(int fd, char *buffer, size_t len) {
+    size_t total = 0;
+
+    while (total < len) {
+        ssize_t n = read(fd, buffer + total, len - total);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (n == 0) break;
+        total += n;
+    }
+
+    return total;
+}
+
+static void advise_sequential(local_file_t *file) {
+#ifdef HAVE_POSIX_FADVISE
+    int status = posix_fadvise(file->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    if (status != 0) {
+        logmsg(DEBUG, "Failed to advise sequential access to '%s': "
+               "error %d %s", file->path, status, strerror(status));
+    }
+#else
+    (void) file;
+#endif
+}
+
+// Reserve the blocks of the whole file at once, so that it is not
+// fragmented by being extended a buffer at a time. Not all file systems
+// support this, which is not an error.
+static void preallocate(local_file_t *file) {
+#ifdef HAVE_POSIX_FALLOCATE
+    if (file->size == 0) return;
+
+    int status = posix_fallocate(file->fd, 0, (off_t) file->size);
+    if (status != 0) {
+        logmsg(DEBUG, "Failed to preallocate %zu bytes for '%s': "
+               "error %d %s", file->size, file->path, status,
+               strerror(status));
+    }
+#else
+    (void) file;
+#endif
+}
+
+local_file_t *open_local_output(const char *path, size_t size,
+                                int for_update, size_t buffer_size,
+                                baton_error_t *error) {
+    local_file_t *file = NULL;
+
+    init_baton_error(error);
+
+    if (buffer_size == 0) {
+        set_baton_error(error, -1, "Invalid buffer_size argument %zu",
+                        buffer_size);
+        goto error;
+    }
+
+    file = new_local_file(path, error);
+    if (error->code != 0) goto error;
+
+    file->output = 1;
+    file->size   = size;
+
+    int flags  = (for_update ? O_RDWR : O_WRONLY) | O_CREAT | O_TRUNC;
+    int direct = !for_update && (local_io_flags & LOCAL_IO_DIRECT);
+
+#ifdef O_DIRECT
+    if (direct) {
+        file->fd = open(path, flags | O_DIRECT, 0666);
+        if (file->fd >= 0) {
+            file->direct = 1;
+        }
+        else if (errno == EINVAL) {
+            logmsg(NOTICE, "The file system of '%s' does not support "
+                   "O_DIRECT; writing through the page cache", path);
+        }
+        else {
+            set_baton_error(error, errno,
+                            "Failed to open '%s' for writing: error %d %s",
+                            path, errno, strerror(errno));
+            goto error;
+        }
+    }
+#else
+    if (direct) {
+        logmsg(NOTICE, "O_DIRECT is not supported on this platform; "
+               "writing '%s' through the page cache", path);
+    }
+#endif
+
+    if (file->fd < 0) file->fd = open(path, flags, 0666);
+    if (file->fd < 0) {
+        set_baton_error(error, errno,
+                        "Failed to open '%s' for writing: error %d %s",
+                        path, errno, strerror(errno));
+        goto error;
+    }
+
+    preallocate(file);
+    advise_sequential(file);
+
+    if (file->direct) {
+        // O_DIRECT requires aligned buffers, offsets and lengths, which
+        // writing whole buffers from the start of the file provides
+        file->capacity = ((buffer_size + LOCAL_IO_ALIGNMENT - 1) /
+                          LOCAL_IO_ALIGNMENT) * LOCAL_IO_ALIGNMENT;
+
+        void *buffer = NULL;
+        int status = posix_memalign(&buffer, LOCAL_IO_ALIGNMENT,
+                                    file->capacity);
+        if (status != 0) {
+            set_baton_error(error, status, "Failed to allocate memory: "
+                            "error %d %s", status, strerror(status));
+            goto error;
+        }
+        file->buffer = buffer;
+    }
+
+    logmsg(DEBUG, "Opened '%s' for writing %zu bytes%s", path, size,
+           file->direct ? " with O_DIRECT" : "");
+
+    return file;
+
+error:
+    if (file) free_local_file(file);
+
+    return NULL;
+}
+
+local_file_t *open_local_input(const char *path, size_t buffer_size,
+                               baton_error_t *error) {
+    local_file_t *file = NULL;
+
+    init_baton_error(error);
+
+    if (buffer_size == 0) {
+        set_baton_error(error, -1, "Invalid buffer_size argument %zu",
+                        buffer_size);
+        goto error;
+    }
+
+    file = new_local_file(path, error);
+    if (error->code != 0) goto error;
+
+    file->fd = open(path, O_RDONLY);
+    if (file->fd < 0) {
+        set_baton_error(error, errno,
+                        "Failed to open '%s' for reading: error %d %s",
+                        path, errno, strerror(errno));
+        goto error;
+    }
+
+    struct stat st;
+    if (fstat(file->fd, &st) != 0) {
+        set_baton_error(error, errno, "Failed to stat '%s': error %d %s",
+                        path, errno, strerror(errno));
+        goto error;
+    }
+
+    file->size = S_ISREG(st.st_mode) ? (size_t) st.st_size : 0;
+
+    advise_sequential(file);
+
+    if ((local_io_flags & LOCAL_IO_MMAP) && file->size > 0) {
+        void *map = mmap(NULL, file->size, PROT_READ, MAP_PRIVATE,
+                         file->fd, 0);
+        if (map == MAP_FAILED) {
+            logmsg(NOTICE, "Failed to map '%s' into memory; reading it "
+                   "instead: error %d %s", path, errno, strerror(errno));
+        }
+        else {
+            posix_madvise(map, file->size, POSIX_MADV_SEQUENTIAL);
+            file->map = map;
+        }
+    }
+
+    if (!file->map) {
+        file->capacity = buffer_size;
+        file->buffer   = malloc(buffer_size);
+        if (!file->buffer) {
+            set_baton_error(error, errno, "Failed to allocate memory: "
+                            "error %d %s", errno, strerror(errno));
+            goto error;
+        }
+    }
+
+    logmsg(DEBUG, "Opened '%s' for reading%s", path,
+           file->map ? " from memory" : "");
+
+    return file;
+
+error:
+    if (file) free_local_file(file);
+
+    return NULL;
+}
+
+size_t write_local_file(local_file_t *file, const char *buffer, size_t len,
+                        baton_error_t *error) {
+    init_baton_error(error);
+
+    if (!file->direct) {
+        if (write_fully(file->fd, buffer, len) != 0) goto write_error;
+
+        file->position += len;
+
+        return len;
+    }
+
+    size_t num_copied = 0;
+    while (num_copied < len) {
+        size_t n = file->capacity - file->length;
+        if (n > len - num_copied) n = len - num_copied;
+
+        memcpy(file->buffer + file->length, buffer + num_copied, n);
+        file->length += n;
+        num_copied   += n;
+
+        if (file->length == file->capacity) {
+            if (write_fully(file->fd, file->buffer, file->length) != 0) {
+                goto write_error;
+            }
+            file->length = 0;
+        }
+    }
+
+    file->position += len;
+
+    return len;
+
+write_error:
+    set_baton_error(error, errno, "Failed to write to '%s': error %d %s",
+                    file->path, errno, strerror(errno));
+
+    return 0;
+}
+
+size_t read_local_file(local_file_t *file, size_t len, const char **data,
+                       baton_error_t *error) {
+    init_baton_error(error);
+
+    *data = NULL;
+
+    if (file->map) {
+        size_t remaining = file->size - file->position;
+        if (len > remaining) len = remaining;
+
+        *data = file->map + file->position;
+        file->position += len;
+
+        return len;
+    }
+
+    if (len > file->capacity) len = file->capacity;
+
+    ssize_t nr = read_fully(file->fd, file->buffer, len);
+    if (nr < 0) {
+        set_baton_error(error, errno, "Failed to read from '%s': "
+                        "error %d %s", file->path, errno, strerror(errno));
+        return 0;
+    }
+
+    *data = file->buffer;
+    file->position += nr;
+
+    return nr;
+}
+
+// Write the bytes held for O_DIRECT: the aligned part directly and the
+// remainder, which O_DIRECT would refuse, through the page cache
+static int flush_direct(local_file_t *file) {
+    size_t aligned = file->length - file->length % LOCAL_IO_ALIGNMENT;
+
+    if (aligned > 0 && write_fully(file->fd, file->buffer, aligned) != 0) {
+        return -1;
+    }
+
+    if (file->length > aligned) {
+#ifdef O_DIRECT
+        int flags = fcntl(file->fd, F_GETFL);
+        if (flags < 0 || fcntl(file->fd, F_SETFL, flags & ~O_DIRECT) < 0) {
+            return -1;
+        }
+#endif
+        if (write_fully(file->fd, file->buffer + aligned,
+                        file->length - aligned) != 0) {
+            return -1;
+        }
+    }
+
+    file->length = 0;
+
+    return 0;
+}
+
+int close_local_file(local_file_t *file, baton_error_t *error) {
+    init_baton_error(error);
+
+    if (file->output) {
+        if (file->direct && file->length > 0 && flush_direct(file) != 0) {
+            set_baton_error(error, errno, "Failed to write to '%s': "
+                            "error %d %s", file->path, errno,
+                            strerror(errno));
+        }
+
+        // Remove any preallocated blocks that were not written
+        if (error->code == 0 && file->position < file->size &&
+            ftruncate(file->fd, (off_t) file->position) != 0) {
+            set_baton_error(error, errno, "Failed to truncate '%s' to %zu "
+                            "bytes: error %d %s", file->path, file->position,
+                            errno, strerror(errno));
+        }
+    }
+
+    if (file->map) {
+        munmap(file->map, file->size);
+        file->map = NULL;
+    }
+
+    int status = close(file->fd);
+    file->fd = -1;
+
+    if (status != 0 && error->code == 0) {
+        set_baton_error(error, errno, "Failed to close '%s': error %d %s",
+                        file->path, errno, strerror(errno));
+    }
+
+    return error->code;
+}
+
+void free_local_file(local_file_t *file) {
+    assert(file);
+
+    if (file->map)     munmap(file->map, file->size);
+    if (file->fd >= 0) close(file->fd);
+
+    if (file->path)   free(file->path);
+    if (file->buffer) free(file->buffer);
+
+    free(file);
+}
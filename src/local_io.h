@@ -0,0 +1,148 @@
+/**
+ * Copyright (C) 2017 Genome Research Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @file local_io.h
+ * @author Keith James <kdj@sanger.ac.uk>
+ */
+
+#ifndef _BATON_LOCAL_IO_H
+#define _BATON_LOCAL_IO_H
+
+#include <stddef.h>
+
+#include "config.h"
+#include "error.h"
+
+/** Write local files with O_DIRECT, bypassing the page cache */
+#define LOCAL_IO_DIRECT    1
+/** Read local files for upload by mapping them into memory */
+#define LOCAL_IO_MMAP      2
+
+/** The alignment of buffers, offsets and lengths for O_DIRECT */
+#define LOCAL_IO_ALIGNMENT 4096
+
+typedef struct local_file {
+    /** The local path */
+    char *path;
+    /** The file descriptor */
+    int fd;
+    /** True if the file was opened for writing */
+    int output;
+    /** True if O_DIRECT is in effect */
+    int direct;
+    /** The expected size of an output file, or the size of an input file */
+    size_t size;
+    /** The number of bytes written or read so far, to be set by a caller
+        that writes to the descriptor itself */
+    size_t position;
+    /** A buffer, aligned for O_DIRECT, through which bytes are copied */
+    char *buffer;
+    /** The capacity of the buffer */
+    size_t capacity;
+    /** The number of bytes held in the buffer, waiting to be written */
+    size_t length;
+    /** The mapping of an input file, if it was mapped */
+    char *map;
+} local_file_t;
+
+/**
+ * Set how local files are read and written for transfers. Output files
+ * are always preallocated to the size of the data object, where the
+ * file system supports it, and both are advised of sequential access.
+ *
+ * @param[in] flags  A bitwise OR of LOCAL_IO_DIRECT and LOCAL_IO_MMAP,
+ *                   or 0 for ordinary reads and writes.
+ */
+void set_local_io(int flags);
+
+int get_local_io(void);
+
+/**
+ * Open a local file to receive the contents of a data object,
+ * truncating any existing file. The file is preallocated to its
+ * expected size. If LOCAL_IO_DIRECT is set and the file is not opened
+ * for update, it is opened with O_DIRECT and written through an
+ * aligned buffer; if the file system refuses O_DIRECT, the file is
+ * written normally.
+ *
+ * @param[in]  path         The local file path.
+ * @param[in]  size         The expected size of the file in bytes.
+ * @param[in]  for_update   True to open for reading as well as writing.
+ * @param[in]  buffer_size  The number of bytes to be written at one time.
+ * @param[out] error        An error report struct.
+ *
+ * @return A new local file handle, which must be freed by the caller.
+ */
+local_file_t *open_local_output(const char *path, size_t size,
+                                int for_update, size_t buffer_size,
+                                baton_error_t *error);
+
+/**
+ * Open a local file to be read, sequentially, for upload. If
+ * LOCAL_IO_MMAP is set and the file is a non-empty regular file, it is
+ * mapped into memory and read without copying.
+ *
+ * @param[in]  path         The local file path.
+ * @param[in]  buffer_size  The number of bytes to be read at one time.
+ * @param[out] error        An error report struct.
+ *
+ * @return A new local file handle, which must be freed by the caller.
+ */
+local_file_t *open_local_input(const char *path, size_t buffer_size,
+                               baton_error_t *error);
+
+/**
+ * Write bytes to the end of a local file opened by open_local_output.
+ *
+ * @param[in]  file    A local file handle.
+ * @param[in]  buffer  The bytes to write.
+ * @param[in]  len     The number of bytes to write.
+ * @param[out] error   An error report struct.
+ *
+ * @return The number of bytes accepted.
+ */
+size_t write_local_file(local_file_t *file, const char *buffer, size_t len,
+                        baton_error_t *error);
+
+/**
+ * Read the next bytes of a local file opened by open_local_input. The
+ * bytes remain valid until the next read or the file is closed.
+ *
+ * @param[in]  file   A local file handle.
+ * @param[in]  len    The maximum number of bytes to read.
+ * @param[out] data   Set to the bytes read.
+ * @param[out] error  An error report struct.
+ *
+ * @return The number of bytes read, 0 at the end of the file or on error.
+ */
+size_t read_local_file(local_file_t *file, size_t len, const char **data,
+                       baton_error_t *error);
+
+/**
+ * Close a local file. An output file has any buffered bytes written and
+ * is truncated to the number of bytes written, so that an interrupted
+ * transfer does not leave a preallocated tail.
+ *
+ * @param[in]  file   A local file handle.
+ * @param[out] error  An error report struct.
+ *
+ * @return 0 on success, or an errno value on failure.
+ */
+int close_local_file(local_file_t *file, baton_error_t *error);
+
+void free_local_file(local_file_t *file);
+
+#endif // _BATON_LOCAL_IO_H
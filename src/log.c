@@ -21,6 +21,7 @@
 #include <errno.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <time.h>
 
@@ -62,38 +63,93 @@ log_level set_log_threshold(log_level level) {
     return THRESHOLD;
 }
 
-void log_impl(int line, const char *file, char const *function,
-              log_level level, ...) {
-    if (level <= THRESHOLD) {
-        char buffer[32];
+// Each thread keeps the formatted timestamp of the last second in
+// which it logged
+static __thread time_t cached_time = (time_t) -1;
+static __thread char cached_timestamp[32];
+
+static const char *log_timestamp(void) {
+    time_t t = time(0);
 
-        time_t t = time(0);
+    if (t != cached_time) {
         struct tm tm;
         gmtime_r(&t, &tm);
 
-        int status = strftime(buffer, sizeof buffer, ISO8601_FORMAT, &tm);
-        if (status == 0) {
-            fprintf(stderr, "Failed to format timestamp '%s': error %d %s",
-                    buffer, errno, strerror(errno));
-            goto error;
+        if (strftime(cached_timestamp, sizeof cached_timestamp,
+                     ISO8601_FORMAT, &tm) == 0) {
+            return NULL;
         }
 
-        fprintf(stderr, "%s %s ", buffer, get_log_level_name(level));
+        cached_time = t;
+    }
 
-        if (level >= TRACE) {
-            fprintf(stderr, "%s:%d:%s: ", file, line, function);
-        }
+    return cached_timestamp;
+}
 
-        va_list args;
-        va_start(args, level);
-        const char *format = va_arg(args, char *);
+void log_impl(int line, const char *file, char const *function,
+              log_level level, ...) {
+    if (level > THRESHOLD) return;
 
-        vfprintf(stderr, format, args);
-        va_end(args);
+    char buffer[LOG_LINE_SIZE];
+    char *message = buffer;
+
+    const char *timestamp = log_timestamp();
+    if (!timestamp) {
+        fprintf(stderr, "Failed to format timestamp: error %d %s\n",
+                errno, strerror(errno));
+        goto error;
+    }
 
-        fprintf(stderr, "\n");
-        fflush(stderr);
+    int len;
+    if (level >= TRACE) {
+        len = snprintf(buffer, sizeof buffer, "%s %s %s:%d:%s: ", timestamp,
+                       get_log_level_name(level), file, line, function);
     }
+    else {
+        len = snprintf(buffer, sizeof buffer, "%s %s ", timestamp,
+                       get_log_level_name(level));
+    }
+    if (len < 0) goto error;
+
+    va_list args;
+    va_start(args, level);
+    const char *format = va_arg(args, char *);
+
+    va_list args_copy;
+    va_copy(args_copy, args);
+
+    size_t prefix_len = (size_t) len < sizeof buffer ? (size_t) len :
+        sizeof buffer - 1;
+    size_t remaining  = sizeof buffer - prefix_len;
+    int msg_len = vsnprintf(buffer + prefix_len, remaining, format, args);
+
+    // Messages too long for the buffer, plus a newline, are formatted
+    // again into one allocated to fit
+    if (msg_len >= 0 && (size_t) msg_len + 1 >= remaining) {
+        char *tmp = malloc(prefix_len + msg_len + 2);
+        if (tmp) {
+            memcpy(tmp, buffer, prefix_len);
+            vsnprintf(tmp + prefix_len, msg_len + 1, format, args_copy);
+            message = tmp;
+        }
+        else {
+            msg_len = remaining - 2;
+        }
+    }
+
+    va_end(args_copy);
+    va_end(args);
+
+    if (msg_len < 0) goto error;
+
+    size_t total = prefix_len + msg_len;
+    message[total++] = '\n';
+
+    // A single write, so that lines from concurrent threads are not
+    // interleaved
+    fwrite(message, 1, total, stderr);
+
+    if (message != buffer) free(message);
 
 error:
     return;
@@ -38,8 +38,17 @@ typedef enum {
     TRACE  = 6
 } log_level;
 
-#define logmsg(level, ...) \
-    log_impl(__LINE__, __FILE__, __func__, level, __VA_ARGS__);
+/** The size of the buffer used to format most log messages */
+#define LOG_LINE_SIZE 1024
+
+// The level is checked before the arguments are evaluated, so that
+// filtered messages cost nothing to build
+#define logmsg(level, ...)                                              \
+    do {                                                                \
+        if ((level) <= get_log_threshold()) {                           \
+            log_impl(__LINE__, __FILE__, __func__, level, __VA_ARGS__); \
+        }                                                               \
+    } while (0)
 
 void log_impl(int line, const char *file, char const *function,
               log_level level, ...);
@@ -18,96 +18,576 @@
  * @author Keith James <kdj@sanger.ac.uk>
  */
 
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+
 #include "config.h"
 
 #include "baton.h"
 #include "operations.h"
 
-static int iterate_json(FILE *input, rodsEnv *env, rcComm_t *conn,
+// The number of queue slots per worker. This bounds the number of
+// items held in memory while waiting to be printed in order.
+#define WORK_QUEUE_SLOTS 4
+
+/**
+ *  @enum work_item_state
+ *  @brief The state of an item in the worker pool queue.
+ */
+typedef enum {
+    /** Read from the input, waiting for a worker. */
+    ITEM_QUEUED,
+    /** Taken by a worker. */
+    ITEM_RUNNING,
+    /** Processed, waiting to be printed. */
+    ITEM_DONE,
+    /** Printed, the slot may be reused. */
+    ITEM_PRINTED
+} work_item_state;
+
+typedef struct work_item {
+    /** The input JSON */
+    json_t *item;
+    /** The JSON to be printed on completion */
+    json_t *output;
+    /** The position of the item in the input stream */
+    int item_num;
+    work_item_state state;
+    /** The arena holding the JSON for the item in this slot. Optional. */
+    json_arena_t *arena;
+} work_item_t;
+
+typedef struct work_pool {
+    pthread_mutex_t lock;
+    /** Signalled when items are queued or input is exhausted */
+    pthread_cond_t queued;
+    /** Signalled when slots are released */
+    pthread_cond_t released;
+    /** A ring of queue slots */
+    work_item_t *items;
+    size_t capacity;
+    /** The total number of items queued */
+    int tail;
+    /** The next item to be taken by a worker */
+    int next_take;
+    /** The oldest item not yet printed and released */
+    int next_release;
+    /** True when there is no more input */
+    int input_done;
+    int error_count;
+    baton_json_op fn;
+    operation_args_t *args;
+    /** The input, checked for readiness to decide when to flush output */
+    json_reader_t *reader;
+} work_pool_t;
+
+typedef struct worker {
+    pthread_t thread;
+    rodsEnv env;
+    rcComm_t *conn;
+    work_pool_t *pool;
+} worker_t;
+
+static json_t *process_item(rodsEnv *env, rcComm_t *conn, baton_json_op fn,
+                            operation_args_t *args, json_t *item,
+                            int item_num, int *error_count) {
+    json_t *output = NULL;
+
+    if (!json_is_object(item)) {
+        logmsg(ERROR, "Item %d in stream was not a JSON object; skipping",
+               item_num);
+        (*error_count)++;
+        return output;
+    }
+
+    set_query_page_size(args->page_size, args->flags & ADAPTIVE_PAGE_SIZE);
+
+    baton_error_t error;
+    json_t *result = fn(env, conn, item, args, &error);
+    if (error.code != 0) {
+        // On error, add an error report to the input JSON as a
+        // property and print the input JSON
+        (*error_count)++;
+        add_error_value(item, &error);
+
+        // A partial result, such as the report of a tree transfer in
+        // which some files failed, is kept with the error
+        if (has_operation(item) && has_operation_target(item) && result) {
+            baton_error_t rerror;
+            add_result(item, result, &rerror);
+        }
+        output = json_incref(item);
+    }
+    else {
+        if (has_operation(item) && has_operation_target(item) && result) {
+            // It's an envelope, so we add the result to the input
+            // JSON as a property and print the input JSON
+            baton_error_t rerror;
+            add_result(item, result, &rerror);
+            if (rerror.code != 0) {
+                logmsg(ERROR, "Failed to add error report to item %d "
+                       "in stream. Error code %d: %s", item_num,
+                       rerror.code, rerror.message);
+                (*error_count)++;
+            }
+            output = json_incref(item);
+        }
+        else if (result) {
+            // There is no envelope and there is some result JSON,
+            // so we print the result JSON
+            output = result;
+        }
+        else if (args->flags & STREAM_RESULTS) {
+            // The results were printed as they arrived, so there is
+            // nothing more to print
+            output = NULL;
+        }
+        else {
+            // There is no envelope and it's a void operation
+            // giving no result JSON, so we print the input JSON
+            // instead
+            output = json_incref(item);
+        }
+    }
+
+    return output;
+}
+
+// Begin or continue a run of operations on the target of an envelope,
+// so that consecutive envelopes naming the same target resolve it and
+// list its catalog results once between them. The run is decided as
+// each envelope arrives, without reading ahead, so that a client that
+// waits for each result is not kept waiting.
+static void follow_target(json_t *item) {
+    json_t *target = has_operation(item) ?
+        json_object_get(item, JSON_TARGET_KEY) : NULL;
+
+    baton_error_t error;
+    char *path = json_is_object(target) ? json_to_path(target, &error) : NULL;
+
+    if (path) {
+        begin_target_run(path);
+        free(path);
+    }
+    else {
+        end_target_run();
+    }
+}
+
+static json_t *load_item(json_reader_t *reader) {
+    baton_error_t error;
+    json_t *item = read_json_item(reader, &error);
+
+    if (error.code != 0) logmsg(ERROR, "%s", error.message);
+
+    return item;
+}
+
+static json_reader_t *open_input(FILE *input) {
+    baton_error_t error;
+    json_reader_t *reader = make_json_reader(input, &error);
+
+    if (error.code != 0) {
+        logmsg(ERROR, "Failed to open input: error %d %s",
+               error.code, error.message);
+    }
+
+    return reader;
+}
+
+static int iterate_json(FILE *input, rodsEnv *env, rcComm_t **conn,
                         baton_json_op fn, operation_args_t *args,
                         int *item_count) {
     int error_count = 0;
 
-    while (!feof(input)) {
-        size_t jflags = JSON_DISABLE_EOF_CHECK | JSON_REJECT_DUPLICATES;
-        json_error_t load_error;
-        json_t *item = json_loadf(input, jflags, &load_error);
+    json_reader_t *reader = open_input(input);
+    if (!reader) return 1;
 
-        if (!item) {
-            if (!feof(input)) {
-                logmsg(ERROR, "JSON error at line %d, column %d: %s",
-                       load_error.line, load_error.column, load_error.text);
-            }
+    // All the JSON for one item is allocated from the arena, which is
+    // reset once the item has been printed
+    json_arena_t *arena = make_json_arena();
 
+    while (!json_reader_eof(reader)) {
+        json_arena_t *previous = use_json_arena(arena);
+        json_t *item = load_item(reader);
+        if (!item) {
+            use_json_arena(previous);
+            reset_json_arena(arena);
             continue;
         }
 
-        if (!json_is_object(item)) {
-            logmsg(ERROR, "Item %d in stream was not a JSON object; skipping",
-                   item_count);
-            error_count++;
-            json_decref(item);
+        follow_target(item);
+        json_t *output = process_item(env, *conn, fn, args, item,
+                                      *item_count, &error_count);
+        use_json_arena(previous);
+
+        // A transfer resumed on a new connection leaves it for the rest
+        *conn = replace_connection(*conn);
+
+        if (output) {
+            print_json(output);
+            json_decref(output);
+        }
+
+        if (args->flags & FLUSH) {
+            maybe_flush_json_output(json_reader_ready(reader));
+        }
+
+        (*item_count)++;
+
+        json_decref(item);
+        reset_json_arena(arena);
+    } // while
+
+    end_target_run();
+    free_json_arena(arena);
+    free_json_reader(reader);
+    flush_json_output();
+
+    return error_count;
+}
+
+// Return true if the error report added to an item is for a failed
+// connection
+static int has_connection_error(json_t *item) {
+    json_t *error = json_object_get(item, JSON_ERROR_KEY);
+    json_t *code  = json_object_get(error, JSON_ERROR_CODE_KEY);
+
+    return json_is_integer(code) &&
+        is_connection_error((int) json_integer_value(code));
+}
+
+int do_operation_stream(FILE *input, FILE *output, rodsEnv *env,
+                        rcComm_t **conn, baton_json_op fn,
+                        operation_args_t *args, int *connection_lost) {
+    int item_count  = 0;
+    int error_count = 0;
+
+    *connection_lost = 0;
+
+    json_reader_t *reader = open_input(input);
+    if (!reader) return 1;
+
+    json_arena_t *arena = make_json_arena();
+
+    while (!json_reader_eof(reader) && !ferror(output)) {
+        json_arena_t *previous = use_json_arena(arena);
+        json_t *item = load_item(reader);
+        if (!item) {
+            use_json_arena(previous);
+            reset_json_arena(arena);
             continue;
         }
 
-        baton_error_t error;
-        json_t *result = fn(env, conn, item, args, &error);
-        if (error.code != 0) {
-            // On error, add an error report to the input JSON as a
-            // property and print the input JSON
-            error_count++;
-            add_error_value(item, &error);
-            print_json(item);
+        follow_target(item);
+        json_t *result = process_item(env, *conn, fn, args, item,
+                                      item_count, &error_count);
+        use_json_arena(previous);
+
+        *conn = replace_connection(*conn);
+
+        if (result) {
+            if (has_connection_error(result)) *connection_lost = 1;
+            print_json_stream(result, output);
+            json_decref(result);
         }
-        else {
-            if (has_operation(item) && has_operation_target(item) && result) {
-                // It's an envelope, so we add the result to the input
-                // JSON as a property and print the input JSON
-                baton_error_t rerror;
-                add_result(item, result, &rerror);
-                if (rerror.code != 0) {
-                    logmsg(ERROR, "Failed to add error report to item %d "
-                           "in stream. Error code %d: %s", item_count,
-                           rerror.code, rerror.message);
-                    error_count++;
-                }
-                print_json(item);
-            }
-            else if (result) {
-                // There is no envelope and there is some result JSON,
-                // so we print the result JSON
-                print_json(result);
-                json_decref(result);
+
+        if (!json_reader_ready(reader)) fflush(output);
+
+        item_count++;
+
+        json_decref(item);
+        reset_json_arena(arena);
+    } // while
+
+    end_target_run();
+    free_json_arena(arena);
+    free_json_reader(reader);
+    fflush(output);
+
+    logmsg(DEBUG, "Processed %d items with %d errors",
+           item_count, error_count);
+
+    return error_count;
+}
+
+// Print and release completed items from the head of the queue. When
+// output order is preserved, each item is printed only once all its
+// predecessors have been printed. Must be called with the pool lock
+// held.
+static void release_items(work_pool_t *pool) {
+    int released = 0;
+
+    while (pool->next_release < pool->tail) {
+        work_item_t *slot = &pool->items[pool->next_release % pool->capacity];
+
+        if (slot->state == ITEM_DONE) {
+            if (slot->output) print_json(slot->output);
+            if (pool->args->flags & FLUSH) {
+                maybe_flush_json_output(json_reader_ready(pool->reader));
             }
-            else {
-                // There is no envelope and it's a void operation
-                // giving no result JSON, so we print the input JSON
-                // instead
-                print_json(item);
+            slot->state = ITEM_PRINTED;
+        }
+
+        if (slot->state != ITEM_PRINTED) break;
+
+        if (slot->output) json_decref(slot->output);
+        json_decref(slot->item);
+        slot->item   = NULL;
+        slot->output = NULL;
+        reset_json_arena(slot->arena);
+
+        pool->next_release++;
+        released++;
+    }
+
+    if (released) pthread_cond_broadcast(&pool->released);
+}
+
+static void *run_worker(void *arg) {
+    worker_t *worker = arg;
+    work_pool_t *pool = worker->pool;
+
+    pthread_mutex_lock(&pool->lock);
+
+    while (1) {
+        while (pool->next_take == pool->tail && !pool->input_done) {
+            pthread_cond_wait(&pool->queued, &pool->lock);
+        }
+
+        if (pool->next_take == pool->tail) break; // No more input
+
+        work_item_t *slot = &pool->items[pool->next_take % pool->capacity];
+        pool->next_take++;
+        slot->state = ITEM_RUNNING;
+
+        pthread_mutex_unlock(&pool->lock);
+
+        int error_count = 0;
+        json_arena_t *previous = use_json_arena(slot->arena);
+        json_t *output = process_item(&worker->env, worker->conn, pool->fn,
+                                      pool->args, slot->item,
+                                      slot->item_num, &error_count);
+        use_json_arena(previous);
+
+        worker->conn = replace_connection(worker->conn);
+
+        pthread_mutex_lock(&pool->lock);
+
+        slot->output = output;
+        pool->error_count += error_count;
+
+        if (pool->args->flags & PRESERVE_ORDER) {
+            slot->state = ITEM_DONE;
+        }
+        else {
+            if (output) print_json(output);
+            if (pool->args->flags & FLUSH) {
+                maybe_flush_json_output(json_reader_ready(pool->reader));
             }
+            slot->state = ITEM_PRINTED;
         }
 
-        if (args->flags & FLUSH) fflush(stdout);
+        release_items(pool);
+    } // while
 
-        (*item_count)++;
+    pthread_mutex_unlock(&pool->lock);
 
-        json_decref(item);
+    return NULL;
+}
+
+static int iterate_json_pool(FILE *input, worker_t *workers,
+                             size_t num_workers, baton_json_op fn,
+                             operation_args_t *args, int *item_count) {
+    int error_count = 0;
+    size_t num_started = 0;
+
+    work_pool_t pool = { .items        = NULL,
+                         .capacity     = num_workers * WORK_QUEUE_SLOTS,
+                         .tail         = 0,
+                         .next_take    = 0,
+                         .next_release = 0,
+                         .input_done   = 0,
+                         .error_count  = 0,
+                         .fn           = fn,
+                         .args         = args,
+                         .reader       = NULL };
+
+    pool.reader = open_input(input);
+    if (!pool.reader) return 1;
+
+    pool.items = calloc(pool.capacity, sizeof (work_item_t));
+    if (!pool.items) {
+        logmsg(ERROR, "Failed to allocate memory: error %d %s",
+               errno, strerror(errno));
+        free_json_reader(pool.reader);
+        return 1;
+    }
+
+    // Each slot has its own arena, which is used by the main thread to
+    // load an item and then by the worker processing it, but never by
+    // both at once
+    for (size_t i = 0; i < pool.capacity; i++) {
+        pool.items[i].arena = make_json_arena();
+    }
+
+    pthread_mutex_init(&pool.lock, NULL);
+    pthread_cond_init(&pool.queued, NULL);
+    pthread_cond_init(&pool.released, NULL);
+
+    for (size_t i = 0; i < num_workers; i++) {
+        workers[i].pool = &pool;
+
+        int status = pthread_create(&workers[i].thread, NULL, run_worker,
+                                    &workers[i]);
+        if (status != 0) {
+            logmsg(ERROR, "Failed to start worker %zu: error %d %s",
+                   i, status, strerror(status));
+            error_count++;
+            break;
+        }
+
+        num_started++;
+    }
+
+    while (num_started > 0 && !json_reader_eof(pool.reader)) {
+        // Wait for a free slot before loading, so that the item can be
+        // allocated from the slot's arena
+        pthread_mutex_lock(&pool.lock);
+
+        while ((size_t) (pool.tail - pool.next_release) >= pool.capacity) {
+            pthread_cond_wait(&pool.released, &pool.lock);
+        }
+
+        work_item_t *slot = &pool.items[pool.tail % pool.capacity];
+
+        pthread_mutex_unlock(&pool.lock);
+
+        json_arena_t *previous = use_json_arena(slot->arena);
+        json_t *item = load_item(pool.reader);
+        use_json_arena(previous);
+
+        if (!item) {
+            reset_json_arena(slot->arena);
+            continue;
+        }
+
+        pthread_mutex_lock(&pool.lock);
+
+        slot->item     = item;
+        slot->output   = NULL;
+        slot->item_num = pool.tail;
+        slot->state    = ITEM_QUEUED;
+        pool.tail++;
+
+        pthread_cond_signal(&pool.queued);
+        pthread_mutex_unlock(&pool.lock);
     } // while
 
+    pthread_mutex_lock(&pool.lock);
+    pool.input_done = 1;
+    pthread_cond_broadcast(&pool.queued);
+    pthread_mutex_unlock(&pool.lock);
+
+    for (size_t i = 0; i < num_started; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+
+    *item_count  = pool.tail;
+    error_count += pool.error_count;
+
+    pthread_cond_destroy(&pool.released);
+    pthread_cond_destroy(&pool.queued);
+    pthread_mutex_destroy(&pool.lock);
+
+    for (size_t i = 0; i < pool.capacity; i++) {
+        free_json_arena(pool.items[i].arena);
+    }
+    free(pool.items);
+    free_json_reader(pool.reader);
+    flush_json_output();
+
     return error_count;
 }
 
+static int do_operation_pool(FILE *input, baton_json_op fn,
+                             operation_args_t *args) {
+    int item_count     = 0;
+    int error_count    = 0;
+    size_t num_workers = args->num_workers;
+
+    worker_t *workers = calloc(num_workers, sizeof (worker_t));
+    if (!workers) {
+        logmsg(ERROR, "Failed to allocate memory: error %d %s",
+               errno, strerror(errno));
+        goto error;
+    }
+
+    if (!input) goto error;
+
+    // Log in before starting any threads; each worker has its own
+    // connection because an rcComm_t may not be shared between threads
+    for (size_t i = 0; i < num_workers; i++) {
+        workers[i].conn = rods_login(&workers[i].env);
+        if (!workers[i].conn) goto error;
+    }
+
+    logmsg(DEBUG, "Started %zu workers", num_workers);
+
+    error_count = iterate_json_pool(input, workers, num_workers, fn, args,
+                                    &item_count);
+    if (error_count > 0) {
+        logmsg(WARN, "Processed %d items with %d errors",
+               item_count, error_count);
+    }
+    else {
+        logmsg(DEBUG, "Processed %d items with %d errors",
+               item_count, error_count);
+    }
+
+    for (size_t i = 0; i < num_workers; i++) {
+        rcDisconnect(workers[i].conn);
+    }
+    free(workers);
+
+    return error_count;
+
+error:
+    if (workers) {
+        for (size_t i = 0; i < num_workers; i++) {
+            if (workers[i].conn) rcDisconnect(workers[i].conn);
+        }
+        free(workers);
+    }
+
+    logmsg(ERROR, "Processed %d items with %d errors",
+           item_count, error_count);
+
+    return 1;
+}
+
 int do_operation(FILE *input, baton_json_op fn, operation_args_t *args) {
     int item_count  = 0;
     int error_count = 0;
 
+    if (args->num_workers > 1 && (args->flags & STREAM_RESULTS)) {
+        logmsg(WARN, "Streamed results cannot be printed by concurrent "
+               "workers; using 1 worker");
+        args->num_workers = 1;
+    }
+
+    if (args->num_workers > 1) {
+        return do_operation_pool(input, fn, args);
+    }
+
     rodsEnv env;
     rcComm_t *conn = rods_login(&env);
     if (!conn) goto error;
 
     if (!input) goto error;
 
-    error_count = iterate_json(input, &env, conn, fn, args, &item_count);
+    error_count = iterate_json(input, &env, &conn, fn, args, &item_count);
     if (error_count > 0) {
         logmsg(WARN, "Processed %d items with %d errors",
                item_count, error_count);
@@ -117,11 +597,13 @@ int do_operation(FILE *input, baton_json_op fn, operation_args_t *args) {
                item_count, error_count);
     }
 
+    free_spare_connection();
     rcDisconnect(conn);
 
     return error_count;
 
 error:
+    free_spare_connection();
     if (conn) rcDisconnect(conn);
 
     logmsg(ERROR, "Processed %d items with %d errors",
@@ -130,20 +612,65 @@ error:
     return 1;
 }
 
+int print_json_results(json_t *results, void *sink_data,
+                       baton_error_t *error) {
+    operation_args_t *args = sink_data;
+
+    init_baton_error(error);
+
+    for (size_t i = 0; i < json_array_size(results); i++) {
+        print_json(json_array_get(results, i));
+    }
+
+    if (args->flags & FLUSH) maybe_flush_json_output(1);
+
+    return error->code;
+}
+
+// Stop counting requests for an envelope and add the counts to it
+static void finish_timing(json_t *envelope, rpc_stats_t *stats,
+                          rpc_stats_t *previous) {
+    if (!stats) return;
+
+    use_rpc_stats(previous);
+
+    baton_error_t error;
+    json_t *timing = rpc_stats_to_json(stats, &error);
+    if (error.code != 0) {
+        logmsg(ERROR, "Failed to report request statistics: %s",
+               error.message);
+    }
+    else {
+        json_object_set_new(envelope, JSON_TIMING_KEY, timing);
+    }
+
+    free_rpc_stats(stats);
+}
+
 json_t *baton_json_dispatch_op(rodsEnv *env, rcComm_t *conn, json_t *envelope,
                                operation_args_t *args, baton_error_t *error) {
     json_t *result  = NULL;
+    rpc_stats_t *stats          = NULL;
+    rpc_stats_t *previous_stats = NULL;
 
     const char *op = get_operation(envelope, error);
     if (error->code != 0) goto error;
 
-    json_t *target = get_operation_target(envelope, error);
-    if (error->code != 0) goto error;
+    // Only the chmod operation accepts an array of targets
+    json_t *target = json_object_get(envelope, JSON_TARGET_KEY);
+    if (!(str_equals(op, JSON_CHMOD_OP, MAX_STR_LEN) &&
+          json_is_array(target))) {
+        target = get_operation_target(envelope, error);
+        if (error->code != 0) goto error;
+    }
 
     operation_args_t args_copy = { .flags       = args->flags,
                                    .buffer_size = args->buffer_size,
                                    .zone_name   = args->zone_name,
-                                   .path        = NULL };
+                                   .page_size   = args->page_size,
+                                   .num_transfers = args->num_transfers,
+                                   .path        = NULL,
+                                   .cursor      = NULL };
 
     if (has_operation(envelope)) {
         json_t *args = get_operation_args(envelope, error);
@@ -158,12 +685,28 @@ json_t *baton_json_dispatch_op(rodsEnv *env, rcComm_t *conn, json_t *envelope,
         if (op_size_p(args))          flags = flags | PRINT_SIZE;
         if (op_timestamp_p(args))     flags = flags | PRINT_TIMESTAMP;
         if (op_recurse_p(args))       flags = flags | RECURSIVE;
+        if (op_save_p(args))          flags = flags | SAVE_FILES;
+        if (op_sync_p(args))          flags = flags | SYNC;
         if (op_force_p(args))         flags = flags | FORCE;
         if (op_collection_p(args))    flags = flags | SEARCH_COLLECTIONS;
         if (op_object_p(args))        flags = flags | SEARCH_OBJECTS;
         if (op_single_server_p(args)) flags = flags | SINGLE_SERVER;
+        if (op_adaptive_p(args))      flags = flags | ADAPTIVE_PAGE_SIZE;
         args_copy.flags = flags;
 
+        if (op_timing_p(args)) {
+            stats = make_rpc_stats();
+            if (stats) previous_stats = use_rpc_stats(stats);
+        }
+
+        if (has_op_page_size(args)) {
+            args_copy.page_size = get_op_page_size(args, error);
+            if (error->code != 0) goto error;
+        }
+
+        set_query_page_size(args_copy.page_size,
+                            args_copy.flags & ADAPTIVE_PAGE_SIZE);
+
         if (has_operation(args)) {
             const char *arg = get_operation(args, error);
             if (error->code != 0) goto error;
@@ -195,6 +738,35 @@ json_t *baton_json_dispatch_op(rodsEnv *env, rcComm_t *conn, json_t *envelope,
 
             args_copy.path = tmp;
         }
+
+        if (has_op_offset(args)) {
+            args_copy.offset = get_op_offset(args, error);
+            if (error->code != 0) goto error;
+        }
+
+        if (has_op_limit(args)) {
+            args_copy.limit = get_op_limit(args, error);
+            if (error->code != 0) goto error;
+        }
+
+        if (has_op_cursor(args)) {
+            const char *cursor = get_op_cursor(args, error);
+            if (error->code != 0) goto error;
+
+            char *tmp = copy_str(cursor, MAX_STR_LEN);
+            if (!tmp) {
+                set_baton_error(error, errno, "Failed to copy string '%s'",
+                                cursor);
+                goto error;
+            }
+
+            args_copy.cursor = tmp;
+        }
+
+        if (has_op_transfers(args)) {
+            args_copy.num_transfers = get_op_transfers(args, error);
+            if (error->code != 0) goto error;
+        }
     }
 
     if (str_equals(op, JSON_CHMOD_OP, MAX_STR_LEN)) {
@@ -240,12 +812,16 @@ json_t *baton_json_dispatch_op(rodsEnv *env, rcComm_t *conn, json_t *envelope,
         goto error;
     }
 
-    if (args_copy.path) free(args_copy.path);
+    if (args_copy.path)   free(args_copy.path);
+    if (args_copy.cursor) free(args_copy.cursor);
+    finish_timing(envelope, stats, previous_stats);
 
     return result;
 
 error:
-    if (args_copy.path) free(args_copy.path);
+    if (args_copy.path)   free(args_copy.path);
+    if (args_copy.cursor) free(args_copy.cursor);
+    finish_timing(envelope, stats, previous_stats);
 
     return result;
 }
@@ -261,7 +837,26 @@ json_t *baton_json_list_op(rodsEnv *env, rcComm_t *conn, json_t *target,
     resolve_rods_path(conn, env, &rods_path, path, args->flags, error);
     if (error->code != 0) goto error;
 
-    result = list_path(conn, &rods_path, args->flags, error);
+    // The entries of a tree are printed as they arrive, instead of
+    // the collection
+    option_flags tree_flags = RECURSIVE | PRINT_CONTENTS | STREAM_RESULTS;
+    if ((args->flags & tree_flags) == tree_flags &&
+        rods_path.objType == COLL_OBJ_T) {
+        list_collection_tree_stream(conn, &rods_path, args->flags,
+                                    print_json_results, args, error);
+    }
+    // Large collections may be listed a page at a time
+    else if ((args->flags & PRINT_CONTENTS) &&
+             rods_path.objType == COLL_OBJ_T &&
+             (args->limit > 0 || args->offset > 0 || args->cursor)) {
+        size_t limit = args->limit > 0 ? args->limit : LIST_DEFAULT_LIMIT;
+        result = list_collection_page(conn, &rods_path, args->flags,
+                                      args->offset, limit, args->cursor,
+                                      error);
+    }
+    else {
+        result = list_path(conn, &rods_path, args->flags, error);
+    }
     if (error->code != 0) goto error;
 
     if (rods_path.rodsObjStat) free(rods_path.rodsObjStat);
@@ -277,38 +872,39 @@ error:
 
 json_t *baton_json_chmod_op(rodsEnv *env, rcComm_t *conn, json_t *target,
                             operation_args_t *args, baton_error_t *error) {
-    json_t *result = NULL;
+    json_t *result  = NULL;
+    json_t *targets = NULL;
 
-    char *path = json_to_path(target, error);
-    if (error->code != 0) goto error;
+    init_baton_error(error);
 
-    json_t *perms = json_object_get(target, JSON_ACCESS_KEY);
-    if (!json_is_array(perms)) {
-        set_baton_error(error, -1, "Permissions data for %s is not in "
-                        "a JSON array", path);
-        goto error;
+    // An array of targets is applied in bulk and reported; a single
+    // target is echoed, as it always has been
+    if (json_is_array(target)) {
+        targets = json_incref(target);
+    }
+    else {
+        targets = json_pack("[O]", target);
+        if (!targets) {
+            set_baton_error(error, -1, "Failed to pack the permissions "
+                            "target");
+            goto error;
+        }
     }
 
-    rodsPath_t rods_path;
-    resolve_rods_path(conn, env, &rods_path, path, args->flags, error);
-    if (error->code != 0) goto error;
-
-    recursive_op recurse = (args->flags & RECURSIVE) ? RECURSE : NO_RECURSE;
-
-    for (size_t i = 0; i < json_array_size(perms); i++) {
-        json_t *perm = json_array_get(perms, i);
-        modify_json_permissions(conn, &rods_path, recurse, perm, error);
+    result = apply_permissions(env, conn, targets, args->flags,
+                               args->num_transfers, error);
 
-        if (error->code != 0) goto error;
+    if (!json_is_array(target) && result) {
+        json_decref(result);
+        result = NULL;
     }
 
-    if (rods_path.rodsObjStat) free(rods_path.rodsObjStat);
-    if (path) free(path);
+    json_decref(targets);
 
     return result;
 
 error:
-    if (path) free(path);
+    if (targets) json_decref(targets);
 
     return result;
 }
@@ -351,9 +947,39 @@ json_t *baton_json_metaquery_op(rodsEnv *env, rcComm_t *conn, json_t *target,
     }
 
     char *zone_name = args->zone_name;
-    logmsg(DEBUG, "Metadata query in zone '%s'", zone_name);
 
-    result = search_metadata(conn, target, zone_name, args->flags, error);
+    // A list of zones, or all zones, are searched concurrently
+    int federated = (args->flags & SEARCH_ALL_ZONES) ||
+        (zone_name && strstr(zone_name, ZONE_LIST_SEPARATOR));
+
+    if (federated) {
+        const char *zone_names =
+            (args->flags & SEARCH_ALL_ZONES) ? NULL : zone_name;
+        logmsg(DEBUG, "Metadata query in zones '%s'",
+               zone_names ? zone_names : "<all>");
+
+        if (args->flags & STREAM_RESULTS) {
+            search_metadata_zones_stream(conn, target, zone_names,
+                                         args->flags, print_json_results,
+                                         args, error);
+        }
+        else {
+            result = search_metadata_zones(conn, target, zone_names,
+                                           args->flags, error);
+        }
+    }
+    else {
+        logmsg(DEBUG, "Metadata query in zone '%s'", zone_name);
+
+        if (args->flags & STREAM_RESULTS) {
+            search_metadata_stream(conn, target, zone_name, args->flags,
+                                   print_json_results, args, error);
+        }
+        else {
+            result = search_metadata(conn, target, zone_name, args->flags,
+                                     error);
+        }
+    }
     if (error->code != 0) goto error;
 
     return result;
@@ -393,11 +1019,18 @@ json_t *baton_json_metamod_op(rodsEnv *env, rcComm_t *conn, json_t *target,
         goto error;
     }
 
-    for (size_t i = 0; i < json_array_size(avus); i++) {
-        json_t *avu = json_array_get(avus, i);
-        modify_json_metadata(conn, &rods_path, operation, avu, error);
-        if (error->code != 0) goto error;
+    // Repeated AVUs are sent once
+    json_t *delta = avu_difference(avus, NULL, error);
+    if (error->code != 0) goto error;
+
+    if (operation == META_ADD) {
+        apply_json_metadata(conn, &rods_path, NULL, delta, error);
     }
+    else {
+        apply_json_metadata(conn, &rods_path, delta, NULL, error);
+    }
+    json_decref(delta);
+    if (error->code != 0) goto error;
 
     if (rods_path.rodsObjStat) free(rods_path.rodsObjStat);
     if (path) free(path);
@@ -424,19 +1057,49 @@ json_t *baton_json_get_op(rodsEnv *env, rcComm_t *conn, json_t *target,
     size_t bsize = args->buffer_size;
     logmsg(DEBUG, "Using a 'get' buffer size of %zu bytes", bsize);
 
-    if (args->flags & SAVE_FILES) {
+    if ((args->flags & RECURSIVE) && (args->flags & SAVE_FILES) &&
+        rods_path.objType == COLL_OBJ_T) {
+        if (!represents_directory(target)) {
+            set_baton_error(error, CAT_INVALID_ARGUMENT,
+                            "Failed to get collection '%s' recursively: "
+                            "no local directory was given", path);
+            goto error;
+        }
+
+        const char *dir = get_directory_value(target, error);
+        if (error->code != 0) goto error;
+
+        result = get_tree(conn, &rods_path, dir, args->flags, bsize,
+                          args->num_transfers, error);
+        if (error->code != 0) goto error;
+    }
+    else if (args->flags & SAVE_FILES) {
         char *file = NULL;
         file = json_to_local_path(target, error);
         if (error->code != 0) goto error;
 
-        get_data_obj_file(conn, &rods_path, file, bsize, error);
+        if ((args->flags & SYNC) &&
+            rods_path_unchanged(conn, &rods_path, file, error)) {
+            logmsg(NOTICE, "Skipping get of unchanged '%s' to '%s'",
+                   rods_path.outPath, file);
+        }
+        else if (error->code == 0) {
+            get_data_obj_file(conn, &rods_path, file, bsize, error);
+        }
         free(file);
         if (error->code != 0) goto error;
     }
     else if (args->flags & PRINT_RAW) {
+        // Raw content is written directly to stdout, so the JSON of
+        // earlier items still held for output must go first
+        flush_json_output();
         get_data_obj_stream(conn, &rods_path, stdout, bsize, error);
         if (error->code != 0) goto error;
     }
+    else if (args->flags & STREAM_RESULTS) {
+        stream_data_obj_json(conn, &rods_path, args->flags, bsize, error);
+        if (error->code != 0) goto error;
+    }
     else {
         result = ingest_data_obj(conn, &rods_path, args->flags, bsize, error);
         if (error->code != 0) goto error;
@@ -470,25 +1133,24 @@ json_t *baton_json_write_op(rodsEnv *env, rcComm_t *conn, json_t *target,
     size_t bsize = args->buffer_size;
     logmsg(DEBUG, "Using a 'write' buffer size of %zu bytes", bsize);
 
-    FILE *in = fopen(file, "r");
-    if (!in) {
-        set_baton_error(error, errno,
-                        "Failed to open '%s' for reading: error %d %s",
-                        file, errno, strerror(errno));
-        goto error;
-    }
+    if (args->flags & SYNC) {
+        int unchanged = rods_path_unchanged(conn, &rods_path, file, error);
+        if (error->code != 0) goto error;
 
-    write_data_obj(conn, in, &rods_path, bsize, error);
-    int status = fclose(in);
+        if (unchanged) {
+            logmsg(NOTICE, "Skipping write of unchanged '%s' to '%s'",
+                   file, rods_path.outPath);
+            free(file);
+            if (path) free(path);
 
-    if (error->code != 0) goto error;
-    if (status != 0) {
-        set_baton_error(error, errno,
-                        "Failed to close '%s': error %d %s",
-                        file, errno, strerror(errno));
-        goto error;
+            return result;
+        }
     }
 
+    write_data_obj_file(conn, file, &rods_path, bsize, error);
+    free(file);
+    if (error->code != 0) goto error;
+
     if (path) free(path);
 
     return result;
@@ -510,9 +1172,36 @@ json_t *baton_json_put_op(rodsEnv *env, rcComm_t *conn, json_t *target,
     resolve_rods_path(conn, env, &rods_path, path, args->flags, error);
     if (error->code != 0) goto error;
 
+    if ((args->flags & RECURSIVE) && represents_directory(target)) {
+        const char *dir = get_directory_value(target, error);
+        if (error->code != 0) goto error;
+
+        result = put_tree(conn, dir, rods_path.outPath, args->flags,
+                          args->num_transfers, error);
+        if (error->code != 0) goto error;
+
+        if (path) free(path);
+
+        return result;
+    }
+
     char *file = json_to_local_path(target, error);
     if (error->code != 0) goto error;
 
+    if (args->flags & SYNC) {
+        int unchanged = rods_path_unchanged(conn, &rods_path, file, error);
+        if (error->code != 0) goto error;
+
+        if (unchanged) {
+            logmsg(NOTICE, "Skipping put of unchanged '%s' to '%s'",
+                   file, rods_path.outPath);
+            free(file);
+            if (path) free(path);
+
+            return result;
+        }
+    }
+
     int status = put_data_obj(conn, file, &rods_path, args->flags, error);
 
     if (error->code != 0) goto error;
@@ -86,7 +86,19 @@ typedef enum {
     /** Force an operation */
     FORCE              = 1 << 18,
     /** Avoid any operations that contact servers other than rodshost */
-    SINGLE_SERVER      = 1 << 19
+    SINGLE_SERVER      = 1 << 19,
+    /** Print results in the same order as their inputs */
+    PRESERVE_ORDER     = 1 << 20,
+    /** Print query results as they arrive, one per line */
+    STREAM_RESULTS     = 1 << 21,
+    /** Adapt the query page size to query performance */
+    ADAPTIVE_PAGE_SIZE = 1 << 22,
+    /** Search the local zone and all the zones federated with it */
+    SEARCH_ALL_ZONES   = 1 << 23,
+    /** Skip transfers where the size and MD5 are already the same */
+    SYNC               = 1 << 24,
+    /** Print data object content encoded as base64 */
+    PRINT_BASE64       = 1 << 25
 } option_flags;
 
 typedef struct operation_args {
@@ -94,6 +106,19 @@ typedef struct operation_args {
     size_t buffer_size;
     char *zone_name;
     char *path;
+    /** The number of concurrent workers, each with its own connection */
+    size_t num_workers;
+    /** The number of query result rows per page, 0 for the default */
+    size_t page_size;
+    /** The number of collection entries to skip when listing a page */
+    size_t offset;
+    /** The maximum number of collection entries in a page, 0 for all */
+    size_t limit;
+    /** A cursor from which to continue listing a collection */
+    char *cursor;
+    /** The number of files to transfer at once in a tree, 0 for the
+        default */
+    size_t num_transfers;
 } operation_args_t;
 
 /**
@@ -118,7 +143,11 @@ typedef json_t *(*baton_json_op) (rodsEnv *env,
 
 /**
  * Process a stream of baton JSON documents by executing the specifed
- * function on each one.
+ * function on each one. If args->num_workers is greater than 1, the
+ * documents are processed concurrently by that number of threads,
+ * each with its own iRODS connection. Results are then printed as
+ * they complete, unless the PRESERVE_ORDER flag is set, in which case
+ * they are printed in input order.
  *
  * @param[in]  input        A file handle.
  * @param[fn]  fn           A function.
@@ -130,6 +159,46 @@ typedef json_t *(*baton_json_op) (rodsEnv *env,
  */
 int do_operation(FILE *input, baton_json_op fn, operation_args_t *args);
 
+/**
+ * Process a stream of baton JSON documents on an existing connection,
+ * writing each result to an output stream as soon as it is complete.
+ * The output is flushed whenever no more input is ready, so that a
+ * client may wait for a result before sending more. Processing stops
+ * at the end of the input, or if the output can no longer be written.
+ *
+ * @param[in]  input            The input stream.
+ * @param[in]  output           The output stream, which must not be
+ *                              stdout.
+ * @param[in]  env              A populated iRODS environment.
+ * @param[in,out] conn          An open iRODS connection. If a transfer
+ *                              is resumed on a new connection after
+ *                              this one fails, it is replaced by the
+ *                              new one.
+ * @param[in]  fn               A function.
+ * @param[in]  args             Function behaviour options.
+ * @param[out] connection_lost  Set to 1 if any document failed because
+ *                              the connection failed, 0 otherwise.
+ *
+ * @return The number of documents that failed.
+ */
+int do_operation_stream(FILE *input, FILE *output, rodsEnv *env,
+                        rcComm_t **conn, baton_json_op fn,
+                        operation_args_t *args, int *connection_lost);
+
+/**
+ * A query result callback which prints each result row to stdout as a
+ * separate JSON document, flushing after each page of results if the
+ * FLUSH flag is set.
+ *
+ * @param[in]     results    A JSON array of result rows.
+ * @param[in]     sink_data  A pointer to the operation_args_t in use.
+ * @param[in,out] error      An error report struct.
+ *
+ * @return 0 on success, error code on failure.
+ */
+int print_json_results(json_t *results, void *sink_data,
+                       baton_error_t *error);
+
 json_t *baton_json_dispatch_op(rodsEnv *env, rcComm_t *conn,
                                json_t *target, operation_args_t *args,
                                baton_error_t *error);
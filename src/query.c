@@ -27,9 +27,11 @@
 #include <errno.h>
 #include <libgen.h>
 #include <math.h>
+#include <pthread.h>
 #include <string.h>
 #include <sys/types.h>
 #include <regex.h>
+#include <time.h>
 
 #include <jansson.h>
 
@@ -37,6 +39,8 @@
 #include "error.h"
 #include "log.h"
 #include "query.h"
+#include "specific_cache.h"
+#include "stats.h"
 #include "utilities.h"
 
 void log_rods_errstack(log_level level, rError_t *error) {
@@ -47,6 +51,83 @@ void log_rods_errstack(log_level level, rError_t *error) {
     }
 }
 
+// The page size settings are per-thread so that concurrent operations
+// (e.g. in baton-do worker threads) may each use their own
+static __thread size_t query_page_size = SEARCH_MAX_ROWS;
+static __thread int query_page_adaptive = 0;
+
+void set_query_page_size(size_t page_size, int adaptive) {
+    if (page_size == 0) {
+        page_size = SEARCH_MAX_ROWS;
+    }
+    if (page_size > MAX_SQL_ROWS) {
+        logmsg(WARN, "Requested query page size of %zu rows exceeded "
+               "the maximum; using %d", page_size, MAX_SQL_ROWS);
+        page_size = MAX_SQL_ROWS;
+    }
+
+    query_page_size     = page_size;
+    query_page_adaptive = adaptive;
+}
+
+size_t get_query_page_size(void) {
+    return query_page_size;
+}
+
+int get_query_page_adaptive(void) {
+    return query_page_adaptive;
+}
+
+int adapt_query_page_size(int max_rows, int row_count, double elapsed) {
+    int page_size = max_rows;
+
+    if (!query_page_adaptive) return page_size;
+
+    if (row_count >= max_rows && elapsed < ADAPTIVE_PAGE_FAST_SECS) {
+        page_size = max_rows * 2;
+        if (page_size > MAX_SQL_ROWS) page_size = MAX_SQL_ROWS;
+    }
+    else if (elapsed > ADAPTIVE_PAGE_SLOW_SECS) {
+        page_size = max_rows / 2;
+        if (page_size < (int) query_page_size) page_size = query_page_size;
+    }
+
+    if (page_size != max_rows) {
+        logmsg(DEBUG, "Adapted query page size from %d to %d rows "
+               "after %d rows in %.3f seconds", max_rows, page_size,
+               row_count, elapsed);
+    }
+
+    return page_size;
+}
+
+int backoff_query_page_size(int max_rows) {
+    if (!query_page_adaptive || max_rows <= 1) return 0;
+
+    return max_rows / 2;
+}
+
+int is_page_size_error(int status) {
+    // An iRODS error code may have an errno added to it
+    switch ((status / 1000) * 1000) {
+        case SYS_MALLOC_ERR:
+        case SYS_REQUESTED_BUF_TOO_LARGE:
+        case SYS_PACKSTRUCT_INPUT_ERR:
+        case USER_PACKSTRUCT_INPUT_ERR:
+            return 1;
+
+        default:
+            return 0;
+    }
+}
+
+double query_clock(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
 genQueryInp_t *make_query_input(size_t max_rows, size_t num_columns,
                                 const int columns[]) {
     genQueryInp_t *query_in = calloc(1, sizeof (genQueryInp_t));
@@ -136,6 +217,28 @@ void free_query_output(genQueryOut_t *query_out) {
     free(query_out);
 }
 
+// Format a condition expression into a buffer, growing it if required
+static int format_query_cond(char **expr, size_t *size, const char *operator,
+                             const char *value) {
+    size_t expr_size = strlen(value) + strlen(operator) + 3 + 1;
+
+    if (expr_size > *size) {
+        char *tmp = realloc(*expr, expr_size);
+        if (!tmp) return -1;
+
+        *expr = tmp;
+        *size = expr_size;
+    }
+
+    if (str_equals_ignore_case(operator, SEARCH_OP_IN, MAX_STR_LEN)) {
+        snprintf(*expr, *size, "%s %s", operator, value);
+    } else {
+        snprintf(*expr, *size, "%s '%s'", operator, value);
+    }
+
+    return 0;
+}
+
 genQueryInp_t *add_query_conds(genQueryInp_t *query_in, size_t num_conds,
                                const query_cond_t conds[]) {
     for (size_t i = 0; i < num_conds; i++) {
@@ -146,15 +249,11 @@ genQueryInp_t *add_query_conds(genQueryInp_t *query_in, size_t num_conds,
         logmsg(DEBUG, "Adding condition %d of %d: %s %s %s",
                1, num_conds, column, operator, value);
 
-        int expr_size = strlen(value) + strlen(operator) + 3 + 1;
-        char *expr = calloc(expr_size, sizeof (char));
-        if (!expr) goto error;
-
-        if (str_equals_ignore_case(operator, SEARCH_OP_IN, MAX_STR_LEN)) {
-            snprintf(expr, expr_size, "%s %s", operator, value);
-        } else {
-            snprintf(expr, expr_size, "%s '%s'", operator, value);
-	}
+        char *expr = NULL;
+        size_t expr_size = 0;
+        if (format_query_cond(&expr, &expr_size, operator, value) != 0) {
+            goto error;
+        }
 
         logmsg(DEBUG, "Made string %d of %d: op: %s value: %s, len %d, "
                "total len %d [%s]",
@@ -175,6 +274,234 @@ error:
     return NULL;
 }
 
+struct prepared_query {
+    /** The shape of the query */
+    const query_shape_t *shape;
+    /** The query, pointing into the arrays below */
+    genQueryInp_t query_in;
+    int select_inx[MAX_NUM_COLUMNS];
+    int select_value[MAX_NUM_COLUMNS];
+    int cond_inx[MAX_NUM_CONDITIONS];
+    char *cond_value[MAX_NUM_CONDITIONS];
+    /** The allocated sizes of the condition values */
+    size_t cond_size[MAX_NUM_CONDITIONS];
+    /** The zone hint, if any */
+    char *zone_keyword[1];
+    char *zone_value[1];
+    size_t zone_size;
+};
+
+typedef struct prepared_query_cache {
+    size_t num_queries;
+    prepared_query_t *queries[PREPARED_QUERY_CACHE_SIZE];
+} prepared_query_cache_t;
+
+static pthread_key_t prepared_query_key;
+static pthread_once_t prepared_query_once = PTHREAD_ONCE_INIT;
+
+prepared_query_t *make_prepared_query(const query_shape_t *shape,
+                                      baton_error_t *error) {
+    init_baton_error(error);
+
+    size_t num_columns = shape->format.num_columns;
+    size_t num_conds   = shape->num_conds + (shape->format.latest ? 1 : 0);
+
+    if (num_columns > MAX_NUM_COLUMNS || num_conds > MAX_NUM_CONDITIONS) {
+        set_baton_error(error, -1, "Invalid query shape having %zu columns "
+                        "and %zu conditions", num_columns, num_conds);
+        goto error;
+    }
+
+    prepared_query_t *query = calloc(1, sizeof (prepared_query_t));
+    if (!query) {
+        set_baton_error(error, errno, "Failed to allocate memory: "
+                        "error %d %s", errno, strerror(errno));
+        goto error;
+    }
+
+    query->shape = shape;
+
+    for (size_t i = 0; i < num_columns; i++) {
+        query->select_inx[i] = shape->format.columns[i];
+    }
+
+    genQueryInp_t *query_in = &query->query_in;
+    query_in->selectInp.inx   = query->select_inx;
+    query_in->selectInp.value = query->select_value;
+    query_in->selectInp.len   = num_columns;
+    query_in->sqlCondInp.inx   = query->cond_inx;
+    query_in->sqlCondInp.value = query->cond_value;
+    query_in->sqlCondInp.len   = num_conds;
+
+    // Values that are fixed by the shape are formatted once
+    for (size_t i = 0; i < shape->num_conds; i++) {
+        query->cond_inx[i] = shape->conds[i].column;
+
+        const char *value = shape->conds[i].value;
+        if (value && format_query_cond(&query->cond_value[i],
+                                       &query->cond_size[i],
+                                       shape->conds[i].operator, value) != 0) {
+            set_baton_error(error, errno, "Failed to allocate memory: "
+                            "error %d %s", errno, strerror(errno));
+            free_prepared_query(query);
+            goto error;
+        }
+    }
+
+    if (shape->format.latest) {
+        char value[16];
+        snprintf(value, sizeof value, "%d", NEWLY_CREATED_COPY);
+
+        size_t i = shape->num_conds;
+        query->cond_inx[i] = COL_D_REPL_STATUS;
+        if (format_query_cond(&query->cond_value[i], &query->cond_size[i],
+                              SEARCH_OP_EQUALS, value) != 0) {
+            set_baton_error(error, errno, "Failed to allocate memory: "
+                            "error %d %s", errno, strerror(errno));
+            free_prepared_query(query);
+            goto error;
+        }
+    }
+
+    logmsg(DEBUG, "Prepared a query to select %zu columns with %zu "
+           "conditions", num_columns, num_conds);
+
+    return query;
+
+error:
+    return NULL;
+}
+
+static void free_prepared_query_cache(void *data) {
+    prepared_query_cache_t *cache = data;
+
+    for (size_t i = 0; i < cache->num_queries; i++) {
+        free_prepared_query(cache->queries[i]);
+    }
+
+    free(cache);
+}
+
+static void make_prepared_query_key(void) {
+    pthread_key_create(&prepared_query_key, free_prepared_query_cache);
+}
+
+prepared_query_t *get_prepared_query(const query_shape_t *shape,
+                                     baton_error_t *error) {
+    init_baton_error(error);
+
+    pthread_once(&prepared_query_once, make_prepared_query_key);
+
+    prepared_query_cache_t *cache = pthread_getspecific(prepared_query_key);
+    if (!cache) {
+        cache = calloc(1, sizeof (prepared_query_cache_t));
+        if (!cache) {
+            set_baton_error(error, errno, "Failed to allocate memory: "
+                            "error %d %s", errno, strerror(errno));
+            goto error;
+        }
+        pthread_setspecific(prepared_query_key, cache);
+    }
+
+    for (size_t i = 0; i < cache->num_queries; i++) {
+        if (cache->queries[i]->shape == shape) return cache->queries[i];
+    }
+
+    prepared_query_t *query = make_prepared_query(shape, error);
+    if (error->code != 0) goto error;
+
+    // When the cache is full, the oldest query makes way
+    if (cache->num_queries == PREPARED_QUERY_CACHE_SIZE) {
+        free_prepared_query(cache->queries[0]);
+        memmove(cache->queries, cache->queries + 1,
+                (PREPARED_QUERY_CACHE_SIZE - 1) * sizeof (prepared_query_t *));
+        cache->num_queries--;
+    }
+
+    cache->queries[cache->num_queries++] = query;
+
+    return query;
+
+error:
+    return NULL;
+}
+
+genQueryInp_t *bind_prepared_query(prepared_query_t *query, size_t max_rows,
+                                   const char *values[],
+                                   const char *zone_hint,
+                                   baton_error_t *error) {
+    const query_shape_t *shape = query->shape;
+    genQueryInp_t *query_in = &query->query_in;
+
+    init_baton_error(error);
+
+    size_t num_bound = 0;
+    for (size_t i = 0; i < shape->num_conds; i++) {
+        if (shape->conds[i].value) continue;
+
+        const char *value = values[num_bound++];
+        if (!value) {
+            set_baton_error(error, -1, "Failed to bind query condition %zu: "
+                            "no value was supplied", i);
+            goto error;
+        }
+
+        if (format_query_cond(&query->cond_value[i], &query->cond_size[i],
+                              shape->conds[i].operator, value) != 0) {
+            set_baton_error(error, errno, "Failed to allocate memory: "
+                            "error %d %s", errno, strerror(errno));
+            goto error;
+        }
+
+        logmsg(DEBUG, "Bound condition %zu: %s", i, query->cond_value[i]);
+    }
+
+    query_in->condInput.len = 0;
+    if (zone_hint) {
+        size_t size = strlen(zone_hint) + 1;
+        if (size > query->zone_size) {
+            char *tmp = realloc(query->zone_value[0], size);
+            if (!tmp) {
+                set_baton_error(error, errno, "Failed to allocate memory: "
+                                "error %d %s", errno, strerror(errno));
+                goto error;
+            }
+
+            query->zone_value[0] = tmp;
+            query->zone_size     = size;
+        }
+        snprintf(query->zone_value[0], size, "%s", zone_hint);
+
+        query->zone_keyword[0] = ZONE_KW;
+        query_in->condInput.keyWord = query->zone_keyword;
+        query_in->condInput.value   = query->zone_value;
+        query_in->condInput.len     = 1;
+    }
+
+    query_in->maxRows     = max_rows;
+    query_in->continueInx = 0;
+
+    return query_in;
+
+error:
+    return NULL;
+}
+
+const query_shape_t *prepared_query_shape(const prepared_query_t *query) {
+    return query->shape;
+}
+
+void free_prepared_query(prepared_query_t *query) {
+    assert(query);
+
+    for (size_t i = 0; i < MAX_NUM_CONDITIONS; i++) {
+        if (query->cond_value[i]) free(query->cond_value[i]);
+    }
+    if (query->zone_value[0]) free(query->zone_value[0]);
+
+    free(query);
+}
+
 genQueryInp_t *prepare_obj_list(genQueryInp_t *query_in,
                                 rodsPath_t *rods_path,
                                 const char *attr_name) {
@@ -247,6 +574,77 @@ genQueryInp_t *prepare_col_list(genQueryInp_t *query_in,
     return query_in;
 }
 
+char *make_in_op_list(const char *values[], size_t num_values) {
+    size_t len = 3; // Parentheses and NUL
+    for (size_t i = 0; i < num_values; i++) {
+        len += strlen(values[i]) + 4; // Quotes, comma and space
+    }
+
+    char *list = calloc(len, sizeof (char));
+    if (!list) goto error;
+
+    char *end = list;
+    end += snprintf(end, len - (end - list), "(");
+    for (size_t i = 0; i < num_values; i++) {
+        end += snprintf(end, len - (end - list), "%s'%s'",
+                        i == 0 ? "" : ", ", values[i]);
+    }
+    snprintf(end, len - (end - list), ")");
+
+    return list;
+
+error:
+    logmsg(ERROR, "Failed to allocate memory: error %d %s",
+           errno, strerror(errno));
+
+    return NULL;
+}
+
+genQueryInp_t *prepare_obj_avu_bulk_list(genQueryInp_t *query_in,
+                                         const char *coll_name,
+                                         const char *data_names) {
+    query_cond_t cn = { .column   = COL_COLL_NAME,
+                        .operator = SEARCH_OP_EQUALS,
+                        .value    = coll_name };
+    query_cond_t dn = { .column   = COL_DATA_NAME,
+                        .operator = SEARCH_OP_IN,
+                        .value    = data_names };
+
+    add_query_conds(query_in, 2, (query_cond_t []) { cn, dn });
+
+    return limit_to_newest_repl(query_in);
+}
+
+genQueryInp_t *prepare_col_avu_bulk_list(genQueryInp_t *query_in,
+                                         const char *coll_names) {
+    query_cond_t cn = { .column   = COL_COLL_NAME,
+                        .operator = SEARCH_OP_IN,
+                        .value    = coll_names };
+
+    return add_query_conds(query_in, 1, (query_cond_t []) { cn });
+}
+
+genQueryInp_t *prepare_obj_attr_list(genQueryInp_t *query_in,
+                                     const char *coll_name,
+                                     const char *data_name) {
+    query_cond_t cn = { .column   = COL_COLL_NAME,
+                        .operator = SEARCH_OP_EQUALS,
+                        .value    = coll_name };
+    query_cond_t dn = { .column   = COL_DATA_NAME,
+                        .operator = SEARCH_OP_EQUALS,
+                        .value    = data_name };
+
+    size_t num_conds = 1;
+    if (data_name) {
+        add_query_conds(query_in, num_conds + 1, (query_cond_t []) { cn, dn });
+    }
+    else {
+        add_query_conds(query_in, num_conds, (query_cond_t []) { cn });
+    }
+
+    return query_in;
+}
+
 genQueryInp_t *prepare_obj_acl_list(genQueryInp_t *query_in,
                                     rodsPath_t *rods_path) {
     char *data_id = rods_path->dataId;
@@ -501,7 +899,7 @@ specificQueryInp_t *prepare_specific_query(specificQueryInp_t *squery_in,
     size_t index;
     json_t *value;
 
-    squery_in->maxRows = SEARCH_MAX_ROWS;
+    squery_in->maxRows = get_query_page_size();
     squery_in->continueInx = 0;
     squery_in->sql = (char *)sql;
 
@@ -718,17 +1116,23 @@ error:
     return NULL;
 }
 
-const char *irods_get_sql_for_specific_alias(rcComm_t *conn,
-                                             const char *alias) {
-    const char *sql;
+char *irods_get_sql_for_specific_alias(rcComm_t *conn, const char *alias) {
+    char *sql;
 
-    specificQueryInp_t *sql_alias_squery_in;
+    specificQueryInp_t *sql_alias_squery_in = NULL;
     genQueryOut_t *query_out = NULL;
 
     const char *err_name;
     char *err_subname;
     int status;
 
+    sql = get_cached_specific_sql(conn, alias);
+    if (sql) {
+        logmsg(TRACE, "Found cached SQL for specific alias '%s': '%s'",
+               alias, sql);
+        return sql;
+    }
+
     sql_alias_squery_in = calloc(1, sizeof (specificQueryInp_t));
     if (!sql_alias_squery_in) goto error;
 
@@ -737,7 +1141,9 @@ const char *irods_get_sql_for_specific_alias(rcComm_t *conn,
     sql_alias_squery_in->sql = "findQueryByAlias";
     sql_alias_squery_in->args[0] = (char *)alias;
 
+    double rpc = rpc_start();
     status = rcSpecificQuery(conn, sql_alias_squery_in, &query_out);
+    rpc_end(RPC_SPECIFIC_QUERY, rpc, 0);
     if (status == 0) {
       logmsg(DEBUG, "Successfully fetched SQL for alias: '%s'", alias);
     }
@@ -774,12 +1180,22 @@ const char *irods_get_sql_for_specific_alias(rcComm_t *conn,
         goto error;
     }
 
-    sql = query_out->sqlResult[1].value;
+    sql = store_specific_sql(conn, alias, query_out->sqlResult[1].value);
+    if (!sql) goto error;
+
     logmsg(TRACE, "Found SQL for specific alias '%s': '%s'", alias, sql);
 
+    free(sql_alias_squery_in);
+    free_query_output(query_out);
+
     return sql;
+
 error:
     logmsg(ERROR, "Could not find SQL for specific alias: '%s'", alias);
+
+    if (sql_alias_squery_in) free(sql_alias_squery_in);
+    if (query_out)           free_query_output(query_out);
+
     return NULL;
 }
 
@@ -790,6 +1206,7 @@ query_format_in_t *prepare_specific_labels(rcComm_t *conn,
     char remsg[MAX_ERROR_MESSAGE_LEN];
 
     const char *sql;
+    char *alias_sql = NULL;
     const char *select_s_re_str ="^select[[:space:]]";
     query_format_in_t *format;
 
@@ -809,10 +1226,11 @@ query_format_in_t *prepare_specific_labels(rcComm_t *conn,
     } else if (reti == REG_NOMATCH) {
         // no SELECT found in sql_or_alias we must have an alias (or a
         // bad query, but try to look up the alias anyway)
-        sql = irods_get_sql_for_specific_alias(conn, sql_or_alias);
-        if (sql == NULL) {
+        alias_sql = irods_get_sql_for_specific_alias(conn, sql_or_alias);
+        if (alias_sql == NULL) {
             goto error;
         }
+        sql = alias_sql;
         logmsg(DEBUG, "Got SQL for specific alias '%s': '%s'",
                sql_or_alias, sql);
     } else {
@@ -822,7 +1240,16 @@ query_format_in_t *prepare_specific_labels(rcComm_t *conn,
     regfree(&select_s_re);
     assert(sql);
 
-    format = make_query_format_from_sql(sql);
+    format = get_cached_specific_format(sql);
+    if (format) {
+        logmsg(TRACE, "Found cached labels for specific query: '%s'", sql);
+    }
+    else {
+        format = make_query_format_from_sql(sql);
+        if (format) store_specific_format(sql, format);
+    }
+
+    if (alias_sql) free(alias_sql);
 
     return format;
 
@@ -836,7 +1263,7 @@ void free_specific_labels(query_format_in_t *format) {
     unsigned int i;
     assert(format);
 
-    for (i=0; i<(format->num_columns-1); i++) {
+    for (i = 0; i < format->num_columns; i++) {
       free((void *)(format->labels[i]));
     }
     free(format);
@@ -27,6 +27,7 @@
 #include <rodsClient.h>
 
 #include "config.h"
+#include "error.h"
 #include "log.h"
 #include "utilities.h"
 
@@ -35,6 +36,21 @@
 
 #define SEARCH_MAX_ROWS      10
 
+/** Pages fetched faster than this (in seconds) may grow in adaptive mode */
+#define ADAPTIVE_PAGE_FAST_SECS 0.5
+/** Pages fetched slower than this (in seconds) shrink in adaptive mode */
+#define ADAPTIVE_PAGE_SLOW_SECS 2.0
+
+/** The maximum number of rows per page for bulk queries */
+#define BULK_MAX_ROWS       256
+/** The maximum number of paths to match in one bulk query */
+#define BULK_MAX_PATHS       64
+/** The maximum length of a path list in one bulk query */
+#define BULK_MAX_PATHS_LEN 2048
+
+/** The number of prepared queries each thread keeps for reuse */
+#define PREPARED_QUERY_CACHE_SIZE 32
+
 #define SEARCH_OP_EQUALS   "="
 #define SEARCH_OP_LIKE     "like"
 #define SEARCH_OP_NOT_LIKE "not like"
@@ -76,6 +92,29 @@ typedef struct query_cond {
     const char *value;
 } query_cond_t;
 
+/**
+ *  @struct query_shape
+ *  @brief The fixed parts of a query that is run many times with
+ *  different values, from which a prepared query is made.
+ */
+typedef struct query_shape {
+    /** The ICAT columns to return, their labels and whether to return
+        the latest replicate only */
+    query_format_in_t format;
+    /** The number of conditions */
+    size_t num_conds;
+    /** The conditions. Those having a NULL value are bound to a new
+        value each time the query is run. */
+    query_cond_t conds[MAX_NUM_CONDITIONS];
+} query_shape_t;
+
+/**
+ *  @struct prepared_query
+ *  @brief A query whose selected columns and fixed conditions are
+ *  built once and whose memory is reused each time it is run.
+ */
+typedef struct prepared_query prepared_query_t;
+
 typedef genQueryInp_t *(*prepare_avu_search_cb) (genQueryInp_t *query_in,
                                                  const char *attr_name,
                                                  const char *attr_value,
@@ -105,6 +144,78 @@ typedef query_format_in_t *(*prepare_specific_labels_cb) (rcComm_t *conn,
  */
 void log_rods_errstack(log_level level, rError_t *error);
 
+/**
+ * Set the number of rows per page to request in queries made by the
+ * calling thread. In adaptive mode, this is the initial page size,
+ * which grows while full pages arrive quickly, up to MAX_SQL_ROWS, and
+ * shrinks again when pages are slow or the server reports an error.
+ *
+ * @param[in] page_size    The number of rows per page. 0 means the default,
+ *                         SEARCH_MAX_ROWS. Values greater than MAX_SQL_ROWS
+ *                         are reduced to MAX_SQL_ROWS.
+ * @param[in] adaptive     Adapt the page size to query performance if true.
+ */
+void set_query_page_size(size_t page_size, int adaptive);
+
+/**
+ * Return the number of rows per page to request in a new query made by
+ * the calling thread.
+ *
+ * @return The page size.
+ */
+size_t get_query_page_size(void);
+
+/**
+ * Return true if the page size of queries made by the calling thread
+ * adapts to query performance.
+ *
+ * @return True if adaptive.
+ */
+int get_query_page_adaptive(void);
+
+/**
+ * Return the page size to request for the next page of a query,
+ * given the previous one. In non-adaptive mode, this is unchanged.
+ *
+ * @param[in] max_rows     The page size of the previous request.
+ * @param[in] row_count    The number of rows returned by that request.
+ * @param[in] elapsed      The time taken by that request, in seconds.
+ *
+ * @return The page size.
+ */
+int adapt_query_page_size(int max_rows, int row_count, double elapsed);
+
+/**
+ * Return a reduced page size with which to retry a query that failed,
+ * or 0 if the query should not be retried. Queries are only retried in
+ * adaptive mode.
+ *
+ * @param[in] max_rows     The page size of the failed request.
+ *
+ * @return The page size, or 0.
+ */
+int backoff_query_page_size(int max_rows);
+
+/**
+ * Return true if an iRODS error code from a query may have been caused
+ * by the size of its pages, so that it is worth retrying with smaller
+ * ones. Connection, catalog and permission errors are not, because a
+ * retry would fail in the same way.
+ *
+ * @param[in] status  An iRODS error code.
+ *
+ * @return 1 if the error may be caused by the page size, 0 otherwise.
+ */
+int is_page_size_error(int status);
+
+/**
+ * Return the time from a monotonic clock, in seconds, for timing query
+ * pages.
+ *
+ * @return The time in seconds.
+ */
+double query_clock(void);
+
 /**
  * Allocate a new iRODS generic query (see rodsGenQuery.h).
  *
@@ -146,6 +257,69 @@ void free_query_output(genQueryOut_t *query_out);
 genQueryInp_t *add_query_conds(genQueryInp_t *query_in, size_t num_conds,
                                const query_cond_t conds[]);
 
+/**
+ * Make a prepared query of a given shape.
+ *
+ * @param[in]     shape      The query shape, which must remain valid for
+ *                           the life of the prepared query.
+ * @param[in,out] error      An error report struct.
+ *
+ * @return A new prepared query, which must be freed using
+ * @ref free_prepared_query.
+ */
+prepared_query_t *make_prepared_query(const query_shape_t *shape,
+                                      baton_error_t *error);
+
+/**
+ * Return the calling thread's prepared query of a given shape, making
+ * it on first use. The query is owned by the thread and freed when it
+ * exits.
+ *
+ * @param[in]     shape      The query shape, usually static, which
+ *                           identifies the query.
+ * @param[in,out] error      An error report struct.
+ *
+ * @return The prepared query.
+ */
+prepared_query_t *get_prepared_query(const query_shape_t *shape,
+                                     baton_error_t *error);
+
+/**
+ * Bind values to the conditions of a prepared query having NULL values
+ * in its shape, ready to run it from the start. The memory used by the
+ * values of the previous run is reused.
+ *
+ * @param[in]     query      A prepared query.
+ * @param[in]     max_rows   The number of rows per page.
+ * @param[in]     values     One value for each condition to bind, in the
+ *                           order of the conditions in the shape.
+ * @param[in]     zone_hint  A path in the zone to query. Optional.
+ * @param[in,out] error      An error report struct.
+ *
+ * @return The bound query, owned by the prepared query and valid until
+ * it is next bound.
+ */
+genQueryInp_t *bind_prepared_query(prepared_query_t *query, size_t max_rows,
+                                   const char *values[],
+                                   const char *zone_hint,
+                                   baton_error_t *error);
+
+/**
+ * Return the shape of a prepared query.
+ *
+ * @param[in] query          A prepared query.
+ *
+ * @return The shape.
+ */
+const query_shape_t *prepared_query_shape(const prepared_query_t *query);
+
+/**
+ * Free a prepared query made by @ref make_prepared_query.
+ *
+ * @param[in] query          A prepared query.
+ */
+void free_prepared_query(prepared_query_t *query);
+
 /**
  * Add a clause to a query to list AVUs on a data object, optionally
  * restricting results to a specific attribute.
@@ -174,6 +348,62 @@ genQueryInp_t *prepare_col_list(genQueryInp_t *query_in,
                                 rodsPath_t *rods_path,
                                 const char *attr_name);
 
+/**
+ * Make a parenthesised, comma-separated list of quoted values for use
+ * with the SEARCH_OP_IN operator e.g. ('a', 'b', 'c'). The values are
+ * not escaped, so must not contain single quotes.
+ *
+ * @param[in]  values      An array of strings.
+ * @param[in]  num_values  The number of strings.
+ *
+ * @return A new string which must be freed by the caller.
+ */
+char *make_in_op_list(const char *values[], size_t num_values);
+
+/**
+ * Add a clause to a query to list AVUs on several data objects in
+ * the same collection.
+ *
+ * @param[out] query_in      The query to update.
+ * @param[in]  coll_name     The collection containing the data objects.
+ * @param[in]  data_names    A list of data object names, as made by
+ *                           @ref make_in_op_list.
+ *
+ * @return The modified query.
+ */
+genQueryInp_t *prepare_obj_avu_bulk_list(genQueryInp_t *query_in,
+                                         const char *coll_name,
+                                         const char *data_names);
+
+/**
+ * Add a clause to a query to list AVUs on several collections.
+ *
+ * @param[out] query_in      The query to update.
+ * @param[in]  coll_names    A list of collection paths, as made by
+ *                           @ref make_in_op_list.
+ *
+ * @return The modified query.
+ */
+genQueryInp_t *prepare_col_avu_bulk_list(genQueryInp_t *query_in,
+                                         const char *coll_names);
+
+/**
+ * Add a clause to a query to list the catalog attributes (replicates,
+ * checksums, timestamps and sizes) of the data objects in a
+ * collection, or of a single data object.
+ *
+ * @param[out] query_in      The query to update.
+ * @param[in]  coll_name     The collection containing the data objects.
+ * @param[in]  data_name     A data object name. Optional, if NULL, all
+ *                           the data objects in the collection are
+ *                           listed.
+ *
+ * @return The modified query.
+ */
+genQueryInp_t *prepare_obj_attr_list(genQueryInp_t *query_in,
+                                     const char *coll_name,
+                                     const char *data_name);
+
 genQueryInp_t *prepare_obj_acl_list(genQueryInp_t *query_in,
                                     rodsPath_t *rods_path);
 
@@ -243,8 +473,15 @@ specificQueryInp_t *prepare_specific_query(specificQueryInp_t *squery_in,
 
 query_format_in_t *make_query_format_from_sql(const char *sql);
 
-const char *irods_get_sql_for_specific_alias(rcComm_t *conn,
-                                             const char *alias);
+/**
+ * Return the SQL of a specific query alias, from the cache if possible.
+ *
+ * @param[in] conn   An open iRODS connection.
+ * @param[in] alias  A specific query alias.
+ *
+ * @return The SQL, which must be freed by the caller, or NULL on error.
+ */
+char *irods_get_sql_for_specific_alias(rcComm_t *conn, const char *alias);
 
 query_format_in_t *prepare_specific_labels(rcComm_t *conn, const char *sql);
 
@@ -20,13 +20,69 @@
  */
 
 #include <assert.h>
+#include <pthread.h>
 
 #include "config.h"
+#include "arena.h"
 #include "compat_checksum.h"
+#include "local_io.h"
+#include "query.h"
 #include "read.h"
+#include "replica.h"
+#include "stat_cache.h"
+#include "stats.h"
+#include "sync.h"
+#include "transfer.h"
+#include "utf8.h"
+
+#if IRODS_VERSION_INTEGER && IRODS_VERSION_INTEGER >= 4002009
+#include <get_file_descriptor_info.h>
+#endif
+
+static checksum_validation validation_policy = VALIDATE_ALWAYS;
+
+// Return the catalog MD5 checksum obtained when the path was resolved,
+// or NULL if there was none, or it was not an MD5
+static const char *catalog_md5(rodsPath_t *rods_path) {
+    const char *checksum = rods_path->chksum;
+    if (rods_path->rodsObjStat) {
+        checksum = rods_path->rodsObjStat->chksum;
+    }
+
+    return is_md5_checksum(checksum) ? checksum : NULL;
+}
+
+checksum_validation set_checksum_validation(checksum_validation policy) {
+    checksum_validation previous = validation_policy;
+    validation_policy = policy;
+
+    return previous;
+}
+
+checksum_validation get_checksum_validation(void) {
+    return validation_policy;
+}
+
+int parse_checksum_validation(const char *name, checksum_validation *policy) {
+    if (str_equals(name, VALIDATE_ALWAYS_NAME, MAX_STR_LEN)) {
+        *policy = VALIDATE_ALWAYS;
+    }
+    else if (str_equals(name, VALIDATE_CATALOG_NAME, MAX_STR_LEN)) {
+        *policy = VALIDATE_CATALOG;
+    }
+    else if (str_equals(name, VALIDATE_NEVER_NAME, MAX_STR_LEN)) {
+        *policy = VALIDATE_NEVER;
+    }
+    else {
+        return -1;
+    }
+
+    return 0;
+}
 
 static char *do_slurp(rcComm_t *conn, rodsPath_t *rods_path,
-                      size_t buffer_size, baton_error_t *error) {
+                      size_t buffer_size, size_t *len, int *is_utf8,
+                      baton_error_t *error) {
     data_obj_file_t *obj_file = NULL;
 
     if (buffer_size == 0) {
@@ -40,7 +96,8 @@ static char *do_slurp(rcComm_t *conn, rodsPath_t *rods_path,
     obj_file = open_data_obj(conn, rods_path, O_RDONLY, error);
     if (error->code != 0) goto error;
 
-    char *content = slurp_data_obj(conn, obj_file, buffer_size, error);
+    char *content = slurp_data_obj_utf8(conn, obj_file, buffer_size, len,
+                                        is_utf8, error);
     int status = close_data_obj(conn, obj_file);
 
     if (error->code != 0) goto error;
@@ -87,14 +144,15 @@ json_t *ingest_data_obj(rcComm_t *conn, rodsPath_t *rods_path,
     json_t *results = list_path(conn, rods_path, flags, error);
     if (error->code != 0) goto error;
 
-    content = do_slurp(conn, rods_path, buffer_size, error);
+    size_t len;
+    int is_utf8;
+    content = do_slurp(conn, rods_path, buffer_size, &len, &is_utf8, error);
     if (error->code != 0) goto error;
 
     if (content) {
-        size_t len = strlen(content);
-
-        if (maybe_utf8(content, len)) {
-            json_t *packed = json_pack("s", content);
+        // The content has been validated as UTF-8 while reading
+        if (is_utf8) {
+            json_t *packed = json_stringn_nocheck(content, len);
             if (!packed) {
                 set_baton_error(error, -1,
                                 "Failed to pack the %zu byte contents "
@@ -121,24 +179,64 @@ error:
     return NULL;
 }
 
-data_obj_file_t *open_data_obj(rcComm_t *conn, rodsPath_t *rods_path,
-                               int flags, baton_error_t *error) {
+// Open a data object, on a pinned replicate if pin is not NULL
+static data_obj_file_t *open_data_obj_replicate(rcComm_t *conn,
+                                                rodsPath_t *rods_path,
+                                                int flags,
+                                                const replica_pin_t *pin,
+                                                baton_error_t *error) {
     data_obj_file_t *data_obj = NULL;
     dataObjInp_t obj_open_in;
     int descriptor;
+    char resource[MAX_NAME_LEN] = "";
+    int replicate = 0;
 
     init_baton_error(error);
 
+    double opened_at = query_clock();
+
     memset(&obj_open_in, 0, sizeof obj_open_in);
 
     logmsg(DEBUG, "Opening data object '%s'", rods_path->outPath);
     snprintf(obj_open_in.objPath, MAX_NAME_LEN, "%s", rods_path->outPath);
 
+    char num_str[32];
+    if (pin) {
+        if (flags == O_WRONLY) {
+            set_baton_error(error, -1, "Failed to open '%s': a pinned "
+                            "replicate may not be truncated",
+                            rods_path->outPath);
+            goto error;
+        }
+
+        replicate = pin->replicate;
+        snprintf(num_str, sizeof num_str, "%d", pin->replicate);
+        addKeyVal(&obj_open_in.condInput, REPL_NUM_KW, num_str);
+
+#if IRODS_VERSION_INTEGER && IRODS_VERSION_INTEGER >= 4002009
+        if (strlen(pin->token) > 0) {
+            addKeyVal(&obj_open_in.condInput, REPLICA_TOKEN_KW, pin->token);
+        }
+#endif
+    }
+
     switch(flags) {
         case (O_RDONLY):
           obj_open_in.openFlags = O_RDONLY;
 
-          descriptor = rcDataObjOpen(conn, &obj_open_in);
+          // The size and checksum used to validate the read must not
+          // predate another client's writes. Pinned opens follow one
+          // that has already done this.
+          if (!pin) refresh_rods_obj_type(conn, rods_path);
+
+          if (!pin && use_replica_selection()) {
+              descriptor = open_best_replica(conn, rods_path, &obj_open_in,
+                                             resource, sizeof resource,
+                                             &replicate);
+          }
+          else {
+              descriptor = rcDataObjOpen(conn, &obj_open_in);
+          }
           break;
 
         case (O_WRONLY):
@@ -150,13 +248,24 @@ data_obj_file_t *open_data_obj(rcComm_t *conn, rodsPath_t *rods_path,
           clearKeyVal(&obj_open_in.condInput);
           break;
 
+        case (O_RDWR):
+          // Opens an existing data object without truncating it
+          obj_open_in.openFlags = O_RDWR;
+
+          descriptor = rcDataObjOpen(conn, &obj_open_in);
+          break;
+
         default:
+          clearKeyVal(&obj_open_in.condInput);
           set_baton_error(error, -1,
-                          "Failed to open '%s': file open flag must be either"
-                          "O_RDONLY or O_WRONLY", rods_path->outPath, flags);
+                          "Failed to open '%s': file open flag must be one of "
+                          "O_RDONLY, O_WRONLY or O_RDWR", rods_path->outPath,
+                          flags);
           goto error;
     }
 
+    clearKeyVal(&obj_open_in.condInput);
+
     if (descriptor < 0) {
         char *err_subname;
         const char *err_name = rodsErrorName(descriptor, &err_subname);
@@ -174,11 +283,33 @@ data_obj_file_t *open_data_obj(rcComm_t *conn, rodsPath_t *rods_path,
     }
 
     data_obj->path                = rods_path->outPath;
+    data_obj->conn                = conn;
     data_obj->flags               = obj_open_in.openFlags;
     data_obj->open_obj            = calloc(1, sizeof (openedDataObjInp_t));
     data_obj->open_obj->l1descInx = descriptor;
     data_obj->md5_last_read       = calloc(33, sizeof (char));
     data_obj->md5_last_write      = calloc(33, sizeof (char));
+    data_obj->md5_catalog         = calloc(33, sizeof (char));
+    data_obj->resource            = strlen(resource) ? strdup(resource) : NULL;
+    data_obj->replicate           = replicate;
+    data_obj->pinned              = pin || strlen(resource) > 0;
+    data_obj->replica_token       = pin && strlen(pin->token) > 0 ?
+        strdup(pin->token) : NULL;
+    data_obj->opened_at           = opened_at;
+
+    if (flags == O_RDONLY) {
+        data_obj->size = rods_path->rodsObjStat ?
+            (size_t) rods_path->rodsObjStat->objSize :
+            (size_t) rods_path->size;
+    }
+
+    // The catalog checksum from the stat made when resolving the path
+    // saves asking the server for it again after reading. No such
+    // checksum applies to new content.
+    const char *md5 = catalog_md5(rods_path);
+    if (flags == O_RDONLY && md5 && data_obj->md5_catalog) {
+        memcpy(data_obj->md5_catalog, md5, 32);
+    }
 
     return data_obj;
 
@@ -188,9 +319,82 @@ error:
     return NULL;
 }
 
+data_obj_file_t *open_data_obj(rcComm_t *conn, rodsPath_t *rods_path,
+                               int flags, baton_error_t *error) {
+    return open_data_obj_replicate(conn, rods_path, flags, NULL, error);
+}
+
+data_obj_file_t *open_data_obj_pinned(rcComm_t *conn, rodsPath_t *rods_path,
+                                      int flags, const replica_pin_t *pin,
+                                      baton_error_t *error) {
+    return open_data_obj_replicate(conn, rods_path, flags, pin, error);
+}
+
+int get_replica_pin(rcComm_t *conn, data_obj_file_t *data_obj,
+                    replica_pin_t *pin) {
+    memset(pin, 0, sizeof (replica_pin_t));
+
+#if IRODS_VERSION_INTEGER && IRODS_VERSION_INTEGER >= 4002009
+    char input[64];
+    snprintf(input, sizeof input, "{\"fd\": %d}",
+             data_obj->open_obj->l1descInx);
+
+    char *output = NULL;
+    int status = rc_get_file_descriptor_info(data_obj_connection(conn,
+                                                                 data_obj),
+                                             input, &output);
+    if (status < 0) {
+        logmsg(WARN, "Failed to get the descriptor information of '%s': "
+               "error %d", data_obj->path, status);
+        if (output) free(output);
+        return -1;
+    }
+
+    json_error_t load_error;
+    json_t *info = json_loads(output, 0, &load_error);
+    free(output);
+
+    json_t *token = json_object_get(info, "replica_token");
+    json_t *number = json_object_get(json_object_get(info,
+                                                     "data_object_info"),
+                                     "replica_number");
+    int found = json_is_string(token) && json_is_integer(number);
+    if (found) {
+        pin->replicate = (int) json_integer_value(number);
+        snprintf(pin->token, sizeof pin->token, "%s",
+                 json_string_value(token));
+    }
+    if (info) json_decref(info);
+
+    return found ? 0 : -1;
+#else
+    (void) conn;
+
+    // Older servers have no logical locking, but only a chosen
+    // replicate is known
+    if (!data_obj->pinned) return -1;
+
+    pin->replicate = data_obj->replicate;
+
+    return 0;
+#endif
+}
+
+rcComm_t *data_obj_connection(rcComm_t *conn, data_obj_file_t *data_obj) {
+    return data_obj->resumed_conn ? data_obj->resumed_conn : conn;
+}
+
 int close_data_obj(rcComm_t *conn, data_obj_file_t *data_obj) {
     logmsg(DEBUG, "Closing '%s'", data_obj->path);
-    int status = rcDataObjClose(conn, data_obj->open_obj);
+    int status = rcDataObjClose(data_obj_connection(conn, data_obj),
+                                data_obj->open_obj);
+
+    // The time taken to read a chosen replicate, including opening it,
+    // informs the next choice
+    if (status >= 0 && data_obj->resource && data_obj->position > 0) {
+        record_replica_throughput(data_obj->resource, data_obj->position,
+                                  query_clock() - data_obj->opened_at);
+    }
 
     return status;
 }
@@ -201,6 +405,15 @@ void free_data_obj(data_obj_file_t *data_obj) {
     if (data_obj->open_obj)       free(data_obj->open_obj);
     if (data_obj->md5_last_read)  free(data_obj->md5_last_read);
     if (data_obj->md5_last_write) free(data_obj->md5_last_write);
+    if (data_obj->md5_catalog)    free(data_obj->md5_catalog);
+    if (data_obj->resource)       free(data_obj->resource);
+    if (data_obj->replica_token)  free(data_obj->replica_token);
+
+    // The original connection has failed, so its owner must take the
+    // one that replaced it
+    if (data_obj->resumed_conn) {
+        hand_over_connection(data_obj->conn, data_obj->resumed_conn);
+    }
 
     free(data_obj);
 }
@@ -209,8 +422,6 @@ size_t read_chunk(rcComm_t *conn, data_obj_file_t *data_obj, char *buffer,
                   size_t len, baton_error_t *error) {
     init_baton_error(error);
 
-    data_obj->open_obj->len = len;
-
     bytesBuf_t obj_read_out;
     memset(&obj_read_out, 0, sizeof obj_read_out);
     obj_read_out.buf = buffer;
@@ -218,7 +429,16 @@ size_t read_chunk(rcComm_t *conn, data_obj_file_t *data_obj, char *buffer,
 
     logmsg(DEBUG, "Reading up to %zu bytes from '%s'", len, data_obj->path);
 
-    int num_read = rcDataObjRead(conn, data_obj->open_obj, &obj_read_out);
+    int num_read;
+    do {
+        data_obj->open_obj->len = len;
+
+        double rpc = rpc_start();
+        num_read = rcDataObjRead(data_obj_connection(conn, data_obj),
+                                 data_obj->open_obj, &obj_read_out);
+        rpc_end(RPC_DATA_OBJ_READ, rpc, num_read > 0 ? num_read : 0);
+    } while (num_read < 0 && resume_data_obj(data_obj, num_read));
+
     if (num_read < 0) {
         char *err_subname;
         const char *err_name = rodsErrorName(num_read, &err_subname);
@@ -229,6 +449,7 @@ size_t read_chunk(rcComm_t *conn, data_obj_file_t *data_obj, char *buffer,
     }
 
     logmsg(DEBUG, "Read %d bytes from '%s'", num_read, data_obj->path);
+    data_obj->position += num_read;
 
     return num_read;
 
@@ -236,13 +457,89 @@ error:
     return num_read;
 }
 
-size_t read_data_obj(rcComm_t *conn, data_obj_file_t *data_obj,
-                     FILE *out, size_t buffer_size, baton_error_t *error) {
+// A ring of buffers filled by a reader thread making iRODS reads, and
+// emptied by a consumer writing and hashing their contents, so that
+// the network and local I/O overlap
+typedef struct read_ahead {
+    pthread_mutex_t lock;
+    pthread_cond_t filled;
+    pthread_cond_t emptied;
+    rcComm_t *conn;
+    data_obj_file_t *data_obj;
+    size_t buffer_size;
+    char *buffers[READ_AHEAD_BUFFERS];
+    size_t lengths[READ_AHEAD_BUFFERS];
+    /** The next buffer to fill */
+    size_t head;
+    /** The next buffer to empty */
+    size_t tail;
+    /** The number of filled buffers */
+    size_t count;
+    /** True when the reader has finished */
+    int done;
+    /** True when the consumer has stopped early */
+    int cancelled;
+    /** Any error encountered by the reader */
+    baton_error_t error;
+} read_ahead_t;
+
+static void *read_ahead_worker(void *arg) {
+    read_ahead_t *ra = arg;
+
+    while (1) {
+        pthread_mutex_lock(&ra->lock);
+        while (ra->count == READ_AHEAD_BUFFERS && !ra->cancelled) {
+            pthread_cond_wait(&ra->emptied, &ra->lock);
+        }
+
+        if (ra->cancelled) {
+            pthread_mutex_unlock(&ra->lock);
+            break;
+        }
+
+        // The buffer at head is not visible to the consumer until
+        // count is incremented, so it may be filled without the lock
+        char *buffer = ra->buffers[ra->head];
+        pthread_mutex_unlock(&ra->lock);
+
+        baton_error_t error;
+        size_t nr = read_chunk(ra->conn, ra->data_obj, buffer,
+                               ra->buffer_size, &error);
+
+        pthread_mutex_lock(&ra->lock);
+        if (error.code != 0 || nr == 0) {
+            if (error.code != 0) ra->error = error;
+            ra->done = 1;
+            pthread_cond_signal(&ra->filled);
+            pthread_mutex_unlock(&ra->lock);
+            break;
+        }
+
+        ra->lengths[ra->head] = nr;
+        ra->head = (ra->head + 1) % READ_AHEAD_BUFFERS;
+        ra->count++;
+        pthread_cond_signal(&ra->filled);
+        pthread_mutex_unlock(&ra->lock);
+    }
+
+    return NULL;
+}
+
+// Read a data object to either a stream or a local file
+static size_t copy_data_obj(rcComm_t *conn, data_obj_file_t *data_obj,
+                            FILE *out, local_file_t *file,
+                            size_t buffer_size, baton_error_t *error) {
     size_t num_read    = 0;
     size_t num_written = 0;
-    char *buffer       = NULL;
+    int initialised    = 0;
+    int started        = 0;
+
+    pthread_t reader;
+    read_ahead_t ra;
+    memset(&ra, 0, sizeof ra);
 
     init_baton_error(error);
+    init_baton_error(&ra.error);
 
     if (buffer_size == 0) {
         set_baton_error(error, -1, "Invalid buffer_size argument %u",
@@ -250,34 +547,85 @@ size_t read_data_obj(rcComm_t *conn, data_obj_file_t *data_obj,
         goto error;
     }
 
-    buffer = calloc(buffer_size +1, sizeof (char));
-    if (!buffer) {
-        logmsg(ERROR, "Failed to allocate memory: error %d %s",
-               errno, strerror(errno));
+    for (size_t i = 0; i < READ_AHEAD_BUFFERS; i++) {
+        ra.buffers[i] = calloc(buffer_size, sizeof (char));
+        if (!ra.buffers[i]) {
+            set_baton_error(error, errno, "Failed to allocate memory: "
+                            "error %d %s", errno, strerror(errno));
+            goto error;
+        }
+    }
+
+    ra.conn        = conn;
+    ra.data_obj    = data_obj;
+    ra.buffer_size = buffer_size;
+    pthread_mutex_init(&ra.lock, NULL);
+    pthread_cond_init(&ra.filled, NULL);
+    pthread_cond_init(&ra.emptied, NULL);
+    initialised = 1;
+
+    int status = pthread_create(&reader, NULL, read_ahead_worker, &ra);
+    if (status != 0) {
+        set_baton_error(error, status, "Failed to start a read-ahead "
+                        "thread for '%s': error %d %s", data_obj->path,
+                        status, strerror(status));
         goto error;
     }
+    started = 1;
 
     unsigned char digest[16];
     MD5_CTX context;
     compat_MD5Init(&context);
 
-    size_t nr, nw;
-    while ((nr = read_chunk(conn, data_obj, buffer, buffer_size, error)) > 0) {
+    while (1) {
+        pthread_mutex_lock(&ra.lock);
+        while (ra.count == 0 && !ra.done) {
+            pthread_cond_wait(&ra.filled, &ra.lock);
+        }
+
+        if (ra.count == 0) {
+            pthread_mutex_unlock(&ra.lock);
+            break;
+        }
+
+        char *buffer = ra.buffers[ra.tail];
+        size_t nr    = ra.lengths[ra.tail];
+        pthread_mutex_unlock(&ra.lock);
+
         num_read += nr;
-        logmsg(DEBUG, "Writing %zu bytes from '%s' to stream",
-               nr, data_obj->path);
+        logmsg(DEBUG, "Writing %zu bytes from '%s' to %s",
+               nr, data_obj->path, file ? file->path : "stream");
 
-        int status = fwrite(buffer, 1, nr, out);
-        if (status < 0) {
-            logmsg(ERROR, "Failed to write to stream: error %d %s",
-                   errno, strerror(errno));
-            goto error;
+        size_t nw;
+        if (file) {
+            nw = write_local_file(file, buffer, nr, error);
+            if (error->code != 0) goto error;
+        }
+        else {
+            nw = fwrite(buffer, 1, nr, out);
+            if (nw != nr) {
+                set_baton_error(error, errno, "Failed to write to stream: "
+                                "error %d %s", errno, strerror(errno));
+                goto error;
+            }
         }
-        nw = nr;
         num_written += nw;
 
         compat_MD5Update(&context, (unsigned char*) buffer, nr);
-        memset(buffer, 0, buffer_size);
+
+        pthread_mutex_lock(&ra.lock);
+        ra.tail = (ra.tail + 1) % READ_AHEAD_BUFFERS;
+        ra.count--;
+        pthread_cond_signal(&ra.emptied);
+        pthread_mutex_unlock(&ra.lock);
+    }
+
+    pthread_join(reader, NULL);
+    started = 0;
+
+    if (ra.error.code != 0) {
+        set_baton_error(error, ra.error.code, "%s", ra.error.message);
+        goto error;
     }
 
     compat_MD5Final(digest, &context);
@@ -297,27 +645,65 @@ size_t read_data_obj(rcComm_t *conn, data_obj_file_t *data_obj,
     logmsg(NOTICE, "Wrote %zu bytes from '%s' to stream having MD5 %s",
            num_written, data_obj->path, data_obj->md5_last_read);
 
-    if (buffer) free(buffer);
+    pthread_mutex_destroy(&ra.lock);
+    pthread_cond_destroy(&ra.filled);
+    pthread_cond_destroy(&ra.emptied);
+
+    for (size_t i = 0; i < READ_AHEAD_BUFFERS; i++) {
+        free(ra.buffers[i]);
+    }
 
     return num_written;
 
 error:
-    if (buffer) free(buffer);
+    if (started) {
+        pthread_mutex_lock(&ra.lock);
+        ra.cancelled = 1;
+        pthread_cond_signal(&ra.emptied);
+        pthread_mutex_unlock(&ra.lock);
+
+        pthread_join(reader, NULL);
+    }
+
+    if (initialised) {
+        pthread_mutex_destroy(&ra.lock);
+        pthread_cond_destroy(&ra.filled);
+        pthread_cond_destroy(&ra.emptied);
+    }
+
+    for (size_t i = 0; i < READ_AHEAD_BUFFERS; i++) {
+        if (ra.buffers[i]) free(ra.buffers[i]);
+    }
 
     return num_written;
 }
 
+size_t read_data_obj(rcComm_t *conn, data_obj_file_t *data_obj,
+                     FILE *out, size_t buffer_size, baton_error_t *error) {
+    return copy_data_obj(conn, data_obj, out, NULL, buffer_size, error);
+}
+
 char *slurp_data_obj(rcComm_t *conn, data_obj_file_t *data_obj,
                      size_t buffer_size, baton_error_t *error) {
-    char *buffer  = NULL;
+    size_t len;
+
+    return slurp_data_obj_utf8(conn, data_obj, buffer_size, &len, NULL,
+                               error);
+}
+
+char *slurp_data_obj_utf8(rcComm_t *conn, data_obj_file_t *data_obj,
+                          size_t buffer_size, size_t *len, int *is_utf8,
+                          baton_error_t *error) {
     char *content = NULL;
 
     init_baton_error(error);
 
-    buffer = calloc(buffer_size +1, sizeof (char));
-    if (!buffer) {
-        logmsg(ERROR, "Failed to allocate memory: error %d %s",
-               errno, strerror(errno));
+    *len = 0;
+    if (is_utf8) *is_utf8 = 0;
+
+    if (buffer_size == 0) {
+        set_baton_error(error, -1, "Invalid buffer_size argument %zu",
+                        buffer_size);
         goto error;
     }
 
@@ -325,43 +711,78 @@ char *slurp_data_obj(rcComm_t *conn, data_obj_file_t *data_obj,
     MD5_CTX context;
     compat_MD5Init(&context);
 
-    size_t capacity = buffer_size;
+    // Allocate for the whole object and its terminating NUL where the
+    // size is known. Otherwise, or if the object has grown, the
+    // capacity is doubled as required.
+    size_t capacity  = data_obj->size > 0 ? data_obj->size + 1 : buffer_size;
     size_t num_read = 0;
 
-    content = calloc(capacity, sizeof (char));
+    utf8_validator_t validator;
+    init_utf8_validator(&validator);
+
+    content = malloc(capacity);
     if (!content) {
-        logmsg(ERROR, "Failed to allocate memory: error %d %s",
-               errno, strerror(errno));
+        set_baton_error(error, errno, "Failed to allocate memory: "
+                        "error %d %s", errno, strerror(errno));
         goto error;
     }
 
-    size_t nr;
-    while ((nr = read_chunk(conn, data_obj, buffer, buffer_size, error)) > 0) {
-      logmsg(TRACE, "Read %zu bytes. Capacity %zu, num read %zu",
-             nr, capacity, num_read);
-        if (num_read + nr > capacity) {
-            capacity = capacity * 2;
+    while (1) {
+        char probe[SLURP_PROBE_SIZE];
+        char *dest;
+        size_t request;
+
+        // A full buffer is expected once an object of known size has
+        // been read, so it is only grown if a probe finds more data
+        int probing = capacity - num_read < 2;
+        if (probing) {
+            dest    = probe;
+            request = sizeof probe < buffer_size ? sizeof probe : buffer_size;
+        }
+        else {
+            // Leave room for the terminating NUL
+            size_t space = capacity - num_read - 1;
+            dest    = content + num_read;
+            request = space < buffer_size ? space : buffer_size;
+        }
+
+        size_t nr = read_chunk(conn, data_obj, dest, request, error);
+        if (error->code != 0) goto error;
+        if (nr == 0) break;
+
+        if (probing) {
+            size_t new_capacity = capacity * 2;
+            while (new_capacity - num_read < nr + 1) new_capacity *= 2;
 
-            char *tmp = NULL;
-            tmp = realloc(content, capacity);
+            char *tmp = realloc(content, new_capacity);
             if (!tmp) {
-                logmsg(ERROR, "Failed to allocate memory: error %d %s",
-                       errno, strerror(errno));
+                set_baton_error(error, errno, "Failed to allocate memory: "
+                                "error %d %s", errno, strerror(errno));
                 goto error;
             }
 
-            memset(tmp + num_read, 0, capacity - num_read);
-            content = tmp;
+            content  = tmp;
+            capacity = new_capacity;
+            memcpy(content + num_read, probe, nr);
+        }
+
+        logmsg(TRACE, "Read %zu bytes. Capacity %zu, num read %zu",
+               nr, capacity, num_read);
+
+        compat_MD5Update(&context, (unsigned char *) content + num_read, nr);
+
+        // Any sequence split across reads is validated with the next one
+        if (is_utf8) {
+            utf8_validate_chunk(&validator, content + num_read, nr);
         }
 
-        memcpy(content + num_read, buffer, nr);
-        memset(buffer, 0, buffer_size);
         num_read += nr;
     }
 
+    content[num_read] = '\0';
+
     logmsg(DEBUG, "Final capacity %zu, offset %zu", capacity, num_read);
 
-    compat_MD5Update(&context, (unsigned char *) content, num_read);
     compat_MD5Final(digest, &context);
     set_md5_last_read(data_obj, digest);
 
@@ -373,21 +794,205 @@ char *slurp_data_obj(rcComm_t *conn, data_obj_file_t *data_obj,
     logmsg(NOTICE, "Wrote %zu bytes from '%s' to buffer having MD5 %s",
            num_read, data_obj->path, data_obj->md5_last_read);
 
-    if (buffer) free(buffer);
+    *len = num_read;
+    if (is_utf8) *is_utf8 = utf8_validate_end(&validator);
 
     return content;
 
 error:
-    if (buffer)  free(buffer);
     if (content) free(content);
 
     return NULL;
 }
 
+// Print a JSON object without its closing brace, followed by the
+// separator needed before another property
+static void print_open_object(json_t *object, baton_error_t *error) {
+    char *str = json_dumps(object, JSON_INDENT(0));
+    if (!str) {
+        set_baton_error(error, -1, "Failed to encode a JSON object");
+        return;
+    }
+
+    print_json_text(str, strlen(str) - 1);
+    if (json_object_size(object) > 0) print_json_text(", ", 2);
+
+    free_json_mem(str);
+}
+
+// Complete a streamed document that has failed part way, reporting the
+// error, so that the output remains valid JSON
+static void print_stream_error(baton_error_t *error) {
+    json_t *report = json_object();
+    if (report) add_error_value(report, error);
+
+    char *str = report ? json_dumps(report, JSON_INDENT(0)) : NULL;
+
+    print_json_text("\", ", 3);
+    if (str) print_json_text(str + 1, strlen(str) - 1);
+    else     print_json_text("}", 1);
+    print_json_text("\n", 1);
+
+    if (str)    free_json_mem(str);
+    if (report) json_decref(report);
+}
+
+int stream_data_obj_json(rcComm_t *conn, rodsPath_t *rods_path,
+                         option_flags flags, size_t buffer_size,
+                         baton_error_t *error) {
+    data_obj_file_t *data_obj = NULL;
+    json_t *results           = NULL;
+    char *buffer              = NULL;
+    char *encoded             = NULL;
+    int started               = 0;
+
+    init_baton_error(error);
+
+    if (buffer_size == 0) {
+        set_baton_error(error, -1, "Invalid buffer_size argument %zu",
+                        buffer_size);
+        goto error;
+    }
+
+    if (rods_path->objType != DATA_OBJ_T) {
+        set_baton_error(error, USER_INPUT_PATH_ERR,
+                        "Cannot read the contents of '%s' because "
+                        "it is not a data object", rods_path->outPath);
+        goto error;
+    }
+
+    int base64 = flags & PRINT_BASE64;
+
+    results = list_path(conn, rods_path, flags, error);
+    if (error->code != 0) goto error;
+
+    if (base64) {
+        json_object_set_new(results, JSON_ENCODING_KEY,
+                            json_string(JSON_BASE64_ENCODING));
+    }
+
+    data_obj = open_data_obj(conn, rods_path, O_RDONLY, error);
+    if (error->code != 0) goto error;
+
+    // Room for the start of a UTF-8 sequence carried from the last read
+    buffer  = malloc(buffer_size + 3);
+    encoded = malloc(JSON_STREAM_SLICE * JSON_ESCAPED_MAX_LEN);
+    if (!buffer || !encoded) {
+        set_baton_error(error, errno, "Failed to allocate memory: "
+                        "error %d %s", errno, strerror(errno));
+        goto error;
+    }
+
+    print_open_object(results, error);
+    if (error->code != 0) goto error;
+
+    print_json_text("\"" JSON_DATA_KEY "\": \"",
+                    strlen("\"" JSON_DATA_KEY "\": \""));
+    started = 1;
+
+    unsigned char digest[16];
+    MD5_CTX context;
+    compat_MD5Init(&context);
+
+    base64_encoder_t encoder;
+    init_base64_encoder(&encoder);
+
+    size_t num_read  = 0;
+    size_t carry_len = 0;
+
+    while (1) {
+        size_t nr = read_chunk(conn, data_obj, buffer + carry_len,
+                               buffer_size, error);
+        if (error->code != 0) goto error;
+        if (nr == 0) break;
+
+        compat_MD5Update(&context, (unsigned char *) buffer + carry_len, nr);
+        num_read += nr;
+
+        // Only complete, valid UTF-8 is printed. The start of a sequence
+        // split by the read is carried to the next.
+        size_t len = carry_len + nr;
+        size_t valid = len;
+        if (!base64) {
+            int partial;
+            valid = utf8_valid_prefix(buffer, len, &partial);
+            if (valid < len && !partial) {
+                set_baton_error(error, USER_INPUT_PATH_ERR,
+                                "The contents of '%s' cannot be encoded "
+                                "as UTF-8 for JSON output",
+                                rods_path->outPath);
+                goto error;
+            }
+        }
+
+        for (size_t i = 0; i < valid; i += JSON_STREAM_SLICE) {
+            size_t n = valid - i < JSON_STREAM_SLICE ?
+                valid - i : JSON_STREAM_SLICE;
+            size_t ne = base64 ?
+                base64_encode_chunk(&encoder, buffer + i, n, encoded) :
+                json_escape_chunk(buffer + i, n, encoded);
+            print_json_text(encoded, ne);
+        }
+
+        carry_len = len - valid;
+        memmove(buffer, buffer + valid, carry_len);
+    }
+
+    if (carry_len > 0) {
+        set_baton_error(error, USER_INPUT_PATH_ERR,
+                        "The contents of '%s' cannot be encoded as UTF-8 "
+                        "for JSON output", rods_path->outPath);
+        goto error;
+    }
+
+    if (base64) print_json_text(encoded, base64_encode_end(&encoder, encoded));
+
+    compat_MD5Final(digest, &context);
+    set_md5_last_read(data_obj, digest);
+
+    if (!validate_md5_last_read(conn, data_obj)) {
+        logmsg(WARN, "Checksum mismatch for '%s' having MD5 %s on reading",
+               data_obj->path, data_obj->md5_last_read);
+    }
+
+    int status = close_data_obj(conn, data_obj);
+    if (status < 0) {
+        char *err_subname;
+        const char *err_name = rodsErrorName(status, &err_subname);
+        set_baton_error(error, status,
+                        "Failed to close data object: '%s' error %d %s",
+                        rods_path->outPath, status, err_name);
+        goto error;
+    }
+
+    print_json_text("\"}\n", 3);
+
+    logmsg(NOTICE, "Streamed %zu bytes from '%s' having MD5 %s",
+           num_read, data_obj->path, data_obj->md5_last_read);
+
+    free_data_obj(data_obj);
+    json_decref(results);
+    free(buffer);
+    free(encoded);
+
+    return error->code;
+
+error:
+    if (started) print_stream_error(error);
+
+    if (data_obj) free_data_obj(data_obj);
+    if (results)  json_decref(results);
+    if (buffer)   free(buffer);
+    if (encoded)  free(encoded);
+
+    return error->code;
+}
+
 int get_data_obj_file(rcComm_t *conn, rodsPath_t *rods_path,
                       const char *local_path, size_t buffer_size,
                       baton_error_t *error) {
-    FILE *stream = NULL;
+    data_obj_file_t *data_obj = NULL;
+    local_file_t *file        = NULL;
 
     init_baton_error(error);
 
@@ -407,28 +1012,55 @@ int get_data_obj_file(rcComm_t *conn, rodsPath_t *rods_path,
         goto error;
     }
 
-    stream = fopen(local_path, "w");
-    if (!stream) {
-        set_baton_error(error, errno,
-                        "Failed to open '%s' for writing: error %d %s",
-                        local_path, errno, strerror(errno));
-        goto error;
+    size_t size = rods_path->rodsObjStat ?
+        (size_t) rods_path->rodsObjStat->objSize : (size_t) rods_path->size;
+
+    // The hash of a parallel transfer is made by reading the file back,
+    // so it must be opened for update
+    int parallel = use_parallel_transfer(size);
+
+    file = open_local_output(local_path, size, parallel, buffer_size, error);
+    if (error->code != 0) goto error;
+
+    if (parallel) {
+        file->position = get_data_obj_ranges(conn, rods_path, file->fd, size,
+                                             buffer_size, error);
+    }
+    else {
+        data_obj = open_data_obj(conn, rods_path, O_RDONLY, error);
+        if (error->code == 0) {
+            copy_data_obj(conn, data_obj, NULL, file, buffer_size, error);
+            int status = close_data_obj(conn, data_obj);
+
+            if (error->code == 0 && status < 0) {
+                char *err_subname;
+                const char *err_name = rodsErrorName(status, &err_subname);
+                set_baton_error(error, status,
+                                "Failed to close data object: '%s' "
+                                "error %d %s", rods_path->outPath, status,
+                                err_name);
+            }
+        }
     }
 
-    get_data_obj_stream(conn, rods_path, stream, buffer_size, error);
-    int status = fclose(stream);
+    baton_error_t close_error;
+    close_local_file(file, &close_error);
 
     if (error->code != 0) goto error;
-    if (status != 0) {
-        set_baton_error(error, errno,
-                        "Failed to close '%s': error %d %s",
-                        local_path, errno, strerror(errno));
+    if (close_error.code != 0) {
+        set_baton_error(error, close_error.code, "%s", close_error.message);
         goto error;
     }
 
+    free_local_file(file);
+    if (data_obj) free_data_obj(data_obj);
+
     return error->code;
 
 error:
+    if (file)     free_local_file(file);
+    if (data_obj) free_data_obj(data_obj);
+
     return error->code;
 }
 
@@ -533,9 +1165,16 @@ json_t *checksum_data_obj(rcComm_t *conn, rodsPath_t *rods_path,
         }
     }
 
+    double rpc = rpc_start();
     status = rcDataObjChksum(conn, &obj_chk_in, &checksum_str);
+    rpc_end(RPC_DATA_OBJ_CHKSUM, rpc, 0);
     clearKeyVal(&obj_chk_in.condInput);
 
+    // Calculating a checksum updates the catalog
+    if (flags & CALCULATE_CHECKSUM) {
+        invalidate_stat_cache(rods_path->outPath);
+    }
+
     if (status < 0) {
         char *err_subname;
         const char *err_name = rodsErrorName(status, &err_subname);
@@ -574,10 +1213,32 @@ int validate_md5_last_read(rcComm_t *conn, data_obj_file_t *data_obj) {
     dataObjInp_t obj_md5_in;
     memset(&obj_md5_in, 0, sizeof obj_md5_in);
 
+    if (validation_policy == VALIDATE_NEVER) {
+        logmsg(DEBUG, "Not validating the checksum of '%s'", data_obj->path);
+        return 1;
+    }
+
+    if (data_obj->md5_catalog && data_obj->md5_catalog[0] != '\0') {
+        logmsg(DEBUG, "Comparing last read MD5 of '%s' with catalog MD5 "
+               "of '%s'", data_obj->md5_last_read, data_obj->md5_catalog);
+
+        return str_equals_ignore_case(data_obj->md5_last_read,
+                                      data_obj->md5_catalog, 32);
+    }
+
+    if (validation_policy == VALIDATE_CATALOG) {
+        logmsg(DEBUG, "Not validating the checksum of '%s' because the "
+               "catalog has none", data_obj->path);
+        return 1;
+    }
+
     snprintf(obj_md5_in.objPath, MAX_NAME_LEN, "%s", data_obj->path);
 
     char *md5 = NULL;
-    int status = rcDataObjChksum(conn, &obj_md5_in, &md5);
+    double rpc = rpc_start();
+    int status = rcDataObjChksum(data_obj_connection(conn, data_obj),
+                                 &obj_md5_in, &md5);
+    rpc_end(RPC_DATA_OBJ_CHKSUM, rpc, 0);
     if (status < 0) goto error;
 
     logmsg(DEBUG, "Comparing last read MD5 of '%s' with expected MD5 of '%s'",
@@ -27,6 +27,46 @@
 #include "config.h"
 #include "list.h"
 
+/** The number of buffers read ahead of the consumer of a data object */
+#define READ_AHEAD_BUFFERS 4
+
+/** The number of bytes escaped or encoded at a time when streaming */
+#define JSON_STREAM_SLICE  4096
+
+/** The number of bytes read to test for more data once a buffer sized
+    for a whole data object is full */
+#define SLURP_PROBE_SIZE   4096
+
+/**
+ *  @enum checksum_validation
+ *  @brief Policies for validating data object checksums after transfer.
+ */
+typedef enum {
+    /** Always validate, asking the server for a checksum if the catalog
+        has none recorded */
+    VALIDATE_ALWAYS  = 0,
+    /** Validate only against a checksum already in the catalog */
+    VALIDATE_CATALOG = 1,
+    /** Never validate */
+    VALIDATE_NEVER   = 2
+} checksum_validation;
+
+#define VALIDATE_ALWAYS_NAME  "always"
+#define VALIDATE_CATALOG_NAME "catalog"
+#define VALIDATE_NEVER_NAME   "never"
+
+/**
+ *  @struct replica_pin
+ *  @brief A replicate that is open, to be opened again alongside it.
+ */
+typedef struct replica_pin {
+    /** The number of the replicate */
+    int replicate;
+    /** The token which permits the replicate to be opened for writing
+        while it is open, or an empty string if none is needed */
+    char token[MAX_NAME_LEN];
+} replica_pin_t;
+
 /**
  *  @struct data_obj_file
  *  @brief Data object handle.
@@ -42,14 +82,65 @@ typedef struct data_obj_file {
     char *md5_last_read;
     /** The MD5 calculated last time the object was written completely */
     char *md5_last_write;
+    /** The MD5 recorded in the catalog when the object was opened for
+        reading, or an empty string if none was known */
+    char *md5_catalog;
+    /** The size recorded in the catalog when the object was opened for
+        reading, or 0 if none was known */
+    size_t size;
+    /** The offset of the next byte to be read or written */
+    size_t position;
+    /** The connection the data object was opened with */
+    rcComm_t *conn;
+    /** A connection made to resume the transfer after the original
+        connection failed, owned by the handle until it is freed, or
+        NULL */
+    rcComm_t *resumed_conn;
+    /** The number of times the transfer has been resumed */
+    size_t num_resumes;
+    /** The resource of the replicate chosen for reading, or NULL if
+        the server chose */
+    char *resource;
+    /** The number of the replicate chosen for reading, or pinned */
+    int replicate;
+    /** True if the replicate was opened by its number */
+    int pinned;
+    /** The token with which a pinned replicate was opened, or NULL */
+    char *replica_token;
+    /** The time at which the data object was opened, in seconds */
+    double opened_at;
 } data_obj_file_t;
 
+/**
+ * Set the policy for validating checksums after reading or writing a
+ * data object.
+ *
+ * @param[in] policy  The policy.
+ *
+ * @return The previous policy.
+ */
+checksum_validation set_checksum_validation(checksum_validation policy);
+
+checksum_validation get_checksum_validation(void);
+
+/**
+ * Parse a checksum validation policy name.
+ *
+ * @param[in]  name   One of "always", "catalog" or "never".
+ * @param[out] policy The parsed policy.
+ *
+ * @return 0 on success, -1 if the name is not recognised.
+ */
+int parse_checksum_validation(const char *name, checksum_validation *policy);
+
 /**
  * Open a data object for reading or writing.
  *
  * @param[in]  conn       An open iRODS connection.
  * @param[in]  rods_path  An iRODS data object path.
- * @param[in]  flags      O_RDONLY or O_WRONLY.
+ * @param[in]  flags      O_RDONLY, O_WRONLY to create or truncate, or
+ *                        O_RDWR to open an existing object for writing
+ *                        without truncating it.
  * @parem[out] error      An error report struct.
  *
  * @return A new struct, which must be freed by the caller.
@@ -57,6 +148,51 @@ typedef struct data_obj_file {
 data_obj_file_t *open_data_obj(rcComm_t *conn, rodsPath_t *rods_path,
                                int flags, baton_error_t *error);
 
+/**
+ * Open a data object for reading, or for writing without truncation,
+ * on the same replicate as an earlier open which is still open, so that
+ * both may transfer parts of it. On servers with logical locking, the
+ * replicate's token permits it to be opened for writing.
+ *
+ * @param[in]  conn       An open iRODS connection.
+ * @param[in]  rods_path  An iRODS data object path.
+ * @param[in]  flags      O_RDONLY or O_RDWR.
+ * @param[in]  pin        The replicate, from @ref get_replica_pin.
+ * @parem[out] error      An error report struct.
+ *
+ * @return A new struct, which must be freed by the caller.
+ */
+data_obj_file_t *open_data_obj_pinned(rcComm_t *conn, rodsPath_t *rods_path,
+                                      int flags, const replica_pin_t *pin,
+                                      baton_error_t *error);
+
+/**
+ * Find the replicate on which a data object is open, and the token
+ * needed to open it again for writing while it is open.
+ *
+ * @param[in]  conn      The connection the data object is open on.
+ * @param[in]  data_obj  A data object handle.
+ * @param[out] pin       The replicate.
+ *
+ * @return 0 on success, or -1 if the replicate is not known, which is
+ * the case for servers before iRODS 4.2.9 unless it was chosen when the
+ * data object was opened.
+ */
+int get_replica_pin(rcComm_t *conn, data_obj_file_t *data_obj,
+                    replica_pin_t *pin);
+
+/**
+ * Return the connection on which a data object is currently open. This
+ * is the connection it was opened with, unless its transfer has been
+ * resumed on a new connection.
+ *
+ * @param[in] conn      The connection the data object was opened with.
+ * @param[in] obj_file  A data object handle.
+ *
+ * @return An iRODS connection.
+ */
+rcComm_t *data_obj_connection(rcComm_t *conn, data_obj_file_t *obj_file);
+
 int close_data_obj(rcComm_t *conn, data_obj_file_t *obj_file);
 
 void free_data_obj(data_obj_file_t *obj_file);
@@ -76,7 +212,9 @@ size_t read_chunk(rcComm_t *conn, data_obj_file_t *obj_file,
                   char *buffer, size_t len, baton_error_t *error);
 
 /**
- * Read a data object and write to a stream.
+ * Read a data object and write to a stream. Reads from iRODS are made
+ * by a separate thread, up to READ_AHEAD_BUFFERS buffers ahead of the
+ * writes and MD5 calculation, so that these overlap.
  *
  * @param[in]  conn        An open iRODS connection.
  * @param[in]  obj_file    A data object handle.
@@ -104,10 +242,57 @@ size_t read_data_obj(rcComm_t *conn, data_obj_file_t *obj_file, FILE *out,
 char *slurp_data_obj(rcComm_t *conn, data_obj_file_t *obj_file,
                      size_t buffer_size, baton_error_t *error);
 
+/**
+ * Read a data object to a new byte string, as slurp_data_obj does,
+ * reporting its length and, optionally, whether it is valid UTF-8. When
+ * the size of the data object is known, the string is allocated once
+ * and each read is made directly into it. The MD5 and UTF-8 validity
+ * are calculated on each chunk as it arrives.
+ *
+ * @param[in]  conn        An open iRODS connection.
+ * @param[in]  obj_file    A data object handle.
+ * @param[in]  buffer_size The maximum number of bytes to read at a time.
+ * @param[out] len         The number of bytes read, excluding the
+ *                         terminating NUL.
+ * @param[out] is_utf8     Set true if the content is valid UTF-8.
+ *                         Optional, the content is not validated if
+ *                         NULL.
+ * @param[out] error       An error report struct.
+ *
+ * @return A new NUL-terminated byte string containing the entire data
+ *         object, which must be freed by the caller.
+ */
+char *slurp_data_obj_utf8(rcComm_t *conn, data_obj_file_t *obj_file,
+                          size_t buffer_size, size_t *len, int *is_utf8,
+                          baton_error_t *error);
+
 json_t *ingest_data_obj(rcComm_t *conn, rodsPath_t *rods_path,
                         option_flags flags,
                         size_t buffer_size, baton_error_t *error);
 
+/**
+ * Print a data object to stdout as a JSON document, as returned by
+ * ingest_data_obj, without holding its contents in memory. The
+ * document is printed up to the start of its data, then the contents
+ * are read, a buffer at a time, and printed as a JSON string before the
+ * document is closed. With PRINT_BASE64 the contents are encoded as
+ * base64 and the document has an encoding property; otherwise they
+ * must be valid UTF-8. If the transfer fails once the document has
+ * begun, it is closed with an error property.
+ *
+ * @param[in]  conn        An open iRODS connection.
+ * @param[in]  rods_path   A resolved iRODS data object path.
+ * @param[in]  flags       Options for listing the data object, and
+ *                         PRINT_BASE64.
+ * @param[in]  buffer_size The number of bytes to read at one time.
+ * @param[out] error       An error report struct.
+ *
+ * @return 0 on success, iRODS error code on failure.
+ */
+int stream_data_obj_json(rcComm_t *conn, rodsPath_t *rods_path,
+                         option_flags flags, size_t buffer_size,
+                         baton_error_t *error);
+
 int get_data_obj_file(rcComm_t *conn, rodsPath_t *rods_path,
                       const char *local_path, size_t buffer_size,
                       baton_error_t *error);
@@ -120,6 +305,20 @@ json_t *checksum_data_obj(rcComm_t *conn, rodsPath_t *rods_path,
 
 void set_md5_last_read(data_obj_file_t *obj_file, unsigned char digest[16]);
 
+/**
+ * Validate the MD5 of the last complete read (or write) of a data object
+ * against its checksum, according to the current validation policy.
+ * When the catalog checksum was obtained when the object was opened,
+ * this is a local comparison. Otherwise, under the VALIDATE_ALWAYS
+ * policy, the checksum is requested from the server, which may
+ * calculate it.
+ *
+ * @param[in]  conn        An open iRODS connection.
+ * @param[in]  obj_file    A data object handle.
+ *
+ * @return 1 if the checksum is valid or was not checked, 0 if invalid,
+ *         or a negative iRODS error code.
+ */
 int validate_md5_last_read(rcComm_t *conn, data_obj_file_t *obj_file);
 
 #endif // _BATON_READ_H
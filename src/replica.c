@@ -0,0 +1,315 @@
+/**
+ * Copyright (C) 2017 Genome Research Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @file replica.c
+ * @author Keith James <kdj@sanger.ac.uk>
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <jansson.h>
+
+#include "config.h"
+#include "json.h"
+#include "list.h"
+#include "log.h"
+#include "replica.h"
+#include "utilities.h"
+
+typedef struct resource_throughput {
+    char name[MAX_NAME_LEN];
+    /** Bytes per second, a moving average of the reads measured */
+    double rate;
+} resource_throughput_t;
+
+typedef struct ranked_replicate {
+    json_t *replicate;
+    /** The position in the preference list, or its length if unlisted */
+    size_t preference;
+    /** The throughput of the resource, negative if not measured */
+    double throughput;
+    int number;
+} ranked_replicate_t;
+
+// The policy and measurements are shared by all threads
+static pthread_mutex_t replica_lock = PTHREAD_MUTEX_INITIALIZER;
+static int selection_enabled  = 0;
+static size_t num_preferences = 0;
+static size_t num_throughputs = 0;
+static char preferences[REPLICA_MAX_PREFERENCES][MAX_NAME_LEN];
+static resource_throughput_t throughputs[REPLICA_MAX_RESOURCES];
+
+int set_replica_selection(int enabled, const char *list) {
+    int status = 0;
+
+    pthread_mutex_lock(&replica_lock);
+
+    selection_enabled = enabled;
+    num_preferences   = 0;
+
+    char *copy = list ? strdup(list) : NULL;
+    if (copy) {
+        char *saveptr = NULL;
+        for (char *name = strtok_r(copy, REPLICA_PREFERENCE_SEPARATOR,
+                                   &saveptr);
+             name;
+             name = strtok_r(NULL, REPLICA_PREFERENCE_SEPARATOR, &saveptr)) {
+            if (num_preferences == REPLICA_MAX_PREFERENCES) {
+                status = -1;
+                break;
+            }
+
+            snprintf(preferences[num_preferences], MAX_NAME_LEN, "%s", name);
+            num_preferences++;
+        }
+
+        free(copy);
+    }
+
+    pthread_mutex_unlock(&replica_lock);
+
+    return status;
+}
+
+int use_replica_selection(void) {
+    pthread_mutex_lock(&replica_lock);
+    int enabled = selection_enabled;
+    pthread_mutex_unlock(&replica_lock);
+
+    return enabled;
+}
+
+// Return the index of a resource in the throughput table, or -1. The
+// lock must be held.
+static int find_resource(const char *resource) {
+    for (size_t i = 0; i < num_throughputs; i++) {
+        if (str_equals(throughputs[i].name, resource, MAX_NAME_LEN)) {
+            return (int) i;
+        }
+    }
+
+    return -1;
+}
+
+// Return the position of the first name in the preference list that is
+// the resource or location of a replicate, or the length of the list
+// if neither is listed. The lock must be held.
+static size_t find_preference(const char *resource, const char *location) {
+    for (size_t i = 0; i < num_preferences; i++) {
+        if ((resource && str_equals(preferences[i], resource, MAX_NAME_LEN)) ||
+            (location && str_equals(preferences[i], location, MAX_NAME_LEN))) {
+            return i;
+        }
+    }
+
+    return num_preferences;
+}
+
+void record_replica_throughput(const char *resource, size_t bytes,
+                               double seconds) {
+    if (!resource || strlen(resource) == 0 || seconds <= 0) return;
+
+    double rate = bytes / seconds;
+
+    pthread_mutex_lock(&replica_lock);
+
+    int index = find_resource(resource);
+    if (index >= 0) {
+        throughputs[index].rate =
+            throughputs[index].rate * (1 - REPLICA_THROUGHPUT_WEIGHT) +
+            rate * REPLICA_THROUGHPUT_WEIGHT;
+        rate = throughputs[index].rate;
+    }
+    else if (num_throughputs < REPLICA_MAX_RESOURCES) {
+        snprintf(throughputs[num_throughputs].name, MAX_NAME_LEN, "%s",
+                 resource);
+        throughputs[num_throughputs].rate = rate;
+        num_throughputs++;
+    }
+
+    pthread_mutex_unlock(&replica_lock);
+
+    logmsg(DEBUG, "Throughput of resource '%s' is %.0f bytes/s",
+           resource, rate);
+}
+
+double get_replica_throughput(const char *resource) {
+    pthread_mutex_lock(&replica_lock);
+    int index = find_resource(resource);
+    double rate = index >= 0 ? throughputs[index].rate : -1;
+    pthread_mutex_unlock(&replica_lock);
+
+    return rate;
+}
+
+void clear_replica_throughput(void) {
+    pthread_mutex_lock(&replica_lock);
+    num_throughputs = 0;
+    pthread_mutex_unlock(&replica_lock);
+}
+
+static int compare_ranked(const void *a, const void *b) {
+    const ranked_replicate_t *x = a;
+    const ranked_replicate_t *y = b;
+
+    if (x->preference != y->preference) {
+        return x->preference < y->preference ? -1 : 1;
+    }
+
+    // Resources not yet measured come first, so that each is measured
+    int x_measured = x->throughput >= 0;
+    int y_measured = y->throughput >= 0;
+    if (x_measured != y_measured) return x_measured ? 1 : -1;
+
+    if (x->throughput > y->throughput) return -1;
+    if (x->throughput < y->throughput) return 1;
+
+    return (x->number > y->number) - (x->number < y->number);
+}
+
+json_t *rank_replicates(json_t *replicates, baton_error_t *error) {
+    ranked_replicate_t *ranked = NULL;
+    json_t *result = NULL;
+
+    init_baton_error(error);
+
+    if (!json_is_array(replicates)) {
+        set_baton_error(error, CAT_INVALID_ARGUMENT,
+                        "Invalid replicates: not a JSON array");
+        goto error;
+    }
+
+    size_t num_elts = json_array_size(replicates);
+    ranked = calloc(num_elts > 0 ? num_elts : 1, sizeof (ranked_replicate_t));
+    if (!ranked) {
+        set_baton_error(error, errno, "Failed to allocate memory: "
+                        "error %d %s", errno, strerror(errno));
+        goto error;
+    }
+
+    size_t num_valid = 0;
+
+    pthread_mutex_lock(&replica_lock);
+
+    for (size_t i = 0; i < num_elts; i++) {
+        json_t *replicate = json_array_get(replicates, i);
+        if (!json_is_true(json_object_get(replicate,
+                                          JSON_REPLICATE_STATUS_KEY))) {
+            continue;
+        }
+
+        const char *resource = json_string_value
+            (json_object_get(replicate, JSON_RESOURCE_KEY));
+        const char *location = json_string_value
+            (json_object_get(replicate, JSON_LOCATION_KEY));
+        json_int_t number = json_integer_value
+            (json_object_get(replicate, JSON_REPLICATE_NUMBER_KEY));
+
+        int index = resource ? find_resource(resource) : -1;
+
+        ranked[num_valid].replicate  = replicate;
+        ranked[num_valid].preference = find_preference(resource, location);
+        ranked[num_valid].throughput = index >= 0 ?
+            throughputs[index].rate : -1;
+        ranked[num_valid].number     = (int) number;
+        num_valid++;
+    }
+
+    pthread_mutex_unlock(&replica_lock);
+
+    qsort(ranked, num_valid, sizeof (ranked_replicate_t), compare_ranked);
+
+    result = json_array();
+    if (!result) {
+        set_baton_error(error, -1, "Failed to allocate a new JSON array");
+        goto error;
+    }
+
+    for (size_t i = 0; i < num_valid; i++) {
+        json_array_append(result, ranked[i].replicate);
+    }
+
+    free(ranked);
+
+    return result;
+
+error:
+    if (ranked) free(ranked);
+    if (result) json_decref(result);
+
+    return NULL;
+}
+
+int open_best_replica(rcComm_t *conn, rodsPath_t *rods_path,
+                      dataObjInp_t *obj_open_in, char *resource,
+                      size_t len, int *number) {
+    json_t *replicates = NULL;
+    json_t *ranked     = NULL;
+    int descriptor     = -1;
+
+    snprintf(resource, len, "%s", "");
+
+    baton_error_t error;
+    replicates = list_replicates(conn, rods_path, &error);
+    if (error.code == 0) ranked = rank_replicates(replicates, &error);
+
+    if (error.code != 0 || json_array_size(ranked) == 0) {
+        logmsg(DEBUG, "No valid replicate of '%s' to choose; the server "
+               "will choose", rods_path->outPath);
+        descriptor = rcDataObjOpen(conn, obj_open_in);
+        goto finally;
+    }
+
+    size_t i;
+    json_t *replicate;
+    json_array_foreach(ranked, i, replicate) {
+        const char *name = json_string_value
+            (json_object_get(replicate, JSON_RESOURCE_KEY));
+        int num = (int) json_integer_value
+            (json_object_get(replicate, JSON_REPLICATE_NUMBER_KEY));
+
+        char num_str[32];
+        snprintf(num_str, sizeof num_str, "%d", num);
+
+        addKeyVal(&obj_open_in->condInput, REPL_NUM_KW, num_str);
+        descriptor = rcDataObjOpen(conn, obj_open_in);
+        clearKeyVal(&obj_open_in->condInput);
+
+        if (descriptor >= 0) {
+            logmsg(DEBUG, "Reading replicate %d of '%s' from '%s'",
+                   num, rods_path->outPath, name ? name : "");
+            snprintf(resource, len, "%s", name ? name : "");
+            *number = num;
+            break;
+        }
+
+        char *err_subname;
+        const char *err_name = rodsErrorName(descriptor, &err_subname);
+        logmsg(WARN, "Failed to open replicate %d of '%s' on '%s': "
+               "error %d %s", num, rods_path->outPath, name ? name : "",
+               descriptor, err_name);
+    }
+
+finally:
+    if (replicates) json_decref(replicates);
+    if (ranked)     json_decref(ranked);
+
+    return descriptor;
+}
@@ -0,0 +1,124 @@
+/**
+ * Copyright (C) 2017 Genome Research Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @file replica.h
+ * @author Keith James <kdj@sanger.ac.uk>
+ */
+
+#ifndef _BATON_REPLICA_H
+#define _BATON_REPLICA_H
+
+#include <jansson.h>
+
+#include <rodsClient.h>
+
+#include "config.h"
+#include "error.h"
+
+/** The separator of names in a resource preference list */
+#define REPLICA_PREFERENCE_SEPARATOR ","
+/** The maximum number of names in a resource preference list */
+#define REPLICA_MAX_PREFERENCES 16
+/** The maximum number of resources whose throughput is recorded */
+#define REPLICA_MAX_RESOURCES   64
+/** The weight given to each new throughput measurement */
+#define REPLICA_THROUGHPUT_WEIGHT 0.25
+
+/**
+ * Set whether data objects are read from a replicate chosen by the
+ * client, rather than by the server. Valid replicates are tried in
+ * order: those on a resource, or at a location, named in the
+ * preference list first, in the order given; then the others by the
+ * throughput measured when reading from their resources, with
+ * resources not yet measured ahead of the rest so that each is tried.
+ *
+ * @param[in] enabled      True to choose replicates.
+ * @param[in] preferences  A comma-separated list of resource names or
+ *                         locations, in order of preference. Optional.
+ *
+ * @return 0 on success, or -1 if the list has more than
+ *         REPLICA_MAX_PREFERENCES names.
+ */
+int set_replica_selection(int enabled, const char *preferences);
+
+/**
+ * Return true if data objects are read from a replicate chosen by the
+ * client.
+ *
+ * @return 1 if replicates are chosen, 0 otherwise.
+ */
+int use_replica_selection(void);
+
+/**
+ * Record the throughput of a read from a resource.
+ *
+ * @param[in] resource  A resource name.
+ * @param[in] bytes     The number of bytes read.
+ * @param[in] seconds   The time taken, including opening the replicate.
+ */
+void record_replica_throughput(const char *resource, size_t bytes,
+                               double seconds);
+
+/**
+ * Return the throughput recorded for a resource.
+ *
+ * @param[in] resource  A resource name.
+ *
+ * @return Bytes per second, or a negative number if none is recorded.
+ */
+double get_replica_throughput(const char *resource);
+
+/**
+ * Forget all recorded throughput.
+ */
+void clear_replica_throughput(void);
+
+/**
+ * Return the valid replicates of a data object in the order in which
+ * they should be tried, as described for @ref set_replica_selection.
+ *
+ * @param[in]  replicates  A JSON array of replicates, as returned by
+ *                         list_replicates.
+ * @param[out] error       An error report struct.
+ *
+ * @return A new JSON array, which may be empty, which must be freed by
+ *         the caller.
+ */
+json_t *rank_replicates(json_t *replicates, baton_error_t *error);
+
+/**
+ * Open a data object for reading from the best of its valid
+ * replicates, falling back to the next best if one cannot be opened.
+ * If the replicates cannot be listed, or none is valid, the server
+ * chooses as usual.
+ *
+ * @param[in]     conn         An open iRODS connection.
+ * @param[in]     rods_path    A resolved iRODS data object path.
+ * @param[in,out] obj_open_in  The open request, with its path and flags
+ *                             set.
+ * @param[out]    resource     A buffer for the resource of the replicate
+ *                             opened, set empty if the server chose.
+ * @param[in]     len          The length of the resource buffer.
+ * @param[out]    number       The number of the replicate opened.
+ *
+ * @return A data object descriptor, or an iRODS error code from the
+ *         last attempt.
+ */
+int open_best_replica(rcComm_t *conn, rodsPath_t *rods_path,
+                      dataObjInp_t *obj_open_in, char *resource,
+                      size_t len, int *number);
+
+#endif // _BATON_REPLICA_H
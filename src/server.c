@@ -0,0 +1,665 @@
+/**
+ * Copyright (C) 2017 Genome Research Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @file server.c
+ * @author Keith James <kdj@sanger.ac.uk>
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <jansson.h>
+
+#include "config.h"
+#include "baton.h"
+#include "json.h"
+#include "server.h"
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+static volatile sig_atomic_t server_stopping = 0;
+
+// Clients accepted by the main thread, waiting for a worker
+typedef struct client_queue {
+    pthread_mutex_t lock;
+    /** Signalled when a client is queued or the server stops */
+    pthread_cond_t queued;
+    /** Signalled when a client is taken by a worker */
+    pthread_cond_t released;
+    /** A ring of client socket descriptors */
+    int *clients;
+    size_t capacity;
+    size_t head;
+    size_t count;
+    /** True when no more clients will be queued */
+    int stopping;
+    baton_json_op fn;
+    operation_args_t *args;
+} client_queue_t;
+
+typedef struct server_worker {
+    pthread_t thread;
+    rodsEnv env;
+    /** The connection kept by the worker between clients */
+    rcComm_t *conn;
+    size_t index;
+    client_queue_t *queue;
+} server_worker_t;
+
+int server_socket_path(char *path, size_t len) {
+    const char *socket_path = getenv(SERVER_SOCKET_ENV);
+    const char *runtime_dir = getenv("XDG_RUNTIME_DIR");
+
+    int n;
+    if (socket_path && strlen(socket_path) > 0) {
+        n = snprintf(path, len, "%s", socket_path);
+    }
+    else if (runtime_dir && strlen(runtime_dir) > 0) {
+        n = snprintf(path, len, "%s/%s", runtime_dir, SERVER_SOCKET_NAME);
+    }
+    else {
+        n = snprintf(path, len, "/tmp/baton-server-%d.sock", (int) getuid());
+    }
+
+    return (n < 0 || (size_t) n >= len) ? -1 : 0;
+}
+
+void stop_server(void) {
+    server_stopping = 1;
+}
+
+static int make_socket_addr(const char *socket_path, struct sockaddr_un *addr,
+                            baton_error_t *error) {
+    memset(addr, 0, sizeof *addr);
+    addr->sun_family = AF_UNIX;
+
+    if (strlen(socket_path) >= sizeof addr->sun_path) {
+        set_baton_error(error, ENAMETOOLONG, "Socket path '%s' is too long",
+                        socket_path);
+        return error->code;
+    }
+
+    snprintf(addr->sun_path, sizeof addr->sun_path, "%s", socket_path);
+
+    return 0;
+}
+
+int connect_server(const char *socket_path, baton_error_t *error) {
+    int sock = -1;
+
+    init_baton_error(error);
+
+    struct sockaddr_un addr;
+    if (make_socket_addr(socket_path, &addr, error) != 0) goto error;
+
+    // A socket belonging to another user could impersonate the server
+    struct stat st;
+    if (lstat(socket_path, &st) != 0) {
+        set_baton_error(error, errno, "Failed to stat socket '%s': "
+                        "error %d %s", socket_path, errno, strerror(errno));
+        goto error;
+    }
+    if (!S_ISSOCK(st.st_mode) || st.st_uid != geteuid()) {
+        set_baton_error(error, -1, "'%s' is not a socket belonging to "
+                        "the current user", socket_path);
+        goto error;
+    }
+
+    sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock < 0) {
+        set_baton_error(error, errno, "Failed to create a socket: "
+                        "error %d %s", errno, strerror(errno));
+        goto error;
+    }
+
+    if (connect(sock, (struct sockaddr *) &addr, sizeof addr) != 0) {
+        set_baton_error(error, errno, "Failed to connect to '%s': "
+                        "error %d %s", socket_path, errno, strerror(errno));
+        goto error;
+    }
+
+    return sock;
+
+error:
+    if (sock >= 0) close(sock);
+
+    return -1;
+}
+
+static int listen_socket(const char *socket_path, baton_error_t *error) {
+    int sock = -1;
+
+    struct sockaddr_un addr;
+    if (make_socket_addr(socket_path, &addr, error) != 0) goto error;
+
+    struct stat st;
+    if (lstat(socket_path, &st) == 0) {
+        if (!S_ISSOCK(st.st_mode) || st.st_uid != geteuid()) {
+            set_baton_error(error, EEXIST, "'%s' exists and is not a socket "
+                            "belonging to the current user", socket_path);
+            goto error;
+        }
+
+        baton_error_t probe_error;
+        int probe = connect_server(socket_path, &probe_error);
+        if (probe >= 0) {
+            close(probe);
+            set_baton_error(error, EADDRINUSE, "A server is already "
+                            "listening on '%s'", socket_path);
+            goto error;
+        }
+
+        // Left by a server that did not stop cleanly
+        logmsg(NOTICE, "Removing stale socket '%s'", socket_path);
+        if (unlink(socket_path) != 0) {
+            set_baton_error(error, errno, "Failed to remove '%s': "
+                            "error %d %s", socket_path, errno,
+                            strerror(errno));
+            goto error;
+        }
+    }
+
+    sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock < 0) {
+        set_baton_error(error, errno, "Failed to create a socket: "
+                        "error %d %s", errno, strerror(errno));
+        goto error;
+    }
+
+    // The server acts with the credentials of its user, so only that
+    // user may connect
+    mode_t mask = umask(0077);
+    int status = bind(sock, (struct sockaddr *) &addr, sizeof addr);
+    umask(mask);
+
+    if (status != 0) {
+        set_baton_error(error, errno, "Failed to bind '%s': error %d %s",
+                        socket_path, errno, strerror(errno));
+        goto error;
+    }
+
+    if (listen(sock, SOMAXCONN) != 0) {
+        set_baton_error(error, errno, "Failed to listen on '%s': "
+                        "error %d %s", socket_path, errno, strerror(errno));
+        unlink(socket_path);
+        goto error;
+    }
+
+    return sock;
+
+error:
+    if (sock >= 0) close(sock);
+
+    return -1;
+}
+
+// Return true if a client runs as the same user as the server
+static int is_own_client(int client) {
+#ifdef SO_PEERCRED
+    struct ucred cred;
+    socklen_t len = sizeof cred;
+    if (getsockopt(client, SOL_SOCKET, SO_PEERCRED, &cred, &len) != 0) {
+        return 0;
+    }
+
+    return cred.uid == geteuid();
+#else
+    (void) client;
+
+    return 1;
+#endif
+}
+
+// Replace a worker's connection, which may be broken, along with any
+// spare connections opened by its thread
+static void reconnect_worker(server_worker_t *worker) {
+    free_spare_connection();
+    if (worker->conn) rcDisconnect(worker->conn);
+
+    worker->conn = rods_login(&worker->env);
+}
+
+// End a session by sending the number of documents that failed, so
+// that the client may exit as baton-do would
+static void print_session_status(FILE *out, int error_count) {
+    fputc(SERVER_STATUS_MARKER, out);
+    fprintf(out, "%d\n", error_count);
+    fflush(out);
+}
+
+static void serve_client(server_worker_t *worker, int client) {
+    client_queue_t *queue = worker->queue;
+    FILE *in  = NULL;
+    FILE *out = NULL;
+
+    int out_fd = dup(client);
+    if (out_fd >= 0) out = fdopen(out_fd, "w");
+    in = fdopen(client, "r");
+
+    if (!in || !out) {
+        logmsg(ERROR, "Failed to open a client stream: error %d %s",
+               errno, strerror(errno));
+        goto finally;
+    }
+
+    if (!worker->conn) reconnect_worker(worker);
+
+    if (!worker->conn) {
+        baton_error_t error;
+        init_baton_error(&error);
+        set_baton_error(&error, -1, "Failed to connect to the iRODS server");
+
+        json_t *report = json_object();
+        if (report) {
+            add_error_value(report, &error);
+            print_json_stream(report, out);
+            json_decref(report);
+        }
+        print_session_status(out, 1);
+        goto finally;
+    }
+
+    // Results are written to the client, so they may not be printed
+    // to stdout as they arrive
+    operation_args_t args = *queue->args;
+    args.flags = args.flags & ~STREAM_RESULTS;
+
+    int connection_lost = 0;
+    int error_count = do_operation_stream(in, out, &worker->env,
+                                          &worker->conn, queue->fn, &args,
+                                          &connection_lost);
+    logmsg(DEBUG, "Worker %zu served a client with %d errors",
+           worker->index, error_count);
+    print_session_status(out, error_count);
+
+    if (connection_lost) {
+        logmsg(WARN, "Worker %zu lost its iRODS connection; reconnecting",
+               worker->index);
+        reconnect_worker(worker);
+    }
+
+finally:
+    if (out)              fclose(out);
+    else if (out_fd >= 0) close(out_fd);
+    if (in)               fclose(in);
+    else                  close(client);
+}
+
+static void *run_server_worker(void *arg) {
+    server_worker_t *worker = arg;
+    client_queue_t *queue   = worker->queue;
+
+    pthread_mutex_lock(&queue->lock);
+
+    while (1) {
+        while (queue->count == 0 && !queue->stopping) {
+            pthread_cond_wait(&queue->queued, &queue->lock);
+        }
+
+        if (queue->count == 0) break; // Stopping
+
+        int client  = queue->clients[queue->head];
+        queue->head = (queue->head + 1) % queue->capacity;
+        queue->count--;
+        pthread_cond_signal(&queue->released);
+
+        pthread_mutex_unlock(&queue->lock);
+        serve_client(worker, client);
+        pthread_mutex_lock(&queue->lock);
+    } // while
+
+    pthread_mutex_unlock(&queue->lock);
+
+    free_spare_connection();
+
+    return NULL;
+}
+
+static void stop_workers(client_queue_t *queue, server_worker_t *workers,
+                         size_t num_started) {
+    pthread_mutex_lock(&queue->lock);
+    queue->stopping = 1;
+    pthread_cond_broadcast(&queue->queued);
+    pthread_mutex_unlock(&queue->lock);
+
+    for (size_t i = 0; i < num_started; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+}
+
+int serve_operations(const char *socket_path, baton_json_op fn,
+                     operation_args_t *args, baton_error_t *error) {
+    int listener       = -1;
+    size_t num_started = 0;
+    size_t num_workers = args->num_workers > 0 ? args->num_workers :
+        SERVER_DEFAULT_WORKERS;
+    if (num_workers > SERVER_MAX_WORKERS) num_workers = SERVER_MAX_WORKERS;
+
+    init_baton_error(error);
+    server_stopping = 0;
+
+    client_queue_t queue = { .clients  = NULL,
+                             .capacity = num_workers * SERVER_QUEUE_SLOTS,
+                             .head     = 0,
+                             .count    = 0,
+                             .stopping = 0,
+                             .fn       = fn,
+                             .args     = args };
+    pthread_mutex_init(&queue.lock, NULL);
+    pthread_cond_init(&queue.queued, NULL);
+    pthread_cond_init(&queue.released, NULL);
+
+    server_worker_t *workers = calloc(num_workers, sizeof (server_worker_t));
+    queue.clients = calloc(queue.capacity, sizeof (int));
+    if (!workers || !queue.clients) {
+        set_baton_error(error, errno, "Failed to allocate memory: "
+                        "error %d %s", errno, strerror(errno));
+        goto error;
+    }
+
+    // Log in before listening, so that the pool is ready for the first
+    // client
+    for (size_t i = 0; i < num_workers; i++) {
+        workers[i].index = i;
+        workers[i].queue = &queue;
+        workers[i].conn  = rods_login(&workers[i].env);
+        if (!workers[i].conn) {
+            set_baton_error(error, -1, "Failed to log in worker %zu", i);
+            goto error;
+        }
+    }
+
+    listener = listen_socket(socket_path, error);
+    if (listener < 0) goto error;
+
+    for (size_t i = 0; i < num_workers; i++) {
+        int status = pthread_create(&workers[i].thread, NULL,
+                                    run_server_worker, &workers[i]);
+        if (status != 0) {
+            set_baton_error(error, status, "Failed to start worker %zu: "
+                            "error %d %s", i, status, strerror(status));
+            goto error;
+        }
+
+        num_started++;
+    }
+
+    logmsg(NOTICE, "Serving on '%s' with %zu workers", socket_path,
+           num_workers);
+
+    while (!server_stopping) {
+        struct pollfd pfd = { .fd = listener, .events = POLLIN, .revents = 0 };
+
+        // Wake from time to time to check whether to stop
+        int ready = poll(&pfd, 1, SERVER_POLL_MSECS);
+        if (ready < 0 && errno != EINTR) {
+            set_baton_error(error, errno, "Failed to poll '%s': error %d %s",
+                            socket_path, errno, strerror(errno));
+            goto error;
+        }
+        if (ready <= 0) continue;
+
+        int client = accept(listener, NULL, NULL);
+        if (client < 0) {
+            if (errno == EINTR || errno == EAGAIN || errno == ECONNABORTED) {
+                continue;
+            }
+
+            set_baton_error(error, errno, "Failed to accept a client on "
+                            "'%s': error %d %s", socket_path, errno,
+                            strerror(errno));
+            goto error;
+        }
+
+        if (!is_own_client(client)) {
+            logmsg(WARN, "Refused a client belonging to another user");
+            close(client);
+            continue;
+        }
+
+        pthread_mutex_lock(&queue.lock);
+
+        while (queue.count == queue.capacity) {
+            pthread_cond_wait(&queue.released, &queue.lock);
+        }
+
+        queue.clients[(queue.head + queue.count) % queue.capacity] = client;
+        queue.count++;
+        pthread_cond_signal(&queue.queued);
+
+        pthread_mutex_unlock(&queue.lock);
+    } // while
+
+    logmsg(NOTICE, "Stopping serving on '%s'", socket_path);
+
+    stop_workers(&queue, workers, num_started);
+
+    close(listener);
+    unlink(socket_path);
+
+    for (size_t i = 0; i < num_workers; i++) {
+        if (workers[i].conn) rcDisconnect(workers[i].conn);
+    }
+    free(workers);
+    free(queue.clients);
+
+    pthread_cond_destroy(&queue.released);
+    pthread_cond_destroy(&queue.queued);
+    pthread_mutex_destroy(&queue.lock);
+
+    return error->code;
+
+error:
+    logmsg(ERROR, "%s", error->message);
+
+    stop_workers(&queue, workers, num_started);
+
+    if (listener >= 0) {
+        close(listener);
+        unlink(socket_path);
+    }
+
+    if (workers) {
+        for (size_t i = 0; i < num_workers; i++) {
+            if (workers[i].conn) rcDisconnect(workers[i].conn);
+        }
+        free(workers);
+    }
+    if (queue.clients) free(queue.clients);
+
+    pthread_cond_destroy(&queue.released);
+    pthread_cond_destroy(&queue.queued);
+    pthread_mutex_destroy(&queue.lock);
+
+    return error->code;
+}
+
+static int write_all(int fd, const char *buffer, size_t len) {
+    while (len > 0) {
+        ssize_t nw = write(fd, buffer, len);
+        if (nw < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+
+        buffer += nw;
+        len    -= (size_t) nw;
+    }
+
+    return 0;
+}
+
+int relay_server(int sock, int in_fd, int out_fd, size_t *num_failed,
+                 baton_error_t *error) {
+    char *in_buffer  = NULL;
+    char *out_buffer = NULL;
+
+    // The status sent after the results, once its marker is seen
+    char status[32];
+    size_t status_len = 0;
+    int status_seen   = 0;
+
+    init_baton_error(error);
+    *num_failed = 0;
+
+    in_buffer  = malloc(SERVER_RELAY_BUFFER_SIZE);
+    out_buffer = malloc(SERVER_RELAY_BUFFER_SIZE);
+    if (!in_buffer || !out_buffer) {
+        set_baton_error(error, errno, "Failed to allocate memory: "
+                        "error %d %s", errno, strerror(errno));
+        goto error;
+    }
+
+    // Input is only read once the previous block has been sent, while
+    // output is always read, so that the server is never blocked from
+    // writing results by a client blocked sending input
+    size_t in_len = 0;
+    size_t in_pos = 0;
+    int in_open   = 1;
+
+    while (1) {
+        struct pollfd fds[2];
+        nfds_t nfds = 1;
+
+        fds[0].fd      = sock;
+        fds[0].events  = POLLIN;
+        fds[0].revents = 0;
+
+        if (in_pos < in_len) {
+            fds[0].events = POLLIN | POLLOUT;
+        }
+        else if (in_open) {
+            fds[1].fd      = in_fd;
+            fds[1].events  = POLLIN;
+            fds[1].revents = 0;
+            nfds = 2;
+        }
+
+        if (poll(fds, nfds, -1) < 0) {
+            if (errno == EINTR) continue;
+
+            set_baton_error(error, errno, "Failed to poll the server "
+                            "connection: error %d %s", errno,
+                            strerror(errno));
+            goto error;
+        }
+
+        if (fds[0].revents & POLLOUT) {
+            ssize_t nw = send(sock, in_buffer + in_pos, in_len - in_pos,
+                              MSG_NOSIGNAL | MSG_DONTWAIT);
+            if (nw < 0 && errno != EINTR && errno != EAGAIN) {
+                set_baton_error(error, errno, "Failed to send to the "
+                                "server: error %d %s", errno,
+                                strerror(errno));
+                goto error;
+            }
+            if (nw > 0) in_pos += (size_t) nw;
+        }
+
+        if (nfds > 1 && (fds[1].revents & (POLLIN | POLLHUP | POLLERR))) {
+            ssize_t nr = read(in_fd, in_buffer, SERVER_RELAY_BUFFER_SIZE);
+            if (nr < 0 && errno != EINTR) {
+                set_baton_error(error, errno, "Failed to read input: "
+                                "error %d %s", errno, strerror(errno));
+                goto error;
+            }
+
+            if (nr == 0) {
+                // The end of the input tells the server to finish
+                in_open = 0;
+                shutdown(sock, SHUT_WR);
+            }
+            else if (nr > 0) {
+                in_len = (size_t) nr;
+                in_pos = 0;
+            }
+        }
+
+        if (fds[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+            ssize_t nr = read(sock, out_buffer, SERVER_RELAY_BUFFER_SIZE);
+            if (nr < 0) {
+                if (errno == EINTR) continue;
+
+                set_baton_error(error, errno, "Failed to read from the "
+                                "server: error %d %s", errno,
+                                strerror(errno));
+                goto error;
+            }
+
+            if (nr == 0) break; // The server has finished
+
+            size_t len = (size_t) nr;
+            const char *rest = out_buffer;
+            if (!status_seen) {
+                const char *marker = memchr(out_buffer, SERVER_STATUS_MARKER,
+                                            len);
+                size_t out_len = marker ? (size_t) (marker - out_buffer) : len;
+
+                if (write_all(out_fd, out_buffer, out_len) != 0) {
+                    set_baton_error(error, errno, "Failed to write output: "
+                                    "error %d %s", errno, strerror(errno));
+                    goto error;
+                }
+
+                status_seen = marker != NULL;
+                rest = marker ? marker + 1 : out_buffer + len;
+                len  = (size_t) (out_buffer + len - rest);
+            }
+
+            size_t room = sizeof status - 1 - status_len;
+            if (len > room) len = room;
+            memcpy(status + status_len, rest, len);
+            status_len += len;
+        }
+    } // while
+
+    if (in_open || in_pos < in_len) {
+        set_baton_error(error, -1, "The server closed the connection "
+                        "before reading all the input");
+        goto error;
+    }
+
+    if (!status_seen) {
+        set_baton_error(error, -1, "The server closed the connection "
+                        "before completing the session");
+        goto error;
+    }
+
+    status[status_len] = '\0';
+    *num_failed = strtoul(status, NULL, 10);
+
+    free(in_buffer);
+    free(out_buffer);
+
+    return error->code;
+
+error:
+    if (in_buffer)  free(in_buffer);
+    if (out_buffer) free(out_buffer);
+
+    return error->code;
+}
@@ -0,0 +1,125 @@
+/**
+ * Copyright (C) 2017 Genome Research Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @file server.h
+ * @author Keith James <kdj@sanger.ac.uk>
+ */
+
+#ifndef _BATON_SERVER_H
+#define _BATON_SERVER_H
+
+#include <stddef.h>
+
+#include "config.h"
+#include "error.h"
+#include "operations.h"
+
+/** The environment variable naming the server socket */
+#define SERVER_SOCKET_ENV  "BATON_SOCKET"
+/** The name of the server socket in the default directory */
+#define SERVER_SOCKET_NAME "baton-server.sock"
+
+/** The default number of sessions served at once */
+#define SERVER_DEFAULT_WORKERS  4
+/** The maximum number of sessions served at once */
+#define SERVER_MAX_WORKERS     64
+/** The number of accepted clients queued per worker */
+#define SERVER_QUEUE_SLOTS      4
+/** The interval at which the server checks whether to stop */
+#define SERVER_POLL_MSECS     500
+
+/** The number of bytes a client relays at one time */
+#define SERVER_RELAY_BUFFER_SIZE (64 * 1024)
+
+/** Precedes the number of failed documents sent at the end of a
+    session; a NUL byte never appears in JSON output */
+#define SERVER_STATUS_MARKER '\0'
+
+/**
+ * Write the default path of the server socket into a buffer. This is
+ * the value of BATON_SOCKET, if set, otherwise SERVER_SOCKET_NAME in
+ * $XDG_RUNTIME_DIR, otherwise a name in /tmp containing the user ID.
+ *
+ * @param[out] path  A buffer.
+ * @param[in]  len   The length of the buffer.
+ *
+ * @return 0 on success, or -1 if the path does not fit.
+ */
+int server_socket_path(char *path, size_t len);
+
+/**
+ * Serve baton JSON documents on a Unix domain socket until @ref
+ * stop_server is called. The server logs in args->num_workers times
+ * before it starts listening and each connection is then kept for the
+ * life of the server, so that clients do not pay for a connection and
+ * login. Each client is served by one worker for as long as it stays
+ * connected, its documents being processed in order as described for
+ * @ref do_operation_stream. A connection that fails is replaced before
+ * the worker serves its next client.
+ *
+ * The socket may only be used by the user running the server. Local
+ * paths in documents are relative to the working directory of the
+ * server. The caller should ignore SIGPIPE, so that a client that
+ * disconnects early does not stop the server.
+ *
+ * @param[in]  socket_path  The path of the socket, which must not be in
+ *                          use by another server.
+ * @param[in]  fn           A function.
+ * @param[in]  args         Function behaviour options applied to all
+ *                          documents.
+ * @param[out] error        An error report struct.
+ *
+ * @return 0 on success, error code on failure.
+ */
+int serve_operations(const char *socket_path, baton_json_op fn,
+                     operation_args_t *args, baton_error_t *error);
+
+/**
+ * Ask a running server to stop. Clients being served are allowed to
+ * finish. This may be called from a signal handler.
+ */
+void stop_server(void);
+
+/**
+ * Connect to a server socket, which must belong to the current user.
+ *
+ * @param[in]  socket_path  The path of the socket.
+ * @param[out] error        An error report struct.
+ *
+ * @return A connected socket descriptor, or -1 on error.
+ */
+int connect_server(const char *socket_path, baton_error_t *error);
+
+/**
+ * Send all input to a connected server and copy everything it sends
+ * back to an output until the server closes the connection. Sending
+ * and receiving are interleaved, so that results are copied while
+ * input is still being sent. The number of documents that failed,
+ * which the server sends after its results, is not copied.
+ *
+ * @param[in]  sock        A socket descriptor from @ref connect_server.
+ * @param[in]  in_fd       The input descriptor.
+ * @param[in]  out_fd      The output descriptor.
+ * @param[out] num_failed  The number of documents that failed.
+ * @param[out] error       An error report struct.
+ *
+ * @return 0 on success, error code on failure, including the server
+ * closing the connection without sending the number that failed.
+ */
+int relay_server(int sock, int in_fd, int out_fd, size_t *num_failed,
+                 baton_error_t *error);
+
+#endif // _BATON_SERVER_H
@@ -0,0 +1,418 @@
+/**
+ * Copyright (C) 2017 Genome Research Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @file specific_cache.c
+ * @author Keith James <kdj@sanger.ac.uk>
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <jansson.h>
+
+#include "config.h"
+#include "arena.h"
+#include "log.h"
+#include "specific_cache.h"
+#include "utilities.h"
+
+/** The maximum length of the key identifying a server */
+#define SERVER_KEY_LEN (NAME_LEN * 2 + 16)
+
+typedef struct sql_entry {
+    /** The server on which the alias is defined */
+    char *server;
+    /** The specific query alias */
+    char *alias;
+    /** The SQL of the alias */
+    char *sql;
+    /** The time at which the SQL was fetched from the server */
+    time_t fetched;
+    struct sql_entry *next;
+} sql_entry_t;
+
+typedef struct format_entry {
+    /** The SQL from which the format was parsed, which is the key */
+    char *sql;
+    /** The format parsed from the SQL */
+    query_format_in_t *format;
+    struct format_entry *next;
+} format_entry_t;
+
+// The cache is shared by all threads. Its memory is allocated from the
+// heap, never from a JSON arena, because it outlives any one operation.
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static sql_entry_t *sql_entries       = NULL;
+static format_entry_t *format_entries = NULL;
+static size_t num_formats = 0;
+static char *cache_file   = NULL;
+static unsigned int cache_ttl = SPECIFIC_CACHE_DEFAULT_TTL;
+
+static void server_key(rcComm_t *conn, char *key) {
+    snprintf(key, SERVER_KEY_LEN, "%s:%d/%s", conn->host, conn->portNum,
+             conn->proxyUser.rodsZone);
+}
+
+static query_format_in_t *copy_format(const query_format_in_t *format) {
+    query_format_in_t *copy = malloc(sizeof (query_format_in_t));
+    if (!copy) goto error;
+
+    memcpy(copy, format, sizeof (query_format_in_t));
+    memset(copy->labels, 0, sizeof copy->labels);
+
+    for (size_t i = 0; i < format->num_columns; i++) {
+        if (format->labels[i]) {
+            copy->labels[i] = strdup(format->labels[i]);
+            if (!copy->labels[i]) goto error;
+        }
+    }
+
+    return copy;
+
+error:
+    logmsg(ERROR, "Failed to allocate memory: error %d %s",
+           errno, strerror(errno));
+    if (copy) free_specific_labels(copy);
+
+    return NULL;
+}
+
+static void free_sql_entry(sql_entry_t *entry) {
+    if (entry->server) free(entry->server);
+    if (entry->alias)  free(entry->alias);
+    if (entry->sql)    free(entry->sql);
+    free(entry);
+}
+
+static void free_format_entry(format_entry_t *entry) {
+    if (entry->sql)    free(entry->sql);
+    if (entry->format) free_specific_labels(entry->format);
+    free(entry);
+}
+
+// Return true if SQL fetched at a time is no longer valid. The cache
+// lock must be held.
+static int is_expired(time_t fetched, time_t now) {
+    return fetched > now || now - fetched >= (time_t) cache_ttl;
+}
+
+// Return the unexpired entry for an alias, freeing any expired one.
+// The cache lock must be held.
+static sql_entry_t *find_sql_entry(const char *server, const char *alias) {
+    time_t now = time(NULL);
+
+    for (sql_entry_t **prev = &sql_entries; *prev; prev = &(*prev)->next) {
+        sql_entry_t *entry = *prev;
+
+        if (str_equals(entry->server, server, SERVER_KEY_LEN) &&
+            str_equals(entry->alias, alias, MAX_NAME_LEN)) {
+            if (!is_expired(entry->fetched, now)) return entry;
+
+            logmsg(DEBUG, "Cached SQL for specific alias '%s' has expired",
+                   alias);
+            *prev = entry->next;
+            free_sql_entry(entry);
+
+            return NULL;
+        }
+    }
+
+    return NULL;
+}
+
+// Add an entry for an alias, or return the existing unexpired one.
+// The cache lock must be held.
+static sql_entry_t *add_sql_entry(const char *server, const char *alias,
+                                  const char *sql, time_t fetched) {
+    sql_entry_t *entry = find_sql_entry(server, alias);
+    if (entry) return entry;
+
+    entry = calloc(1, sizeof (sql_entry_t));
+    if (!entry) goto error;
+
+    entry->server  = strdup(server);
+    entry->alias   = strdup(alias);
+    entry->sql     = strdup(sql);
+    entry->fetched = fetched;
+    if (!entry->server || !entry->alias || !entry->sql) goto error;
+
+    entry->next = sql_entries;
+    sql_entries = entry;
+
+    return entry;
+
+error:
+    logmsg(ERROR, "Failed to allocate memory: error %d %s",
+           errno, strerror(errno));
+    if (entry) free_sql_entry(entry);
+
+    return NULL;
+}
+
+// Read entries from the cache file, as a JSON object of servers, each
+// an object of aliases. The cache lock must be held.
+static int load_cache_file(const char *path) {
+    json_t *servers = NULL;
+    time_t now = time(NULL);
+
+    FILE *in = fopen(path, "r");
+    if (!in) {
+        if (errno == ENOENT) return 0;
+
+        logmsg(ERROR, "Failed to open specific query cache '%s': "
+               "error %d %s", path, errno, strerror(errno));
+        goto error;
+    }
+
+    json_error_t load_error;
+    servers = json_loadf(in, 0, &load_error);
+    fclose(in);
+
+    if (!servers || !json_is_object(servers)) {
+        logmsg(ERROR, "Failed to read specific query cache '%s': %s",
+               path, servers ? "not a JSON object" : load_error.text);
+        goto error;
+    }
+
+    const char *server;
+    json_t *aliases;
+    json_object_foreach(servers, server, aliases) {
+        if (!json_is_object(aliases)) continue;
+
+        const char *alias;
+        json_t *cached;
+        json_object_foreach(aliases, alias, cached) {
+            json_t *sql     = json_object_get(cached, "sql");
+            json_t *fetched = json_object_get(cached, "time");
+            if (!json_is_string(sql) || !json_is_integer(fetched)) continue;
+
+            time_t t = (time_t) json_integer_value(fetched);
+            if (is_expired(t, now)) continue;
+
+            add_sql_entry(server, alias, json_string_value(sql), t);
+        }
+    }
+
+    json_decref(servers);
+
+    return 0;
+
+error:
+    if (servers) json_decref(servers);
+
+    return -1;
+}
+
+// Write all the entries to the cache file, by way of a temporary file
+// so that concurrent readers never see a partial file. The cache lock
+// must be held.
+static void save_cache_file(const char *path) {
+    char tmp_path[MAX_NAME_LEN];
+    json_t *servers = json_object();
+    if (!servers) goto error;
+
+    for (sql_entry_t *entry = sql_entries; entry; entry = entry->next) {
+        json_t *aliases = json_object_get(servers, entry->server);
+        if (!aliases) {
+            aliases = json_object();
+            if (json_object_set_new(servers, entry->server, aliases) != 0) {
+                goto error;
+            }
+        }
+
+        json_t *cached = json_pack("{s:s, s:I}", "sql", entry->sql,
+                                   "time", (json_int_t) entry->fetched);
+        if (json_object_set_new(aliases, entry->alias, cached) != 0) {
+            goto error;
+        }
+    }
+
+    snprintf(tmp_path, sizeof tmp_path, "%s.%d", path, (int) getpid());
+    if (json_dump_file(servers, tmp_path, JSON_INDENT(2)) != 0 ||
+        rename(tmp_path, path) != 0) {
+        logmsg(WARN, "Failed to write specific query cache '%s': "
+               "error %d %s", path, errno, strerror(errno));
+        unlink(tmp_path);
+    }
+
+    json_decref(servers);
+
+    return;
+
+error:
+    logmsg(WARN, "Failed to prepare specific query cache '%s'", path);
+    if (servers) json_decref(servers);
+
+    return;
+}
+
+void set_specific_cache_ttl(unsigned int ttl) {
+    pthread_mutex_lock(&cache_lock);
+    cache_ttl = ttl;
+    pthread_mutex_unlock(&cache_lock);
+}
+
+unsigned int get_specific_cache_ttl(void) {
+    pthread_mutex_lock(&cache_lock);
+    unsigned int ttl = cache_ttl;
+    pthread_mutex_unlock(&cache_lock);
+
+    return ttl;
+}
+
+int set_specific_cache_file(const char *path) {
+    int status = 0;
+
+    pthread_mutex_lock(&cache_lock);
+
+    if (cache_file) free(cache_file);
+    cache_file = NULL;
+
+    if (path) {
+        cache_file = strdup(path);
+
+        json_arena_t *previous = use_json_arena(NULL);
+        status = load_cache_file(path);
+        use_json_arena(previous);
+    }
+
+    pthread_mutex_unlock(&cache_lock);
+
+    return status;
+}
+
+// Return a copy of the SQL of an entry, which may be freed as soon
+// as the cache lock is released. The cache lock must be held.
+static char *copy_sql(const sql_entry_t *entry) {
+    if (!entry) return NULL;
+
+    char *sql = strdup(entry->sql);
+    if (!sql) {
+        logmsg(ERROR, "Failed to allocate memory: error %d %s",
+               errno, strerror(errno));
+    }
+
+    return sql;
+}
+
+char *get_cached_specific_sql(rcComm_t *conn, const char *alias) {
+    char server[SERVER_KEY_LEN];
+    server_key(conn, server);
+
+    pthread_mutex_lock(&cache_lock);
+
+    char *sql = copy_sql(find_sql_entry(server, alias));
+
+    pthread_mutex_unlock(&cache_lock);
+
+    return sql;
+}
+
+char *store_specific_sql(rcComm_t *conn, const char *alias,
+                         const char *sql) {
+    char server[SERVER_KEY_LEN];
+    server_key(conn, server);
+
+    pthread_mutex_lock(&cache_lock);
+
+    sql_entry_t *entry = add_sql_entry(server, alias, sql, time(NULL));
+    if (entry && cache_file) {
+        json_arena_t *previous = use_json_arena(NULL);
+        save_cache_file(cache_file);
+        use_json_arena(previous);
+    }
+
+    char *copy = copy_sql(entry);
+
+    pthread_mutex_unlock(&cache_lock);
+
+    return copy;
+}
+
+query_format_in_t *get_cached_specific_format(const char *sql) {
+    query_format_in_t *format = NULL;
+
+    pthread_mutex_lock(&cache_lock);
+
+    for (format_entry_t *entry = format_entries; entry; entry = entry->next) {
+        if (strcmp(entry->sql, sql) == 0) {
+            format = copy_format(entry->format);
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&cache_lock);
+
+    return format;
+}
+
+void store_specific_format(const char *sql, const query_format_in_t *format) {
+    format_entry_t *entry = calloc(1, sizeof (format_entry_t));
+    if (!entry) goto error;
+
+    entry->sql    = strdup(sql);
+    entry->format = copy_format(format);
+    if (!entry->sql || !entry->format) goto error;
+
+    pthread_mutex_lock(&cache_lock);
+
+    // Literal SQL may differ in every query, so the number of formats
+    // is capped, while the number of aliases is limited by the servers
+    if (num_formats >= SPECIFIC_CACHE_MAX_FORMATS) {
+        pthread_mutex_unlock(&cache_lock);
+        free_format_entry(entry);
+
+        return;
+    }
+
+    entry->next    = format_entries;
+    format_entries = entry;
+    num_formats++;
+
+    pthread_mutex_unlock(&cache_lock);
+
+    return;
+
+error:
+    if (entry) free_format_entry(entry);
+
+    return;
+}
+
+void clear_specific_cache(void) {
+    pthread_mutex_lock(&cache_lock);
+
+    while (sql_entries) {
+        sql_entry_t *next = sql_entries->next;
+        free_sql_entry(sql_entries);
+        sql_entries = next;
+    }
+
+    while (format_entries) {
+        format_entry_t *next = format_entries->next;
+        free_format_entry(format_entries);
+        format_entries = next;
+    }
+
+    num_formats = 0;
+
+    pthread_mutex_unlock(&cache_lock);
+}
@@ -0,0 +1,113 @@
+/**
+ * Copyright (C) 2017 Genome Research Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @file specific_cache.h
+ * @author Keith James <kdj@sanger.ac.uk>
+ */
+
+#ifndef _BATON_SPECIFIC_CACHE_H
+#define _BATON_SPECIFIC_CACHE_H
+
+#include <rodsClient.h>
+
+#include "config.h"
+#include "query.h"
+
+/** The default number of seconds for which the SQL of an alias is
+    valid, whether fetched from a server or read from a cache file */
+#define SPECIFIC_CACHE_DEFAULT_TTL    86400
+/** The maximum number of SQL label formats held in the cache */
+#define SPECIFIC_CACHE_MAX_FORMATS     1024
+
+/**
+ * Set the time for which the SQL of cached aliases remains valid, so
+ * that aliases redefined on a server are eventually fetched again.
+ *
+ * @param[in] ttl   The time to live, in seconds.
+ */
+void set_specific_cache_ttl(unsigned int ttl);
+
+/**
+ * Return the time for which the SQL of cached aliases remains valid.
+ *
+ * @return The time to live, in seconds.
+ */
+unsigned int get_specific_cache_ttl(void);
+
+/**
+ * Set a file in which the SQL of specific query aliases is kept
+ * between invocations. Any valid entries already in the file are
+ * loaded and the file is rewritten whenever a new alias is fetched
+ * from a server.
+ *
+ * @param[in] path  A file path, or NULL to stop using a file.
+ *
+ * @return 0 on success, or -1 if an existing file could not be read.
+ */
+int set_specific_cache_file(const char *path);
+
+/**
+ * Return the SQL of a specific query alias on the server of a
+ * connection, if it is in the cache and has not expired.
+ *
+ * @param[in] conn   An open iRODS connection.
+ * @param[in] alias  A specific query alias.
+ *
+ * @return A copy of the SQL, which must be freed by the caller, or NULL
+ *         if it is not cached.
+ */
+char *get_cached_specific_sql(rcComm_t *conn, const char *alias);
+
+/**
+ * Add the SQL of a specific query alias on the server of a connection
+ * to the cache, replacing any expired SQL. Unexpired SQL already in
+ * the cache is kept.
+ *
+ * @param[in] conn   An open iRODS connection.
+ * @param[in] alias  A specific query alias.
+ * @param[in] sql    The SQL of the alias.
+ *
+ * @return A copy of the SQL in the cache, which must be freed by the
+ *         caller, or NULL on error.
+ */
+char *store_specific_sql(rcComm_t *conn, const char *alias,
+                         const char *sql);
+
+/**
+ * Return a copy of the label format parsed from a SQL query, if it is
+ * in the cache.
+ *
+ * @param[in] sql  A SQL query.
+ *
+ * @return A new format which must be freed by the caller with
+ *         free_specific_labels, or NULL if it is not cached.
+ */
+query_format_in_t *get_cached_specific_format(const char *sql);
+
+/**
+ * Add a copy of the label format parsed from a SQL query to the cache.
+ *
+ * @param[in] sql     A SQL query.
+ * @param[in] format  The format parsed from the query.
+ */
+void store_specific_format(const char *sql, const query_format_in_t *format);
+
+/**
+ * Remove all aliases and formats from the cache.
+ */
+void clear_specific_cache(void);
+
+#endif // _BATON_SPECIFIC_CACHE_H
@@ -0,0 +1,284 @@
+/**
+ * Copyright (C) 2017 Genome Research Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @file stat_cache.c
+ * @author Keith James <kdj@sanger.ac.uk>
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "config.h"
+#include "log.h"
+#include "stat_cache.h"
+#include "stats.h"
+#include "target_cache.h"
+#include "utilities.h"
+
+typedef struct stat_entry {
+    /** The iRODS path, which is the cache key */
+    char *path;
+    /** The time after which the entry is no longer valid */
+    time_t expires;
+    /** The path state as set by getRodsObjType */
+    rodsPath_t rods_path;
+    /** The stat result as returned by getRodsObjType */
+    rodsObjStat_t obj_stat;
+    struct stat_entry *next;
+} stat_entry_t;
+
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static stat_entry_t *cache[STAT_CACHE_BUCKETS];
+static size_t num_entries = 0;
+static unsigned int cache_ttl = STAT_CACHE_DEFAULT_TTL;
+
+static size_t hash_path(const char *path) {
+    size_t hash = 5381;
+
+    for (const char *c = path; *c; c++) {
+        hash = ((hash << 5) + hash) + (unsigned char) *c;
+    }
+
+    return hash % STAT_CACHE_BUCKETS;
+}
+
+static void free_entry(stat_entry_t *entry) {
+    free(entry->path);
+    free(entry);
+}
+
+// Remove expired entries from a bucket, along with any for the path
+// and, optionally, any for paths beneath it. The cache lock must be
+// held.
+static void remove_entries(size_t bucket, const char *path, time_t now,
+                           int descendants) {
+    size_t len = strnlen(path, MAX_NAME_LEN);
+    stat_entry_t **link = &cache[bucket];
+
+    while (*link) {
+        stat_entry_t *entry = *link;
+
+        int expired = entry->expires <= now;
+        int matched = str_equals(entry->path, path, MAX_NAME_LEN);
+        int beneath = descendants && len > 0 &&
+            str_starts_with(entry->path, path, MAX_NAME_LEN) &&
+            (path[len - 1] == '/' || entry->path[len] == '/');
+
+        if (expired || matched || beneath) {
+            *link = entry->next;
+            free_entry(entry);
+            num_entries--;
+        }
+        else {
+            link = &entry->next;
+        }
+    }
+}
+
+static void clear_entries(void) {
+    for (size_t i = 0; i < STAT_CACHE_BUCKETS; i++) {
+        stat_entry_t *entry = cache[i];
+        while (entry) {
+            stat_entry_t *next = entry->next;
+            free_entry(entry);
+            entry = next;
+        }
+
+        cache[i] = NULL;
+    }
+
+    num_entries = 0;
+}
+
+static int load_entry(rodsPath_t *rods_path) {
+    int found = 0;
+    time_t now = time(NULL);
+
+    pthread_mutex_lock(&cache_lock);
+
+    size_t bucket = hash_path(rods_path->outPath);
+    for (stat_entry_t *entry = cache[bucket]; entry; entry = entry->next) {
+        if (entry->expires > now &&
+            str_equals(entry->path, rods_path->outPath, MAX_NAME_LEN)) {
+
+            rodsObjStat_t *obj_stat = malloc(sizeof (rodsObjStat_t));
+            if (!obj_stat) break;
+
+            memcpy(obj_stat, &entry->obj_stat, sizeof (rodsObjStat_t));
+
+            rods_path->objType     = entry->rods_path.objType;
+            rods_path->objState    = entry->rods_path.objState;
+            rods_path->size        = entry->rods_path.size;
+            rods_path->objMode     = entry->rods_path.objMode;
+            rods_path->rodsObjStat = obj_stat;
+            memcpy(rods_path->dataId, entry->rods_path.dataId,
+                   sizeof rods_path->dataId);
+            memcpy(rods_path->chksum, entry->rods_path.chksum,
+                   sizeof rods_path->chksum);
+
+            found = 1;
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&cache_lock);
+
+    return found;
+}
+
+static void store_entry(rodsPath_t *rods_path) {
+    stat_entry_t *entry = calloc(1, sizeof (stat_entry_t));
+    if (!entry) goto error;
+
+    entry->path = copy_str(rods_path->outPath, MAX_NAME_LEN);
+    if (!entry->path) goto error;
+
+    memcpy(&entry->rods_path, rods_path, sizeof (rodsPath_t));
+    memcpy(&entry->obj_stat, rods_path->rodsObjStat, sizeof (rodsObjStat_t));
+    entry->rods_path.rodsObjStat = NULL;
+
+    time_t now = time(NULL);
+
+    pthread_mutex_lock(&cache_lock);
+
+    entry->expires = now + cache_ttl;
+
+    size_t bucket = hash_path(entry->path);
+    remove_entries(bucket, entry->path, now, 0);
+
+    if (num_entries >= STAT_CACHE_MAX_ENTRIES) {
+        logmsg(DEBUG, "Stat cache is full with %zu entries; clearing it",
+               num_entries);
+        clear_entries();
+    }
+
+    entry->next   = cache[bucket];
+    cache[bucket] = entry;
+    num_entries++;
+
+    pthread_mutex_unlock(&cache_lock);
+
+    return;
+
+error:
+    if (entry) free_entry(entry);
+
+    return;
+}
+
+void set_stat_cache_ttl(unsigned int ttl) {
+    pthread_mutex_lock(&cache_lock);
+
+    cache_ttl = ttl;
+    if (cache_ttl == 0) clear_entries();
+
+    pthread_mutex_unlock(&cache_lock);
+}
+
+unsigned int get_stat_cache_ttl(void) {
+    pthread_mutex_lock(&cache_lock);
+    unsigned int ttl = cache_ttl;
+    pthread_mutex_unlock(&cache_lock);
+
+    return ttl;
+}
+
+int get_cached_rods_obj_type(rcComm_t *conn, rodsPath_t *rods_path) {
+    // The result of getRodsObjType depends on any type already set on
+    // the path, so only untyped paths are cached
+    if (get_stat_cache_ttl() == 0 || rods_path->objType != UNKNOWN_OBJ_T) {
+        double rpc = rpc_start();
+        int status = getRodsObjType(conn, rods_path);
+        rpc_end(RPC_OBJ_STAT, rpc, 0);
+
+        return status;
+    }
+
+    if (load_entry(rods_path)) {
+        logmsg(TRACE, "Stat cache hit for '%s'", rods_path->outPath);
+        return rods_path->objState;
+    }
+
+    double rpc = rpc_start();
+    int status = getRodsObjType(conn, rods_path);
+    rpc_end(RPC_OBJ_STAT, rpc, 0);
+
+    // Special collections carry state which is not copied
+    if (status == EXIST_ST && rods_path->rodsObjStat &&
+        !rods_path->rodsObjStat->specColl) {
+        store_entry(rods_path);
+    }
+
+    return status;
+}
+
+int refresh_rods_obj_type(rcComm_t *conn, rodsPath_t *rods_path) {
+    if (get_stat_cache_ttl() == 0) return rods_path->objState;
+
+    time_t now = time(NULL);
+
+    pthread_mutex_lock(&cache_lock);
+    remove_entries(hash_path(rods_path->outPath), rods_path->outPath, now, 0);
+    pthread_mutex_unlock(&cache_lock);
+
+    forget_target(rods_path->outPath, TARGET_ALL, 0);
+
+    logmsg(TRACE, "Refreshing the stat of '%s'", rods_path->outPath);
+
+    if (rods_path->rodsObjStat) free(rods_path->rodsObjStat);
+    rods_path->rodsObjStat = NULL;
+    rods_path->objType     = UNKNOWN_OBJ_T;
+
+    return get_cached_rods_obj_type(conn, rods_path);
+}
+
+void invalidate_stat_cache(const char *path) {
+    char *parent = copy_str(path, MAX_NAME_LEN);
+    time_t now = time(NULL);
+
+    pthread_mutex_lock(&cache_lock);
+
+    logmsg(TRACE, "Invalidating stat cache for '%s'", path);
+
+    for (size_t i = 0; i < STAT_CACHE_BUCKETS; i++) {
+        if (cache[i]) remove_entries(i, path, now, 1);
+    }
+
+    // The parent collection is modified by any change to its contents
+    if (parent) {
+        char *slash = strrchr(parent, '/');
+        if (slash && slash != parent) {
+            *slash = '\0';
+            remove_entries(hash_path(parent), parent, now, 0);
+        }
+    }
+
+    pthread_mutex_unlock(&cache_lock);
+
+    // Nor is anything that a run of operations on the path has kept
+    forget_target(path, TARGET_ALL, 1);
+    if (parent) forget_target(parent, TARGET_ALL, 0);
+
+    if (parent) free(parent);
+}
+
+void clear_stat_cache(void) {
+    pthread_mutex_lock(&cache_lock);
+    clear_entries();
+    pthread_mutex_unlock(&cache_lock);
+}
@@ -0,0 +1,95 @@
+/**
+ * Copyright (C) 2017 Genome Research Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @file stat_cache.h
+ * @author Keith James <kdj@sanger.ac.uk>
+ */
+
+#ifndef _BATON_STAT_CACHE_H
+#define _BATON_STAT_CACHE_H
+
+#include <rodsClient.h>
+
+#include "config.h"
+
+/** The default number of seconds for which a cached stat is valid */
+#define STAT_CACHE_DEFAULT_TTL      10
+/** The number of hash buckets in the stat cache */
+#define STAT_CACHE_BUCKETS        1024
+/** The maximum number of paths held in the stat cache */
+#define STAT_CACHE_MAX_ENTRIES    4096
+
+/**
+ * Set the time for which cached path stats remain valid. Setting 0
+ * disables the cache and empties it.
+ *
+ * @param[in] ttl   The time to live, in seconds.
+ */
+void set_stat_cache_ttl(unsigned int ttl);
+
+/**
+ * Return the time for which cached path stats remain valid.
+ *
+ * @return The time to live, in seconds.
+ */
+unsigned int get_stat_cache_ttl(void);
+
+/**
+ * Determine the type and state of an iRODS path, as getRodsObjType
+ * does, using a cached result for the path, if there is a valid one.
+ * Paths found to exist are added to the cache. The cache is shared by
+ * all threads.
+ *
+ * @param[in]      conn       An open iRODS connection.
+ * @param[in,out]  rods_path  An iRODS path whose outPath has been set.
+ *                            On success, its rodsObjStat is a new copy
+ *                            which must be freed by the caller.
+ *
+ * @return The path state e.g. EXIST_ST, or an iRODS error code.
+ */
+int get_cached_rods_obj_type(rcComm_t *conn, rodsPath_t *rods_path);
+
+/**
+ * Determine the type and state of a resolved iRODS path afresh,
+ * replacing any cached result for the path, so that its size and
+ * checksum reflect changes made by other clients. This should be
+ * called before those are relied upon. Nothing is done if the cache
+ * is disabled, because a path is then stat'd whenever it is resolved.
+ *
+ * @param[in]      conn       An open iRODS connection.
+ * @param[in,out]  rods_path  A resolved iRODS path. Its rodsObjStat
+ *                            is replaced by a new copy which must be
+ *                            freed by the caller.
+ *
+ * @return The path state e.g. EXIST_ST, or an iRODS error code.
+ */
+int refresh_rods_obj_type(rcComm_t *conn, rodsPath_t *rods_path);
+
+/**
+ * Remove a path, and any paths beneath it, from the stat cache. This
+ * must be called after any operation that moves, creates, writes or
+ * removes the path.
+ *
+ * @param[in] path  An absolute iRODS path.
+ */
+void invalidate_stat_cache(const char *path);
+
+/**
+ * Remove all paths from the stat cache.
+ */
+void clear_stat_cache(void);
+
+#endif // _BATON_STAT_CACHE_H
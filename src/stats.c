@@ -0,0 +1,236 @@
+/**
+ * Copyright (C) 2017 Genome Research Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @file stats.c
+ * @author Keith James <kdj@sanger.ac.uk>
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+#include "json.h"
+#include "log.h"
+#include "query.h"
+#include "stats.h"
+
+typedef struct rpc_counts {
+    uint64_t count;
+    uint64_t bytes;
+    double seconds;
+    uint64_t histogram[RPC_HISTOGRAM_BINS];
+} rpc_counts_t;
+
+struct rpc_stats {
+    pthread_mutex_t lock;
+    rpc_counts_t kinds[RPC_NUM_KINDS];
+};
+
+static rpc_stats_t process_stats = { .lock = PTHREAD_MUTEX_INITIALIZER };
+static int process_stats_enabled = 0;
+static __thread rpc_stats_t *current_stats = NULL;
+
+static size_t histogram_bin(double seconds) {
+    double usec = seconds * 1e6;
+    size_t bin = 0;
+
+    while (bin < RPC_HISTOGRAM_BINS - 1 && usec >= 1.0) {
+        usec /= 2;
+        bin++;
+    }
+
+    return bin;
+}
+
+static void add_rpc(rpc_stats_t *stats, rpc_kind kind, double seconds,
+                    size_t bytes) {
+    pthread_mutex_lock(&stats->lock);
+
+    rpc_counts_t *counts = &stats->kinds[kind];
+    counts->count++;
+    counts->bytes   += bytes;
+    counts->seconds += seconds;
+    counts->histogram[histogram_bin(seconds)]++;
+
+    pthread_mutex_unlock(&stats->lock);
+}
+
+void enable_rpc_stats(void) {
+    process_stats_enabled = 1;
+}
+
+rpc_stats_t *make_rpc_stats(void) {
+    rpc_stats_t *stats = calloc(1, sizeof (rpc_stats_t));
+    if (!stats) return NULL;
+
+    pthread_mutex_init(&stats->lock, NULL);
+
+    return stats;
+}
+
+void free_rpc_stats(rpc_stats_t *stats) {
+    if (!stats) return;
+
+    if (current_stats == stats) current_stats = NULL;
+
+    pthread_mutex_destroy(&stats->lock);
+    free(stats);
+}
+
+rpc_stats_t *use_rpc_stats(rpc_stats_t *stats) {
+    rpc_stats_t *previous = current_stats;
+    current_stats = stats;
+
+    return previous;
+}
+
+rpc_stats_t *get_rpc_stats(void) {
+    return current_stats;
+}
+
+double rpc_start(void) {
+    if (!process_stats_enabled && !current_stats) return -1;
+
+    return query_clock();
+}
+
+void rpc_end(rpc_kind kind, double start, size_t bytes) {
+    if (start < 0 || kind >= RPC_NUM_KINDS) return;
+
+    double seconds = query_clock() - start;
+
+    if (process_stats_enabled) add_rpc(&process_stats, kind, seconds, bytes);
+    if (current_stats)         add_rpc(current_stats, kind, seconds, bytes);
+}
+
+const char *rpc_kind_name(rpc_kind kind) {
+    switch (kind) {
+        case RPC_LOGIN:
+            return "login";
+        case RPC_OBJ_STAT:
+            return "obj_stat";
+        case RPC_GEN_QUERY:
+            return "gen_query";
+        case RPC_SPECIFIC_QUERY:
+            return "specific_query";
+        case RPC_DATA_OBJ_READ:
+            return "data_obj_read";
+        case RPC_DATA_OBJ_WRITE:
+            return "data_obj_write";
+        case RPC_DATA_OBJ_CHKSUM:
+            return "data_obj_chksum";
+        case RPC_MOD_AVU_METADATA:
+            return "mod_avu_metadata";
+        default:
+            return "unknown";
+    }
+}
+
+static json_t *counts_to_json(rpc_counts_t *counts, baton_error_t *error) {
+    json_t *histogram = json_array();
+    if (!histogram) {
+        set_baton_error(error, -1, "Failed to allocate a new JSON array");
+        goto error;
+    }
+
+    // Only occupied bins are included, each with its upper bound in
+    // microseconds; the last bin has no upper bound
+    for (size_t i = 0; i < RPC_HISTOGRAM_BINS; i++) {
+        if (counts->histogram[i] == 0) continue;
+
+        json_t *bound = i < RPC_HISTOGRAM_BINS - 1 ?
+            json_integer((json_int_t) 1 << i) : json_null();
+        json_t *bin = json_pack("{s:o, s:I}",
+                                JSON_RPC_USEC_KEY,  bound,
+                                JSON_RPC_COUNT_KEY,
+                                (json_int_t) counts->histogram[i]);
+        if (!bin) {
+            set_baton_error(error, -1, "Failed to pack a histogram bin");
+            goto error;
+        }
+
+        json_array_append_new(histogram, bin);
+    }
+
+    json_t *result = json_pack("{s:I, s:I, s:f, s:o}",
+                               JSON_RPC_COUNT_KEY,
+                               (json_int_t) counts->count,
+                               JSON_RPC_BYTES_KEY,
+                               (json_int_t) counts->bytes,
+                               JSON_RPC_SECONDS_KEY, counts->seconds,
+                               JSON_RPC_HISTOGRAM_KEY, histogram);
+    if (!result) {
+        set_baton_error(error, -1, "Failed to pack request statistics");
+        goto error;
+    }
+
+    return result;
+
+error:
+    if (histogram) json_decref(histogram);
+
+    return NULL;
+}
+
+json_t *rpc_stats_to_json(rpc_stats_t *stats, baton_error_t *error) {
+    init_baton_error(error);
+
+    if (!stats) stats = &process_stats;
+
+    rpc_counts_t kinds[RPC_NUM_KINDS];
+
+    pthread_mutex_lock(&stats->lock);
+    memcpy(kinds, stats->kinds, sizeof kinds);
+    pthread_mutex_unlock(&stats->lock);
+
+    json_t *result = json_object();
+    if (!result) {
+        set_baton_error(error, -1, "Failed to allocate a new JSON object");
+        goto error;
+    }
+
+    for (int i = 0; i < RPC_NUM_KINDS; i++) {
+        if (kinds[i].count == 0) continue;
+
+        json_t *counts = counts_to_json(&kinds[i], error);
+        if (error->code != 0) goto error;
+
+        json_object_set_new(result, rpc_kind_name(i), counts);
+    }
+
+    return result;
+
+error:
+    if (result) json_decref(result);
+
+    return NULL;
+}
+
+void print_rpc_stats(FILE *stream) {
+    baton_error_t error;
+    json_t *stats = rpc_stats_to_json(NULL, &error);
+
+    if (error.code != 0) {
+        logmsg(ERROR, "Failed to report request statistics: %s",
+               error.message);
+        return;
+    }
+
+    print_json_stream(stats, stream);
+    json_decref(stats);
+}
@@ -0,0 +1,134 @@
+/**
+ * Copyright (C) 2017 Genome Research Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @file stats.h
+ * @author Keith James <kdj@sanger.ac.uk>
+ */
+
+#ifndef _BATON_STATS_H
+#define _BATON_STATS_H
+
+#include <stdio.h>
+
+#include <jansson.h>
+
+#include "config.h"
+#include "error.h"
+
+/** The number of latency histogram bins. Bin 0 counts calls taking
+    less than 1 microsecond, bin i those taking less than 2^i
+    microseconds and the last bin all the rest. */
+#define RPC_HISTOGRAM_BINS 28
+
+#define JSON_RPC_COUNT_KEY     "count"
+#define JSON_RPC_BYTES_KEY     "bytes"
+#define JSON_RPC_SECONDS_KEY   "seconds"
+#define JSON_RPC_HISTOGRAM_KEY "histogram"
+#define JSON_RPC_USEC_KEY      "usec"
+
+/**
+ *  @enum rpc_kind
+ *  @brief The kinds of iRODS request that are measured.
+ */
+typedef enum {
+    RPC_LOGIN,
+    RPC_OBJ_STAT,
+    RPC_GEN_QUERY,
+    RPC_SPECIFIC_QUERY,
+    RPC_DATA_OBJ_READ,
+    RPC_DATA_OBJ_WRITE,
+    RPC_DATA_OBJ_CHKSUM,
+    RPC_MOD_AVU_METADATA,
+    RPC_NUM_KINDS
+} rpc_kind;
+
+/**
+ *  @struct rpc_stats
+ *  @brief Counts, bytes and latencies of iRODS requests.
+ */
+typedef struct rpc_stats rpc_stats_t;
+
+/**
+ * Start collecting statistics for the whole process.
+ */
+void enable_rpc_stats(void);
+
+/**
+ * Make a new, empty set of statistics, which may be shared between
+ * threads.
+ *
+ * @return A new set of statistics, which must be freed by the caller.
+ */
+rpc_stats_t *make_rpc_stats(void);
+
+void free_rpc_stats(rpc_stats_t *stats);
+
+/**
+ * Set the statistics to which requests made by the calling thread are
+ * added, in addition to those for the whole process.
+ *
+ * @param[in] stats  A set of statistics, or NULL.
+ *
+ * @return The statistics previously used by the calling thread.
+ */
+rpc_stats_t *use_rpc_stats(rpc_stats_t *stats);
+
+/**
+ * Return the statistics used by the calling thread.
+ *
+ * @return A set of statistics, or NULL.
+ */
+rpc_stats_t *get_rpc_stats(void);
+
+/**
+ * Return the time at which a request starts, if it is to be measured.
+ *
+ * @return The time in seconds, or a negative value if the request is
+ *         not to be measured.
+ */
+double rpc_start(void);
+
+/**
+ * Record a completed request.
+ *
+ * @param[in] kind   The kind of request.
+ * @param[in] start  The value returned by rpc_start when the request
+ *                   started.
+ * @param[in] bytes  The number of bytes of data transferred.
+ */
+void rpc_end(rpc_kind kind, double start, size_t bytes);
+
+const char *rpc_kind_name(rpc_kind kind);
+
+/**
+ * Return statistics as JSON, as an object with a property for each
+ * kind of request made.
+ *
+ * @param[in]  stats  A set of statistics, or NULL for the whole process.
+ * @param[out] error  An error report struct.
+ *
+ * @return A new JSON object.
+ */
+json_t *rpc_stats_to_json(rpc_stats_t *stats, baton_error_t *error);
+
+/**
+ * Print the statistics for the whole process as JSON.
+ *
+ * @param[in] stream  The stream to print to.
+ */
+void print_rpc_stats(FILE *stream);
+
+#endif // _BATON_STATS_H
@@ -0,0 +1,321 @@
+/**
+ * Copyright (C) 2017 Genome Research Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @file sync.c
+ * @author Keith James <kdj@sanger.ac.uk>
+ */
+
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <jansson.h>
+
+#include "config.h"
+#include "arena.h"
+#include "compat_checksum.h"
+#include "log.h"
+#include "stat_cache.h"
+#include "sync.h"
+#include "utilities.h"
+
+/** The number of bytes read at a time to calculate an MD5 */
+#define SYNC_READ_SIZE (1024 * 1024)
+
+#define SYNC_SIZE_KEY  "size"
+#define SYNC_MTIME_KEY "mtime"
+#define SYNC_MD5_KEY   "md5"
+
+// The index is shared by all threads. It is a JSON object of entries
+// keyed by the real path of each file, allocated from the heap, never
+// from a JSON arena, because it outlives any one operation.
+static pthread_mutex_t index_lock = PTHREAD_MUTEX_INITIALIZER;
+static json_t *index_entries = NULL;
+static char *index_file      = NULL;
+static int index_dirty       = 0;
+
+int is_md5_checksum(const char *checksum) {
+    if (!checksum) return 0;
+
+    size_t len = strnlen(checksum, MD5_HEX_LEN + 1);
+    if (len != MD5_HEX_LEN) return 0;
+
+    for (size_t i = 0; i < len; i++) {
+        if (!isxdigit((unsigned char) checksum[i])) return 0;
+    }
+
+    return 1;
+}
+
+// Return the index entry for a file, if it matches the file's current
+// modification time and size. The index lock must be held.
+static const char *find_index_md5(const char *key, struct stat *st) {
+    if (!index_entries) return NULL;
+
+    json_t *entry = json_object_get(index_entries, key);
+    if (!entry) return NULL;
+
+    json_t *size  = json_object_get(entry, SYNC_SIZE_KEY);
+    json_t *mtime = json_object_get(entry, SYNC_MTIME_KEY);
+    json_t *md5   = json_object_get(entry, SYNC_MD5_KEY);
+
+    if (!json_is_integer(size) || !json_is_integer(mtime) ||
+        !json_is_string(md5)) return NULL;
+    if (json_integer_value(size)  != (json_int_t) st->st_size ||
+        json_integer_value(mtime) != (json_int_t) st->st_mtime) return NULL;
+
+    const char *value = json_string_value(md5);
+
+    return is_md5_checksum(value) ? value : NULL;
+}
+
+// Add or replace the index entry for a file. The index lock must be
+// held.
+static void add_index_md5(const char *key, struct stat *st, const char *md5) {
+    if (!index_entries) {
+        index_entries = json_object();
+        if (!index_entries) return;
+    }
+
+    json_t *entry = json_pack("{s:I, s:I, s:s}",
+                              SYNC_SIZE_KEY,  (json_int_t) st->st_size,
+                              SYNC_MTIME_KEY, (json_int_t) st->st_mtime,
+                              SYNC_MD5_KEY,   md5);
+    if (entry && json_object_set_new(index_entries, key, entry) == 0) {
+        index_dirty = 1;
+    }
+}
+
+static int calculate_md5(const char *path, char *md5, baton_error_t *error) {
+    char *buffer = NULL;
+
+    FILE *in = fopen(path, "r");
+    if (!in) {
+        set_baton_error(error, errno, "Failed to open '%s' for reading: "
+                        "error %d %s", path, errno, strerror(errno));
+        goto error;
+    }
+
+    buffer = malloc(SYNC_READ_SIZE);
+    if (!buffer) {
+        set_baton_error(error, errno, "Failed to allocate memory: "
+                        "error %d %s", errno, strerror(errno));
+        goto error;
+    }
+
+    unsigned char digest[16];
+    MD5_CTX context;
+    compat_MD5Init(&context);
+
+    size_t nr;
+    while ((nr = fread(buffer, 1, SYNC_READ_SIZE, in)) > 0) {
+        compat_MD5Update(&context, (unsigned char *) buffer, nr);
+    }
+
+    if (ferror(in)) {
+        set_baton_error(error, errno, "Failed to read '%s': error %d %s",
+                        path, errno, strerror(errno));
+        goto error;
+    }
+
+    compat_MD5Final(digest, &context);
+    for (int i = 0; i < 16; i++) {
+        snprintf(md5 + i * 2, 3, "%02x", digest[i]);
+    }
+
+    free(buffer);
+    fclose(in);
+
+    return error->code;
+
+error:
+    if (buffer) free(buffer);
+    if (in)     fclose(in);
+
+    return error->code;
+}
+
+int set_sync_index_file(const char *path) {
+    int status = 0;
+
+    pthread_mutex_lock(&index_lock);
+
+    json_arena_t *previous = use_json_arena(NULL);
+
+    if (index_file) free(index_file);
+    index_file = NULL;
+    if (index_entries) json_decref(index_entries);
+    index_entries = NULL;
+    index_dirty   = 0;
+
+    if (path) {
+        index_file = strdup(path);
+
+        if (access(path, F_OK) == 0) {
+            json_error_t load_error;
+            index_entries = json_load_file(path, 0, &load_error);
+            if (!index_entries || !json_is_object(index_entries)) {
+                logmsg(ERROR, "Failed to read sync index '%s': %s", path,
+                       index_entries ? "not a JSON object" : load_error.text);
+                if (index_entries) json_decref(index_entries);
+                index_entries = NULL;
+                status = -1;
+            }
+        }
+    }
+
+    use_json_arena(previous);
+
+    pthread_mutex_unlock(&index_lock);
+
+    return status;
+}
+
+int save_sync_index(void) {
+    int status = 0;
+
+    pthread_mutex_lock(&index_lock);
+
+    if (index_file && index_entries && index_dirty) {
+        char tmp_path[MAX_NAME_LEN];
+        snprintf(tmp_path, sizeof tmp_path, "%s.%d", index_file,
+                 (int) getpid());
+
+        // Written by way of a temporary file so that concurrent readers
+        // never see a partial file
+        if (json_dump_file(index_entries, tmp_path, JSON_COMPACT) != 0 ||
+            rename(tmp_path, index_file) != 0) {
+            logmsg(WARN, "Failed to write sync index '%s': error %d %s",
+                   index_file, errno, strerror(errno));
+            unlink(tmp_path);
+            status = -1;
+        }
+        else {
+            index_dirty = 0;
+        }
+    }
+
+    pthread_mutex_unlock(&index_lock);
+
+    return status;
+}
+
+void clear_sync_index(void) {
+    pthread_mutex_lock(&index_lock);
+
+    if (index_entries) json_decref(index_entries);
+    index_entries = NULL;
+    index_dirty   = 0;
+
+    pthread_mutex_unlock(&index_lock);
+}
+
+int local_file_md5(const char *path, char *md5, baton_error_t *error) {
+    init_baton_error(error);
+
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        set_baton_error(error, errno, "Failed to stat '%s': error %d %s",
+                        path, errno, strerror(errno));
+        goto error;
+    }
+
+    char key[PATH_MAX];
+    if (!realpath(path, key)) snprintf(key, sizeof key, "%s", path);
+
+    pthread_mutex_lock(&index_lock);
+    const char *cached = index_file ? find_index_md5(key, &st) : NULL;
+    if (cached) snprintf(md5, MD5_HEX_LEN + 1, "%s", cached);
+    pthread_mutex_unlock(&index_lock);
+
+    if (cached) {
+        logmsg(DEBUG, "Using the indexed MD5 %s of '%s'", md5, path);
+        return error->code;
+    }
+
+    calculate_md5(path, md5, error);
+    if (error->code != 0) goto error;
+
+    logmsg(DEBUG, "Calculated MD5 %s of '%s'", md5, path);
+
+    if (index_file) {
+        pthread_mutex_lock(&index_lock);
+        json_arena_t *previous = use_json_arena(NULL);
+        add_index_md5(key, &st, md5);
+        use_json_arena(previous);
+        pthread_mutex_unlock(&index_lock);
+    }
+
+    return error->code;
+
+error:
+    return error->code;
+}
+
+int local_file_unchanged(const char *path, size_t size,
+                         const char *checksum, baton_error_t *error) {
+    init_baton_error(error);
+
+    struct stat st;
+    if (stat(path, &st) != 0 || !S_ISREG(st.st_mode)) {
+        logmsg(DEBUG, "Local file '%s' is absent", path);
+        return 0;
+    }
+
+    if ((size_t) st.st_size != size) {
+        logmsg(DEBUG, "Local file '%s' has size %zu, not %zu", path,
+               (size_t) st.st_size, size);
+        return 0;
+    }
+
+    if (!is_md5_checksum(checksum)) {
+        logmsg(DEBUG, "No catalog MD5 to compare with local file '%s'",
+               path);
+        return 0;
+    }
+
+    char md5[MD5_HEX_LEN + 1];
+    local_file_md5(path, md5, error);
+    if (error->code != 0) return 0;
+
+    return str_equals_ignore_case(md5, checksum, MD5_HEX_LEN + 1);
+}
+
+int rods_path_unchanged(rcComm_t *conn, rodsPath_t *rods_path,
+                        const char *local_path, baton_error_t *error) {
+    init_baton_error(error);
+
+    // A cached size and checksum may predate another client's writes
+    refresh_rods_obj_type(conn, rods_path);
+
+    if (rods_path->objState != EXIST_ST ||
+        rods_path->objType  != DATA_OBJ_T) return 0;
+
+    size_t size          = (size_t) rods_path->size;
+    const char *checksum = rods_path->chksum;
+    if (rods_path->rodsObjStat) {
+        size     = (size_t) rods_path->rodsObjStat->objSize;
+        checksum = rods_path->rodsObjStat->chksum;
+    }
+
+    return local_file_unchanged(local_path, size, checksum, error);
+}
@@ -0,0 +1,113 @@
+/**
+ * Copyright (C) 2017 Genome Research Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @file sync.h
+ * @author Keith James <kdj@sanger.ac.uk>
+ */
+
+#ifndef _BATON_SYNC_H
+#define _BATON_SYNC_H
+
+#include <rodsClient.h>
+
+#include "config.h"
+#include "error.h"
+
+/** The length of an MD5 checksum in hexadecimal, without terminator */
+#define MD5_HEX_LEN 32
+
+/**
+ * Return true if a checksum is an MD5 in hexadecimal, which may be
+ * compared with the MD5 of a local file.
+ *
+ * @param[in] checksum  A checksum string, may be NULL.
+ *
+ * @return 1 if the checksum is an MD5, 0 otherwise.
+ */
+int is_md5_checksum(const char *checksum);
+
+/**
+ * Set a file in which the MD5 of local files is kept between
+ * invocations, keyed by file path, modification time and size. Any
+ * entries already in the file are loaded. The file is only written by
+ * save_sync_index.
+ *
+ * @param[in] path  A file path, or NULL to stop using a file.
+ *
+ * @return 0 on success, or -1 if an existing file could not be read.
+ */
+int set_sync_index_file(const char *path);
+
+/**
+ * Write the index to the file given to set_sync_index_file, if any
+ * entries were added since it was loaded.
+ *
+ * @return 0 on success, or -1 if the file could not be written.
+ */
+int save_sync_index(void);
+
+/**
+ * Remove all entries from the index, without writing the file.
+ */
+void clear_sync_index(void);
+
+/**
+ * Calculate the MD5 of a local file, or return it from the index if
+ * the file is unmodified since it was last calculated.
+ *
+ * @param[in]  path   A local file path.
+ * @param[out] md5    A buffer of at least MD5_HEX_LEN + 1 bytes.
+ * @param[out] error  An error report struct.
+ *
+ * @return 0 on success, error code on failure.
+ */
+int local_file_md5(const char *path, char *md5, baton_error_t *error);
+
+/**
+ * Return true if a local file has the same size and MD5 as a data
+ * object in the catalog. The MD5 is only calculated when the sizes
+ * match, so a file that does not exist, or differs in size, costs one
+ * stat. A catalog checksum that is missing, or not an MD5, never
+ * matches.
+ *
+ * @param[in]  path      A local file path.
+ * @param[in]  size      The size of the data object in the catalog.
+ * @param[in]  checksum  The checksum of the data object in the catalog.
+ * @param[out] error     An error report struct.
+ *
+ * @return 1 if the file is unchanged, 0 if it differs or on error.
+ */
+int local_file_unchanged(const char *path, size_t size,
+                         const char *checksum, baton_error_t *error);
+
+/**
+ * Return true if a local file has the same size and MD5 as a resolved
+ * data object. The catalog size and checksum obtained when the path
+ * was resolved are used, after refreshing them if they may have come
+ * from the stat cache.
+ *
+ * @param[in]  conn        An open iRODS connection.
+ * @param[in]  rods_path   A resolved iRODS path.
+ * @param[in]  local_path  A local file path.
+ * @param[out] error       An error report struct.
+ *
+ * @return 1 if the file is unchanged, 0 if it differs, if the data
+ * object does not exist, or on error.
+ */
+int rods_path_unchanged(rcComm_t *conn, rodsPath_t *rods_path,
+                        const char *local_path, baton_error_t *error);
+
+#endif // _BATON_SYNC_H
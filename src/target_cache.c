@@ -0,0 +1,263 @@
+/**
+ * Copyright (C) 2017 Genome Research Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @file target_cache.c
+ * @author Keith James <kdj@sanger.ac.uk>
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "config.h"
+#include "arena.h"
+#include "log.h"
+#include "stat_cache.h"
+#include "target_cache.h"
+#include "utilities.h"
+
+// The kinds of catalog result kept, in the order of their bits after
+// TARGET_STAT
+#define TARGET_NUM_RESULTS 4
+
+typedef struct target_run {
+    /** The target path as given by the operations, empty if none */
+    char target[MAX_NAME_LEN];
+    /** The target path as resolved, empty until resolved */
+    char resolved[MAX_NAME_LEN];
+    /** A bitwise OR of the kinds kept */
+    int kept;
+    /** The time after which each kind is no longer valid */
+    time_t expires[TARGET_NUM_RESULTS + 1];
+    /** The resolved path, kept if TARGET_STAT is */
+    rodsPath_t rods_path;
+    /** The stat result of the resolved path */
+    rodsObjStat_t obj_stat;
+    /** The catalog results kept, allocated from the heap */
+    json_t *results[TARGET_NUM_RESULTS];
+    struct target_run *next;
+} target_run_t;
+
+// Runs are owned by their threads, but are registered so that any
+// thread may discard what they keep
+static pthread_mutex_t run_lock = PTHREAD_MUTEX_INITIALIZER;
+static target_run_t *runs = NULL;
+static __thread target_run_t *current_run = NULL;
+
+// Return the index of a single kind, TARGET_STAT being 0
+static int kind_index(int kind) {
+    for (int i = 0; i <= TARGET_NUM_RESULTS; i++) {
+        if (kind == 1 << i) return i;
+    }
+
+    return -1;
+}
+
+// Discard kinds kept by a run. The run lock must be held.
+static void discard_kinds(target_run_t *run, int kinds) {
+    if ((kinds & TARGET_STAT) && (run->kept & TARGET_STAT)) {
+        memset(&run->rods_path, 0, sizeof (rodsPath_t));
+    }
+
+    for (int i = 0; i < TARGET_NUM_RESULTS; i++) {
+        int kind = 1 << (i + 1);
+        if ((kinds & kind) && run->results[i]) {
+            json_decref(run->results[i]);
+            run->results[i] = NULL;
+        }
+    }
+
+    run->kept &= ~kinds;
+}
+
+// Return true if a kind is kept by the calling thread's run for a
+// resolved path and has not expired. The run lock must be held.
+static int is_kept(const char *path, int kind) {
+    target_run_t *run = current_run;
+    int index = kind_index(kind);
+
+    if (!run || index < 0 || !(run->kept & kind)) return 0;
+    if (!str_equals(run->resolved, path, MAX_NAME_LEN)) return 0;
+
+    if (run->expires[index] <= time(NULL)) {
+        discard_kinds(run, kind);
+        return 0;
+    }
+
+    return 1;
+}
+
+void begin_target_run(const char *path) {
+    pthread_mutex_lock(&run_lock);
+
+    if (!current_run) {
+        current_run = calloc(1, sizeof (target_run_t));
+        if (!current_run) goto finally;
+
+        current_run->next = runs;
+        runs = current_run;
+    }
+
+    if (str_equals(current_run->target, path, MAX_NAME_LEN)) {
+        logmsg(TRACE, "Continuing the run of operations on '%s'", path);
+        goto finally;
+    }
+
+    discard_kinds(current_run, TARGET_ALL);
+    snprintf(current_run->target, MAX_NAME_LEN, "%s", path);
+    current_run->resolved[0] = '\0';
+
+finally:
+    pthread_mutex_unlock(&run_lock);
+}
+
+void end_target_run(void) {
+    pthread_mutex_lock(&run_lock);
+
+    target_run_t *run = current_run;
+    if (run) {
+        target_run_t **link = &runs;
+        while (*link && *link != run) link = &(*link)->next;
+        if (*link) *link = run->next;
+
+        discard_kinds(run, TARGET_ALL);
+        free(run);
+        current_run = NULL;
+    }
+
+    pthread_mutex_unlock(&run_lock);
+}
+
+int load_target_path(const char *inpath, rodsPath_t *rods_path) {
+    int found = 0;
+
+    pthread_mutex_lock(&run_lock);
+
+    target_run_t *run = current_run;
+    if (run && str_equals(run->target, inpath, MAX_NAME_LEN) &&
+        is_kept(run->resolved, TARGET_STAT)) {
+        rodsObjStat_t *obj_stat = malloc(sizeof (rodsObjStat_t));
+        if (obj_stat) {
+            memcpy(rods_path, &run->rods_path, sizeof (rodsPath_t));
+            memcpy(obj_stat, &run->obj_stat, sizeof (rodsObjStat_t));
+            rods_path->rodsObjStat = obj_stat;
+
+            logmsg(TRACE, "Reusing the resolution of '%s'", inpath);
+            found = 1;
+        }
+    }
+
+    pthread_mutex_unlock(&run_lock);
+
+    return found;
+}
+
+void store_target_path(const char *inpath, rodsPath_t *rods_path) {
+    unsigned int ttl = get_stat_cache_ttl();
+    if (ttl == 0) return;
+
+    // Special collections carry state which is not copied
+    if (rods_path->objState != EXIST_ST || !rods_path->rodsObjStat ||
+        rods_path->rodsObjStat->specColl) return;
+
+    pthread_mutex_lock(&run_lock);
+
+    target_run_t *run = current_run;
+    if (run && str_equals(run->target, inpath, MAX_NAME_LEN)) {
+        if (!str_equals(run->resolved, rods_path->outPath, MAX_NAME_LEN)) {
+            discard_kinds(run, TARGET_ALL);
+            snprintf(run->resolved, MAX_NAME_LEN, "%s", rods_path->outPath);
+        }
+
+        memcpy(&run->rods_path, rods_path, sizeof (rodsPath_t));
+        memcpy(&run->obj_stat, rods_path->rodsObjStat,
+               sizeof (rodsObjStat_t));
+        run->rods_path.rodsObjStat = NULL;
+        run->expires[0] = time(NULL) + ttl;
+        run->kept |= TARGET_STAT;
+    }
+
+    pthread_mutex_unlock(&run_lock);
+}
+
+json_t *load_target_result(const char *path, int kind) {
+    json_t *result = NULL;
+
+    pthread_mutex_lock(&run_lock);
+
+    if (kind != TARGET_STAT && is_kept(path, kind)) {
+        // Copied into the caller's arena, if it has one
+        result = json_deep_copy(current_run->results[kind_index(kind) - 1]);
+        if (result) {
+            logmsg(TRACE, "Reusing catalog results of '%s'", path);
+        }
+    }
+
+    pthread_mutex_unlock(&run_lock);
+
+    return result;
+}
+
+void store_target_result(const char *path, int kind, json_t *result) {
+    unsigned int ttl = get_stat_cache_ttl();
+    int index = kind_index(kind);
+    if (ttl == 0 || index < 1 || !result) return;
+
+    pthread_mutex_lock(&run_lock);
+
+    target_run_t *run = current_run;
+    if (run && strlen(run->resolved) > 0 &&
+        str_equals(run->resolved, path, MAX_NAME_LEN)) {
+        // Kept results outlive the arena of the operation that listed
+        // them
+        json_arena_t *previous = use_json_arena(NULL);
+        json_t *copy = json_deep_copy(result);
+        use_json_arena(previous);
+
+        if (copy) {
+            discard_kinds(run, kind);
+            run->results[index - 1] = copy;
+            run->expires[index] = time(NULL) + ttl;
+            run->kept |= kind;
+        }
+    }
+
+    pthread_mutex_unlock(&run_lock);
+}
+
+void forget_target(const char *path, int kinds, int descendants) {
+    size_t len = strnlen(path, MAX_NAME_LEN);
+
+    pthread_mutex_lock(&run_lock);
+
+    for (target_run_t *run = runs; run; run = run->next) {
+        if (!run->kept) continue;
+
+        int matched = str_equals(run->resolved, path, MAX_NAME_LEN);
+        int beneath = descendants && len > 0 &&
+            str_starts_with(run->resolved, path, MAX_NAME_LEN) &&
+            (path[len - 1] == '/' || run->resolved[len] == '/');
+
+        if (matched || beneath) {
+            logmsg(TRACE, "Forgetting what is kept about '%s'",
+                   run->resolved);
+            discard_kinds(run, kinds);
+        }
+    }
+
+    pthread_mutex_unlock(&run_lock);
+}
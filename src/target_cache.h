@@ -0,0 +1,117 @@
+/**
+ * Copyright (C) 2017 Genome Research Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @file target_cache.h
+ * @author Keith James <kdj@sanger.ac.uk>
+ */
+
+#ifndef _BATON_TARGET_CACHE_H
+#define _BATON_TARGET_CACHE_H
+
+#include <jansson.h>
+
+#include <rodsClient.h>
+
+#include "config.h"
+
+/** The resolved path of the target */
+#define TARGET_STAT      (1 << 0)
+/** The access control list of the target */
+#define TARGET_ACL       (1 << 1)
+/** The metadata of the target */
+#define TARGET_AVU       (1 << 2)
+/** The replicates of the target */
+#define TARGET_REPLICATE (1 << 3)
+/** The timestamps of the target */
+#define TARGET_TIMESTAMP (1 << 4)
+/** Everything known about the target */
+#define TARGET_ALL       (TARGET_STAT | TARGET_ACL | TARGET_AVU | \
+                          TARGET_REPLICATE | TARGET_TIMESTAMP)
+
+/**
+ * Begin, or continue, a run of operations by the calling thread on one
+ * target. While consecutive operations name the same target, its
+ * resolved path and the catalog results listed for it are kept and
+ * reused; a different target starts a new run, discarding them. Kept
+ * results expire as cached stats do, and none are kept if the stat
+ * cache is disabled.
+ *
+ * @param[in] path  The target path, as given by the operation.
+ */
+void begin_target_run(const char *path);
+
+/**
+ * End the calling thread's run of operations, discarding what was kept.
+ */
+void end_target_run(void);
+
+/**
+ * Set a path to the resolution kept for it in the calling thread's
+ * run, if there is one.
+ *
+ * @param[in]  inpath     The path as given to be resolved.
+ * @param[out] rods_path  The path to set. On success, its rodsObjStat
+ *                        is a new copy which must be freed by the
+ *                        caller.
+ *
+ * @return 1 if the path was set, 0 otherwise.
+ */
+int load_target_path(const char *inpath, rodsPath_t *rods_path);
+
+/**
+ * Keep the resolution of a path in the calling thread's run, if the
+ * path is its target and exists.
+ *
+ * @param[in] inpath     The path as given to be resolved.
+ * @param[in] rods_path  The resolved path.
+ */
+void store_target_path(const char *inpath, rodsPath_t *rods_path);
+
+/**
+ * Return a catalog result kept for the target of the calling thread's
+ * run.
+ *
+ * @param[in] path  A resolved iRODS path.
+ * @param[in] kind  The kind of result e.g. TARGET_ACL.
+ *
+ * @return A new copy of the result, which must be freed by the caller,
+ * or NULL if none is kept for the path.
+ */
+json_t *load_target_result(const char *path, int kind);
+
+/**
+ * Keep a copy of a catalog result for the target of the calling
+ * thread's run. Results for other paths are not kept.
+ *
+ * @param[in] path    A resolved iRODS path.
+ * @param[in] kind    The kind of result e.g. TARGET_ACL.
+ * @param[in] result  The result.
+ */
+void store_target_result(const char *path, int kind, json_t *result);
+
+/**
+ * Discard what any thread's run has kept about a path, optionally
+ * including paths beneath it. This must be called after any operation
+ * that changes what was kept.
+ *
+ * @param[in] path         An absolute iRODS path.
+ * @param[in] kinds        A bitwise OR of the kinds to discard e.g.
+ *                         TARGET_AVU, or TARGET_ALL.
+ * @param[in] descendants  True to include paths beneath the path.
+ */
+void forget_target(const char *path, int kinds, int descendants);
+
+#endif // _BATON_TARGET_CACHE_H
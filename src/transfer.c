@@ -0,0 +1,760 @@
+/**
+ * Copyright (C) 2017 Genome Research Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @file transfer.c
+ * @author Keith James <kdj@sanger.ac.uk>
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "baton.h"
+#include "compat_checksum.h"
+#include "transfer.h"
+
+static size_t parallel_streams  = 1;
+static size_t parallel_min_size = PARALLEL_DEFAULT_MIN_SIZE;
+static size_t resume_retries    = 0;
+static size_t resume_delay      = RESUME_DEFAULT_DELAY;
+
+// A failed connection and the one that replaced it when a transfer on
+// it was resumed, kept until the owner of the failed connection takes
+// the replacement
+typedef struct replaced_conn {
+    rcComm_t *failed;
+    rcComm_t *replacement;
+    struct replaced_conn *next;
+} replaced_conn_t;
+
+static pthread_mutex_t replaced_lock = PTHREAD_MUTEX_INITIALIZER;
+static replaced_conn_t *replaced_conns = NULL;
+
+// State shared by all the ranges of one transfer
+typedef struct transfer {
+    pthread_mutex_t lock;
+    /** Signalled when any range makes progress, finishes or fails */
+    pthread_cond_t progress;
+    /** True when any range has failed */
+    int failed;
+    /** The request statistics of the calling thread */
+    rpc_stats_t *stats;
+} transfer_t;
+
+// One byte range of a data object, transferred over its own connection
+typedef struct range {
+    transfer_t *transfer;
+    rcComm_t *conn;
+    /** True if the connection was made for this range */
+    int own_conn;
+    data_obj_file_t *data_obj;
+    /** True while the data object is open on the connection */
+    int is_open;
+    /** The local file descriptor */
+    int fd;
+    /** O_RDONLY to get the range, O_WRONLY to write it */
+    int flags;
+    size_t offset;
+    size_t length;
+    size_t buffer_size;
+    /** The number of bytes transferred from the start of the range */
+    size_t transferred;
+    /** True when the range has finished, successfully or not */
+    int done;
+    baton_error_t error;
+} range_t;
+
+void set_parallel_transfer(size_t num_streams, size_t min_size) {
+    if (num_streams < 1)                    num_streams = 1;
+    if (num_streams > PARALLEL_MAX_STREAMS) num_streams = PARALLEL_MAX_STREAMS;
+
+    parallel_streams  = num_streams;
+    parallel_min_size = min_size ? min_size : PARALLEL_DEFAULT_MIN_SIZE;
+}
+
+size_t get_parallel_streams(void) {
+    return parallel_streams;
+}
+
+size_t get_parallel_min_size(void) {
+    return parallel_min_size;
+}
+
+int use_parallel_transfer(size_t size) {
+    return parallel_streams > 1 && size > 0 && size >= parallel_min_size;
+}
+
+void set_transfer_retries(size_t max_retries, size_t delay) {
+    if (max_retries > RESUME_MAX_RETRIES) max_retries = RESUME_MAX_RETRIES;
+
+    resume_retries = max_retries;
+    resume_delay   = delay ? delay : RESUME_DEFAULT_DELAY;
+}
+
+size_t get_transfer_retries(void) {
+    return resume_retries;
+}
+
+int is_connection_error(int status) {
+    // An iRODS error code may have an errno added to it
+    switch ((status / 1000) * 1000) {
+        case SYS_HEADER_READ_LEN_ERR:
+        case SYS_HEADER_WRITE_LEN_ERR:
+        case SYS_SOCK_READ_TIMEDOUT:
+        case SYS_SOCK_READ_ERR:
+            return 1;
+
+        default:
+            return 0;
+    }
+}
+
+// Wait before a reconnection, twice as long as before the previous one
+static void resume_wait(size_t attempt) {
+    size_t delay = resume_delay;
+    for (size_t i = 1; i < attempt && delay < RESUME_MAX_DELAY; i++) {
+        delay *= 2;
+    }
+    if (delay > RESUME_MAX_DELAY) delay = RESUME_MAX_DELAY;
+
+    struct timespec ts = { .tv_sec  = delay / 1000,
+                           .tv_nsec = (delay % 1000) * 1000000L };
+    nanosleep(&ts, NULL);
+}
+
+// Open a data object on a new connection, positioned at the offset of
+// the next byte to transfer. Returns the descriptor, or an iRODS error
+// code.
+static int reopen_data_obj(rcComm_t *conn, data_obj_file_t *data_obj) {
+    dataObjInp_t obj_open_in;
+    memset(&obj_open_in, 0, sizeof obj_open_in);
+    snprintf(obj_open_in.objPath, MAX_NAME_LEN, "%s", data_obj->path);
+
+    // A data object being written must not be truncated
+    obj_open_in.openFlags = data_obj->flags == O_RDONLY ? O_RDONLY : O_RDWR;
+
+    // A chosen or pinned replicate is transferred to the end
+    char num_str[32];
+    if (data_obj->pinned) {
+        snprintf(num_str, sizeof num_str, "%d", data_obj->replicate);
+        addKeyVal(&obj_open_in.condInput, REPL_NUM_KW, num_str);
+    }
+#if IRODS_VERSION_INTEGER && IRODS_VERSION_INTEGER >= 4002009
+    if (data_obj->replica_token) {
+        addKeyVal(&obj_open_in.condInput, REPLICA_TOKEN_KW,
+                  data_obj->replica_token);
+    }
+#endif
+
+    int descriptor = rcDataObjOpen(conn, &obj_open_in);
+    clearKeyVal(&obj_open_in.condInput);
+    if (descriptor < 0 || data_obj->position == 0) return descriptor;
+
+    openedDataObjInp_t seek_in;
+    memset(&seek_in, 0, sizeof seek_in);
+    seek_in.l1descInx = descriptor;
+    seek_in.offset    = data_obj->position;
+    seek_in.whence    = SEEK_SET;
+
+    fileLseekOut_t *seek_out = NULL;
+    int status = rcDataObjLseek(conn, &seek_in, &seek_out);
+    if (seek_out) free(seek_out);
+
+    return status < 0 ? status : descriptor;
+}
+
+int resume_data_obj(data_obj_file_t *data_obj, int status) {
+    if (resume_retries == 0 || !is_connection_error(status)) return 0;
+
+    while (data_obj->num_resumes < resume_retries) {
+        data_obj->num_resumes++;
+
+        logmsg(WARN, "Connection failed while transferring '%s' at offset "
+               "%zu: error %d; resuming, attempt %zu of %zu",
+               data_obj->path, data_obj->position, status,
+               data_obj->num_resumes, resume_retries);
+        resume_wait(data_obj->num_resumes);
+
+        rodsEnv env;
+        rcComm_t *conn = rods_login(&env);
+        if (!conn) continue;
+
+        int descriptor = reopen_data_obj(conn, data_obj);
+        if (descriptor < 0) {
+            char *err_subname;
+            const char *err_name = rodsErrorName(descriptor, &err_subname);
+            logmsg(WARN, "Failed to reopen '%s' at offset %zu: error %d %s",
+                   data_obj->path, data_obj->position, descriptor, err_name);
+            rcDisconnect(conn);
+            continue;
+        }
+
+        // The failed connection belongs to the caller, or to an
+        // earlier resumption, which is replaced
+        if (data_obj->resumed_conn) rcDisconnect(data_obj->resumed_conn);
+        data_obj->resumed_conn        = conn;
+        data_obj->open_obj->l1descInx = descriptor;
+
+        logmsg(NOTICE, "Resumed transferring '%s' at offset %zu",
+               data_obj->path, data_obj->position);
+
+        return 1;
+    }
+
+    logmsg(ERROR, "Failed to resume transferring '%s' after %zu attempts",
+           data_obj->path, data_obj->num_resumes);
+
+    return 0;
+}
+
+void hand_over_connection(rcComm_t *failed, rcComm_t *replacement) {
+    replaced_conn_t *entry = calloc(1, sizeof (replaced_conn_t));
+    if (!failed || !entry) {
+        logmsg(ERROR, "Failed to hand over a resumed connection");
+        rcDisconnect(replacement);
+        if (entry) free(entry);
+        return;
+    }
+
+    entry->failed      = failed;
+    entry->replacement = replacement;
+
+    pthread_mutex_lock(&replaced_lock);
+    entry->next    = replaced_conns;
+    replaced_conns = entry;
+    pthread_mutex_unlock(&replaced_lock);
+}
+
+// Find the replacement of a connection. The replaced lock must be held.
+static replaced_conn_t **find_replaced(rcComm_t *conn) {
+    replaced_conn_t **link = &replaced_conns;
+    while (*link && (*link)->failed != conn) link = &(*link)->next;
+
+    return link;
+}
+
+rcComm_t *live_connection(rcComm_t *conn) {
+    pthread_mutex_lock(&replaced_lock);
+
+    replaced_conn_t *entry;
+    while (conn && (entry = *find_replaced(conn))) conn = entry->replacement;
+
+    pthread_mutex_unlock(&replaced_lock);
+
+    return conn;
+}
+
+rcComm_t *replace_connection(rcComm_t *conn) {
+    pthread_mutex_lock(&replaced_lock);
+
+    // A replacement may itself have failed and been replaced
+    replaced_conn_t **link;
+    while (conn && *(link = find_replaced(conn))) {
+        replaced_conn_t *entry = *link;
+        *link = entry->next;
+
+        logmsg(NOTICE, "Replacing a failed connection with the one made "
+               "to resume a transfer");
+        rcDisconnect(conn);
+        conn = entry->replacement;
+        free(entry);
+    }
+
+    pthread_mutex_unlock(&replaced_lock);
+
+    return conn;
+}
+
+static ssize_t read_fully(int fd, char *buffer, size_t len, off_t offset) {
+    size_t total = 0;
+
+    while (total < len) {
+        ssize_t n = pread(fd, buffer + total, len - total, offset + total);
+        if (n < 0)  return -1;
+        if (n == 0) break;
+        total += n;
+    }
+
+    return total;
+}
+
+static ssize_t write_fully(int fd, const char *buffer, size_t len,
+                           off_t offset) {
+    size_t total = 0;
+
+    while (total < len) {
+        ssize_t n = pwrite(fd, buffer + total, len - total, offset + total);
+        if (n < 0) return -1;
+        total += n;
+    }
+
+    return total;
+}
+
+static int seek_range(range_t *range) {
+    openedDataObjInp_t seek_in;
+    memset(&seek_in, 0, sizeof seek_in);
+    seek_in.l1descInx = range->data_obj->open_obj->l1descInx;
+    seek_in.offset    = range->offset;
+    seek_in.whence    = SEEK_SET;
+
+    fileLseekOut_t *seek_out = NULL;
+    int status = rcDataObjLseek(range->conn, &seek_in, &seek_out);
+    if (seek_out) free(seek_out);
+
+    if (status >= 0) range->data_obj->position = range->offset;
+
+    if (status < 0) {
+        char *err_subname;
+        const char *err_name = rodsErrorName(status, &err_subname);
+        set_baton_error(&range->error, status,
+                        "Failed to seek to offset %zu in '%s': error %d %s",
+                        range->offset, range->data_obj->path, status,
+                        err_name);
+    }
+
+    return status;
+}
+
+static size_t get_range_chunk(range_t *range, char *buffer, size_t len) {
+    size_t pos = range->offset + range->transferred;
+
+    size_t nr = read_chunk(range->conn, range->data_obj, buffer, len,
+                           &range->error);
+    if (range->error.code != 0) goto error;
+
+    if (nr == 0) {
+        set_baton_error(&range->error, -1, "Unexpected end of '%s' at "
+                        "offset %zu", range->data_obj->path, pos);
+        goto error;
+    }
+
+    if (write_fully(range->fd, buffer, nr, pos) < 0) {
+        set_baton_error(&range->error, errno, "Failed to write at offset "
+                        "%zu: error %d %s", pos, errno, strerror(errno));
+        goto error;
+    }
+
+    return nr;
+
+error:
+    return 0;
+}
+
+static size_t put_range_chunk(range_t *range, char *buffer, size_t len) {
+    size_t pos = range->offset + range->transferred;
+
+    ssize_t nr = read_fully(range->fd, buffer, len, pos);
+    if (nr < 0) {
+        set_baton_error(&range->error, errno, "Failed to read at offset "
+                        "%zu: error %d %s", pos, errno, strerror(errno));
+        goto error;
+    }
+
+    if ((size_t) nr != len) {
+        set_baton_error(&range->error, -1, "Unexpected end of file at "
+                        "offset %zu while writing '%s'", pos + nr,
+                        range->data_obj->path);
+        goto error;
+    }
+
+    size_t nw = write_chunk(range->conn, buffer, range->data_obj, len,
+                            &range->error);
+    if (range->error.code != 0) goto error;
+
+    if (nw != len) {
+        set_baton_error(&range->error, -1, "Wrote %zu of %zu bytes at "
+                        "offset %zu to '%s'", nw, len, pos,
+                        range->data_obj->path);
+        goto error;
+    }
+
+    return nw;
+
+error:
+    return 0;
+}
+
+static void *range_worker(void *arg) {
+    range_t *range       = arg;
+    transfer_t *transfer = range->transfer;
+
+    // Requests are counted towards the operation that started the
+    // transfer
+    use_rpc_stats(transfer->stats);
+
+    char *buffer = calloc(range->buffer_size, sizeof (char));
+    if (!buffer) {
+        set_baton_error(&range->error, errno, "Failed to allocate memory: "
+                        "error %d %s", errno, strerror(errno));
+        goto finish;
+    }
+
+    if (range->offset > 0 && seek_range(range) < 0) goto finish;
+
+    logmsg(DEBUG, "Transferring %zu bytes at offset %zu of '%s'",
+           range->length, range->offset, range->data_obj->path);
+
+    while (range->transferred < range->length) {
+        pthread_mutex_lock(&transfer->lock);
+        int failed = transfer->failed;
+        pthread_mutex_unlock(&transfer->lock);
+
+        if (failed) break;
+
+        size_t remaining = range->length - range->transferred;
+        size_t len = remaining < range->buffer_size ?
+            remaining : range->buffer_size;
+
+        size_t n;
+        if (range->flags == O_RDONLY) {
+            n = get_range_chunk(range, buffer, len);
+        }
+        else {
+            n = put_range_chunk(range, buffer, len);
+        }
+
+        if (range->error.code != 0) break;
+
+        pthread_mutex_lock(&transfer->lock);
+        range->transferred += n;
+        pthread_cond_broadcast(&transfer->progress);
+        pthread_mutex_unlock(&transfer->lock);
+    }
+
+finish:
+    pthread_mutex_lock(&transfer->lock);
+    range->done = 1;
+    if (range->error.code != 0) transfer->failed = 1;
+    pthread_cond_broadcast(&transfer->progress);
+    pthread_mutex_unlock(&transfer->lock);
+
+    if (buffer) free(buffer);
+
+    return NULL;
+}
+
+// Calculate the MD5 of the local file, range by range, in order. MD5
+// cannot be combined from the digests of separate ranges, so when
+// following a get, each range is read back from the file as its bytes
+// arrive. Returns 0 on success, or -1 if a range failed.
+static int hash_ranges(transfer_t *transfer, range_t *ranges,
+                       size_t num_ranges, int fd, size_t buffer_size,
+                       int follow, unsigned char digest[16],
+                       baton_error_t *error) {
+    char *buffer = calloc(buffer_size, sizeof (char));
+    if (!buffer) {
+        set_baton_error(error, errno, "Failed to allocate memory: "
+                        "error %d %s", errno, strerror(errno));
+        goto error;
+    }
+
+    MD5_CTX context;
+    compat_MD5Init(&context);
+
+    for (size_t i = 0; i < num_ranges; i++) {
+        range_t *range = &ranges[i];
+        size_t hashed  = 0;
+
+        while (hashed < range->length) {
+            size_t available = range->length;
+
+            if (follow) {
+                pthread_mutex_lock(&transfer->lock);
+                while (range->transferred == hashed && !range->done &&
+                       !transfer->failed) {
+                    pthread_cond_wait(&transfer->progress, &transfer->lock);
+                }
+
+                int failed = transfer->failed;
+                available  = range->transferred;
+                pthread_mutex_unlock(&transfer->lock);
+
+                if (failed || available == hashed) goto error;
+            }
+
+            while (hashed < available) {
+                size_t remaining = available - hashed;
+                size_t len = remaining < buffer_size ? remaining : buffer_size;
+                size_t pos = range->offset + hashed;
+
+                ssize_t nr = read_fully(fd, buffer, len, pos);
+                if (nr < 0 || (size_t) nr != len) {
+                    set_baton_error(error, errno, "Failed to read %zu bytes "
+                                    "at offset %zu for the MD5: error %d %s",
+                                    len, pos, errno, strerror(errno));
+                    goto error;
+                }
+
+                compat_MD5Update(&context, (unsigned char *) buffer, len);
+                hashed += len;
+            }
+        }
+    }
+
+    compat_MD5Final(digest, &context);
+    free(buffer);
+
+    return 0;
+
+error:
+    // Stop the ranges early
+    pthread_mutex_lock(&transfer->lock);
+    transfer->failed = 1;
+    pthread_mutex_unlock(&transfer->lock);
+
+    if (buffer) free(buffer);
+
+    return -1;
+}
+
+// Stop and join any running ranges, then close their data objects
+// and connections
+static void finish_ranges(transfer_t *transfer, range_t *ranges,
+                          size_t num_ranges, pthread_t *threads,
+                          size_t num_started) {
+    if (num_started > 0) {
+        pthread_mutex_lock(&transfer->lock);
+        transfer->failed = 1;
+        pthread_mutex_unlock(&transfer->lock);
+
+        for (size_t i = 0; i < num_started; i++) {
+            pthread_join(threads[i], NULL);
+        }
+    }
+
+    // The first range holds the replicate open for the others, so it
+    // is closed last
+    for (size_t i = num_ranges; i > 0; i--) {
+        range_t *range = &ranges[i - 1];
+        if (range->is_open)  close_data_obj(range->conn, range->data_obj);
+        if (range->data_obj) free_data_obj(range->data_obj);
+        if (range->own_conn) rcDisconnect(replace_connection(range->conn));
+    }
+}
+
+static size_t transfer_ranges(rcComm_t *conn, rodsPath_t *rods_path, int fd,
+                              size_t size, size_t buffer_size, int flags,
+                              baton_error_t *error) {
+    range_t *ranges      = NULL;
+    pthread_t *threads   = NULL;
+    size_t num_ranges    = 0;
+    size_t num_started   = 0;
+    size_t num_copied    = 0;
+    int initialised      = 0;
+
+    transfer_t transfer;
+    memset(&transfer, 0, sizeof transfer);
+    transfer.stats = get_rpc_stats();
+
+    init_baton_error(error);
+
+    if (buffer_size == 0) {
+        set_baton_error(error, -1, "Invalid buffer_size argument %zu",
+                        buffer_size);
+        goto error;
+    }
+
+    // Ranges are whole multiples of the buffer size, except the last
+    size_t streams   = parallel_streams;
+    size_t range_len = (size + streams - 1) / streams;
+    range_len  = ((range_len + buffer_size - 1) / buffer_size) * buffer_size;
+    num_ranges = (size + range_len - 1) / range_len;
+
+    ranges  = calloc(num_ranges, sizeof (range_t));
+    threads = calloc(num_ranges, sizeof (pthread_t));
+    if (!ranges || !threads) {
+        set_baton_error(error, errno, "Failed to allocate memory: "
+                        "error %d %s", errno, strerror(errno));
+        goto error;
+    }
+
+    pthread_mutex_init(&transfer.lock, NULL);
+    pthread_cond_init(&transfer.progress, NULL);
+    initialised = 1;
+
+    // The first range creates the data object when writing, so it
+    // must be opened before the others. The others open the same
+    // replicate, which they may only write with its token while the
+    // first holds it open.
+    replica_pin_t pin;
+
+    for (size_t i = 0; i < num_ranges; i++) {
+        range_t *range = &ranges[i];
+        range->transfer    = &transfer;
+        range->fd          = fd;
+        range->flags       = flags;
+        range->offset      = i * range_len;
+        range->length      = size - range->offset < range_len ?
+            size - range->offset : range_len;
+        range->buffer_size = buffer_size;
+        init_baton_error(&range->error);
+
+        int open_flags = flags;
+        if (i == 0) {
+            range->conn = conn;
+        }
+        else {
+            rodsEnv env;
+            range->conn = rods_login(&env);
+            if (!range->conn) {
+                set_baton_error(error, -1, "Failed to connect for range %zu "
+                                "of '%s'", i, rods_path->outPath);
+                goto error;
+            }
+            range->own_conn = 1;
+
+            if (flags == O_WRONLY) open_flags = O_RDWR;
+        }
+
+        if (i == 0) {
+            range->data_obj = open_data_obj(range->conn, rods_path,
+                                            open_flags, error);
+        }
+        else {
+            range->data_obj = open_data_obj_pinned(range->conn, rods_path,
+                                                   open_flags, &pin, error);
+        }
+        if (error->code != 0) goto error;
+        range->is_open = 1;
+
+        if (i == 0 && num_ranges > 1 &&
+            get_replica_pin(range->conn, range->data_obj, &pin) != 0) {
+            logmsg(NOTICE, "Transferring '%s' in one range because the "
+                   "replicate it is open on is not known",
+                   rods_path->outPath);
+            range->length = size;
+            num_ranges    = 1;
+        }
+    }
+
+    logmsg(DEBUG, "Transferring '%s' in %zu ranges of up to %zu bytes",
+           rods_path->outPath, num_ranges, range_len);
+
+    for (size_t i = 0; i < num_ranges; i++) {
+        int status = pthread_create(&threads[i], NULL, range_worker,
+                                    &ranges[i]);
+        if (status != 0) {
+            set_baton_error(error, status, "Failed to start a transfer "
+                            "thread for '%s': error %d %s",
+                            rods_path->outPath, status, strerror(status));
+            goto error;
+        }
+        num_started++;
+    }
+
+    unsigned char digest[16];
+    baton_error_t hash_error;
+    init_baton_error(&hash_error);
+
+    int hashed = hash_ranges(&transfer, ranges, num_ranges, fd, buffer_size,
+                             flags == O_RDONLY, digest, &hash_error);
+
+    for (size_t i = 0; i < num_started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    num_started = 0;
+
+    for (size_t i = 0; i < num_ranges; i++) {
+        if (ranges[i].error.code != 0) {
+            set_baton_error(error, ranges[i].error.code, "%s",
+                            ranges[i].error.message);
+            goto error;
+        }
+        num_copied += ranges[i].transferred;
+    }
+
+    if (hash_error.code != 0) {
+        set_baton_error(error, hash_error.code, "%s", hash_error.message);
+        goto error;
+    }
+    if (hashed != 0) {
+        set_baton_error(error, -1, "Failed to calculate the MD5 of '%s'",
+                        rods_path->outPath);
+        goto error;
+    }
+
+    // Close the first range last, after all its data has been written
+    for (size_t i = num_ranges; i-- > 0;) {
+        int status = close_data_obj(ranges[i].conn, ranges[i].data_obj);
+        ranges[i].is_open = 0;
+
+        if (status < 0) {
+            char *err_subname;
+            const char *err_name = rodsErrorName(status, &err_subname);
+            set_baton_error(error, status,
+                            "Failed to close data object: '%s' error %d %s",
+                            rods_path->outPath, status, err_name);
+            goto error;
+        }
+
+    }
+
+    data_obj_file_t *data_obj = ranges[0].data_obj;
+    set_md5_last_read(data_obj, digest);
+
+    if (!validate_md5_last_read(conn, data_obj)) {
+        logmsg(WARN, "Checksum mismatch for '%s' having MD5 %s on reading",
+               data_obj->path, data_obj->md5_last_read);
+    }
+
+    logmsg(NOTICE, "Transferred %zu bytes of '%s' in %zu ranges having "
+           "MD5 %s", num_copied, data_obj->path, num_ranges,
+           data_obj->md5_last_read);
+
+    finish_ranges(&transfer, ranges, num_ranges, threads, num_started);
+    free(ranges);
+    free(threads);
+
+    pthread_mutex_destroy(&transfer.lock);
+    pthread_cond_destroy(&transfer.progress);
+
+    if (flags == O_WRONLY) invalidate_stat_cache(rods_path->outPath);
+
+    return num_copied;
+
+error:
+    if (ranges)  finish_ranges(&transfer, ranges, num_ranges, threads,
+                               num_started);
+    if (ranges)  free(ranges);
+    if (threads) free(threads);
+
+    if (initialised) {
+        pthread_mutex_destroy(&transfer.lock);
+        pthread_cond_destroy(&transfer.progress);
+    }
+
+    if (flags == O_WRONLY) invalidate_stat_cache(rods_path->outPath);
+
+    return num_copied;
+}
+
+size_t get_data_obj_ranges(rcComm_t *conn, rodsPath_t *rods_path, int fd,
+                           size_t size, size_t buffer_size,
+                           baton_error_t *error) {
+    return transfer_ranges(conn, rods_path, fd, size, buffer_size,
+                           O_RDONLY, error);
+}
+
+size_t write_data_obj_ranges(rcComm_t *conn, int fd, size_t size,
+                             rodsPath_t *rods_path, size_t buffer_size,
+                             baton_error_t *error) {
+    return transfer_ranges(conn, rods_path, fd, size, buffer_size,
+                           O_WRONLY, error);
+}
@@ -0,0 +1,182 @@
+/**
+ * Copyright (C) 2017 Genome Research Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @file transfer.h
+ * @author Keith James <kdj@sanger.ac.uk>
+ */
+
+#ifndef _BATON_TRANSFER_H
+#define _BATON_TRANSFER_H
+
+#include <rodsClient.h>
+
+#include "config.h"
+#include "error.h"
+#include "read.h"
+
+/** The maximum number of parallel streams used for one transfer */
+#define PARALLEL_MAX_STREAMS          16
+/** The default size above which transfers are made in parallel */
+#define PARALLEL_DEFAULT_MIN_SIZE     (64 * 1024 * 1024)
+
+/** The maximum number of times one transfer may be resumed */
+#define RESUME_MAX_RETRIES            16
+/** The default delay before the first reconnection, in milliseconds */
+#define RESUME_DEFAULT_DELAY          500
+/** The maximum delay between reconnections, in milliseconds */
+#define RESUME_MAX_DELAY              30000
+
+/**
+ * Set the number of parallel streams used to transfer a large data
+ * object, each having its own iRODS connection and byte range. A value
+ * of 0 or 1 disables parallel transfers.
+ *
+ * @param[in] num_streams  The number of streams, at most
+ *                         PARALLEL_MAX_STREAMS.
+ * @param[in] min_size     The size in bytes at or above which transfers
+ *                         are made in parallel. 0 for the default.
+ */
+void set_parallel_transfer(size_t num_streams, size_t min_size);
+
+size_t get_parallel_streams(void);
+
+size_t get_parallel_min_size(void);
+
+/**
+ * Return true if a transfer of this size will be made in parallel.
+ *
+ * @param[in] size  The number of bytes to transfer.
+ *
+ * @return 1 if parallel, 0 otherwise.
+ */
+int use_parallel_transfer(size_t size);
+
+/**
+ * Read a data object to a local file in parallel byte ranges. The file
+ * is written in place, each range at its own offset, while the calling
+ * thread reads each part back as it arrives to calculate the MD5 of the
+ * whole, in order.
+ *
+ * @param[in]  conn        An open iRODS connection, used for the first
+ *                         range and to validate the checksum.
+ * @param[in]  rods_path   A resolved iRODS data object path.
+ * @param[in]  fd          A local file descriptor, open for reading and
+ *                         writing.
+ * @param[in]  size        The size of the data object in bytes.
+ * @param[in]  buffer_size The number of bytes to copy at one time.
+ * @param[out] error       An error report struct.
+ *
+ * @return The number of bytes copied in total.
+ */
+size_t get_data_obj_ranges(rcComm_t *conn, rodsPath_t *rods_path, int fd,
+                           size_t size, size_t buffer_size,
+                           baton_error_t *error);
+
+/**
+ * Write a data object from a local file in parallel byte ranges. The
+ * data object is created on the given connection and each further range
+ * opens it, without truncation, on its own. The MD5 of the file is
+ * calculated by the calling thread while the ranges are sent.
+ *
+ * @param[in]  conn        An open iRODS connection, used for the first
+ *                         range and to validate the checksum.
+ * @param[in]  fd          A local file descriptor, open for reading.
+ * @param[in]  size        The size of the local file in bytes.
+ * @param[in]  rods_path   An iRODS data object path.
+ * @param[in]  buffer_size The number of bytes to copy at one time.
+ * @param[out] error       An error report struct.
+ *
+ * @return The number of bytes copied in total.
+ */
+size_t write_data_obj_ranges(rcComm_t *conn, int fd, size_t size,
+                             rodsPath_t *rods_path, size_t buffer_size,
+                             baton_error_t *error);
+
+/**
+ * Set the number of times a transfer is resumed after its connection
+ * fails. The delay before each reconnection doubles, up to
+ * RESUME_MAX_DELAY. A value of 0 disables resumption.
+ *
+ * @param[in] max_retries  The number of times, at most
+ *                         RESUME_MAX_RETRIES.
+ * @param[in] delay        The delay before the first reconnection, in
+ *                         milliseconds. 0 for the default.
+ */
+void set_transfer_retries(size_t max_retries, size_t delay);
+
+size_t get_transfer_retries(void);
+
+/**
+ * Return true if an iRODS error code indicates that the connection to
+ * the server failed, rather than the request.
+ *
+ * @param[in] status  An iRODS error code.
+ *
+ * @return 1 if the connection failed, 0 otherwise.
+ */
+int is_connection_error(int status);
+
+/**
+ * Resume the transfer of an open data object after a connection error.
+ * A new connection is made, after a delay, and the data object is
+ * reopened, without truncation, and positioned at the offset of the
+ * next byte to read or write, so that the failed request may be made
+ * again. Any hash of the bytes transferred so far remains valid because
+ * no byte is transferred twice. The new connection is kept by the
+ * handle and used for the rest of the transfer, then handed over to
+ * the owner of the failed connection when the handle is freed.
+ *
+ * @param[in] data_obj  A data object handle.
+ * @param[in] status    The iRODS error code of the failed request.
+ *
+ * @return 1 if the transfer was resumed, 0 if the error was not a
+ * connection error, retries are disabled or exhausted, or every
+ * reconnection failed.
+ */
+int resume_data_obj(data_obj_file_t *data_obj, int status);
+
+/**
+ * Hand over the connection made to resume a transfer, to be taken by
+ * the owner of the connection that failed with @ref replace_connection.
+ *
+ * @param[in] failed       The connection that failed.
+ * @param[in] replacement  The connection that replaced it.
+ */
+void hand_over_connection(rcComm_t *failed, rcComm_t *replacement);
+
+/**
+ * Return the connection to use in place of one that may have failed
+ * during a resumed transfer, without taking it over.
+ *
+ * @param[in] conn  An iRODS connection.
+ *
+ * @return The replacement connection, or conn if it was not replaced.
+ */
+rcComm_t *live_connection(rcComm_t *conn);
+
+/**
+ * Take over the replacement of a connection that failed during a
+ * resumed transfer. The failed connection is disconnected. This must be
+ * called by the owner of a connection between operations and before
+ * disconnecting it.
+ *
+ * @param[in] conn  An iRODS connection.
+ *
+ * @return The replacement connection, or conn if it was not replaced.
+ */
+rcComm_t *replace_connection(rcComm_t *conn);
+
+#endif // _BATON_TRANSFER_H
@@ -0,0 +1,743 @@
+/**
+ * Copyright (C) 2017 Genome Research Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @file tree.c
+ * @author Keith James <kdj@sanger.ac.uk>
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <time.h>
+
+#include "config.h"
+#include "baton.h"
+#include "tree.h"
+
+typedef struct tree_file {
+    /** The local file path */
+    char *local_path;
+    /** The data object path */
+    char *remote_path;
+    /** The number of bytes to transfer */
+    size_t size;
+    /** True if the file is unchanged and need not be transferred */
+    int skipped;
+    /** The result of the transfer */
+    baton_error_t error;
+} tree_file_t;
+
+typedef struct tree_files {
+    tree_file_t *files;
+    size_t num_files;
+    size_t capacity;
+} tree_files_t;
+
+typedef struct tree_paths {
+    char **paths;
+    size_t num_paths;
+    size_t capacity;
+} tree_paths_t;
+
+typedef struct tree_transfer {
+    /** Protects next */
+    pthread_mutex_t lock;
+    tree_file_t *files;
+    size_t num_files;
+    /** The index of the next file to transfer */
+    size_t next;
+    /** True to put files, false to get data objects */
+    int put;
+    option_flags flags;
+    size_t buffer_size;
+} tree_transfer_t;
+
+typedef struct tree_worker {
+    rcComm_t *conn;
+    tree_transfer_t *transfer;
+    /** The statistics of the caller, to which requests are added */
+    rpc_stats_t *stats;
+    /** The query page size of the caller */
+    size_t page_size;
+    int adaptive;
+    /** True if any transfer by this worker failed */
+    int failed;
+} tree_worker_t;
+
+static double tree_clock(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int add_tree_file(tree_files_t *files, const char *local_path,
+                         const char *remote_path, size_t size,
+                         baton_error_t *error) {
+    if (files->num_files == files->capacity) {
+        size_t capacity = files->capacity ? files->capacity * 2 : 64;
+        tree_file_t *tmp = realloc(files->files,
+                                   capacity * sizeof (tree_file_t));
+        if (!tmp) goto error;
+
+        files->files    = tmp;
+        files->capacity = capacity;
+    }
+
+    tree_file_t *file = &files->files[files->num_files];
+    memset(file, 0, sizeof (tree_file_t));
+
+    file->local_path  = strdup(local_path);
+    file->remote_path = strdup(remote_path);
+    file->size        = size;
+    init_baton_error(&file->error);
+    files->num_files++;
+
+    if (!file->local_path || !file->remote_path) goto error;
+
+    return 0;
+
+error:
+    set_baton_error(error, errno, "Failed to allocate memory: error %d %s",
+                    errno, strerror(errno));
+
+    return error->code;
+}
+
+static void free_tree_files(tree_files_t *files) {
+    for (size_t i = 0; i < files->num_files; i++) {
+        if (files->files[i].local_path)  free(files->files[i].local_path);
+        if (files->files[i].remote_path) free(files->files[i].remote_path);
+    }
+
+    if (files->files) free(files->files);
+}
+
+static int add_tree_path(tree_paths_t *paths, const char *path,
+                         baton_error_t *error) {
+    if (paths->num_paths == paths->capacity) {
+        size_t capacity = paths->capacity ? paths->capacity * 2 : 16;
+        char **tmp = realloc(paths->paths, capacity * sizeof (char *));
+        if (!tmp) goto error;
+
+        paths->paths    = tmp;
+        paths->capacity = capacity;
+    }
+
+    paths->paths[paths->num_paths] = strdup(path);
+    if (!paths->paths[paths->num_paths]) goto error;
+    paths->num_paths++;
+
+    return 0;
+
+error:
+    set_baton_error(error, errno, "Failed to allocate memory: error %d %s",
+                    errno, strerror(errno));
+
+    return error->code;
+}
+
+static void free_tree_paths(tree_paths_t *paths) {
+    for (size_t i = 0; i < paths->num_paths; i++) {
+        free(paths->paths[i]);
+    }
+
+    if (paths->paths) free(paths->paths);
+}
+
+static int join_path(char *dest, const char *dir, const char *name,
+                     baton_error_t *error) {
+    int len = snprintf(dest, MAX_NAME_LEN, "%s/%s", dir, name);
+    if (len < 0 || len >= MAX_NAME_LEN) {
+        set_baton_error(error, USER_PATH_EXCEEDS_MAX,
+                        "Path '%s/%s' is too long (exceeds %d)",
+                        dir, name, MAX_NAME_LEN);
+    }
+
+    return error->code;
+}
+
+// Find the files beneath a local directory and the collections they
+// will be put into. Only the collections of directories having no
+// subdirectories are recorded, because their parents are created with
+// them.
+static int walk_directory(const char *local_dir, const char *coll_name,
+                          tree_files_t *files, tree_paths_t *leaves,
+                          baton_error_t *error) {
+    size_t num_subdirs = 0;
+
+    DIR *dir = opendir(local_dir);
+    if (!dir) {
+        set_baton_error(error, errno, "Failed to open directory '%s': "
+                        "error %d %s", local_dir, errno, strerror(errno));
+        goto error;
+    }
+
+    struct dirent *entry;
+    while ((entry = readdir(dir))) {
+        if (str_equals(entry->d_name, ".", 2) ||
+            str_equals(entry->d_name, "..", 3)) continue;
+
+        char local_path[MAX_NAME_LEN];
+        char remote_path[MAX_NAME_LEN];
+        join_path(local_path, local_dir, entry->d_name, error);
+        if (error->code != 0) goto error;
+        join_path(remote_path, coll_name, entry->d_name, error);
+        if (error->code != 0) goto error;
+
+        // Symbolic links to files are followed, but not those to
+        // directories, which may form cycles
+        struct stat st;
+        if (lstat(local_path, &st) != 0 ||
+            (S_ISLNK(st.st_mode) && (stat(local_path, &st) != 0 ||
+                                     S_ISDIR(st.st_mode)))) {
+            logmsg(WARN, "Skipping '%s', which is not a file or directory",
+                   local_path);
+            continue;
+        }
+
+        if (S_ISDIR(st.st_mode)) {
+            num_subdirs++;
+            walk_directory(local_path, remote_path, files, leaves, error);
+            if (error->code != 0) goto error;
+        }
+        else if (S_ISREG(st.st_mode)) {
+            add_tree_file(files, local_path, remote_path, st.st_size, error);
+            if (error->code != 0) goto error;
+        }
+        else {
+            logmsg(WARN, "Skipping '%s', which is not a regular file",
+                   local_path);
+        }
+    }
+
+    closedir(dir);
+    dir = NULL;
+
+    if (num_subdirs == 0) {
+        add_tree_path(leaves, coll_name, error);
+        if (error->code != 0) goto error;
+    }
+
+    return error->code;
+
+error:
+    if (dir) closedir(dir);
+
+    return error->code;
+}
+
+// Create a collection and any missing parents
+static int make_collection(rcComm_t *conn, const char *coll_name,
+                           baton_error_t *error) {
+    collInp_t coll_in;
+    memset(&coll_in, 0, sizeof coll_in);
+
+    snprintf(coll_in.collName, MAX_NAME_LEN, "%s", coll_name);
+    addKeyVal(&coll_in.condInput, RECURSIVE_OPR__KW, "");
+
+    logmsg(DEBUG, "Creating collection '%s'", coll_name);
+
+    int status = rcCollCreate(conn, &coll_in);
+    invalidate_stat_cache(coll_name);
+
+    if (status < 0 && status != CATALOG_ALREADY_HAS_ITEM_BY_THAT_NAME) {
+        char *err_subname;
+        const char *err_name = rodsErrorName(status, &err_subname);
+        set_baton_error(error, status,
+                        "Failed to create collection: '%s' error %d %s",
+                        coll_name, status, err_name);
+    }
+
+    return error->code;
+}
+
+// Create a local directory and any missing parents
+static int make_directory(const char *path, baton_error_t *error) {
+    char tmp[MAX_NAME_LEN];
+    snprintf(tmp, sizeof tmp, "%s", path);
+
+    for (char *p = tmp + 1; ; p++) {
+        if (*p == '/' || *p == '\0') {
+            char c = *p;
+            *p = '\0';
+
+            if (mkdir(tmp, 0777) != 0 && errno != EEXIST) {
+                set_baton_error(error, errno, "Failed to create directory "
+                                "'%s': error %d %s", tmp, errno,
+                                strerror(errno));
+                return error->code;
+            }
+
+            *p = c;
+            if (c == '\0') break;
+        }
+    }
+
+    return error->code;
+}
+
+// Mark a file to be skipped if it has the same size and MD5 as the data
+// object described by a listing entry
+static void mark_unchanged(tree_file_t *file, json_t *entry) {
+    baton_error_t error;
+
+    json_t *size     = json_object_get(entry, JSON_SIZE_KEY);
+    json_t *checksum = json_object_get(entry, JSON_CHECKSUM_KEY);
+    if (!json_is_integer(size) || !json_is_string(checksum)) return;
+
+    file->skipped = local_file_unchanged(file->local_path,
+                                         json_integer_value(size),
+                                         json_string_value(checksum), &error);
+    if (error.code != 0) {
+        logmsg(WARN, "Failed to compare '%s' with '%s'; transferring it: "
+               "error %d %s", file->local_path, file->remote_path,
+               error.code, error.message);
+    }
+}
+
+// Mark the files to be put whose data objects already exist with the
+// same size and MD5, using the sizes and checksums of the whole tree
+// from one paged listing, rather than a request per file
+static int mark_unchanged_puts(rcComm_t *conn, const char *coll_name,
+                               tree_files_t *files, baton_error_t *error) {
+    json_t *entries = NULL;
+    json_t *objects = NULL;
+
+    rodsPath_t rods_path;
+    memset(&rods_path, 0, sizeof rods_path);
+    snprintf(rods_path.inPath,  MAX_NAME_LEN, "%s", coll_name);
+    snprintf(rods_path.outPath, MAX_NAME_LEN, "%s", coll_name);
+
+    int status = get_cached_rods_obj_type(conn, &rods_path);
+    if (status != EXIST_ST || rods_path.objType != COLL_OBJ_T) goto done;
+
+    entries = list_collection_tree(conn, &rods_path,
+                                   PRINT_SIZE | PRINT_CHECKSUM, error);
+    if (error->code != 0) goto error;
+
+    objects = json_object();
+    if (!objects) {
+        set_baton_error(error, -1, "Failed to allocate a new JSON object");
+        goto error;
+    }
+
+    size_t i;
+    json_t *entry;
+    json_array_foreach(entries, i, entry) {
+        if (!represents_data_object(entry)) continue;
+
+        const char *coll = get_collection_value(entry, error);
+        if (error->code != 0) goto error;
+        const char *name = get_data_object_value(entry, error);
+        if (error->code != 0) goto error;
+
+        char obj_path[MAX_NAME_LEN];
+        join_path(obj_path, coll, name, error);
+        if (error->code != 0) goto error;
+
+        json_object_set(objects, obj_path, entry);
+    }
+
+    size_t num_skipped = 0;
+    for (size_t j = 0; j < files->num_files; j++) {
+        tree_file_t *file = &files->files[j];
+        json_t *obj = json_object_get(objects, file->remote_path);
+        if (!obj) continue;
+
+        mark_unchanged(file, obj);
+        if (file->skipped) num_skipped++;
+    }
+
+    logmsg(DEBUG, "Skipping %zu unchanged files of %zu beneath '%s'",
+           num_skipped, files->num_files, coll_name);
+
+done:
+    if (rods_path.rodsObjStat) free(rods_path.rodsObjStat);
+    if (objects) json_decref(objects);
+    if (entries) json_decref(entries);
+
+    return error->code;
+
+error:
+    if (rods_path.rodsObjStat) free(rods_path.rodsObjStat);
+    if (objects) json_decref(objects);
+    if (entries) json_decref(entries);
+
+    return error->code;
+}
+
+static void transfer_tree_file(rcComm_t *conn, tree_transfer_t *transfer,
+                               tree_file_t *file) {
+    rodsPath_t rods_path;
+    memset(&rods_path, 0, sizeof rods_path);
+
+    if (transfer->put) {
+        logmsg(DEBUG, "Putting '%s' to '%s'", file->local_path,
+               file->remote_path);
+
+        snprintf(rods_path.inPath,  MAX_NAME_LEN, "%s", file->remote_path);
+        snprintf(rods_path.outPath, MAX_NAME_LEN, "%s", file->remote_path);
+        rods_path.objType = DATA_OBJ_T;
+
+        put_data_obj(conn, file->local_path, &rods_path, transfer->flags,
+                     &file->error);
+    }
+    else {
+        logmsg(DEBUG, "Getting '%s' to '%s'", file->remote_path,
+               file->local_path);
+
+        set_rods_path(conn, &rods_path, file->remote_path, &file->error);
+        if (file->error.code == 0) {
+            get_data_obj_file(conn, &rods_path, file->local_path,
+                              transfer->buffer_size, &file->error);
+        }
+
+        if (rods_path.rodsObjStat) free(rods_path.rodsObjStat);
+    }
+}
+
+static void *run_tree_worker(void *arg) {
+    tree_worker_t *worker = arg;
+    tree_transfer_t *transfer = worker->transfer;
+
+    // Requests are counted towards, and queries paged like, those of
+    // the operation that started the transfer
+    use_rpc_stats(worker->stats);
+    set_query_page_size(worker->page_size, worker->adaptive);
+
+    while (1) {
+        pthread_mutex_lock(&transfer->lock);
+        size_t i = transfer->next++;
+        pthread_mutex_unlock(&transfer->lock);
+
+        if (i >= transfer->num_files) break;
+
+        tree_file_t *file = &transfer->files[i];
+        if (file->skipped) continue;
+
+        // A transfer resumed on a new connection leaves it for the
+        // next; the owner of the worker's connection takes it over
+        transfer_tree_file(live_connection(worker->conn), transfer, file);
+        if (file->error.code != 0) worker->failed = 1;
+    }
+
+    return NULL;
+}
+
+// Transfer the files in threads, the first using the caller's
+// connection and each other using a spare connection
+static void transfer_tree_files(rcComm_t *conn, tree_transfer_t *transfer,
+                                size_t num_transfers) {
+    tree_worker_t workers[TREE_MAX_TRANSFERS];
+    pthread_t threads[TREE_MAX_TRANSFERS];
+    size_t num_started = 0;
+
+    if (num_transfers < 1) num_transfers = TREE_DEFAULT_TRANSFERS;
+    if (num_transfers > TREE_MAX_TRANSFERS) {
+        num_transfers = TREE_MAX_TRANSFERS;
+    }
+    if (num_transfers > transfer->num_files) {
+        num_transfers = transfer->num_files;
+    }
+
+    memset(workers, 0, sizeof workers);
+    for (size_t i = 0; i < TREE_MAX_TRANSFERS; i++) {
+        workers[i].stats     = get_rpc_stats();
+        workers[i].page_size = get_query_page_size();
+        workers[i].adaptive  = get_query_page_adaptive();
+    }
+
+    for (size_t i = 0; i < num_transfers; i++) {
+        workers[i].transfer = transfer;
+        workers[i].conn = i == 0 ? conn : get_spare_connection(i - 1);
+        if (!workers[i].conn) {
+            logmsg(WARN, "Failed to connect for transfer %zu; continuing "
+                   "with %zu", i, num_started);
+            break;
+        }
+
+        int status = pthread_create(&threads[i], NULL, run_tree_worker,
+                                    &workers[i]);
+        if (status != 0) {
+            logmsg(WARN, "Failed to start transfer thread %zu: error %d %s",
+                   i, status, strerror(status));
+            break;
+        }
+        num_started++;
+    }
+
+    logmsg(DEBUG, "Transferring %zu files with %zu threads",
+           transfer->num_files, num_started);
+
+    // With no threads, the caller transfers every file itself
+    if (num_started == 0) {
+        workers[0].transfer = transfer;
+        workers[0].conn     = conn;
+        run_tree_worker(&workers[0]);
+    }
+
+    for (size_t i = 0; i < num_started; i++) {
+        pthread_join(threads[i], NULL);
+        if (i > 0 && workers[i].failed) drop_spare_connection(i - 1);
+    }
+}
+
+// Report the files transferred, as baton paths, and those that failed
+static json_t *make_tree_report(tree_transfer_t *transfer,
+                                size_t num_colls, double elapsed,
+                                baton_error_t *error) {
+    json_t *failed = json_array();
+    if (!failed) {
+        set_baton_error(error, -1, "Failed to allocate a new JSON array");
+        goto error;
+    }
+
+    size_t num_files = 0;
+    size_t num_bytes = 0;
+    size_t num_skipped = 0;
+    size_t num_failed = 0;
+    baton_error_t *first = NULL;
+
+    for (size_t i = 0; i < transfer->num_files; i++) {
+        tree_file_t *file = &transfer->files[i];
+        if (file->skipped) {
+            num_skipped++;
+            continue;
+        }
+        if (file->error.code == 0) {
+            num_files++;
+            num_bytes += file->size;
+            continue;
+        }
+
+        if (!first) first = &file->error;
+        num_failed++;
+
+        char local_dir[MAX_NAME_LEN];
+        char coll_name[MAX_NAME_LEN];
+        snprintf(local_dir, sizeof local_dir, "%s", file->local_path);
+        snprintf(coll_name, sizeof coll_name, "%s", file->remote_path);
+        char *file_name = strrchr(local_dir, '/');
+        char *data_name = strrchr(coll_name, '/');
+        *file_name++ = '\0';
+        *data_name++ = '\0';
+
+        json_t *item = json_pack("{s:s, s:s, s:s, s:s, s:o}",
+                                 JSON_DIRECTORY_KEY,   local_dir,
+                                 JSON_FILE_KEY,        file_name,
+                                 JSON_COLLECTION_KEY,  coll_name,
+                                 JSON_DATA_OBJECT_KEY, data_name,
+                                 JSON_ERROR_KEY, error_to_json(&file->error));
+        if (!item || json_array_append_new(failed, item) != 0) {
+            set_baton_error(error, -1, "Failed to report transfer of '%s'",
+                            file->local_path);
+            goto error;
+        }
+    }
+
+    json_t *report =
+        json_pack("{s:I, s:I, s:I, s:I, s:f, s:o}",
+                  JSON_TREE_FILES_KEY,       (json_int_t) num_files,
+                  JSON_TREE_COLLECTIONS_KEY, (json_int_t) num_colls,
+                  JSON_TREE_BYTES_KEY,       (json_int_t) num_bytes,
+                  JSON_TREE_SKIPPED_KEY,     (json_int_t) num_skipped,
+                  JSON_TREE_SECONDS_KEY,     elapsed,
+                  JSON_TREE_FAILED_KEY,      failed);
+    failed = NULL;
+    if (!report) {
+        set_baton_error(error, -1, "Failed to pack the transfer report");
+        goto error;
+    }
+
+    if (first) {
+        set_baton_error(error, first->code, "Failed to transfer %zu of %zu "
+                        "files; first error: %s", num_failed,
+                        transfer->num_files, first->message);
+    }
+
+    return report;
+
+error:
+    if (failed) json_decref(failed);
+
+    return NULL;
+}
+
+static json_t *transfer_tree(rcComm_t *conn, tree_files_t *files, int put,
+                             option_flags flags, size_t buffer_size,
+                             size_t num_transfers, size_t num_colls,
+                             double start, baton_error_t *error) {
+    tree_transfer_t transfer = { .files       = files->files,
+                                 .num_files   = files->num_files,
+                                 .next        = 0,
+                                 .put         = put,
+                                 .flags       = flags,
+                                 .buffer_size = buffer_size };
+
+    pthread_mutex_init(&transfer.lock, NULL);
+    transfer_tree_files(conn, &transfer, num_transfers);
+    pthread_mutex_destroy(&transfer.lock);
+
+    return make_tree_report(&transfer, num_colls, tree_clock() - start,
+                            error);
+}
+
+json_t *put_tree(rcComm_t *conn, const char *local_dir, const char *coll_name,
+                 option_flags flags, size_t num_transfers,
+                 baton_error_t *error) {
+    tree_files_t files  = { NULL, 0, 0 };
+    tree_paths_t leaves = { NULL, 0, 0 };
+    json_t *report = NULL;
+    double start = tree_clock();
+
+    init_baton_error(error);
+
+    logmsg(DEBUG, "Putting directory '%s' into '%s'", local_dir, coll_name);
+
+    walk_directory(local_dir, coll_name, &files, &leaves, error);
+    if (error->code != 0) goto error;
+
+    if (flags & SYNC) {
+        mark_unchanged_puts(conn, coll_name, &files, error);
+        if (error->code != 0) goto error;
+    }
+
+    for (size_t i = 0; i < leaves.num_paths; i++) {
+        make_collection(conn, leaves.paths[i], error);
+        if (error->code != 0) goto error;
+    }
+
+    logmsg(DEBUG, "Created %zu leaf collections beneath '%s'",
+           leaves.num_paths, coll_name);
+
+    report = transfer_tree(conn, &files, 1, flags, 0, num_transfers,
+                           leaves.num_paths, start, error);
+
+    free_tree_files(&files);
+    free_tree_paths(&leaves);
+
+    return report;
+
+error:
+    logmsg(ERROR, "Failed to put directory '%s': error %d %s",
+           local_dir, error->code, error->message);
+
+    free_tree_files(&files);
+    free_tree_paths(&leaves);
+
+    return NULL;
+}
+
+json_t *get_tree(rcComm_t *conn, rodsPath_t *rods_path, const char *local_dir,
+                 option_flags flags, size_t buffer_size, size_t num_transfers,
+                 baton_error_t *error) {
+    tree_files_t files = { NULL, 0, 0 };
+    json_t *entries = NULL;
+    json_t *report  = NULL;
+    double start = tree_clock();
+
+    init_baton_error(error);
+
+    const char *root = rods_path->outPath;
+
+    logmsg(DEBUG, "Getting collection '%s' into '%s'", root, local_dir);
+
+    option_flags list_flags = PRINT_SIZE;
+    if (flags & SYNC) list_flags = list_flags | PRINT_CHECKSUM;
+
+    entries = list_collection_tree(conn, rods_path, list_flags, error);
+    if (error->code != 0) goto error;
+
+    make_directory(local_dir, error);
+    if (error->code != 0) goto error;
+
+    size_t num_colls = 0;
+    size_t i;
+    json_t *entry;
+    json_array_foreach(entries, i, entry) {
+        const char *coll_name = get_collection_value(entry, error);
+        if (error->code != 0) goto error;
+
+        // Each path beneath the root maps to the same path beneath the
+        // local directory. Anything else has no place there.
+        const char *relative = path_beneath(coll_name, root, MAX_NAME_LEN);
+        if (!relative) {
+            logmsg(WARN, "Skipping '%s', which is not beneath '%s'",
+                   coll_name, root);
+            continue;
+        }
+
+        char local_path[MAX_NAME_LEN];
+        int len = snprintf(local_path, sizeof local_path, "%s%s",
+                           local_dir, relative);
+        if (len < 0 || len >= MAX_NAME_LEN) {
+            set_baton_error(error, USER_PATH_EXCEEDS_MAX,
+                            "Path '%s%s' is too long (exceeds %d)",
+                            local_dir, relative, MAX_NAME_LEN);
+            goto error;
+        }
+
+        if (represents_data_object(entry)) {
+            const char *data_name = get_data_object_value(entry, error);
+            if (error->code != 0) goto error;
+
+            char file_path[MAX_NAME_LEN];
+            char obj_path[MAX_NAME_LEN];
+            join_path(file_path, local_path, data_name, error);
+            if (error->code != 0) goto error;
+            join_path(obj_path, coll_name, data_name, error);
+            if (error->code != 0) goto error;
+
+            json_int_t size =
+                json_integer_value(json_object_get(entry, JSON_SIZE_KEY));
+            add_tree_file(&files, file_path, obj_path, size, error);
+            if (error->code != 0) goto error;
+
+            if (flags & SYNC) {
+                mark_unchanged(&files.files[files.num_files - 1], entry);
+            }
+        }
+        else {
+            make_directory(local_path, error);
+            if (error->code != 0) goto error;
+            num_colls++;
+        }
+    }
+
+    json_decref(entries);
+    entries = NULL;
+
+    report = transfer_tree(conn, &files, 0, 0, buffer_size, num_transfers,
+                           num_colls, start, error);
+
+    free_tree_files(&files);
+
+    return report;
+
+error:
+    logmsg(ERROR, "Failed to get collection '%s': error %d %s",
+           rods_path->outPath, error->code, error->message);
+
+    if (entries) json_decref(entries);
+    free_tree_files(&files);
+
+    return NULL;
+}
@@ -0,0 +1,96 @@
+/**
+ * Copyright (C) 2017 Genome Research Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @file tree.h
+ * @author Keith James <kdj@sanger.ac.uk>
+ */
+
+#ifndef _BATON_TREE_H
+#define _BATON_TREE_H
+
+#include <jansson.h>
+
+#include <rodsClient.h>
+
+#include "config.h"
+#include "error.h"
+#include "operations.h"
+
+/** The default number of files transferred at once in a tree */
+#define TREE_DEFAULT_TRANSFERS  4
+/** The maximum number of files transferred at once in a tree */
+#define TREE_MAX_TRANSFERS     16
+
+#define JSON_TREE_FILES_KEY       "files"
+#define JSON_TREE_COLLECTIONS_KEY "collections"
+#define JSON_TREE_BYTES_KEY       "bytes"
+#define JSON_TREE_SKIPPED_KEY     "skipped"
+#define JSON_TREE_SECONDS_KEY     "seconds"
+#define JSON_TREE_FAILED_KEY      "failed"
+
+/**
+ * Put a local directory and everything beneath it into a collection,
+ * which is created if necessary. The collections are created first,
+ * then the files are put concurrently, each thread having its own
+ * connection.
+ *
+ * @param[in]  conn           An open iRODS connection.
+ * @param[in]  local_dir      A local directory.
+ * @param[in]  coll_name      The collection to put the directory into.
+ * @param[in]  flags          CALCULATE_CHECKSUM to calculate checksums on
+ *                            the server side, SYNC to skip files whose
+ *                            data objects have the same size and MD5.
+ *                            Optional.
+ * @param[in]  num_transfers  The number of files to transfer at once,
+ *                            at most TREE_MAX_TRANSFERS, or 0 for
+ *                            TREE_DEFAULT_TRANSFERS.
+ * @param[out] error          An error report struct.
+ *
+ * @return A newly constructed JSON object reporting the number of files,
+ * collections and bytes transferred, the number of files skipped, the
+ * time taken and any files that failed, each with its error. The report
+ * is returned even if some files failed, when the error is also set.
+ */
+json_t *put_tree(rcComm_t *conn, const char *local_dir, const char *coll_name,
+                 option_flags flags, size_t num_transfers,
+                 baton_error_t *error);
+
+/**
+ * Get a collection and everything beneath it into a local directory,
+ * which is created if necessary. The tree is listed and the local
+ * directories are created first, then the data objects are fetched
+ * concurrently, each thread having its own connection.
+ *
+ * @param[in]  conn           An open iRODS connection.
+ * @param[in]  rods_path      A resolved iRODS collection path.
+ * @param[in]  local_dir      The local directory to get the collection
+ *                            into.
+ * @param[in]  flags          SYNC to skip data objects whose local files
+ *                            have the same size and MD5. Optional.
+ * @param[in]  buffer_size    The number of bytes to copy at one time.
+ * @param[in]  num_transfers  The number of files to transfer at once,
+ *                            at most TREE_MAX_TRANSFERS, or 0 for
+ *                            TREE_DEFAULT_TRANSFERS.
+ * @param[out] error          An error report struct.
+ *
+ * @return A newly constructed JSON object reporting the transfer, as
+ * for @ref put_tree.
+ */
+json_t *get_tree(rcComm_t *conn, rodsPath_t *rods_path, const char *local_dir,
+                 option_flags flags, size_t buffer_size, size_t num_transfers,
+                 baton_error_t *error);
+
+#endif // _BATON_TREE_H
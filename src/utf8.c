@@ -0,0 +1,452 @@
+/**
+ * Copyright (C) 2017 Genome Research Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @file utf8.c
+ * @author Keith James <kdj@sanger.ac.uk>
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "config.h"
+
+#ifdef HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+#include "log.h"
+#include "utf8.h"
+#include "utilities.h"
+
+// Validate num_blocks consecutive blocks of UTF8_BLOCK_SIZE bytes,
+// given the last 3 bytes of the preceding content in history, which
+// is updated. Return true if the blocks are valid UTF-8.
+typedef int (*utf8_block_fn)(const unsigned char *blocks, size_t num_blocks,
+                             unsigned char *history);
+
+static pthread_once_t utf8_impl_once = PTHREAD_ONCE_INIT;
+static utf8_block_fn validate_blocks = NULL;
+static const char *validate_blocks_name = NULL;
+
+// Return the number of bytes at the end of history that begin a
+// sequence not yet complete.
+static size_t utf8_pending_len(const unsigned char *history) {
+    for (size_t i = 0; i < 3; i++) {
+        unsigned char lead = history[i];
+        size_t len = lead >= 0xf0 ? 4 : lead >= 0xe0 ? 3 : lead >= 0xc0 ? 2 : 0;
+
+        if (len > 3 - i) return 3 - i;
+    }
+
+    return 0;
+}
+
+static int is_ascii_block(const unsigned char *block) {
+    uint64_t bits = 0;
+
+    for (size_t i = 0; i < UTF8_BLOCK_SIZE; i += sizeof bits) {
+        uint64_t word;
+        memcpy(&word, block + i, sizeof word);
+        bits |= word;
+    }
+
+    return (bits & 0x8080808080808080ULL) == 0;
+}
+
+static int validate_blocks_scalar(const unsigned char *blocks,
+                                  size_t num_blocks, unsigned char *history) {
+    unsigned char buffer[3 + UTF8_BLOCK_SIZE];
+
+    for (size_t i = 0; i < num_blocks; i++) {
+        const unsigned char *block = blocks + i * UTF8_BLOCK_SIZE;
+        size_t pending = utf8_pending_len(history);
+
+        if (pending > 0 || !is_ascii_block(block)) {
+            // Prefix the block with any sequence split from the last one
+            memcpy(buffer, history + 3 - pending, pending);
+            memcpy(buffer + pending, block, UTF8_BLOCK_SIZE);
+
+            size_t len = pending + UTF8_BLOCK_SIZE;
+            int partial;
+            if (utf8_valid_prefix((const char *) buffer, len, &partial) != len
+                && !partial) {
+                return 0;
+            }
+        }
+
+        memcpy(history, block + UTF8_BLOCK_SIZE - 3, 3);
+    }
+
+    return 1;
+}
+
+#ifdef HAVE_X86_SIMD
+
+// The vectorized implementation classifies each byte by looking up
+// its high nibble, its low nibble and the high nibble of the byte
+// following it in three tables, whose entries are sets of the errors
+// possible for such a pair. An error is present where all three match.
+// Lengths are checked by requiring continuation bytes exactly where
+// the bytes 2 and 3 before them start 3 and 4 byte sequences.
+//
+// See J. Keiser and D. Lemire, "Validating UTF-8 in less than one
+// instruction per byte", Software: Practice and Experience 51 (2021).
+
+#define UTF8_TOO_SHORT      0x01 // 11______ 0_______ or 11______ 11______
+#define UTF8_TOO_LONG       0x02 // 0_______ 10______
+#define UTF8_OVERLONG_3     0x04 // 11100000 100_____
+#define UTF8_TOO_LARGE      0x08 // 11110100 1001____ and above
+#define UTF8_SURROGATE      0x10 // 11101101 101_____
+#define UTF8_OVERLONG_2     0x20 // 1100000_ 10______
+#define UTF8_TOO_LARGE_1000 0x40 // 11110101 1000____ and above
+#define UTF8_OVERLONG_4     0x40 // 11110000 1000____
+#define UTF8_TWO_CONTS      0x80 // 10______ 10______
+#define UTF8_CARRY (UTF8_TOO_SHORT | UTF8_TOO_LONG | UTF8_TWO_CONTS)
+
+static const unsigned char byte_1_high_table[16] = {
+    // 0_______ ________ ASCII
+    UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG,
+    UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG,
+    // 10______ ________ continuation
+    UTF8_TWO_CONTS, UTF8_TWO_CONTS, UTF8_TWO_CONTS, UTF8_TWO_CONTS,
+    // 1100____ ________ 2 byte lead
+    UTF8_TOO_SHORT | UTF8_OVERLONG_2,
+    // 1101____ ________ 2 byte lead
+    UTF8_TOO_SHORT,
+    // 1110____ ________ 3 byte lead
+    UTF8_TOO_SHORT | UTF8_OVERLONG_3 | UTF8_SURROGATE,
+    // 1111____ ________ 4 byte lead
+    UTF8_TOO_SHORT | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000 | UTF8_OVERLONG_4
+};
+
+static const unsigned char byte_1_low_table[16] = {
+    // ____0000 ________
+    UTF8_CARRY | UTF8_OVERLONG_3 | UTF8_OVERLONG_2 | UTF8_OVERLONG_4,
+    // ____0001 ________
+    UTF8_CARRY | UTF8_OVERLONG_2,
+    // ____001_ ________
+    UTF8_CARRY,
+    UTF8_CARRY,
+    // ____0100 ________
+    UTF8_CARRY | UTF8_TOO_LARGE,
+    // ____0101 ________ to ____1100 ________
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    // ____1101 ________
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000 | UTF8_SURROGATE,
+    // ____111_ ________
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000
+};
+
+static const unsigned char byte_2_high_table[16] = {
+    // ________ 0_______ ASCII
+    UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT,
+    UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT,
+    // ________ 1000____
+    UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_OVERLONG_3 |
+    UTF8_TOO_LARGE_1000 | UTF8_OVERLONG_4,
+    // ________ 1001____
+    UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_OVERLONG_3 |
+    UTF8_TOO_LARGE,
+    // ________ 101_____
+    UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_SURROGATE |
+    UTF8_TOO_LARGE,
+    UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_SURROGATE |
+    UTF8_TOO_LARGE,
+    // ________ 11______ lead
+    UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT
+};
+
+// The largest values of the last 3 bytes of content that do not begin
+// an incomplete sequence
+static const unsigned char incomplete_max[32] = {
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xef, 0xdf, 0xbf
+};
+
+__attribute__((target("sse4.1")))
+static inline __m128i check_sse(__m128i input, __m128i prev,
+                                __m128i table_1_high, __m128i table_1_low,
+                                __m128i table_2_high) {
+    const __m128i nibble = _mm_set1_epi8(0x0f);
+
+    __m128i prev1 = _mm_alignr_epi8(input, prev, 15);
+    __m128i prev2 = _mm_alignr_epi8(input, prev, 14);
+    __m128i prev3 = _mm_alignr_epi8(input, prev, 13);
+
+    __m128i byte_1_high = _mm_shuffle_epi8
+        (table_1_high, _mm_and_si128(_mm_srli_epi16(prev1, 4), nibble));
+    __m128i byte_1_low = _mm_shuffle_epi8
+        (table_1_low, _mm_and_si128(prev1, nibble));
+    __m128i byte_2_high = _mm_shuffle_epi8
+        (table_2_high, _mm_and_si128(_mm_srli_epi16(input, 4), nibble));
+    __m128i special = _mm_and_si128(_mm_and_si128(byte_1_high, byte_1_low),
+                                    byte_2_high);
+
+    // Bytes 0xe0 and above start 3 byte sequences, 0xf0 and above 4
+    __m128i third  = _mm_subs_epu8(prev2, _mm_set1_epi8(0xe0 - 0x80));
+    __m128i fourth = _mm_subs_epu8(prev3, _mm_set1_epi8(0xf0 - 0x80));
+    __m128i must_continue = _mm_and_si128(_mm_or_si128(third, fourth),
+                                          _mm_set1_epi8((char) 0x80));
+
+    return _mm_xor_si128(must_continue, special);
+}
+
+__attribute__((target("sse4.1")))
+static int validate_blocks_sse(const unsigned char *blocks, size_t num_blocks,
+                               unsigned char *history) {
+    const __m128i table_1_high =
+        _mm_loadu_si128((const __m128i *) byte_1_high_table);
+    const __m128i table_1_low =
+        _mm_loadu_si128((const __m128i *) byte_1_low_table);
+    const __m128i table_2_high =
+        _mm_loadu_si128((const __m128i *) byte_2_high_table);
+    const __m128i max =
+        _mm_loadu_si128((const __m128i *) (incomplete_max + 16));
+
+    unsigned char last[16] = { 0 };
+    memcpy(last + 13, history, 3);
+
+    __m128i prev  = _mm_loadu_si128((const __m128i *) last);
+    __m128i error = _mm_setzero_si128();
+
+    for (size_t i = 0; i < num_blocks; i++) {
+        const __m128i *block =
+            (const __m128i *) (blocks + i * UTF8_BLOCK_SIZE);
+        __m128i in0 = _mm_loadu_si128(block);
+        __m128i in1 = _mm_loadu_si128(block + 1);
+        __m128i in2 = _mm_loadu_si128(block + 2);
+        __m128i in3 = _mm_loadu_si128(block + 3);
+
+        __m128i any = _mm_or_si128(_mm_or_si128(in0, in1),
+                                   _mm_or_si128(in2, in3));
+        if (_mm_movemask_epi8(any) == 0) {
+            // Entirely ASCII, so valid unless the last block ended
+            // part way through a sequence
+            error = _mm_or_si128(error, _mm_subs_epu8(prev, max));
+            prev  = _mm_setzero_si128();
+        }
+        else {
+            error = _mm_or_si128(error, check_sse(in0, prev, table_1_high,
+                                                  table_1_low, table_2_high));
+            error = _mm_or_si128(error, check_sse(in1, in0, table_1_high,
+                                                  table_1_low, table_2_high));
+            error = _mm_or_si128(error, check_sse(in2, in1, table_1_high,
+                                                  table_1_low, table_2_high));
+            error = _mm_or_si128(error, check_sse(in3, in2, table_1_high,
+                                                  table_1_low, table_2_high));
+            prev = in3;
+        }
+
+        if (!_mm_testz_si128(error, error)) return 0;
+    }
+
+    _mm_storeu_si128((__m128i *) last, prev);
+    memcpy(history, last + 13, 3);
+
+    return 1;
+}
+
+__attribute__((target("avx2")))
+static inline __m256i check_avx2(__m256i input, __m256i prev,
+                                 __m256i table_1_high, __m256i table_1_low,
+                                 __m256i table_2_high) {
+    const __m256i nibble = _mm256_set1_epi8(0x0f);
+
+    // Byte alignment is within 128 bit lanes, so the lane spanning the
+    // previous and current vectors is made first
+    __m256i span  = _mm256_permute2x128_si256(prev, input, 0x21);
+    __m256i prev1 = _mm256_alignr_epi8(input, span, 15);
+    __m256i prev2 = _mm256_alignr_epi8(input, span, 14);
+    __m256i prev3 = _mm256_alignr_epi8(input, span, 13);
+
+    __m256i byte_1_high = _mm256_shuffle_epi8
+        (table_1_high, _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble));
+    __m256i byte_1_low = _mm256_shuffle_epi8
+        (table_1_low, _mm256_and_si256(prev1, nibble));
+    __m256i byte_2_high = _mm256_shuffle_epi8
+        (table_2_high, _mm256_and_si256(_mm256_srli_epi16(input, 4), nibble));
+    __m256i special = _mm256_and_si256
+        (_mm256_and_si256(byte_1_high, byte_1_low), byte_2_high);
+
+    __m256i third  = _mm256_subs_epu8(prev2, _mm256_set1_epi8(0xe0 - 0x80));
+    __m256i fourth = _mm256_subs_epu8(prev3, _mm256_set1_epi8(0xf0 - 0x80));
+    __m256i must_continue = _mm256_and_si256
+        (_mm256_or_si256(third, fourth), _mm256_set1_epi8((char) 0x80));
+
+    return _mm256_xor_si256(must_continue, special);
+}
+
+__attribute__((target("avx2")))
+static int validate_blocks_avx2(const unsigned char *blocks, size_t num_blocks,
+                                unsigned char *history) {
+    const __m256i table_1_high = _mm256_broadcastsi128_si256
+        (_mm_loadu_si128((const __m128i *) byte_1_high_table));
+    const __m256i table_1_low = _mm256_broadcastsi128_si256
+        (_mm_loadu_si128((const __m128i *) byte_1_low_table));
+    const __m256i table_2_high = _mm256_broadcastsi128_si256
+        (_mm_loadu_si128((const __m128i *) byte_2_high_table));
+    const __m256i max =
+        _mm256_loadu_si256((const __m256i *) incomplete_max);
+
+    unsigned char last[32] = { 0 };
+    memcpy(last + 29, history, 3);
+
+    __m256i prev  = _mm256_loadu_si256((const __m256i *) last);
+    __m256i error = _mm256_setzero_si256();
+
+    for (size_t i = 0; i < num_blocks; i++) {
+        const __m256i *block =
+            (const __m256i *) (blocks + i * UTF8_BLOCK_SIZE);
+        __m256i in0 = _mm256_loadu_si256(block);
+        __m256i in1 = _mm256_loadu_si256(block + 1);
+
+        if (_mm256_movemask_epi8(_mm256_or_si256(in0, in1)) == 0) {
+            error = _mm256_or_si256(error, _mm256_subs_epu8(prev, max));
+            prev  = _mm256_setzero_si256();
+        }
+        else {
+            error = _mm256_or_si256(error, check_avx2(in0, prev, table_1_high,
+                                                      table_1_low,
+                                                      table_2_high));
+            error = _mm256_or_si256(error, check_avx2(in1, in0, table_1_high,
+                                                      table_1_low,
+                                                      table_2_high));
+            prev = in1;
+        }
+
+        if (!_mm256_testz_si256(error, error)) return 0;
+    }
+
+    _mm256_storeu_si256((__m256i *) last, prev);
+    memcpy(history, last + 29, 3);
+
+    return 1;
+}
+
+#endif // HAVE_X86_SIMD
+
+static void select_validate_blocks(void) {
+    validate_blocks      = validate_blocks_scalar;
+    validate_blocks_name = "scalar";
+
+#ifdef HAVE_X86_SIMD
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2")) {
+        validate_blocks      = validate_blocks_avx2;
+        validate_blocks_name = "avx2";
+    }
+    else if (__builtin_cpu_supports("sse4.1")) {
+        validate_blocks      = validate_blocks_sse;
+        validate_blocks_name = "sse4.1";
+    }
+#endif
+
+    logmsg(DEBUG, "Using the %s UTF-8 validator", validate_blocks_name);
+}
+
+const char *utf8_validator_impl(void) {
+    pthread_once(&utf8_impl_once, select_validate_blocks);
+
+    return validate_blocks_name;
+}
+
+void init_utf8_validator(utf8_validator_t *validator) {
+    pthread_once(&utf8_impl_once, select_validate_blocks);
+
+    validator->valid     = 1;
+    validator->carry_len = 0;
+    memset(validator->history, 0, sizeof validator->history);
+}
+
+int utf8_validate_chunk(utf8_validator_t *validator, const char *chunk,
+                        size_t len) {
+    const unsigned char *bytes = (const unsigned char *) chunk;
+
+    if (!validator->valid || len == 0) return validator->valid;
+
+    if (validator->carry_len > 0) {
+        size_t space = UTF8_BLOCK_SIZE - validator->carry_len;
+        size_t n = len < space ? len : space;
+
+        memcpy(validator->carry + validator->carry_len, bytes, n);
+        validator->carry_len += n;
+        bytes += n;
+        len   -= n;
+
+        if (validator->carry_len < UTF8_BLOCK_SIZE) return 1;
+
+        validator->carry_len = 0;
+        validator->valid = validate_blocks(validator->carry, 1,
+                                           validator->history);
+        if (!validator->valid) return 0;
+    }
+
+    // Whole blocks are validated in place
+    size_t num_blocks = len / UTF8_BLOCK_SIZE;
+    if (num_blocks > 0) {
+        validator->valid = validate_blocks(bytes, num_blocks,
+                                           validator->history);
+        if (!validator->valid) return 0;
+    }
+
+    size_t rem = len % UTF8_BLOCK_SIZE;
+    if (rem > 0) {
+        memcpy(validator->carry, bytes + num_blocks * UTF8_BLOCK_SIZE, rem);
+        validator->carry_len = rem;
+    }
+
+    return 1;
+}
+
+int utf8_validate_end(utf8_validator_t *validator) {
+    if (!validator->valid) return 0;
+
+    if (validator->carry_len > 0) {
+        // Padding with NUL bytes detects a sequence cut short by the end
+        memset(validator->carry + validator->carry_len, 0,
+               UTF8_BLOCK_SIZE - validator->carry_len);
+        validator->carry_len = 0;
+        validator->valid = validate_blocks(validator->carry, 1,
+                                           validator->history);
+    }
+
+    if (validator->valid && utf8_pending_len(validator->history) > 0) {
+        validator->valid = 0;
+    }
+
+    return validator->valid;
+}
+
+int utf8_valid(const char *str, size_t len) {
+    utf8_validator_t validator;
+
+    init_utf8_validator(&validator);
+    utf8_validate_chunk(&validator, str, len);
+
+    return utf8_validate_end(&validator);
+}
@@ -0,0 +1,94 @@
+/**
+ * Copyright (C) 2017 Genome Research Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @file utf8.h
+ * @author Keith James <kdj@sanger.ac.uk>
+ */
+
+#ifndef _BATON_UTF8_H
+#define _BATON_UTF8_H
+
+#include <stddef.h>
+
+#include "config.h"
+
+/** The number of bytes validated at a time */
+#define UTF8_BLOCK_SIZE 64
+
+/**
+ *  @struct utf8_validator
+ *  @brief The state of an incremental UTF-8 validation, allowing
+ *  content to be validated in chunks of any size as it arrives.
+ */
+typedef struct utf8_validator {
+    /** False once any invalid UTF-8 has been seen. */
+    int valid;
+    /** The last 3 bytes of the blocks validated so far. */
+    unsigned char history[3];
+    /** Bytes awaiting a complete block. */
+    unsigned char carry[UTF8_BLOCK_SIZE];
+    /** The number of bytes in carry. */
+    size_t carry_len;
+} utf8_validator_t;
+
+/**
+ * Return the name of the UTF-8 validation implementation selected for
+ * this CPU; one of "avx2", "sse4.1" or "scalar".
+ */
+const char *utf8_validator_impl(void);
+
+/**
+ * Initialise an incremental UTF-8 validator.
+ *
+ * @param[out] validator  The validator to initialise.
+ */
+void init_utf8_validator(utf8_validator_t *validator);
+
+/**
+ * Validate the next chunk of content. A sequence may be split between
+ * chunks.
+ *
+ * @param[in,out] validator  A validator.
+ * @param[in]     chunk      The next chunk.
+ * @param[in]     len        The length of the chunk.
+ *
+ * @return False if any content validated so far is invalid UTF-8.
+ */
+int utf8_validate_chunk(utf8_validator_t *validator, const char *chunk,
+                        size_t len);
+
+/**
+ * Finish validation, checking that the content did not end part way
+ * through a sequence.
+ *
+ * @param[in,out] validator  A validator.
+ *
+ * @return True if all the content was valid UTF-8.
+ */
+int utf8_validate_end(utf8_validator_t *validator);
+
+/**
+ * Return true if a buffer is entirely valid UTF-8. NUL bytes are valid
+ * and do not end the buffer.
+ *
+ * @param[in] str  A buffer.
+ * @param[in] len  The length of the buffer.
+ *
+ * @return True if the buffer is valid UTF-8.
+ */
+int utf8_valid(const char *str, size_t len);
+
+#endif // _BATON_UTF8_H
@@ -30,6 +30,7 @@
 #include <time.h>
 
 #include "log.h"
+#include "utf8.h"
 #include "utilities.h"
 
 char *copy_str(const char *str, size_t max_len) {
@@ -114,6 +115,32 @@ const char *parse_base_name(const char *path) {
     return base_name;
 }
 
+// Return the part of path beneath root, beginning with '/', the empty
+// string if path is root itself, or NULL if it is neither. Unlike a
+// prefix test, this does not match siblings of root whose names begin
+// with its name.
+const char *path_beneath(const char *path, const char *root,
+                         size_t max_len) {
+    if (!path || !root) return NULL;
+
+    // A trailing separator is not part of the root's name
+    size_t len = strnlen(root, max_len);
+    while (len > 0 && root[len - 1] == '/') len--;
+
+    if (strnlen(path, max_len) < len || strncmp(path, root, len) != 0) {
+        return NULL;
+    }
+
+    const char *rest = path + len;
+    if (*rest == '\0') return rest;
+    if (*rest != '/')  return NULL;
+
+    // The root collection '/' itself
+    if (len == 0 && rest[1] == '\0') return rest + 1;
+
+    return rest;
+}
+
 char *parse_zone_name(const char *path) {
     const char delim = '/';
 
@@ -297,84 +324,157 @@ size_t to_utf8(const char *input, char *output, size_t max_len) {
     return len;
 }
 
-int maybe_utf8 (const char *str, size_t max_len) {
+// Return the length of the valid UTF-8 sequence starting at bytes, or
+// 0 if there is none. If the sequence is valid as far as avail bytes,
+// but is truncated by their end, partial is set true.
+static size_t utf8_sequence_len(const unsigned char *bytes, size_t avail,
+                                int *partial) {
     // http://www.rfc-editor.org/rfc/rfc3629.txt, Section 4. for the syntax
     // of UTF-8 byte sequences.
     //
     // UTF8-octets = *( UTF8-char )
     // UTF8-char   = UTF8-1 / UTF8-2 / UTF8-3 / UTF8-4
     // UTF8-tail   = %x80-BF
+    unsigned char lead = bytes[0];
+    unsigned char min  = 0x80; // The range of the byte following the lead
+    unsigned char max  = 0xbf;
+    size_t len;
+
+    *partial = 0;
+
+    // UTF8-1 = %x00-7F
+    // Includes 0x7f DEL and other control characters
+    if (lead <= 0x7f) return 1;
+
+    // UTF8-2 = %xC2-DF UTF8-tail
+    if (lead >= 0xc2 && lead <= 0xdf) {
+        len = 2;
+    }
+    // UTF8-3 = %xE0 %xA0-BF UTF8-tail / %xE1-EC 2( UTF8-tail ) /
+    //          %xED %x80-9F UTF8-tail / %xEE-EF 2( UTF8-tail )
+    else if (lead == 0xe0) {
+        len = 3;
+        min = 0xa0;
+    }
+    else if ((lead >= 0xe1 && lead <= 0xec) ||
+             (lead >= 0xee && lead <= 0xef)) {
+        len = 3;
+    }
+    else if (lead == 0xed) {
+        len = 3;
+        max = 0x9f;
+    }
+    // UTF8-4 = %xF0 %x90-BF 2( UTF8-tail ) / %xF1-F3 3( UTF8-tail ) /
+    //          %xF4 %x80-8F 2( UTF8-tail )
+    else if (lead == 0xf0) {
+        len = 4;
+        min = 0x90;
+    }
+    else if (lead >= 0xf1 && lead <= 0xf3) {
+        len = 4;
+    }
+    else if (lead == 0xf4) {
+        len = 4;
+        max = 0x8f;
+    }
+    else {
+        return 0;
+    }
+
+    for (size_t i = 1; i < len; i++) {
+        if (i >= avail) {
+            *partial = 1;
+            return 0;
+        }
 
-    size_t len = strnlen(str, max_len);
-    size_t i   = 0;
+        if (bytes[i] < min || bytes[i] > max) return 0;
 
+        min = 0x80;
+        max = 0xbf;
+    }
+
+    return len;
+}
+
+size_t utf8_valid_prefix(const char *str, size_t len, int *partial) {
     const unsigned char *bytes = (const unsigned char *) str;
+    size_t i = 0;
+
+    *partial = 0;
 
     while (i < len) {
-        // UTF8-1 = %x00-7F
-        // Includes 0x7f DEL and other control characters
-        if (bytes[i + 0] <= 0x7F) {
-            i += 1;
-            continue;
-        }
+        size_t n = utf8_sequence_len(bytes + i, len - i, partial);
+        if (n == 0) break;
+        i += n;
+    }
 
-        // UTF8-2 = %xC2-DF UTF8-tail
-        if ((bytes[i + 0] >= 0xc2) && (bytes[i + 0] <= 0xdf) &&
-            (bytes[i + 1] >= 0x80) && (bytes[i + 1] <= 0xbf)) {
-            i += 2;
-            continue;
-        }
+    return i;
+}
+
+int maybe_utf8 (const char *str, size_t max_len) {
+    return utf8_valid(str, strnlen(str, max_len));
+}
+
+static const char base64_alphabet[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static size_t base64_encode_group(const unsigned char *group, size_t len,
+                                  char *output) {
+    unsigned int bits = group[0] << 16;
+    if (len > 1) bits |= group[1] << 8;
+    if (len > 2) bits |= group[2];
+
+    output[0] = base64_alphabet[(bits >> 18) & 0x3f];
+    output[1] = base64_alphabet[(bits >> 12) & 0x3f];
+    output[2] = len > 1 ? base64_alphabet[(bits >> 6) & 0x3f] : '=';
+    output[3] = len > 2 ? base64_alphabet[bits & 0x3f]        : '=';
+
+    return 4;
+}
 
-        // UTF8-3 = %xE0 %xA0-BF UTF8-tail / %xE1-EC 2( UTF8-tail ) /
-        //          %xED %x80-9F UTF8-tail / %xEE-EF 2( UTF8-tail )
-        if (// %xE0 %xA0-BF UTF8-tail
-            ((bytes[i + 0] == 0xe0)                             &&
-             ((bytes[i + 1] >= 0xa0) && (bytes[i + 1] <= 0xbf)) &&
-             ((bytes[i + 2] >= 0x80) && (bytes[i + 2] <= 0xbf)))
-            ||
-            // %xE1-EC 2( UTF8-tail )
-            (((bytes[i + 0] >= 0xe1) && (bytes[i + 0] <= 0xec)) &&
-             ((bytes[i + 1] >= 0x80) && (bytes[i + 1] <= 0xbf)) &&
-             ((bytes[i + 2] >= 0x80) && (bytes[i + 2] <= 0xbf)))
-            ||
-            // %xED %x80-9F UTF8-tail
-            ((bytes[i + 0] == 0xed)                             &&
-             ((bytes[i + 1] >= 0x80) && (bytes[i + 1] <= 0x9f)) &&
-             ((bytes[i + 2] >= 0x80) && (bytes[i + 2] <= 0xbf)))
-            ||
-            // %xEE-EF 2( UTF8-tail )
-            (((bytes[i + 0] >= 0xee) && (bytes[i + 0] <= 0xef)) &&
-             ((bytes[i + 1] >= 0x80) && (bytes[i + 1] <= 0xbf)) &&
-             ((bytes[i + 2] >= 0x80) && (bytes[i + 2] <= 0xbf)))) {
-            i += 3;
-            continue;
-         }
-
-        // UTF8-4 = %xF0 %x90-BF 2( UTF8-tail ) / %xF1-F3 3( UTF8-tail ) /
-        //          %xF4 %x80-8F 2( UTF8-tail )
-        if (// %xF0 %x90-BF 2( UTF8-tail )
-            ((bytes[i + 0] == 0xf0)                             &&
-             ((bytes[i + 1] >= 0x90) && (bytes[i + 1] <= 0xbf)) &&
-             ((bytes[i + 2] >= 0x80) && (bytes[i + 2] <= 0xbf)) &&
-             ((bytes[i + 3] >= 0x80) && (bytes[i + 3] <= 0xbf)))
-            ||
-            // %xF1-F3 3( UTF8-tail )
-            (((bytes[i + 0] >= 0xf1) && (bytes[i + 0] <= 0xf3)) &&
-             ((bytes[i + 1] >= 0x80) && (bytes[i + 1] <= 0xbf)) &&
-             ((bytes[i + 2] >= 0x80) && (bytes[i + 2] <= 0xbf)) &&
-             ((bytes[i + 3] >= 0x80) && (bytes[i + 3] <= 0xbf)))
-            ||
-            // %xF4 %x80-8F 2( UTF8-tail )
-            ((bytes[i + 0] == 0xf4)                             &&
-             ((bytes[i + 1] >= 0x80) && (bytes[i + 1] <= 0x8f)) &&
-             ((bytes[i + 2] >= 0x80) && (bytes[i + 2] <= 0xbf)) &&
-             ((bytes[i + 3] >= 0x80) && (bytes[i + 3] <= 0xbf)))) {
-            i += 4;
-            continue;
+void init_base64_encoder(base64_encoder_t *encoder) {
+    encoder->carry_len = 0;
+}
+
+size_t base64_encode_chunk(base64_encoder_t *encoder, const char *input,
+                           size_t len, char *output) {
+    const unsigned char *bytes = (const unsigned char *) input;
+    size_t num_written = 0;
+    size_t i = 0;
+
+    // Complete a group begun in the previous chunk
+    if (encoder->carry_len > 0) {
+        unsigned char group[3];
+        size_t n = encoder->carry_len;
+        memcpy(group, encoder->carry, n);
+
+        while (n < 3 && i < len) group[n++] = bytes[i++];
+
+        if (n < 3) {
+            memcpy(encoder->carry, group, n);
+            encoder->carry_len = n;
+            return 0;
         }
 
-        return 0;
+        num_written += base64_encode_group(group, 3, output);
+        encoder->carry_len = 0;
     }
 
-    return 1;
+    while (len - i >= 3) {
+        num_written += base64_encode_group(bytes + i, 3,
+                                           output + num_written);
+        i += 3;
+    }
+
+    encoder->carry_len = len - i;
+    memcpy(encoder->carry, bytes + i, encoder->carry_len);
+
+    return num_written;
+}
+
+size_t base64_encode_end(base64_encoder_t *encoder, char *output) {
+    size_t n = encoder->carry_len;
+    encoder->carry_len = 0;
+
+    return n > 0 ? base64_encode_group(encoder->carry, n, output) : 0;
 }
@@ -40,6 +40,8 @@ char *copy_str(const char *str, size_t max_len);
 
 const char *parse_base_name(const char *path);
 
+const char *path_beneath(const char *path, const char *root, size_t max_len);
+
 char *parse_zone_name(const char *path);
 
 size_t parse_size(const char *str);
@@ -52,6 +54,32 @@ char *parse_timestamp(const char *timestamp, const char *format);
 
 int maybe_utf8 (const char *str, size_t max_len);
 
+// Return the length of the longest prefix of str that is complete,
+// valid UTF-8. Sets partial if the remainder is the start of a valid
+// sequence, so that a buffer may be validated as it fills.
+size_t utf8_valid_prefix(const char *str, size_t len, int *partial);
+
 size_t to_utf8(const char *input, char *output, size_t max_len);
 
+// The number of bytes needed to base64 encode len bytes, with padding
+#define BASE64_ENCODED_LEN(len) ((((len) + 2) / 3) * 4)
+
+// The state of a base64 encoding made a chunk at a time. Up to 2 bytes
+// are carried to the next chunk so that each is encoded in whole groups.
+typedef struct base64_encoder {
+    unsigned char carry[2];
+    size_t carry_len;
+} base64_encoder_t;
+
+void init_base64_encoder(base64_encoder_t *encoder);
+
+// Encode the next chunk into output, which must have room for
+// BASE64_ENCODED_LEN(len) bytes. Returns the number of bytes written.
+size_t base64_encode_chunk(base64_encoder_t *encoder, const char *input,
+                           size_t len, char *output);
+
+// Encode any carried bytes, with padding, into output, which must have
+// room for 4 bytes. Returns the number of bytes written.
+size_t base64_encode_end(base64_encoder_t *encoder, char *output);
+
 #endif // _BATON_UTILITIES_H
@@ -19,8 +19,14 @@
  * @author Keith James <kdj@sanger.ac.uk>
  */
 
+#include <sys/stat.h>
+
 #include "config.h"
 #include "compat_checksum.h"
+#include "local_io.h"
+#include "stat_cache.h"
+#include "stats.h"
+#include "transfer.h"
 #include "write.h"
 
 int put_data_obj(rcComm_t *conn, const char *path, rodsPath_t *rods_path,
@@ -53,6 +59,8 @@ int put_data_obj(rcComm_t *conn, const char *path, rodsPath_t *rods_path,
     addKeyVal(&obj_open_in.condInput, FORCE_FLAG_KW, "");
 
     status = rcDataObjPut(conn, &obj_open_in, tmpname);
+    invalidate_stat_cache(rods_path->outPath);
+
     if (status < 0) {
         char *err_subname;
         const char *err_name = rodsErrorName(status, &err_subname);
@@ -72,8 +80,10 @@ error:
     return error->code;
 }
 
-size_t write_data_obj(rcComm_t *conn, FILE *in, rodsPath_t *rods_path,
-                      size_t buffer_size, baton_error_t *error) {
+// Write to a data object from either a stream or a local file
+static size_t send_data_obj(rcComm_t *conn, FILE *in, local_file_t *file,
+                            rodsPath_t *rods_path, size_t buffer_size,
+                            baton_error_t *error) {
     data_obj_file_t *obj = NULL;
     char *buffer         = NULL;
     size_t num_read      = 0;
@@ -87,11 +97,23 @@ size_t write_data_obj(rcComm_t *conn, FILE *in, rodsPath_t *rods_path,
         goto error;
     }
 
-    buffer = calloc(buffer_size +1, sizeof (char));
-    if (!buffer) {
-        logmsg(ERROR, "Failed to allocate memory: error %d %s",
-               errno, strerror(errno));
-        goto error;
+    // Only a regular file can be read in ranges
+    int fd = file ? file->fd : fileno(in);
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) &&
+        use_parallel_transfer(st.st_size)) {
+        return write_data_obj_ranges(conn, fd, st.st_size, rods_path,
+                                     buffer_size, error);
+    }
+
+    // A local file provides its own buffer, or memory map
+    if (!file) {
+        buffer = calloc(buffer_size +1, sizeof (char));
+        if (!buffer) {
+            logmsg(ERROR, "Failed to allocate memory: error %d %s",
+                   errno, strerror(errno));
+            goto error;
+        }
     }
 
     obj = open_data_obj(conn, rods_path, O_WRONLY, error);
@@ -101,12 +123,24 @@ size_t write_data_obj(rcComm_t *conn, FILE *in, rodsPath_t *rods_path,
     MD5_CTX context;
     compat_MD5Init(&context);
 
-    size_t nr, nw;
-    while ((nr = fread(buffer, 1, buffer_size, in)) > 0) {
+    while (1) {
+        const char *data = buffer;
+        size_t nr;
+
+        if (file) {
+            nr = read_local_file(file, buffer_size, &data, error);
+            if (error->code != 0) goto error;
+        }
+        else {
+            nr = fread(buffer, 1, buffer_size, in);
+        }
+        if (nr == 0) break;
+
         num_read += nr;
-        logmsg(DEBUG, "Writing %zu bytes from stream to '%s'", nr, obj->path);
+        logmsg(DEBUG, "Writing %zu bytes from %s to '%s'", nr,
+               file ? file->path : "stream", obj->path);
 
-        nw = write_chunk(conn, buffer, obj, nr, error);
+        size_t nw = write_chunk(conn, (char *) data, obj, nr, error);
         if (error->code != 0) {
             logmsg(ERROR, "Failed to write to '%s': error %d %s",
                    obj->path, error->code, error->message);
@@ -114,8 +148,7 @@ size_t write_data_obj(rcComm_t *conn, FILE *in, rodsPath_t *rods_path,
         }
         num_written += nw;
 
-        compat_MD5Update(&context, (unsigned char*) buffer, nr);
-        memset(buffer, 0, buffer_size);
+        compat_MD5Update(&context, (unsigned char*) data, nr);
     }
 
     compat_MD5Final(digest, &context);
@@ -145,12 +178,16 @@ size_t write_data_obj(rcComm_t *conn, FILE *in, rodsPath_t *rods_path,
     logmsg(NOTICE, "Wrote %zu bytes to '%s' having MD5 %s",
            num_written, obj->path, obj->md5_last_read);
 
+    invalidate_stat_cache(rods_path->outPath);
+
     if (obj)    free_data_obj(obj);
     if (buffer) free(buffer);
 
     return num_written;
 
 error:
+    invalidate_stat_cache(rods_path->outPath);
+
     if (obj)    free_data_obj(obj);
     if (buffer) free(buffer);
 
@@ -161,14 +198,23 @@ size_t write_chunk(rcComm_t *conn, char *buffer, data_obj_file_t *data_obj,
                    size_t len, baton_error_t *error) {
     init_baton_error(error);
 
-    data_obj->open_obj->len = len;
-
     bytesBuf_t obj_write_in;
     memset(&obj_write_in, 0, sizeof obj_write_in);
     obj_write_in.buf = buffer;
     obj_write_in.len = len;
 
-    int num_written = rcDataObjWrite(conn, data_obj->open_obj, &obj_write_in);
+    // Bytes are only counted as written once the server has confirmed
+    // them, so a resumed write sends the whole buffer again
+    int num_written;
+    do {
+        data_obj->open_obj->len = len;
+
+        double rpc = rpc_start();
+        num_written = rcDataObjWrite(data_obj_connection(conn, data_obj),
+                                     data_obj->open_obj, &obj_write_in);
+        rpc_end(RPC_DATA_OBJ_WRITE, rpc, num_written > 0 ? num_written : 0);
+    } while (num_written < 0 && resume_data_obj(data_obj, num_written));
+
     if (num_written < 0) {
         char *err_subname;
         const char *err_name = rodsErrorName(num_written, &err_subname);
@@ -179,9 +225,45 @@ size_t write_chunk(rcComm_t *conn, char *buffer, data_obj_file_t *data_obj,
     }
 
     logmsg(DEBUG, "Wrote %d bytes to '%s'", num_written, data_obj->path);
+    data_obj->position += num_written;
 
     return num_written;
 
 error:
     return num_written;
 }
+
+size_t write_data_obj(rcComm_t *conn, FILE *in, rodsPath_t *rods_path,
+                      size_t buffer_size, baton_error_t *error) {
+    return send_data_obj(conn, in, NULL, rods_path, buffer_size, error);
+}
+
+size_t write_data_obj_file(rcComm_t *conn, const char *local_path,
+                           rodsPath_t *rods_path, size_t buffer_size,
+                           baton_error_t *error) {
+    size_t num_written = 0;
+
+    local_file_t *file = open_local_input(local_path, buffer_size, error);
+    if (error->code != 0) goto error;
+
+    num_written = send_data_obj(conn, NULL, file, rods_path, buffer_size,
+                                error);
+
+    baton_error_t close_error;
+    close_local_file(file, &close_error);
+
+    if (error->code != 0) goto error;
+    if (close_error.code != 0) {
+        set_baton_error(error, close_error.code, "%s", close_error.message);
+        goto error;
+    }
+
+    free_local_file(file);
+
+    return num_written;
+
+error:
+    if (file) free_local_file(file);
+
+    return num_written;
+}
@@ -70,4 +70,20 @@ size_t write_chunk(rcComm_t *conn, char *buffer, data_obj_file_t *obj_file,
 size_t write_data_obj(rcComm_t *conn, FILE *in, rodsPath_t *rods_path,
                       size_t buffer_size, baton_error_t *error);
 
+/**
+ * Write to a data object from a local file, as write_data_obj does,
+ * reading the file as set by set_local_io.
+ *
+ * @param[in]  conn        An open iRODS connection.
+ * @param[in]  local_path  The local file path.
+ * @param[in]  rods_path   An iRODS data object path.
+ * @param[in]  buffer_size The number of bytes to copy at one time.
+ * @param[out] error       An error report struct.
+ *
+ * @return The number of bytes copied in total.
+ */
+size_t write_data_obj_file(rcComm_t *conn, const char *local_path,
+                           rodsPath_t *rods_path, size_t buffer_size,
+                           baton_error_t *error);
+
 #endif // _BATON_WRITE_H
@@ -0,0 +1,327 @@
+/**
+ * Copyright (C) 2017 Genome Research Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * @file bench_baton.c
+ * @author Keith James <kdj@sanger.ac.uk>
+ *
+ * Microbenchmarks of the CPU-bound parts of baton, which need no iRODS
+ * server. Each benchmark prints one JSON object to STDOUT.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <jansson.h>
+
+#include "../src/baton.h"
+#include "../src/json.h"
+#include "../src/log.h"
+#include "../src/query.h"
+#include "../src/utilities.h"
+
+// The minimum time for which each benchmark runs
+#define BENCH_MIN_SECS 1.0
+
+#define BENCH_ROWS      1000
+#define BENCH_AVUS      1000
+#define BENCH_ITEMS     10000
+#define BENCH_STR_LEN   (1024 * 1024)
+
+typedef size_t (*bench_fn)(void *data);
+
+static json_t *results = NULL;
+
+// Run a benchmark function repeatedly for at least BENCH_MIN_SECS and
+// record the time per call. The function returns the number of
+// operations each call performed.
+static void run_bench(const char *name, bench_fn fn, void *data,
+                      size_t bytes) {
+    size_t calls = 0;
+    size_t ops   = 0;
+
+    double start = query_clock();
+    double elapsed;
+    do {
+        ops += fn(data);
+        calls++;
+        elapsed = query_clock() - start;
+    } while (elapsed < BENCH_MIN_SECS);
+
+    json_t *result = json_pack("{s:s, s:I, s:I, s:f, s:f}",
+                               "benchmark",  name,
+                               "calls",      (json_int_t) calls,
+                               "operations", (json_int_t) ops,
+                               "seconds",    elapsed,
+                               "ns_per_op",  elapsed * 1e9 / ops);
+    if (bytes > 0) {
+        json_object_set_new(result, "mb_per_sec",
+                            json_real(bytes * calls / elapsed / 1e6));
+    }
+
+    json_array_append_new(results, result);
+}
+
+typedef struct query_data {
+    genQueryOut_t query_out;
+    const char *labels[3];
+} query_data_t;
+
+static size_t bench_make_json_objects(void *data) {
+    query_data_t *qd = data;
+
+    json_t *objects = make_json_objects(&qd->query_out, qd->labels);
+    size_t num_objects = json_array_size(objects);
+    json_decref(objects);
+
+    return num_objects;
+}
+
+static size_t bench_maybe_utf8(void *data) {
+    const char *str = data;
+
+    return maybe_utf8(str, BENCH_STR_LEN) ? 1 : 0;
+}
+
+static size_t bench_utf8_valid(void *data) {
+    const char *str = data;
+
+    return utf8_valid(str, BENCH_STR_LEN) ? 1 : 0;
+}
+
+// Validate in the chunk size typical of reads from iRODS
+static size_t bench_utf8_validate_chunk(void *data) {
+    const char *str = data;
+    const size_t chunk_size = 64 * 1024 - 1;
+    utf8_validator_t validator;
+
+    init_utf8_validator(&validator);
+    for (size_t i = 0; i < BENCH_STR_LEN; i += chunk_size) {
+        size_t len = BENCH_STR_LEN - i;
+        utf8_validate_chunk(&validator, str + i,
+                            len < chunk_size ? len : chunk_size);
+    }
+
+    return utf8_validate_end(&validator) ? 1 : 0;
+}
+
+static size_t bench_to_utf8(void *data) {
+    const char *str = data;
+    static char output[BENCH_STR_LEN + 1];
+
+    to_utf8(str, output, BENCH_STR_LEN + 1);
+
+    return 1;
+}
+
+static size_t bench_contains_avu(void *data) {
+    json_t *avus = data;
+    size_t num_avus = json_array_size(avus);
+
+    // Look up an AVU at each of several positions, and one absent
+    size_t found = 0;
+    for (size_t i = 0; i < num_avus; i += num_avus / 10) {
+        found += contains_avu(avus, json_array_get(avus, i));
+    }
+
+    json_t *absent = json_pack("{s:s, s:s}", JSON_ATTRIBUTE_KEY, "absent",
+                               JSON_VALUE_KEY, "absent");
+    contains_avu(avus, absent);
+    json_decref(absent);
+
+    return found + 1;
+}
+
+static size_t bench_avu_difference(void *data) {
+    json_t *avus = data;
+    baton_error_t error;
+
+    json_t *diff = avu_difference(avus, avus, &error);
+    json_decref(diff);
+
+    return json_array_size(avus);
+}
+
+static size_t bench_json_to_path(void *data) {
+    json_t *obj = data;
+    baton_error_t error;
+
+    for (int i = 0; i < 100; i++) {
+        char *path = json_to_path(obj, &error);
+        free(path);
+    }
+
+    return 100;
+}
+
+static size_t bench_read_input(void *data) {
+    FILE *input = data;
+    baton_error_t error;
+
+    rewind(input);
+    json_reader_t *reader = make_json_reader(input, &error);
+
+    size_t num_items = 0;
+    while (!json_reader_eof(reader)) {
+        json_t *item = read_json_item(reader, &error);
+        if (item) {
+            num_items++;
+            json_decref(item);
+        }
+    }
+
+    free_json_reader(reader);
+
+    return num_items;
+}
+
+static size_t bench_print_json(void *data) {
+    json_t *items = data;
+    size_t num_items = json_array_size(items);
+
+    for (size_t i = 0; i < num_items; i++) {
+        print_json(json_array_get(items, i));
+    }
+    flush_json_output();
+
+    return num_items;
+}
+
+static json_t *make_avus(size_t num_avus) {
+    json_t *avus = json_array();
+
+    for (size_t i = 0; i < num_avus; i++) {
+        char value[32];
+        snprintf(value, sizeof value, "value%zu", i);
+        json_array_append_new(avus, json_pack("{s:s, s:s, s:s}",
+                                              JSON_ATTRIBUTE_KEY, "attr",
+                                              JSON_VALUE_KEY,     value,
+                                              JSON_UNITS_KEY,     "units"));
+    }
+
+    return avus;
+}
+
+static json_t *make_envelopes(size_t num_items, json_t *avus) {
+    json_t *items = json_array();
+
+    for (size_t i = 0; i < num_items; i++) {
+        char name[32];
+        snprintf(name, sizeof name, "f%zu.txt", i);
+        json_array_append_new
+            (items, json_pack("{s:s, s:{s:b}, s:{s:s, s:s, s:O}}",
+                              JSON_OP_KEY, JSON_LIST_OP,
+                              JSON_OP_ARGS_KEY, JSON_OP_AVU, 1,
+                              JSON_TARGET_KEY,
+                              JSON_COLLECTION_KEY,  "/zone/home/user/coll",
+                              JSON_DATA_OBJECT_KEY, name,
+                              JSON_AVUS_KEY,        avus));
+    }
+
+    return items;
+}
+
+int main(void) {
+    set_log_threshold(ERROR);
+
+    results = json_array();
+
+    // Query results of (collection, data object, size) for many rows
+    query_data_t qd = { .labels = { JSON_COLLECTION_KEY,
+                                    JSON_DATA_OBJECT_KEY,
+                                    JSON_SIZE_KEY } };
+    size_t col_len = 64;
+    qd.query_out.rowCnt   = BENCH_ROWS;
+    qd.query_out.attriCnt = 3;
+    for (int i = 0; i < 3; i++) {
+        qd.query_out.sqlResult[i].len   = col_len;
+        qd.query_out.sqlResult[i].value = calloc(BENCH_ROWS, col_len);
+    }
+    for (size_t row = 0; row < BENCH_ROWS; row++) {
+        snprintf(qd.query_out.sqlResult[0].value + row * col_len, col_len,
+                 "/zone/home/user/coll");
+        snprintf(qd.query_out.sqlResult[1].value + row * col_len, col_len,
+                 "f%zu.txt", row);
+        snprintf(qd.query_out.sqlResult[2].value + row * col_len, col_len,
+                 "%zu", row * 1024);
+    }
+    run_bench("make_json_objects", bench_make_json_objects, &qd, 0);
+
+    // Mostly ASCII text with some multibyte characters
+    char *str = calloc(BENCH_STR_LEN + 1, 1);
+    for (size_t i = 0; i < BENCH_STR_LEN; i++) {
+        str[i] = 'a' + i % 26;
+    }
+    for (size_t i = 0; i + 2 < BENCH_STR_LEN; i += 1000) {
+        memcpy(str + i, "\xc3\xa9", 2);
+    }
+    run_bench("maybe_utf8", bench_maybe_utf8, str, BENCH_STR_LEN);
+    run_bench("utf8_valid", bench_utf8_valid, str, BENCH_STR_LEN);
+    run_bench("utf8_validate_chunk", bench_utf8_validate_chunk, str,
+              BENCH_STR_LEN);
+    run_bench("to_utf8", bench_to_utf8, str, BENCH_STR_LEN);
+
+    json_t *avus = make_avus(BENCH_AVUS);
+    run_bench("contains_avu", bench_contains_avu, avus, 0);
+    run_bench("avu_difference", bench_avu_difference, avus, 0);
+
+    json_t *obj = json_pack("{s:s, s:s}",
+                            JSON_COLLECTION_KEY,  "/zone/home/user/coll",
+                            JSON_DATA_OBJECT_KEY, "f1.txt");
+    run_bench("json_to_path", bench_json_to_path, obj, 0);
+
+    json_t *small_avus = make_avus(10);
+    json_t *items = make_envelopes(BENCH_ITEMS, small_avus);
+
+    FILE *input = tmpfile();
+    for (size_t i = 0; i < json_array_size(items); i++) {
+        json_dumpf(json_array_get(items, i), input, JSON_COMPACT);
+        fputc('\n', input);
+    }
+    fflush(input);
+    long input_len = ftell(input);
+    run_bench("read_json_input", bench_read_input, input, input_len);
+
+    // Serialise to /dev/null, restoring STDOUT for the results
+    fflush(stdout);
+    int stdout_fd = dup(fileno(stdout));
+    FILE *null_out = fopen("/dev/null", "w");
+    dup2(fileno(null_out), fileno(stdout));
+    run_bench("print_json", bench_print_json, items, input_len);
+    fflush(stdout);
+    dup2(stdout_fd, fileno(stdout));
+    close(stdout_fd);
+    fclose(null_out);
+
+    for (size_t i = 0; i < json_array_size(results); i++) {
+        print_json(json_array_get(results, i));
+    }
+    flush_json_output();
+
+    fclose(input);
+    json_decref(items);
+    json_decref(small_avus);
+    json_decref(obj);
+    json_decref(avus);
+    free(str);
+    for (int i = 0; i < 3; i++) {
+        free(qd.query_out.sqlResult[i].value);
+    }
+    json_decref(results);
+
+    return 0;
+}
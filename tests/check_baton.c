@@ -20,6 +20,7 @@
 
 #include <assert.h>
 #include <limits.h>
+#include <pthread.h>
 #include <unistd.h>
 
 #include <jansson.h>
@@ -104,6 +105,9 @@ static void basic_setup() {
     printf("Data setup: %s\n", command);
     int ret = system(command);
 
+    // The test data are recreated outside this process
+    clear_stat_cache();
+
     if (ret != 0) raise(SIGTERM);
 }
 
@@ -166,6 +170,21 @@ START_TEST(test_str_starts_with) {
 }
 END_TEST
 
+START_TEST(test_path_beneath) {
+    size_t len = MAX_STR_LEN;
+    ck_assert_str_eq(path_beneath("/a/b",   "/a/b",  len), "");
+    ck_assert_str_eq(path_beneath("/a/b/c", "/a/b",  len), "/c");
+    ck_assert_str_eq(path_beneath("/a/b/c", "/a/b/", len), "/c");
+    ck_assert_str_eq(path_beneath("/a/b",   "/",     len), "/a/b");
+    ck_assert_str_eq(path_beneath("/",      "/",     len), "");
+
+    // Siblings sharing the root as a prefix are not beneath it
+    ck_assert_ptr_eq(path_beneath("/a/bc",  "/a/b",  len), NULL);
+    ck_assert_ptr_eq(path_beneath("/a/bc/d", "/a/b", len), NULL);
+    ck_assert_ptr_eq(path_beneath("/a",     "/a/b",  len), NULL);
+}
+END_TEST
+
 START_TEST(test_str_ends_with) {
     size_t len = MAX_STR_LEN;
     ck_assert_msg(str_ends_with("",   "", len),    "'' ends with ''");
@@ -249,6 +268,420 @@ START_TEST(test_parse_size) {
 }
 END_TEST
 
+// Can we write and read local files, preallocated, directly and mapped?
+START_TEST(test_local_file_io) {
+    char content[10000];
+    for (size_t i = 0; i < sizeof content; i++) {
+        content[i] = 'a' + (i % 26);
+    }
+
+    int modes[] = { 0, LOCAL_IO_DIRECT | LOCAL_IO_MMAP };
+    for (size_t m = 0; m < 2; m++) {
+        set_local_io(modes[m]);
+
+        char template[] = "baton_test_local_io.XXXXXX";
+        int fd = mkstemp(template);
+        close(fd);
+
+        // Chunks of a length that is not aligned, to a file preallocated
+        // to more than is written
+        baton_error_t error;
+        local_file_t *file = open_local_output(template, 20000, 0, 4096,
+                                               &error);
+        ck_assert_int_eq(error.code, 0);
+
+        for (size_t i = 0; i < sizeof content; i += 1000) {
+            ck_assert_int_eq(write_local_file(file, content + i, 1000,
+                                              &error), 1000);
+            ck_assert_int_eq(error.code, 0);
+        }
+        ck_assert_int_eq(close_local_file(file, &error), 0);
+        free_local_file(file);
+
+        struct stat st;
+        ck_assert_int_eq(stat(template, &st), 0);
+        ck_assert_int_eq(st.st_size, sizeof content);
+
+        file = open_local_input(template, 3000, &error);
+        ck_assert_int_eq(error.code, 0);
+        ck_assert_int_eq(file->size, sizeof content);
+
+        size_t total = 0;
+        size_t nr;
+        const char *data;
+        while ((nr = read_local_file(file, 3000, &data, &error)) > 0) {
+            ck_assert(nr <= 3000);
+            ck_assert(memcmp(data, content + total, nr) == 0);
+            total += nr;
+        }
+        ck_assert_int_eq(error.code, 0);
+        ck_assert_int_eq(total, sizeof content);
+
+        ck_assert_int_eq(close_local_file(file, &error), 0);
+        free_local_file(file);
+        unlink(template);
+    }
+
+    set_local_io(0);
+    ck_assert_int_eq(get_local_io(), 0);
+}
+END_TEST
+
+// Can we encode content for a JSON string a chunk at a time?
+START_TEST(test_stream_encoding) {
+    char escaped[256];
+    const char *raw = "a\"b\\c\n\t\x01\xc3\xa9";
+    size_t len = json_escape_chunk(raw, strlen(raw), escaped);
+    escaped[len] = '\0';
+    ck_assert_str_eq(escaped, "a\\\"b\\\\c\\n\\t\\u0001\xc3\xa9");
+
+    // The escaped text is decoded to the original by a JSON parser
+    char doc[300];
+    snprintf(doc, sizeof doc, "\"%s\"", escaped);
+    json_error_t load_error;
+    json_t *str = json_loads(doc, JSON_DECODE_ANY, &load_error);
+    ck_assert_ptr_ne(str, NULL);
+    ck_assert_str_eq(json_string_value(str), raw);
+    json_decref(str);
+
+    const char *inputs[]   = { "M", "Ma", "Man", "Many hands" };
+    const char *expected[] = { "TQ==", "TWE=", "TWFu", "TWFueSBoYW5kcw==" };
+
+    for (size_t i = 0; i < 4; i++) {
+        size_t input_len = strlen(inputs[i]);
+
+        // Each input is encoded a chunk of every size at a time
+        for (size_t chunk = 1; chunk <= input_len; chunk++) {
+            char encoded[64];
+            size_t num_encoded = 0;
+
+            base64_encoder_t encoder;
+            init_base64_encoder(&encoder);
+
+            for (size_t j = 0; j < input_len; j += chunk) {
+                size_t n = input_len - j < chunk ? input_len - j : chunk;
+                num_encoded += base64_encode_chunk(&encoder, inputs[i] + j,
+                                                   n, encoded + num_encoded);
+            }
+            num_encoded += base64_encode_end(&encoder,
+                                             encoded + num_encoded);
+            encoded[num_encoded] = '\0';
+
+            ck_assert_int_eq(num_encoded, BASE64_ENCODED_LEN(input_len));
+            ck_assert_str_eq(encoded, expected[i]);
+        }
+    }
+}
+END_TEST
+
+// Can we set and adapt the query page size?
+// Arenas replace jansson's allocator for the whole process, so this
+// test relies on Check running each test in its own process
+START_TEST(test_json_arena) {
+    ck_assert_ptr_eq(make_json_arena(), NULL);
+
+    enable_json_arenas();
+    ck_assert(json_arenas_enabled());
+
+    json_t *heap_obj = json_pack("{s:s}", "attribute", "a");
+    ck_assert_ptr_ne(heap_obj, NULL);
+
+    json_arena_t *arena = make_json_arena();
+    ck_assert_ptr_ne(arena, NULL);
+
+    for (int i = 0; i < 3; i++) {
+        json_arena_t *previous = use_json_arena(arena);
+        ck_assert_ptr_eq(previous, NULL);
+
+        json_t *avus = json_array();
+        for (int j = 0; j < 1000; j++) {
+            json_array_append_new(avus, json_pack("{s:s, s:i}",
+                                                  "attribute", "a",
+                                                  "value", j));
+        }
+
+        ck_assert_ptr_eq(use_json_arena(previous), arena);
+
+        // Arena values may be mixed with heap values
+        json_object_set(heap_obj, "avus", avus);
+        ck_assert_int_eq(json_array_size(avus), 1000);
+        ck_assert_int_eq(json_integer_value
+                         (json_object_get(json_array_get(avus, 999),
+                                          "value")), 999);
+
+        char *str = json_dumps(json_array_get(avus, 0), JSON_COMPACT);
+        ck_assert_str_eq(str, "{\"attribute\":\"a\",\"value\":0}");
+        free_json_mem(str);
+
+        json_object_del(heap_obj, "avus");
+        json_decref(avus);
+        reset_json_arena(arena);
+    }
+
+    ck_assert_str_eq(json_string_value(json_object_get(heap_obj,
+                                                       "attribute")), "a");
+    json_decref(heap_obj);
+
+    free_json_arena(arena);
+    reset_json_arena(NULL);
+    free_json_arena(NULL);
+}
+END_TEST
+
+// Are specific query aliases and labels cached, in memory and on disk?
+START_TEST(test_specific_cache) {
+    rcComm_t conn;
+    memset(&conn, 0, sizeof conn);
+    snprintf(conn.host, sizeof conn.host, "%s", "localhost");
+    snprintf(conn.proxyUser.rodsZone, sizeof conn.proxyUser.rodsZone, "%s",
+             "testZone");
+    conn.portNum = 1247;
+
+    const char *alias = "cachedAlias";
+    const char *sql   = "SELECT a, b AS c FROM some_table";
+
+    ck_assert_ptr_eq(get_cached_specific_sql(&conn, alias), NULL);
+
+    // The SQL returned is a copy and the first one added is kept
+    char *stored = store_specific_sql(&conn, alias, sql);
+    ck_assert_str_eq(stored, sql);
+    char *kept = store_specific_sql(&conn, alias, "SELECT x");
+    ck_assert_str_eq(kept, sql);
+    ck_assert_ptr_ne(kept, stored);
+    char *found = get_cached_specific_sql(&conn, alias);
+    ck_assert_str_eq(found, sql);
+    free(kept);
+    free(found);
+
+    // Aliases are specific to a server
+    rcComm_t other = conn;
+    other.portNum = 1248;
+    ck_assert_ptr_eq(get_cached_specific_sql(&other, alias), NULL);
+
+    // Expired SQL is replaced
+    set_specific_cache_ttl(0);
+    char *expired = store_specific_sql(&other, alias, "SELECT x");
+    ck_assert_str_eq(expired, "SELECT x");
+    ck_assert_ptr_eq(get_cached_specific_sql(&other, alias), NULL);
+    char *renewed = store_specific_sql(&other, alias, "SELECT y");
+    ck_assert_str_eq(renewed, "SELECT y");
+    ck_assert_str_eq(expired, "SELECT x");
+    free(expired);
+    free(renewed);
+
+    set_specific_cache_ttl(SPECIFIC_CACHE_DEFAULT_TTL);
+    found = get_cached_specific_sql(&conn, alias);
+    ck_assert_str_eq(found, stored);
+    free(found);
+    free(stored);
+
+    // Each format returned is a copy
+    ck_assert_ptr_eq(get_cached_specific_format(sql), NULL);
+    query_format_in_t *format = make_query_format_from_sql(sql);
+    store_specific_format(sql, format);
+
+    query_format_in_t *cached = get_cached_specific_format(sql);
+    ck_assert_ptr_ne(cached, NULL);
+    ck_assert_ptr_ne(cached, format);
+    ck_assert_int_eq(cached->num_columns, 2);
+    ck_assert_str_eq(cached->labels[0], "a");
+    ck_assert_str_eq(cached->labels[1], "c");
+    free_specific_labels(cached);
+    free_specific_labels(format);
+
+    // Aliases survive in the cache file
+    char template[] = "baton_test_specific_cache.XXXXXX";
+    int fd = mkstemp(template);
+    close(fd);
+    unlink(template);
+
+    ck_assert_int_eq(set_specific_cache_file(template), 0);
+    free(store_specific_sql(&conn, "anotherAlias",
+                            "SELECT d FROM some_table"));
+    clear_specific_cache();
+    ck_assert_ptr_eq(get_cached_specific_sql(&conn, alias), NULL);
+
+    ck_assert_int_eq(set_specific_cache_file(template), 0);
+    found = get_cached_specific_sql(&conn, alias);
+    ck_assert_str_eq(found, sql);
+    free(found);
+    found = get_cached_specific_sql(&conn, "anotherAlias");
+    ck_assert_str_eq(found, "SELECT d FROM some_table");
+    free(found);
+    ck_assert_ptr_eq(get_cached_specific_format(sql), NULL);
+
+    set_specific_cache_file(NULL);
+    clear_specific_cache();
+    unlink(template);
+}
+END_TEST
+
+START_TEST(test_logmsg_lazy) {
+    log_level threshold = get_log_threshold();
+    set_log_threshold(WARN);
+
+    // Arguments of filtered messages are not evaluated
+    int count = 0;
+    logmsg(DEBUG, "Count %d", count++);
+    ck_assert_int_eq(count, 0);
+
+    logmsg(WARN, "Count %d", count++);
+    ck_assert_int_eq(count, 1);
+
+    set_log_threshold(threshold);
+}
+END_TEST
+
+START_TEST(test_rpc_stats) {
+    // Nothing is measured unless statistics are being collected
+    ck_assert(rpc_start() < 0);
+
+    rpc_stats_t *stats = make_rpc_stats();
+    ck_assert_ptr_ne(stats, NULL);
+    ck_assert_ptr_eq(use_rpc_stats(stats), NULL);
+    ck_assert_ptr_eq(get_rpc_stats(), stats);
+
+    for (int i = 0; i < 2; i++) {
+        double start = rpc_start();
+        ck_assert(start >= 0);
+        rpc_end(RPC_DATA_OBJ_READ, start, 1024);
+    }
+    rpc_end(RPC_GEN_QUERY, rpc_start(), 0);
+
+    ck_assert_ptr_eq(use_rpc_stats(NULL), stats);
+
+    baton_error_t error;
+    json_t *result = rpc_stats_to_json(stats, &error);
+    ck_assert_int_eq(error.code, 0);
+    ck_assert_int_eq(json_object_size(result), 2);
+
+    json_t *reads = json_object_get(result, rpc_kind_name(RPC_DATA_OBJ_READ));
+    ck_assert_int_eq(json_integer_value(json_object_get(reads,
+                                                        JSON_RPC_COUNT_KEY)),
+                     2);
+    ck_assert_int_eq(json_integer_value(json_object_get(reads,
+                                                        JSON_RPC_BYTES_KEY)),
+                     2048);
+
+    json_t *histogram = json_object_get(reads, JSON_RPC_HISTOGRAM_KEY);
+    ck_assert(json_array_size(histogram) >= 1);
+
+    json_int_t binned = 0;
+    for (size_t i = 0; i < json_array_size(histogram); i++) {
+        json_t *bin = json_array_get(histogram, i);
+        binned += json_integer_value(json_object_get(bin,
+                                                     JSON_RPC_COUNT_KEY));
+    }
+    ck_assert_int_eq(binned, 2);
+
+    json_decref(result);
+    free_rpc_stats(stats);
+}
+END_TEST
+
+START_TEST(test_query_page_size) {
+    set_query_page_size(0, 0);
+    ck_assert_int_eq(get_query_page_size(), SEARCH_MAX_ROWS);
+
+    set_query_page_size(MAX_SQL_ROWS + 1, 0);
+    ck_assert_int_eq(get_query_page_size(), MAX_SQL_ROWS);
+
+    // Non-adaptive pages don't change size, or retry on error
+    set_query_page_size(100, 0);
+    ck_assert_int_eq(adapt_query_page_size(100, 100, 0.0), 100);
+    ck_assert_int_eq(backoff_query_page_size(100), 0);
+
+    // Adaptive pages grow while full and fast, up to MAX_SQL_ROWS
+    set_query_page_size(100, 1);
+    ck_assert_int_eq(adapt_query_page_size(100, 100, 0.0), 200);
+    ck_assert_int_eq(adapt_query_page_size(200, 200, 0.0), MAX_SQL_ROWS);
+    ck_assert_int_eq(adapt_query_page_size(200, 50, 0.0), 200);
+
+    // and shrink when slow, down to the initial size
+    ck_assert_int_eq(adapt_query_page_size(MAX_SQL_ROWS, MAX_SQL_ROWS,
+                                           ADAPTIVE_PAGE_SLOW_SECS + 1), 128);
+    ck_assert_int_eq(adapt_query_page_size(128, 128,
+                                           ADAPTIVE_PAGE_SLOW_SECS + 1), 100);
+
+    ck_assert_int_eq(backoff_query_page_size(100), 50);
+    ck_assert_int_eq(backoff_query_page_size(1), 0);
+
+    // Only errors which smaller pages might avoid are retried
+    ck_assert(is_page_size_error(SYS_REQUESTED_BUF_TOO_LARGE));
+    ck_assert(!is_page_size_error(SYS_HEADER_READ_LEN_ERR));
+    ck_assert(!is_page_size_error(CAT_NO_ACCESS_PERMISSION));
+    ck_assert(!is_page_size_error(CAT_SQL_ERR));
+
+    set_query_page_size(0, 0);
+}
+END_TEST
+
+// Can we validate UTF-8 incrementally?
+START_TEST(test_utf8_valid_prefix) {
+    int partial;
+
+    // "caf\u00e9" with the two byte sequence split
+    const char *text = "caf\xc3\xa9";
+    ck_assert_int_eq(utf8_valid_prefix(text, 5, &partial), 5);
+    ck_assert(!partial);
+    ck_assert_int_eq(utf8_valid_prefix(text, 4, &partial), 3);
+    ck_assert(partial);
+
+    // An overlong encoding is invalid, not partial
+    const char *overlong = "ab\xc0\xaf";
+    ck_assert_int_eq(utf8_valid_prefix(overlong, 4, &partial), 2);
+    ck_assert(!partial);
+
+    // A surrogate is invalid
+    const char *surrogate = "\xed\xa0\x80";
+    ck_assert_int_eq(utf8_valid_prefix(surrogate, 3, &partial), 0);
+    ck_assert(!partial);
+}
+END_TEST
+
+// Can we validate UTF-8 in blocks and in chunks of any size?
+START_TEST(test_utf8_validator) {
+    ck_assert(utf8_validator_impl() != NULL);
+
+    // Longer than a block, with sequences of each length either side
+    // of the block boundary and an embedded NUL
+    char text[UTF8_BLOCK_SIZE * 3];
+    memset(text, 'a', sizeof text);
+    text[10] = '\0';
+    memcpy(text + UTF8_BLOCK_SIZE - 1, "\xc3\xa9", 2);
+    memcpy(text + UTF8_BLOCK_SIZE * 2 - 2, "\xe2\x82\xac", 3);
+    memcpy(text + sizeof text - 4, "\xf0\x9f\x98\x80", 4);
+
+    ck_assert(utf8_valid(text, sizeof text));
+    ck_assert(!utf8_valid(text, sizeof text - 1)); // Truncated
+    ck_assert(utf8_valid(text, 0));
+
+    for (size_t chunk_size = 1; chunk_size <= sizeof text; chunk_size++) {
+        utf8_validator_t validator;
+        init_utf8_validator(&validator);
+
+        for (size_t i = 0; i < sizeof text; i += chunk_size) {
+            size_t len = sizeof text - i;
+            if (len > chunk_size) len = chunk_size;
+            ck_assert(utf8_validate_chunk(&validator, text + i, len));
+        }
+        ck_assert(utf8_validate_end(&validator));
+    }
+
+    // Overlong, surrogate, too large and stray continuation bytes
+    const char *invalid[] = { "\xc0\xaf", "\xe0\x80\xaf", "\xed\xa0\x80",
+                              "\xf4\x90\x80\x80", "\xf5\x80\x80\x80",
+                              "\x80", "\xc3\xa9\xa9" };
+    for (size_t i = 0; i < sizeof invalid / sizeof invalid[0]; i++) {
+        char copy[sizeof text];
+        memcpy(copy, text, sizeof text);
+        memcpy(copy + UTF8_BLOCK_SIZE + 20, invalid[i], strlen(invalid[i]));
+
+        ck_assert(!utf8_valid(copy, sizeof copy));
+    }
+}
+END_TEST
+
 // Can we coerce ISO-8859-1 to UTF-8?
 START_TEST(test_to_utf8) {
     char in[2]  = { 0, 0 };
@@ -331,6 +764,159 @@ START_TEST(test_resolve_rods_path) {
 }
 END_TEST
 
+// Do cached path stats match uncached ones, and are they invalidated?
+START_TEST(test_stat_cache) {
+    option_flags flags = 0;
+    rodsEnv env;
+    rcComm_t *conn = rods_login(&env);
+
+    char rods_root[MAX_PATH_LEN];
+    set_current_rods_root(TEST_COLL, rods_root);
+
+    char obj_path[MAX_PATH_LEN];
+    snprintf(obj_path, MAX_PATH_LEN, "%s/f1.txt", rods_root);
+
+    rodsPath_t rods_path1;
+    baton_error_t error1;
+    ck_assert_int_eq(resolve_rods_path(conn, &env, &rods_path1, obj_path,
+                                       flags, &error1), EXIST_ST);
+
+    // A second resolution is satisfied by the cache
+    rodsPath_t rods_path2;
+    baton_error_t error2;
+    ck_assert_int_eq(resolve_rods_path(conn, &env, &rods_path2, obj_path,
+                                       flags, &error2), EXIST_ST);
+    ck_assert_int_eq(rods_path2.objType, DATA_OBJ_T);
+    ck_assert_int_eq(rods_path2.size, rods_path1.size);
+    ck_assert_str_eq(rods_path2.chksum, rods_path1.chksum);
+    ck_assert_ptr_ne(rods_path2.rodsObjStat, rods_path1.rodsObjStat);
+
+    char new_path[MAX_PATH_LEN];
+    snprintf(new_path, MAX_PATH_LEN, "%s/f1.txt.moved", rods_root);
+
+    baton_error_t move_error;
+    move_rods_path(conn, &rods_path2, new_path, &move_error);
+    ck_assert_int_eq(move_error.code, 0);
+
+    // The moved path must not be found in the cache
+    rodsPath_t rods_path3;
+    baton_error_t error3;
+    ck_assert_int_ne(resolve_rods_path(conn, &env, &rods_path3, obj_path,
+                                       flags, &error3), EXIST_ST);
+
+    // Disabling the cache gives the same results
+    set_stat_cache_ttl(0);
+
+    rodsPath_t rods_path4;
+    baton_error_t error4;
+    ck_assert_int_eq(resolve_rods_path(conn, &env, &rods_path4, new_path,
+                                       flags, &error4), EXIST_ST);
+    ck_assert_int_eq(rods_path4.size, rods_path1.size);
+
+    set_stat_cache_ttl(STAT_CACHE_DEFAULT_TTL);
+
+    rodsPath_t rods_path5;
+    baton_error_t error5;
+    ck_assert_int_eq(resolve_rods_path(conn, &env, &rods_path5, new_path,
+                                       flags, &error5), EXIST_ST);
+
+    // Writes by another client are not seen in the cache until the
+    // path is refreshed
+    char command[MAX_COMMAND_LEN];
+    snprintf(command, MAX_COMMAND_LEN, "iput -f %s/%s/lorem_1k.txt %s",
+             TEST_ROOT, TEST_DATA_PATH, new_path);
+    ck_assert_int_eq(system(command), 0);
+
+    rodsPath_t rods_path6;
+    baton_error_t error6;
+    ck_assert_int_eq(resolve_rods_path(conn, &env, &rods_path6, new_path,
+                                       flags, &error6), EXIST_ST);
+    ck_assert_int_eq(rods_path6.rodsObjStat->objSize, rods_path1.size);
+
+    ck_assert_int_eq(refresh_rods_obj_type(conn, &rods_path6), EXIST_ST);
+    ck_assert_int_eq(rods_path6.rodsObjStat->objSize, 1024);
+
+    if (rods_path1.rodsObjStat) free(rods_path1.rodsObjStat);
+    if (rods_path2.rodsObjStat) free(rods_path2.rodsObjStat);
+    if (rods_path4.rodsObjStat) free(rods_path4.rodsObjStat);
+    if (rods_path5.rodsObjStat) free(rods_path5.rodsObjStat);
+    if (rods_path6.rodsObjStat) free(rods_path6.rodsObjStat);
+
+    if (conn) rcDisconnect(conn);
+}
+END_TEST
+
+// Are a target's resolution and catalog results kept across a run of
+// operations on it, and discarded when it changes?
+START_TEST(test_target_run) {
+    option_flags flags = 0;
+    rodsEnv env;
+    rcComm_t *conn = rods_login(&env);
+
+    char rods_root[MAX_PATH_LEN];
+    set_current_rods_root(TEST_COLL, rods_root);
+
+    char obj_path[MAX_PATH_LEN];
+    snprintf(obj_path, MAX_PATH_LEN, "%s/f1.txt", rods_root);
+
+    begin_target_run(obj_path);
+
+    rodsPath_t rods_path;
+    baton_error_t resolve_error;
+    ck_assert_int_eq(resolve_rods_path(conn, &env, &rods_path, obj_path,
+                                       flags, &resolve_error), EXIST_ST);
+
+    baton_error_t list_error1;
+    json_t *acl1 = list_permissions(conn, &rods_path, &list_error1);
+    ck_assert_int_eq(list_error1.code, 0);
+
+    // The listed permissions are kept for the next operation
+    json_t *kept = load_target_result(rods_path.outPath, TARGET_ACL);
+    ck_assert_ptr_ne(kept, NULL);
+    ck_assert(json_equal(kept, acl1));
+    json_decref(kept);
+
+    // A change of permissions discards them
+    baton_error_t mod_error;
+    ck_assert_int_eq(modify_permissions(conn, &rods_path, NO_RECURSE,
+                                        "public", ACCESS_LEVEL_READ,
+                                        &mod_error), 0);
+    ck_assert_ptr_eq(load_target_result(rods_path.outPath, TARGET_ACL),
+                     NULL);
+
+    json_t *expected = json_pack("{s:s, s:s, s:s}",
+                                 JSON_OWNER_KEY, "public",
+                                 JSON_ZONE_KEY,  env.rodsZone,
+                                 JSON_LEVEL_KEY, ACCESS_LEVEL_READ);
+
+    baton_error_t list_error2;
+    json_t *acl2 = list_permissions(conn, &rods_path, &list_error2);
+    ck_assert_int_eq(list_error2.code, 0);
+
+    int found = 0;
+    for (size_t i = 0; i < json_array_size(acl2); i++) {
+        if (json_equal(expected, json_array_get(acl2, i))) found = 1;
+    }
+    ck_assert_int_eq(found, 1);
+
+    // A run on a different target keeps nothing of the last
+    char other_path[MAX_PATH_LEN];
+    snprintf(other_path, MAX_PATH_LEN, "%s/f2.txt", rods_root);
+    begin_target_run(other_path);
+    ck_assert_ptr_eq(load_target_result(rods_path.outPath, TARGET_ACL),
+                     NULL);
+
+    end_target_run();
+
+    json_decref(expected);
+    json_decref(acl1);
+    json_decref(acl2);
+    if (rods_path.rodsObjStat) free(rods_path.rodsObjStat);
+
+    if (conn) rcDisconnect(conn);
+}
+END_TEST
+
 // Do we fail to list a non-existent path?
 START_TEST(test_list_missing_path) {
     option_flags flags = 0;
@@ -636,84 +1222,129 @@ START_TEST(test_list_coll_contents) {
 }
 END_TEST
 
-// Can we build a general query input?
-START_TEST(test_make_query_input) {
-    int max_rows = 10;
-    int num_columns = 1;
-    int columns[] = { COL_COLL_NAME };
-    genQueryInp_t* query_input =
-        make_query_input(max_rows, num_columns, columns);
-
-    ck_assert_ptr_ne(query_input, NULL);
-    ck_assert_ptr_ne(query_input->selectInp.inx, NULL);
-    ck_assert_ptr_ne(query_input->selectInp.value, NULL);
-    ck_assert_int_eq(query_input->selectInp.len, num_columns);
-
-    ck_assert_int_eq(query_input->maxRows, max_rows);
-    ck_assert_int_eq(query_input->continueInx, 0);
-    ck_assert_int_eq(query_input->condInput.len, 0);
-
-    ck_assert_ptr_ne(query_input->sqlCondInp.inx, NULL);
-    ck_assert_ptr_ne(query_input->sqlCondInp.value, NULL);
-    ck_assert_int_eq(query_input->sqlCondInp.len, 0);
-
-    free_query_input(query_input);
-}
-END_TEST
-
-// Do we fail to list the ACL of a non-existent path?
-START_TEST(test_list_permissions_missing_path) {
+// Do we get the same data object attributes from a single query of a
+// collection's contents as we do from querying them one at a time?
+START_TEST(test_list_coll_contents_attrs) {
     option_flags flags = 0;
     rodsEnv env;
     rcComm_t *conn = rods_login(&env);
 
-    char *path = "no such path";
+    char rods_root[MAX_PATH_LEN];
+    set_current_rods_root(TEST_COLL, rods_root);
+
     rodsPath_t rods_path;
     baton_error_t resolve_error;
-    resolve_rods_path(conn, &env, &rods_path, path, flags, &resolve_error);
+    ck_assert_int_eq(resolve_rods_path(conn, &env, &rods_path, rods_root,
+                                       flags, &resolve_error), EXIST_ST);
+
+    const char *keys[] = { JSON_CHECKSUM_KEY, JSON_TIMESTAMPS_KEY,
+                           JSON_REPLICATE_KEY };
+    option_flags key_flags[] = { PRINT_CHECKSUM, PRINT_TIMESTAMP,
+                                 PRINT_REPLICATE };
+    int num_keys = 3;
 
     baton_error_t error;
-    ck_assert_ptr_eq(list_permissions(conn, &rods_path, &error), NULL);
-    ck_assert_int_ne(error.code, 0);
+    json_t *combined = list_path(conn, &rods_path,
+                                 PRINT_CONTENTS | PRINT_CHECKSUM |
+                                 PRINT_TIMESTAMP | PRINT_REPLICATE, &error);
+    ck_assert_int_eq(error.code, 0);
+    json_t *combined_contents = json_object_get(combined, JSON_CONTENTS_KEY);
+
+    for (int i = 0; i < num_keys; i++) {
+        json_t *single = list_path(conn, &rods_path,
+                                   PRINT_CONTENTS | key_flags[i], &error);
+        ck_assert_int_eq(error.code, 0);
+        json_t *single_contents = json_object_get(single, JSON_CONTENTS_KEY);
+
+        ck_assert_int_eq(json_array_size(single_contents),
+                         json_array_size(combined_contents));
+
+        for (size_t j = 0; j < json_array_size(single_contents); j++) {
+            json_t *x = json_array_get(single_contents, j);
+            json_t *y = json_array_get(combined_contents, j);
+
+            if (represents_data_object(x)) {
+                ck_assert_int_eq(json_equal(json_object_get(x, keys[i]),
+                                            json_object_get(y, keys[i])), 1);
+            }
+        }
+
+        json_decref(single);
+    }
+
+    json_decref(combined);
 
     if (conn) rcDisconnect(conn);
 }
 END_TEST
 
-// Can we list the ACL of an object?
-START_TEST(test_list_permissions_obj) {
+// Can we list the whole tree beneath a collection?
+START_TEST(test_list_coll_contents_recurse) {
     option_flags flags = 0;
     rodsEnv env;
     rcComm_t *conn = rods_login(&env);
 
     char rods_root[MAX_PATH_LEN];
     set_current_rods_root(TEST_COLL, rods_root);
-    char obj_path[MAX_PATH_LEN];
-    snprintf(obj_path, MAX_PATH_LEN, "%s/f1.txt", rods_root);
 
     rodsPath_t rods_path;
     baton_error_t resolve_error;
-    ck_assert_int_eq(resolve_rods_path(conn, &env, &rods_path, obj_path,
+    ck_assert_int_eq(resolve_rods_path(conn, &env, &rods_path, rods_root,
                                        flags, &resolve_error), EXIST_ST);
 
     baton_error_t error;
-    json_t *results = list_permissions(conn, &rods_path, &error);
-    json_t *expected = json_pack("[{s:s, s:s, s:s}]",
-                                 JSON_OWNER_KEY, env.rodsUserName,
-                                 JSON_ZONE_KEY,  env.rodsZone,
-                                 JSON_LEVEL_KEY, ACCESS_OWN);
-
-    ck_assert_int_eq(json_equal(results, expected), 1);
+    json_t *results = list_path(conn, &rods_path,
+                                PRINT_SIZE | PRINT_CONTENTS | RECURSIVE,
+                                &error);
     ck_assert_int_eq(error.code, 0);
 
+    json_t *contents = json_object_get(results, JSON_CONTENTS_KEY);
+    ck_assert(json_is_array(contents));
+
+    char m[MAX_PATH_LEN];
+    snprintf(m, MAX_PATH_LEN, "%s/a/x/m", rods_path.outPath);
+
+    // a, a/x, a/x/m, a/x/n, a/x/o, a/y, a/z, b and c, followed by the
+    // data objects, each once whatever its number of replicates
+    size_t num_colls = 0;
+    size_t num_in_m  = 0;
+    size_t num_f1    = 0;
+
+    size_t i;
+    json_t *item;
+    json_array_foreach(contents, i, item) {
+        const char *coll =
+            json_string_value(json_object_get(item, JSON_COLLECTION_KEY));
+        ck_assert_ptr_ne(coll, NULL);
+
+        if (represents_collection(item)) {
+            ck_assert_str_ne(coll, rods_path.outPath);
+            ck_assert_int_eq(i, num_colls);
+            num_colls++;
+            continue;
+        }
+
+        ck_assert(json_is_integer(json_object_get(item, JSON_SIZE_KEY)));
+        if (str_equals(coll, m, MAX_PATH_LEN)) num_in_m++;
+        if (str_equals(coll, rods_path.outPath, MAX_PATH_LEN) &&
+            str_equals(json_string_value(json_object_get
+                                         (item, JSON_DATA_OBJECT_KEY)),
+                       "f1.txt", MAX_PATH_LEN)) num_f1++;
+    }
+
+    ck_assert_int_eq(num_colls, 9);
+    ck_assert_int_eq(num_in_m, 3);
+    ck_assert_int_eq(num_f1, 1);
+
     json_decref(results);
 
     if (conn) rcDisconnect(conn);
 }
 END_TEST
 
-// Can we list the ACL of a collection?
-START_TEST(test_list_permissions_coll) {
+// Does a recursive listing exclude siblings whose names match the
+// root's where it has a LIKE wildcard?
+START_TEST(test_list_coll_contents_recurse_siblings) {
     option_flags flags = 0;
     rodsEnv env;
     rcComm_t *conn = rods_login(&env);
@@ -721,35 +1352,297 @@ START_TEST(test_list_permissions_coll) {
     char rods_root[MAX_PATH_LEN];
     set_current_rods_root(TEST_COLL, rods_root);
 
+    char command[MAX_COMMAND_LEN];
+    snprintf(command, MAX_COMMAND_LEN, "imkdir -p %s/p_q/in %s/pXq/out",
+             rods_root, rods_root);
+    ck_assert_int_eq(system(command), 0);
+
+    char coll_path[MAX_PATH_LEN];
+    snprintf(coll_path, MAX_PATH_LEN, "%s/p_q", rods_root);
+
     rodsPath_t rods_path;
     baton_error_t resolve_error;
-    ck_assert_int_eq(resolve_rods_path(conn, &env, &rods_path, rods_root,
+    ck_assert_int_eq(resolve_rods_path(conn, &env, &rods_path, coll_path,
                                        flags, &resolve_error), EXIST_ST);
 
     baton_error_t error;
-    json_t *results = list_permissions(conn, &rods_path, &error);
-    json_t *expected = json_pack("[{s:s, s:s, s:s}]",
-                                 JSON_OWNER_KEY, env.rodsUserName,
-                                 JSON_ZONE_KEY,  env.rodsZone,
-                                 JSON_LEVEL_KEY, ACCESS_OWN);
-
-    ck_assert_int_eq(json_equal(results, expected), 1);
+    json_t *results = list_collection_tree(conn, &rods_path, 0, &error);
     ck_assert_int_eq(error.code, 0);
 
+    char in_path[MAX_PATH_LEN];
+    snprintf(in_path, MAX_PATH_LEN, "%s/in", rods_path.outPath);
+
+    ck_assert_int_eq(json_array_size(results), 1);
+    ck_assert_str_eq(json_string_value
+                     (json_object_get(json_array_get(results, 0),
+                                      JSON_COLLECTION_KEY)), in_path);
+
     json_decref(results);
+    if (rods_path.rodsObjStat) free(rods_path.rodsObjStat);
 
     if (conn) rcDisconnect(conn);
 }
 END_TEST
 
-// Can we list metadata on a data object?
-START_TEST(test_list_metadata_obj) {
+// Can we list a collection a page at a time?
+START_TEST(test_list_coll_contents_page) {
     option_flags flags = 0;
     rodsEnv env;
     rcComm_t *conn = rods_login(&env);
 
-    char *no_path = "no such path";
-    rodsPath_t no_rods_path;
+    char rods_root[MAX_PATH_LEN];
+    set_current_rods_root(TEST_COLL, rods_root);
+
+    rodsPath_t rods_path;
+    baton_error_t resolve_error;
+    ck_assert_int_eq(resolve_rods_path(conn, &env, &rods_path, rods_root,
+                                       flags, &resolve_error), EXIST_ST);
+
+    // 7 data objects, followed by the collections a, b and c
+    const char *expected[] = { "f1.txt", "f2.txt", "f3.txt",
+                               "lorem_10k.txt", "lorem_1b.txt",
+                               "lorem_1k.txt", "r1.txt", "a", "b", "c" };
+    size_t num_expected = 10;
+    size_t num_pages    = 0;
+    size_t num_entries  = 0;
+    char *cursor = NULL;
+
+    do {
+        baton_error_t error;
+        json_t *results = list_collection_page(conn, &rods_path,
+                                               PRINT_SIZE | PRINT_CONTENTS,
+                                               0, 4, cursor, &error);
+        ck_assert_int_eq(error.code, 0);
+        num_pages++;
+
+        json_t *contents = json_object_get(results, JSON_CONTENTS_KEY);
+        ck_assert(json_array_size(contents) <= 4);
+
+        size_t i;
+        json_t *item;
+        json_array_foreach(contents, i, item) {
+            ck_assert(num_entries < num_expected);
+
+            char path[MAX_PATH_LEN];
+            if (represents_data_object(item)) {
+                ck_assert(json_is_integer(json_object_get(item,
+                                                          JSON_SIZE_KEY)));
+                snprintf(path, MAX_PATH_LEN, "%s",
+                         json_string_value(json_object_get
+                                           (item, JSON_DATA_OBJECT_KEY)));
+            }
+            else {
+                const char *coll = json_string_value
+                    (json_object_get(item, JSON_COLLECTION_KEY));
+                snprintf(path, MAX_PATH_LEN, "%s", strrchr(coll, '/') + 1);
+            }
+
+            ck_assert_str_eq(path, expected[num_entries]);
+            num_entries++;
+        }
+
+        if (cursor) free(cursor);
+        cursor = NULL;
+
+        json_t *next = json_object_get(results, JSON_CURSOR_KEY);
+        if (next) cursor = strdup(json_string_value(next));
+
+        json_decref(results);
+    } while (cursor);
+
+    ck_assert_int_eq(num_pages, 3);
+    ck_assert_int_eq(num_entries, num_expected);
+
+    // An offset skips entries, across data objects and collections
+    baton_error_t error;
+    json_t *results = list_collection_page(conn, &rods_path, PRINT_CONTENTS,
+                                           6, 2, NULL, &error);
+    ck_assert_int_eq(error.code, 0);
+
+    json_t *contents = json_object_get(results, JSON_CONTENTS_KEY);
+    ck_assert_int_eq(json_array_size(contents), 2);
+    ck_assert(represents_data_object(json_array_get(contents, 0)));
+    ck_assert(represents_collection(json_array_get(contents, 1)));
+    ck_assert_ptr_ne(json_object_get(results, JSON_CURSOR_KEY), NULL);
+
+    json_decref(results);
+
+    if (conn) rcDisconnect(conn);
+}
+END_TEST
+
+// Can we build a general query input?
+START_TEST(test_make_query_input) {
+    int max_rows = 10;
+    int num_columns = 1;
+    int columns[] = { COL_COLL_NAME };
+    genQueryInp_t* query_input =
+        make_query_input(max_rows, num_columns, columns);
+
+    ck_assert_ptr_ne(query_input, NULL);
+    ck_assert_ptr_ne(query_input->selectInp.inx, NULL);
+    ck_assert_ptr_ne(query_input->selectInp.value, NULL);
+    ck_assert_int_eq(query_input->selectInp.len, num_columns);
+
+    ck_assert_int_eq(query_input->maxRows, max_rows);
+    ck_assert_int_eq(query_input->continueInx, 0);
+    ck_assert_int_eq(query_input->condInput.len, 0);
+
+    ck_assert_ptr_ne(query_input->sqlCondInp.inx, NULL);
+    ck_assert_ptr_ne(query_input->sqlCondInp.value, NULL);
+    ck_assert_int_eq(query_input->sqlCondInp.len, 0);
+
+    free_query_input(query_input);
+}
+END_TEST
+
+// Can we reuse a prepared general query with new values?
+START_TEST(test_prepared_query) {
+    static const query_shape_t shape =
+        { .format    = { .latest      = 1,
+                         .num_columns = 2,
+                         .columns     = { COL_COLL_NAME, COL_DATA_NAME },
+                         .labels      = { JSON_COLLECTION_KEY,
+                                          JSON_DATA_OBJECT_KEY } },
+          .num_conds = 2,
+          .conds     = { { COL_COLL_NAME, SEARCH_OP_EQUALS, NULL },
+                         { COL_DATA_TOKEN_NAMESPACE, SEARCH_OP_EQUALS,
+                           ACCESS_NAMESPACE } } };
+    baton_error_t error;
+
+    prepared_query_t *query = make_prepared_query(&shape, &error);
+    ck_assert_int_eq(error.code, 0);
+    ck_assert_ptr_eq(prepared_query_shape(query), &shape);
+
+    genQueryInp_t *query_in =
+        bind_prepared_query(query, 10, (const char *[]) { "/a" }, NULL,
+                            &error);
+    ck_assert_int_eq(error.code, 0);
+    ck_assert_int_eq(query_in->maxRows, 10);
+    ck_assert_int_eq(query_in->selectInp.len, 2);
+    ck_assert_int_eq(query_in->selectInp.inx[1], COL_DATA_NAME);
+    ck_assert_int_eq(query_in->condInput.len, 0);
+
+    // The fixed condition and the newest replicate are included
+    ck_assert_int_eq(query_in->sqlCondInp.len, 3);
+    ck_assert_str_eq(query_in->sqlCondInp.value[0], "= '/a'");
+    ck_assert_str_eq(query_in->sqlCondInp.value[1], "= '" ACCESS_NAMESPACE "'");
+    ck_assert_int_eq(query_in->sqlCondInp.inx[2], COL_D_REPL_STATUS);
+
+    // Binding again replaces the value in the same query, from the start
+    query_in->continueInx = 1;
+    genQueryInp_t *rebound =
+        bind_prepared_query(query, 20, (const char *[]) { "/a/much/longer" },
+                            "/zone", &error);
+    ck_assert_int_eq(error.code, 0);
+    ck_assert_ptr_eq(rebound, query_in);
+    ck_assert_int_eq(rebound->maxRows, 20);
+    ck_assert_int_eq(rebound->continueInx, 0);
+    ck_assert_str_eq(rebound->sqlCondInp.value[0], "= '/a/much/longer'");
+    ck_assert_int_eq(rebound->condInput.len, 1);
+    ck_assert_str_eq(rebound->condInput.value[0], "/zone");
+
+    bind_prepared_query(query, 10, (const char *[]) { NULL }, NULL, &error);
+    ck_assert_int_ne(error.code, 0);
+
+    free_prepared_query(query);
+
+    // Each thread keeps one prepared query per shape
+    prepared_query_t *cached = get_prepared_query(&shape, &error);
+    ck_assert_int_eq(error.code, 0);
+    ck_assert_ptr_eq(get_prepared_query(&shape, &error), cached);
+}
+END_TEST
+
+// Do we fail to list the ACL of a non-existent path?
+START_TEST(test_list_permissions_missing_path) {
+    option_flags flags = 0;
+    rodsEnv env;
+    rcComm_t *conn = rods_login(&env);
+
+    char *path = "no such path";
+    rodsPath_t rods_path;
+    baton_error_t resolve_error;
+    resolve_rods_path(conn, &env, &rods_path, path, flags, &resolve_error);
+
+    baton_error_t error;
+    ck_assert_ptr_eq(list_permissions(conn, &rods_path, &error), NULL);
+    ck_assert_int_ne(error.code, 0);
+
+    if (conn) rcDisconnect(conn);
+}
+END_TEST
+
+// Can we list the ACL of an object?
+START_TEST(test_list_permissions_obj) {
+    option_flags flags = 0;
+    rodsEnv env;
+    rcComm_t *conn = rods_login(&env);
+
+    char rods_root[MAX_PATH_LEN];
+    set_current_rods_root(TEST_COLL, rods_root);
+    char obj_path[MAX_PATH_LEN];
+    snprintf(obj_path, MAX_PATH_LEN, "%s/f1.txt", rods_root);
+
+    rodsPath_t rods_path;
+    baton_error_t resolve_error;
+    ck_assert_int_eq(resolve_rods_path(conn, &env, &rods_path, obj_path,
+                                       flags, &resolve_error), EXIST_ST);
+
+    baton_error_t error;
+    json_t *results = list_permissions(conn, &rods_path, &error);
+    json_t *expected = json_pack("[{s:s, s:s, s:s}]",
+                                 JSON_OWNER_KEY, env.rodsUserName,
+                                 JSON_ZONE_KEY,  env.rodsZone,
+                                 JSON_LEVEL_KEY, ACCESS_OWN);
+
+    ck_assert_int_eq(json_equal(results, expected), 1);
+    ck_assert_int_eq(error.code, 0);
+
+    json_decref(results);
+
+    if (conn) rcDisconnect(conn);
+}
+END_TEST
+
+// Can we list the ACL of a collection?
+START_TEST(test_list_permissions_coll) {
+    option_flags flags = 0;
+    rodsEnv env;
+    rcComm_t *conn = rods_login(&env);
+
+    char rods_root[MAX_PATH_LEN];
+    set_current_rods_root(TEST_COLL, rods_root);
+
+    rodsPath_t rods_path;
+    baton_error_t resolve_error;
+    ck_assert_int_eq(resolve_rods_path(conn, &env, &rods_path, rods_root,
+                                       flags, &resolve_error), EXIST_ST);
+
+    baton_error_t error;
+    json_t *results = list_permissions(conn, &rods_path, &error);
+    json_t *expected = json_pack("[{s:s, s:s, s:s}]",
+                                 JSON_OWNER_KEY, env.rodsUserName,
+                                 JSON_ZONE_KEY,  env.rodsZone,
+                                 JSON_LEVEL_KEY, ACCESS_OWN);
+
+    ck_assert_int_eq(json_equal(results, expected), 1);
+    ck_assert_int_eq(error.code, 0);
+
+    json_decref(results);
+
+    if (conn) rcDisconnect(conn);
+}
+END_TEST
+
+// Can we list metadata on a data object?
+START_TEST(test_list_metadata_obj) {
+    option_flags flags = 0;
+    rodsEnv env;
+    rcComm_t *conn = rods_login(&env);
+
+    char *no_path = "no such path";
+    rodsPath_t no_rods_path;
     baton_error_t resolve_no_path_error;
     resolve_rods_path(conn, &env, &no_rods_path, no_path,
                       flags, &resolve_no_path_error);
@@ -985,6 +1878,63 @@ START_TEST(test_list_timestamps_coll) {
 }
 END_TEST
 
+// Can we add metadata to many data objects and collections at once?
+START_TEST(test_add_avus_json_array) {
+    rodsEnv env;
+    rcComm_t *conn = rods_login(&env);
+
+    char rods_root[MAX_PATH_LEN];
+    set_current_rods_root(TEST_COLL, rods_root);
+
+    char coll_path[MAX_PATH_LEN];
+    snprintf(coll_path, MAX_PATH_LEN, "%s/a", rods_root);
+
+    const char *names[] = { "f1.txt", "f2.txt", "f3.txt", "lorem_1b.txt" };
+    int num_names = 4;
+
+    json_t *array = json_array();
+    json_array_append_new(array, json_pack("{s:s}",
+                                           JSON_COLLECTION_KEY, coll_path));
+    for (int i = 0; i < num_names; i++) {
+        json_array_append_new(array,
+                              json_pack("{s:s, s:s}",
+                                        JSON_COLLECTION_KEY,  rods_root,
+                                        JSON_DATA_OBJECT_KEY, names[i]));
+    }
+
+    baton_error_t error;
+    json_t *result = add_avus_json_array(conn, array, &error);
+    ck_assert_int_eq(error.code, 0);
+    ck_assert_ptr_eq(result, array);
+
+    json_t *coll_avus = json_pack("[{s:s, s:s, s:s}]",
+                                  JSON_ATTRIBUTE_KEY, "attr2",
+                                  JSON_VALUE_KEY,     "value2",
+                                  JSON_UNITS_KEY,     "units2");
+    json_t *obj_avus = json_pack("[{s:s, s:s, s:s}]",
+                                 JSON_ATTRIBUTE_KEY, "attr1",
+                                 JSON_VALUE_KEY,     "value1",
+                                 JSON_UNITS_KEY,     "units1");
+    json_t *no_avus = json_array();
+
+    ck_assert(json_equal(json_object_get(json_array_get(array, 0),
+                                         JSON_AVUS_KEY), coll_avus));
+    for (int i = 1; i < num_names; i++) {
+        ck_assert(json_equal(json_object_get(json_array_get(array, i),
+                                             JSON_AVUS_KEY), obj_avus));
+    }
+    ck_assert(json_equal(json_object_get(json_array_get(array, num_names),
+                                         JSON_AVUS_KEY), no_avus));
+
+    json_decref(array);
+    json_decref(coll_avus);
+    json_decref(obj_avus);
+    json_decref(no_avus);
+
+    if (conn) rcDisconnect(conn);
+}
+END_TEST
+
 // Can we search for data objects by their metadata?
 START_TEST(test_search_metadata_obj) {
     option_flags flags = 0;
@@ -1035,6 +1985,142 @@ START_TEST(test_search_metadata_obj) {
 }
 END_TEST
 
+typedef struct stream_results {
+    size_t num_pages;
+    json_t *rows;
+} stream_results_t;
+
+static int collect_stream_results(json_t *results, void *sink_data,
+                                  baton_error_t *error) {
+    stream_results_t *collected = sink_data;
+
+    init_baton_error(error);
+    collected->num_pages++;
+    json_array_extend(collected->rows, results);
+
+    return error->code;
+}
+
+// Can we stream the results of a metadata search, page by page?
+START_TEST(test_search_metadata_stream) {
+    option_flags flags = 0;
+    rodsEnv env;
+    rcComm_t *conn = rods_login(&env);
+
+    char rods_root[MAX_PATH_LEN];
+    set_current_rods_root(TEST_COLL, rods_root);
+
+    rodsPath_t rods_path;
+    baton_error_t resolve_error;
+    ck_assert_int_eq(resolve_rods_path(conn, &env, &rods_path, rods_root,
+                                       flags, &resolve_error), EXIST_ST);
+
+    json_t *avu = json_pack("{s:s, s:s}",
+                            JSON_ATTRIBUTE_KEY, "attr1",
+                            JSON_VALUE_KEY,     "value1");
+    json_t *query = json_pack("{s:s, s:[o]}",
+                              JSON_COLLECTION_KEY, rods_path.outPath,
+                              JSON_AVUS_KEY,       avu);
+    flags = SEARCH_COLLECTIONS | SEARCH_OBJECTS;
+
+    stream_results_t collected = { .num_pages = 0, .rows = json_array() };
+
+    baton_error_t error;
+    search_metadata_stream(conn, query, NULL, flags | PRINT_AVU,
+                           collect_stream_results, &collected, &error);
+    ck_assert_int_eq(error.code, 0);
+
+    // The 12 results span more than one page of SEARCH_MAX_ROWS
+    ck_assert_int_eq(json_array_size(collected.rows), 12);
+    ck_assert(collected.num_pages > 1);
+
+    for (size_t i = 0; i < 12; i++) {
+        json_t *obj = json_array_get(collected.rows, i);
+        ck_assert_ptr_ne(json_object_get(obj, JSON_DATA_OBJECT_KEY), NULL);
+        ck_assert_ptr_ne(json_object_get(obj, JSON_AVUS_KEY), NULL);
+    }
+
+    json_decref(query);
+    json_decref(collected.rows);
+
+    if (conn) rcDisconnect(conn);
+}
+END_TEST
+
+typedef struct arena_usage {
+    json_arena_t *arena;
+    size_t num_pages;
+    size_t num_results;
+    size_t first_used;
+    size_t last_used;
+} arena_usage_t;
+
+static int record_arena_usage(json_t *results, void *sink_data,
+                              baton_error_t *error) {
+    arena_usage_t *usage = sink_data;
+
+    init_baton_error(error);
+    size_t used = json_arena_used(usage->arena);
+    if (usage->num_pages == 0) usage->first_used = used;
+    usage->last_used = used;
+    usage->num_pages++;
+    usage->num_results += json_array_size(results);
+
+    return error->code;
+}
+
+// Does streaming a search keep the memory of the item's arena bounded,
+// however many pages there are?
+// Arenas replace jansson's allocator for the whole process, so this
+// test relies on Check running each test in its own process
+START_TEST(test_search_metadata_stream_arena) {
+    enable_json_arenas();
+
+    option_flags flags = 0;
+    rodsEnv env;
+    rcComm_t *conn = rods_login(&env);
+
+    char rods_root[MAX_PATH_LEN];
+    set_current_rods_root(TEST_COLL, rods_root);
+
+    rodsPath_t rods_path;
+    baton_error_t resolve_error;
+    ck_assert_int_eq(resolve_rods_path(conn, &env, &rods_path, rods_root,
+                                       flags, &resolve_error), EXIST_ST);
+
+    arena_usage_t usage = { .arena = make_json_arena() };
+    json_arena_t *previous = use_json_arena(usage.arena);
+
+    json_t *avu = json_pack("{s:s, s:s}",
+                            JSON_ATTRIBUTE_KEY, "attr1",
+                            JSON_VALUE_KEY,     "value1");
+    json_t *query = json_pack("{s:s, s:[o]}",
+                              JSON_COLLECTION_KEY, rods_path.outPath,
+                              JSON_AVUS_KEY,       avu);
+    flags = SEARCH_COLLECTIONS | SEARCH_OBJECTS;
+
+    // One result per page
+    set_query_page_size(1, 0);
+
+    baton_error_t error;
+    search_metadata_stream(conn, query, NULL, flags | PRINT_AVU,
+                           record_arena_usage, &usage, &error);
+    ck_assert_int_eq(error.code, 0);
+    ck_assert_int_eq(usage.num_results, 12);
+    ck_assert_int_eq(usage.num_pages, usage.num_results);
+
+    // Pages freed as they are streamed do not accumulate in the arena
+    ck_assert_int_eq(usage.last_used, usage.first_used);
+
+    set_query_page_size(0, 0);
+    json_decref(query);
+    use_json_arena(previous);
+    free_json_arena(usage.arena);
+
+    if (conn) rcDisconnect(conn);
+}
+END_TEST
+
 // Can we search for data objects by their metadata, limiting scope by
 // path?
 START_TEST(test_search_metadata_path_obj) {
@@ -1277,7 +2363,140 @@ START_TEST(test_search_metadata_coll) {
 }
 END_TEST
 
-// Can we add an AVU to a data object?
+// Do concurrent collection and data object searches give the same
+// results, in the same order, as separate searches?
+START_TEST(test_search_metadata_concurrent) {
+    option_flags flags = 0;
+    rodsEnv env;
+    rcComm_t *conn = rods_login(&env);
+
+    char rods_root[MAX_PATH_LEN];
+    set_current_rods_root(TEST_COLL, rods_root);
+
+    rodsPath_t rods_path;
+    baton_error_t resolve_error;
+    ck_assert_int_eq(resolve_rods_path(conn, &env, &rods_path, rods_root,
+                                       flags, &resolve_error), EXIST_ST);
+
+    const char *attrs[]  = { "attr1",  "attr2"  };
+    const char *values[] = { "value1", "value2" };
+    flags = PRINT_AVU | PRINT_ACL;
+
+    for (size_t i = 0; i < 2; i++) {
+        json_t *query = json_pack("{s:s, s:[{s:s, s:s}]}",
+                                  JSON_COLLECTION_KEY, rods_path.outPath,
+                                  JSON_AVUS_KEY,
+                                  JSON_ATTRIBUTE_KEY, attrs[i],
+                                  JSON_VALUE_KEY,     values[i]);
+
+        baton_error_t col_error;
+        json_t *expected = search_metadata(conn, query, NULL,
+                                           flags | SEARCH_COLLECTIONS,
+                                           &col_error);
+        ck_assert_int_eq(col_error.code, 0);
+
+        baton_error_t obj_error;
+        json_t *objects = search_metadata(conn, query, NULL,
+                                          flags | SEARCH_OBJECTS,
+                                          &obj_error);
+        ck_assert_int_eq(obj_error.code, 0);
+        ck_assert_int_eq(json_array_extend(expected, objects), 0);
+
+        baton_error_t error;
+        json_t *results =
+            search_metadata(conn, query, NULL,
+                            flags | SEARCH_COLLECTIONS | SEARCH_OBJECTS,
+                            &error);
+        ck_assert_int_eq(error.code, 0);
+        ck_assert_int_eq(json_array_size(results), i == 0 ? 12 : 3);
+        ck_assert(json_equal(results, expected));
+
+        json_decref(query);
+        json_decref(objects);
+        json_decref(expected);
+        json_decref(results);
+    }
+
+    free_spare_connection();
+
+    if (conn) rcDisconnect(conn);
+}
+END_TEST
+
+// Can we search several zones at once, getting the results of each
+// zone in turn and an error naming any zone that failed?
+START_TEST(test_search_metadata_zones) {
+    option_flags flags = 0;
+    rodsEnv env;
+    rcComm_t *conn = rods_login(&env);
+
+    char rods_root[MAX_PATH_LEN];
+    set_current_rods_root(TEST_COLL, rods_root);
+
+    rodsPath_t rods_path;
+    baton_error_t resolve_error;
+    ck_assert_int_eq(resolve_rods_path(conn, &env, &rods_path, rods_root,
+                                       flags, &resolve_error), EXIST_ST);
+
+    json_t *query = json_pack("{s:s, s:[{s:s, s:s}]}",
+                              JSON_COLLECTION_KEY, rods_path.outPath,
+                              JSON_AVUS_KEY,
+                              JSON_ATTRIBUTE_KEY, "attr1",
+                              JSON_VALUE_KEY,     "value1");
+    flags = SEARCH_COLLECTIONS | SEARCH_OBJECTS | PRINT_AVU;
+
+    baton_error_t error1;
+    json_t *expected = search_metadata(conn, query, env.rodsZone, flags,
+                                       &error1);
+    ck_assert_int_eq(error1.code, 0);
+    ck_assert_int_eq(json_array_size(expected), 12);
+
+    // Naming the same zone twice gives its results twice, in order
+    char zone_names[NAME_LEN * 2 + 1];
+    snprintf(zone_names, sizeof zone_names, "%s%s%s", env.rodsZone,
+             ZONE_LIST_SEPARATOR, env.rodsZone);
+
+    baton_error_t error2;
+    json_t *results2 = search_metadata_zones(conn, query, zone_names, flags,
+                                             &error2);
+    ck_assert_int_eq(error2.code, 0);
+    ck_assert_int_eq(json_array_size(results2), 24);
+    for (size_t i = 0; i < 24; i++) {
+        ck_assert(json_equal(json_array_get(results2, i),
+                             json_array_get(expected, i % 12)));
+    }
+
+    // All zones include the local zone
+    baton_error_t error3;
+    json_t *results3 = search_metadata_zones(conn, query, NULL, flags,
+                                             &error3);
+    ck_assert_int_eq(error3.code, 0);
+    ck_assert_int_eq(json_array_size(results3), 12);
+
+    baton_error_t error4;
+    snprintf(zone_names, sizeof zone_names, "%s%s%s", env.rodsZone,
+             ZONE_LIST_SEPARATOR, "no_such_zone");
+    json_t *results4 = search_metadata_zones(conn, query, zone_names, flags,
+                                             &error4);
+    ck_assert_int_ne(error4.code, 0);
+    ck_assert_ptr_ne(strstr(error4.message, "'no_such_zone'"), NULL);
+
+    // The results of the zone searched are kept with the error
+    ck_assert_int_eq(json_array_size(results4), 12);
+
+    json_decref(query);
+    json_decref(expected);
+    json_decref(results2);
+    json_decref(results3);
+    json_decref(results4);
+
+    free_spare_connection();
+
+    if (conn) rcDisconnect(conn);
+}
+END_TEST
+
+// Can we add an AVU to a data object?
 START_TEST(test_add_metadata_obj) {
     option_flags flags = 0;
     rodsEnv env;
@@ -1513,6 +2732,68 @@ START_TEST(test_remove_json_metadata_obj) {
 }
 END_TEST
 
+// Can we supersede AVUs on a data object in one batch?
+START_TEST(test_supersede_json_metadata_obj) {
+    option_flags flags = 0;
+    rodsEnv env;
+    rcComm_t *conn = rods_login(&env);
+
+    char rods_root[MAX_PATH_LEN];
+    set_current_rods_root(TEST_COLL, rods_root);
+    char obj_path[MAX_PATH_LEN];
+    snprintf(obj_path, MAX_PATH_LEN, "%s/f1.txt", rods_root);
+
+    rodsPath_t rods_path;
+    baton_error_t resolve_error;
+    ck_assert_int_eq(resolve_rods_path(conn, &env, &rods_path, obj_path,
+                                       flags, &resolve_error), EXIST_ST);
+
+    baton_error_t list_error;
+    json_t *current = list_metadata(conn, &rods_path, NULL, &list_error);
+    ck_assert_int_eq(list_error.code, 0);
+
+    // Keeps attr1, adds two more
+    json_t *target = json_pack("[{s:s, s:s, s:s}, {s:s, s:s}, {s:s, s:s}]",
+                               JSON_ATTRIBUTE_KEY, "attr1",
+                               JSON_VALUE_KEY,     "value1",
+                               JSON_UNITS_KEY,     "units1",
+                               JSON_ATTRIBUTE_KEY, "attr2",
+                               JSON_VALUE_KEY,     "value2",
+                               JSON_ATTRIBUTE_KEY, "attr3",
+                               JSON_VALUE_KEY,     "value3");
+
+    baton_error_t error;
+    supersede_json_metadata(conn, &rods_path, current, target, &error);
+    ck_assert_int_eq(error.code, 0);
+
+    json_t *results = list_metadata(conn, &rods_path, NULL, &list_error);
+    ck_assert_int_eq(list_error.code, 0);
+    ck_assert_int_eq(json_array_size(results), 3);
+    for (size_t i = 0; i < json_array_size(target); i++) {
+        ck_assert(contains_avu(results, json_array_get(target, i)));
+    }
+
+    // Replaces all of them with one
+    json_t *single = json_pack("[{s:s, s:s}]",
+                               JSON_ATTRIBUTE_KEY, "attr4",
+                               JSON_VALUE_KEY,     "value4");
+    supersede_json_metadata(conn, &rods_path, results, single, &error);
+    ck_assert_int_eq(error.code, 0);
+
+    json_t *final = list_metadata(conn, &rods_path, NULL, &list_error);
+    ck_assert_int_eq(list_error.code, 0);
+    ck_assert_int_eq(json_equal(final, single), 1);
+
+    json_decref(current);
+    json_decref(target);
+    json_decref(results);
+    json_decref(single);
+    json_decref(final);
+
+    if (conn) rcDisconnect(conn);
+}
+END_TEST
+
 // Can we change permissions on a data object?
 START_TEST(test_modify_permissions_obj) {
     option_flags flags = 0;
@@ -1657,7 +2938,270 @@ START_TEST(test_modify_json_permissions_obj) {
 }
 END_TEST
 
+// Can we apply permissions in bulk, skipping those that already match?
+START_TEST(test_apply_permissions) {
+    option_flags flags = RECURSIVE;
+    rodsEnv env;
+    rcComm_t *conn = rods_login(&env);
+
+    char rods_root[MAX_PATH_LEN];
+    set_current_rods_root(TEST_COLL, rods_root);
+    char obj_path[MAX_PATH_LEN];
+    snprintf(obj_path, MAX_PATH_LEN, "%s/a/x/m/f10.txt", rods_root);
+
+    // The last level given for an owner is the one applied
+    json_t *targets =
+        json_pack("[{s:s, s:[{s:s, s:s}, {s:s, s:s, s:s}]}]",
+                  JSON_COLLECTION_KEY, rods_root,
+                  JSON_ACCESS_KEY,
+                  JSON_OWNER_KEY, "public", JSON_LEVEL_KEY, ACCESS_LEVEL_NULL,
+                  JSON_OWNER_KEY, "public", JSON_ZONE_KEY, env.rodsZone,
+                  JSON_LEVEL_KEY, ACCESS_LEVEL_READ);
+
+    baton_error_t error;
+    json_t *report = apply_permissions(&env, conn, targets, flags, 2, &error);
+    ck_assert_int_eq(error.code, 0);
+    ck_assert(json_is_object(report));
+
+    json_int_t changed = json_integer_value
+        (json_object_get(report, JSON_CHMOD_CHANGED_KEY));
+    json_int_t unchanged = json_integer_value
+        (json_object_get(report, JSON_CHMOD_UNCHANGED_KEY));
+    ck_assert_int_gt(changed, 0);
+    ck_assert_int_eq(json_array_size(json_object_get(report,
+                                                     JSON_CHMOD_FAILED_KEY)),
+                     0);
+
+    rodsPath_t rods_path;
+    baton_error_t resolve_error;
+    ck_assert_int_eq(resolve_rods_path(conn, &env, &rods_path, obj_path,
+                                       0, &resolve_error), EXIST_ST);
+
+    json_t *expected = json_pack("{s:s, s:s, s:s}",
+                                 JSON_OWNER_KEY, "public",
+                                 JSON_ZONE_KEY,  env.rodsZone,
+                                 JSON_LEVEL_KEY, ACCESS_LEVEL_READ);
+
+    baton_error_t list_error;
+    json_t *acl = list_permissions(conn, &rods_path, &list_error);
+    ck_assert_int_eq(list_error.code, 0);
+
+    int found = 0;
+    for (size_t i = 0; i < json_array_size(acl); i++) {
+        if (json_equal(expected, json_array_get(acl, i))) found = 1;
+    }
+    ck_assert_int_eq(found, 1);
+
+    // Applied again, every permission already matches
+    baton_error_t again_error;
+    json_t *again = apply_permissions(&env, conn, targets, flags, 2,
+                                      &again_error);
+    ck_assert_int_eq(again_error.code, 0);
+    ck_assert_int_eq(json_integer_value
+                     (json_object_get(again, JSON_CHMOD_CHANGED_KEY)), 0);
+    ck_assert_int_eq(json_integer_value
+                     (json_object_get(again, JSON_CHMOD_UNCHANGED_KEY)),
+                     changed + unchanged);
+
+    // An invalid level is refused before any change is made
+    json_t *bad_targets =
+        json_pack("[{s:s, s:[{s:s, s:s}]}]",
+                  JSON_COLLECTION_KEY, rods_root,
+                  JSON_ACCESS_KEY,
+                  JSON_OWNER_KEY, "public", JSON_LEVEL_KEY, "invalid");
+    baton_error_t bad_error;
+    json_t *bad = apply_permissions(&env, conn, bad_targets, flags, 2,
+                                    &bad_error);
+    ck_assert_int_ne(bad_error.code, 0);
+    ck_assert_ptr_eq(bad, NULL);
+
+    json_decref(targets);
+    json_decref(bad_targets);
+    json_decref(report);
+    json_decref(again);
+    json_decref(expected);
+    json_decref(acl);
+    if (rods_path.rodsObjStat) free(rods_path.rodsObjStat);
+
+    if (conn) rcDisconnect(conn);
+}
+END_TEST
+
+// Does applying permissions recursively leave alone the siblings whose
+// names match the root's where it has a LIKE wildcard?
+START_TEST(test_apply_permissions_siblings) {
+    option_flags flags = RECURSIVE;
+    rodsEnv env;
+    rcComm_t *conn = rods_login(&env);
+
+    char rods_root[MAX_PATH_LEN];
+    set_current_rods_root(TEST_COLL, rods_root);
+
+    char command[MAX_COMMAND_LEN];
+    snprintf(command, MAX_COMMAND_LEN, "imkdir -p %s/p_q/in %s/pXq/out",
+             rods_root, rods_root);
+    ck_assert_int_eq(system(command), 0);
+
+    char coll_path[MAX_PATH_LEN];
+    char sibling_path[MAX_PATH_LEN];
+    snprintf(coll_path,    MAX_PATH_LEN, "%s/p_q", rods_root);
+    snprintf(sibling_path, MAX_PATH_LEN, "%s/pXq/out", rods_root);
+
+    json_t *targets =
+        json_pack("[{s:s, s:[{s:s, s:s}]}]",
+                  JSON_COLLECTION_KEY, coll_path,
+                  JSON_ACCESS_KEY,
+                  JSON_OWNER_KEY, "public", JSON_LEVEL_KEY, ACCESS_LEVEL_READ);
+
+    baton_error_t error;
+    json_t *report = apply_permissions(&env, conn, targets, flags, 2, &error);
+    ck_assert_int_eq(error.code, 0);
+
+    // The root and the one collection in it
+    ck_assert_int_eq(json_integer_value
+                     (json_object_get(report, JSON_CHMOD_CHANGED_KEY)), 2);
+
+    rodsPath_t rods_path;
+    baton_error_t resolve_error;
+    ck_assert_int_eq(resolve_rods_path(conn, &env, &rods_path, sibling_path,
+                                       0, &resolve_error), EXIST_ST);
+
+    baton_error_t list_error;
+    json_t *acl = list_permissions(conn, &rods_path, &list_error);
+    ck_assert_int_eq(list_error.code, 0);
+
+    for (size_t i = 0; i < json_array_size(acl); i++) {
+        const char *owner = json_string_value
+            (json_object_get(json_array_get(acl, i), JSON_OWNER_KEY));
+        ck_assert_str_ne(owner, "public");
+    }
+
+    json_decref(targets);
+    json_decref(report);
+    json_decref(acl);
+    if (rods_path.rodsObjStat) free(rods_path.rodsObjStat);
+
+    if (conn) rcDisconnect(conn);
+}
+END_TEST
+
 // Can we convert JSON representation to a useful path string?
+START_TEST(test_json_output) {
+    FILE *tmp = tmpfile();
+    ck_assert_ptr_ne(tmp, NULL);
+
+    fflush(stdout);
+    int saved_fd = dup(fileno(stdout));
+    ck_assert_int_ne(dup2(fileno(tmp), fileno(stdout)), -1);
+
+    set_json_output_flush_policy(2, 0);
+
+    json_t *obj1 = json_pack("{s:s}", "collection", "a");
+    json_t *obj2 = json_pack("{s:s}", "collection", "b");
+
+    // Output is held until the policy requires a flush
+    print_json(obj1);
+    maybe_flush_json_output(1);
+    ck_assert_int_eq(lseek(fileno(tmp), 0, SEEK_END), 0);
+
+    print_json(obj2);
+    maybe_flush_json_output(1);
+
+    const char *expected = "{\"collection\": \"a\"}\n"
+                           "{\"collection\": \"b\"}\n";
+    char buffer[64] = { 0 };
+    ck_assert_int_eq(pread(fileno(tmp), buffer, sizeof buffer - 1, 0),
+                     strlen(expected));
+    ck_assert_str_eq(buffer, expected);
+
+    // An explicit flush writes any remainder
+    print_json(obj1);
+    flush_json_output();
+    ck_assert_int_eq(lseek(fileno(tmp), 0, SEEK_END),
+                     strlen(expected) + strlen(expected) / 2);
+
+    set_json_output_flush_policy(JSON_OUTPUT_FLUSH_ITEMS,
+                                 JSON_OUTPUT_FLUSH_MSECS);
+
+    dup2(saved_fd, fileno(stdout));
+    close(saved_fd);
+    fclose(tmp);
+
+    json_decref(obj1);
+    json_decref(obj2);
+}
+END_TEST
+
+START_TEST(test_json_reader) {
+    const char *input = "{\"collection\": \"a}\\\"\"}\n"
+                        "[1, 2]{\"b\":\n"
+                        "  {\"c\": 1}}\n"
+                        "{\"d\": 1, \"d\": 2}\n"
+                        "{\"e\": 1}\n\n";
+
+    FILE *tmp = tmpfile();
+    ck_assert_ptr_ne(tmp, NULL);
+    fputs(input, tmp);
+    rewind(tmp);
+
+    int fds[2];
+    ck_assert_int_eq(pipe(fds), 0);
+    ck_assert_int_eq(write(fds[1], input, strlen(input)), strlen(input));
+    close(fds[1]);
+    FILE *pipe_in = fdopen(fds[0], "r");
+
+    // A regular file is mapped, a pipe is read in blocks
+    FILE *inputs[2] = { tmp, pipe_in };
+
+    for (int i = 0; i < 2; i++) {
+        baton_error_t error;
+        json_reader_t *reader = make_json_reader(inputs[i], &error);
+        ck_assert_int_eq(error.code, 0);
+        ck_assert(!json_reader_eof(reader));
+
+        json_t *item = read_json_item(reader, &error);
+        ck_assert_int_eq(error.code, 0);
+        ck_assert_str_eq(json_string_value(json_object_get(item,
+                                                           "collection")),
+                         "a}\"");
+        json_decref(item);
+
+        item = read_json_item(reader, &error);
+        ck_assert_int_eq(error.code, 0);
+        ck_assert_int_eq(json_array_size(item), 2);
+        json_decref(item);
+
+        item = read_json_item(reader, &error);
+        ck_assert_int_eq(error.code, 0);
+        ck_assert(json_is_object(json_object_get(item, "b")));
+        json_decref(item);
+
+        // Duplicate keys are rejected, then reading continues
+        item = read_json_item(reader, &error);
+        ck_assert_ptr_eq(item, NULL);
+        ck_assert_int_ne(error.code, 0);
+
+        ck_assert(json_reader_ready(reader));
+        item = read_json_item(reader, &error);
+        ck_assert_int_eq(error.code, 0);
+        ck_assert_ptr_ne(json_object_get(item, "e"), NULL);
+        json_decref(item);
+
+        ck_assert(json_reader_eof(reader));
+        ck_assert_ptr_eq(read_json_item(reader, &error), NULL);
+        ck_assert_int_eq(error.code, 0);
+
+        free_json_reader(reader);
+    }
+
+    // The stream is left after the last value read
+    ck_assert_int_eq(ftell(tmp), strlen(input));
+
+    fclose(tmp);
+    fclose(pipe_in);
+}
+END_TEST
+
 START_TEST(test_json_to_path) {
     const char *coll_path = "/a/b/c";
     json_t *coll1 = json_pack("{s:s}", JSON_COLLECTION_KEY, coll_path);
@@ -1766,6 +3310,55 @@ START_TEST(test_contains_avu) {
 }
 END_TEST
 
+// Can we diff AVU arrays by attribute, value and units?
+START_TEST(test_avu_difference) {
+    json_t *current = json_pack("[{s:s, s:s, s:s}, {s:s, s:s}, {s:s, s:s}]",
+                                JSON_ATTRIBUTE_KEY, "foo",
+                                JSON_VALUE_KEY,     "bar",
+                                JSON_UNITS_KEY,     "baz",
+                                JSON_ATTRIBUTE_KEY, "qux",
+                                JSON_VALUE_KEY,     "quux",
+                                JSON_ATTRIBUTE_KEY, "corge",
+                                JSON_VALUE_KEY,     "grault");
+
+    // Short keys and empty units match, repeats are removed
+    json_t *target = json_pack("[{s:s, s:s, s:s}, {s:s, s:s, s:s}, "
+                               "{s:s, s:s}, {s:s, s:s}]",
+                               JSON_ATTRIBUTE_SHORT_KEY, "foo",
+                               JSON_VALUE_SHORT_KEY,     "bar",
+                               JSON_UNITS_SHORT_KEY,     "baz",
+                               JSON_ATTRIBUTE_KEY,       "qux",
+                               JSON_VALUE_KEY,           "quux",
+                               JSON_UNITS_KEY,           "",
+                               JSON_ATTRIBUTE_KEY,       "garply",
+                               JSON_VALUE_KEY,           "waldo",
+                               JSON_ATTRIBUTE_KEY,       "garply",
+                               JSON_VALUE_KEY,           "waldo");
+
+    baton_error_t error;
+    json_t *rem = avu_difference(current, target, &error);
+    ck_assert_int_eq(error.code, 0);
+    ck_assert_int_eq(json_array_size(rem), 1);
+    ck_assert(json_equal(json_array_get(rem, 0), json_array_get(current, 2)));
+
+    json_t *add = avu_difference(target, current, &error);
+    ck_assert_int_eq(error.code, 0);
+    ck_assert_int_eq(json_array_size(add), 1);
+    ck_assert(json_equal(json_array_get(add, 0), json_array_get(target, 2)));
+
+    avu_set_t *set = make_avu_set(current, &error);
+    ck_assert_int_eq(error.code, 0);
+    ck_assert(avu_set_contains(set, json_array_get(target, 0)));
+    ck_assert(!avu_set_contains(set, json_array_get(target, 2)));
+    free_avu_set(set);
+
+    json_decref(current);
+    json_decref(target);
+    json_decref(rem);
+    json_decref(add);
+}
+END_TEST
+
 // Can we test for JSON representation of a collection?
 START_TEST(test_represents_collection) {
     json_t *col = json_pack("{s:s}", JSON_COLLECTION_KEY, "foo");
@@ -1901,6 +3494,84 @@ START_TEST(test_slurp_data_obj) {
         if (data) free(data);
     }
 
+    // The data object size is used to allocate the content at once
+    baton_error_t open_error;
+    data_obj_file_t *obj = open_data_obj(conn, &rods_obj_path,
+                                         O_RDONLY, &open_error);
+    ck_assert_int_eq(open_error.code, 0);
+    ck_assert_int_eq(obj->size, 10240);
+
+    size_t len;
+    int is_utf8;
+    baton_error_t slurp_error;
+    char *data = slurp_data_obj_utf8(conn, obj, 1024, &len, &is_utf8,
+                                     &slurp_error);
+    ck_assert_int_eq(slurp_error.code, 0);
+    ck_assert_int_eq(len, 10240);
+    ck_assert(is_utf8);
+    ck_assert_str_eq(obj->md5_last_read,
+                     "4efe0c1befd6f6ac4621cbdb13241246");
+
+    ck_assert_int_eq(close_data_obj(conn, obj), 0);
+    free_data_obj(obj);
+
+    if (data) free(data);
+    if (conn) rcDisconnect(conn);
+}
+END_TEST
+
+// Do we validate checksums according to the validation policy?
+START_TEST(test_checksum_validation) {
+    option_flags flags = 0;
+    rodsEnv env;
+    rcComm_t *conn = rods_login(&env);
+
+    checksum_validation policy;
+    ck_assert_int_eq(parse_checksum_validation("catalog", &policy), 0);
+    ck_assert_int_eq(policy, VALIDATE_CATALOG);
+    ck_assert_int_ne(parse_checksum_validation("sometimes", &policy), 0);
+
+    char rods_root[MAX_PATH_LEN];
+    set_current_rods_root(TEST_COLL, rods_root);
+
+    char obj_path[MAX_PATH_LEN];
+    snprintf(obj_path, MAX_PATH_LEN, "%s/lorem_10k.txt", rods_root);
+
+    rodsPath_t rods_obj_path;
+    baton_error_t resolve_error;
+    ck_assert_int_eq(resolve_rods_path(conn, &env, &rods_obj_path, obj_path,
+                                       flags, &resolve_error), EXIST_ST);
+
+    baton_error_t open_error;
+    data_obj_file_t *obj = open_data_obj(conn, &rods_obj_path,
+                                         O_RDONLY, &open_error);
+    ck_assert_int_eq(open_error.code, 0);
+
+    baton_error_t slurp_error;
+    char *data = slurp_data_obj(conn, obj, 1024, &slurp_error);
+    ck_assert_int_eq(slurp_error.code, 0);
+
+    // A known catalog checksum is compared locally
+    snprintf(obj->md5_catalog, 33, "%s", "4efe0c1befd6f6ac4621cbdb13241246");
+    ck_assert_int_eq(validate_md5_last_read(conn, obj), 1);
+
+    snprintf(obj->md5_catalog, 33, "%s", "00000000000000000000000000000000");
+    ck_assert_int_eq(validate_md5_last_read(conn, obj), 0);
+
+    set_checksum_validation(VALIDATE_NEVER);
+    ck_assert_int_eq(validate_md5_last_read(conn, obj), 1);
+
+    // Without a catalog checksum, the catalog policy skips validation
+    set_checksum_validation(VALIDATE_CATALOG);
+    obj->md5_catalog[0] = '\0';
+    ck_assert_int_eq(validate_md5_last_read(conn, obj), 1);
+
+    set_checksum_validation(VALIDATE_ALWAYS);
+
+    ck_assert_int_eq(close_data_obj(conn, obj), 0);
+    free_data_obj(obj);
+
+    if (data) free(data);
     if (conn) rcDisconnect(conn);
 }
 END_TEST
@@ -2049,6 +3720,422 @@ START_TEST(test_write_data_obj) {
 }
 END_TEST
 
+// Can we write and get data objects in parallel byte ranges?
+START_TEST(test_parallel_transfer) {
+    option_flags flags = 0;
+    rodsEnv env;
+    rcComm_t *conn = rods_login(&env);
+
+    char file_path[MAX_PATH_LEN];
+    snprintf(file_path, MAX_PATH_LEN, "%s/%s/lorem_10k.txt",
+             TEST_ROOT, TEST_DATA_PATH);
+
+    char rods_root[MAX_PATH_LEN];
+    set_current_rods_root(TEST_COLL, rods_root);
+
+    char obj_path[MAX_PATH_LEN];
+    snprintf(obj_path, MAX_PATH_LEN, "%s/test_parallel_transfer.txt",
+             rods_root);
+
+    // Four ranges of up to 3072 bytes
+    set_parallel_transfer(4, 1024);
+    ck_assert_int_eq(get_parallel_streams(), 4);
+    ck_assert(use_parallel_transfer(10240));
+    ck_assert(!use_parallel_transfer(1023));
+
+    rodsPath_t rods_obj_path;
+    baton_error_t resolve_error;
+    resolve_rods_path(conn, &env, &rods_obj_path, obj_path,
+                      flags, &resolve_error);
+
+    size_t buffer_size = 1024;
+    baton_error_t write_error;
+    FILE *in = fopen(file_path, "r");
+    size_t num_written = write_data_obj(conn, in, &rods_obj_path,
+                                        buffer_size, &write_error);
+    ck_assert_int_eq(write_error.code, 0);
+    ck_assert_int_eq(num_written, 10240);
+    ck_assert_int_eq(fclose(in), 0);
+
+    rodsPath_t result_obj_path;
+    baton_error_t result_error;
+    resolve_rods_path(conn, &env, &result_obj_path, obj_path,
+                      flags, &result_error);
+    ck_assert_int_eq(result_error.code, 0);
+
+    baton_error_t list_error;
+    json_t *result = list_path(conn, &result_obj_path, PRINT_CHECKSUM,
+                               &list_error);
+    ck_assert_int_eq(list_error.code, 0);
+    json_t *checksum = json_object_get(result, JSON_CHECKSUM_KEY);
+    ck_assert(json_is_string(checksum));
+    ck_assert_str_eq(json_string_value(checksum),
+                     "4efe0c1befd6f6ac4621cbdb13241246");
+    json_decref(result);
+
+    char template[] = "baton_test_parallel_transfer.XXXXXX";
+    int fd = mkstemp(template);
+
+    baton_error_t get_error;
+    int get_status = get_data_obj_file(conn, &result_obj_path, template,
+                                       buffer_size, &get_error);
+    ck_assert_int_eq(get_error.code, 0);
+    ck_assert_int_eq(get_status, 0);
+    close(fd);
+
+    FILE *tmp = fopen(template, "r");
+    confirm_checksum(tmp, "4efe0c1befd6f6ac4621cbdb13241246");
+    fclose(tmp);
+    unlink(template);
+
+    set_parallel_transfer(1, 0);
+    ck_assert(!use_parallel_transfer(10240));
+
+    if (conn) rcDisconnect(conn);
+}
+END_TEST
+
+START_TEST(test_put_get_tree) {
+    option_flags flags = 0;
+    rodsEnv env;
+    rcComm_t *conn = rods_login(&env);
+
+    char dir_path[MAX_PATH_LEN];
+    snprintf(dir_path, MAX_PATH_LEN, "%s/%s/a", TEST_ROOT, TEST_DATA_PATH);
+
+    char rods_root[MAX_PATH_LEN];
+    set_current_rods_root(TEST_COLL, rods_root);
+
+    char coll_path[MAX_PATH_LEN];
+    snprintf(coll_path, MAX_PATH_LEN, "%s/test_put_get_tree", rods_root);
+
+    // 13 files, including the .gitignore files keeping the empty
+    // directories, into 5 leaf collections
+    baton_error_t put_error;
+    json_t *put_report = put_tree(conn, dir_path, coll_path,
+                                  CALCULATE_CHECKSUM, 4, &put_error);
+    ck_assert_int_eq(put_error.code, 0);
+    ck_assert_int_eq(json_integer_value
+                     (json_object_get(put_report, JSON_TREE_FILES_KEY)), 13);
+    ck_assert_int_eq(json_integer_value
+                     (json_object_get(put_report,
+                                      JSON_TREE_COLLECTIONS_KEY)), 5);
+    ck_assert_int_eq(json_array_size
+                     (json_object_get(put_report, JSON_TREE_FAILED_KEY)), 0);
+    json_decref(put_report);
+
+    // Putting again overwrites the data objects in the existing tree
+    put_report = put_tree(conn, dir_path, coll_path, CALCULATE_CHECKSUM, 2,
+                          &put_error);
+    ck_assert_int_eq(put_error.code, 0);
+    json_decref(put_report);
+
+    rodsPath_t rods_path;
+    baton_error_t resolve_error;
+    resolve_rods_path(conn, &env, &rods_path, coll_path, flags,
+                      &resolve_error);
+    ck_assert_int_eq(resolve_error.code, 0);
+
+    char template[] = "baton_test_put_get_tree.XXXXXX";
+    char *local_dir = mkdtemp(template);
+    ck_assert_ptr_ne(local_dir, NULL);
+
+    char get_dir[MAX_PATH_LEN];
+    snprintf(get_dir, MAX_PATH_LEN, "%s/a", local_dir);
+
+    // Collections x, x/m, x/n, x/o, y and z are made as directories
+    baton_error_t get_error;
+    json_t *get_report = get_tree(conn, &rods_path, get_dir, 0, 1024, 4,
+                                  &get_error);
+    ck_assert_int_eq(get_error.code, 0);
+    ck_assert_int_eq(json_integer_value
+                     (json_object_get(get_report, JSON_TREE_FILES_KEY)), 13);
+    ck_assert_int_eq(json_integer_value
+                     (json_object_get(get_report,
+                                      JSON_TREE_COLLECTIONS_KEY)), 6);
+    ck_assert_int_eq(json_array_size
+                     (json_object_get(get_report, JSON_TREE_FAILED_KEY)), 0);
+    json_decref(get_report);
+
+    char file_path[MAX_PATH_LEN];
+    snprintf(file_path, MAX_PATH_LEN, "%s/x/m/f12.txt", get_dir);
+    ck_assert_int_eq(access(file_path, F_OK), 0);
+    snprintf(file_path, MAX_PATH_LEN, "%s/z/.gitignore", get_dir);
+    ck_assert_int_eq(access(file_path, F_OK), 0);
+
+    // In sync mode, the unchanged files are skipped in both directions
+    get_report = get_tree(conn, &rods_path, get_dir, SYNC, 1024, 4,
+                          &get_error);
+    ck_assert_int_eq(get_error.code, 0);
+    ck_assert_int_eq(json_integer_value
+                     (json_object_get(get_report, JSON_TREE_FILES_KEY)), 0);
+    ck_assert_int_eq(json_integer_value
+                     (json_object_get(get_report, JSON_TREE_SKIPPED_KEY)), 13);
+    json_decref(get_report);
+
+    put_report = put_tree(conn, get_dir, coll_path, SYNC, 4, &put_error);
+    ck_assert_int_eq(put_error.code, 0);
+    ck_assert_int_eq(json_integer_value
+                     (json_object_get(put_report, JSON_TREE_FILES_KEY)), 0);
+    ck_assert_int_eq(json_integer_value
+                     (json_object_get(put_report, JSON_TREE_SKIPPED_KEY)), 13);
+    json_decref(put_report);
+
+    char command[MAX_COMMAND_LEN];
+    snprintf(command, MAX_COMMAND_LEN, "rm -r %s", local_dir);
+    ck_assert_int_eq(system(command), 0);
+
+    if (rods_path.rodsObjStat) free(rods_path.rodsObjStat);
+    if (conn) rcDisconnect(conn);
+}
+END_TEST
+
+START_TEST(test_local_file_unchanged) {
+    char file_path[MAX_PATH_LEN];
+    snprintf(file_path, MAX_PATH_LEN, "%s/%s/lorem_10k.txt",
+             TEST_ROOT, TEST_DATA_PATH);
+
+    char md5[MD5_HEX_LEN + 1];
+    baton_error_t md5_error;
+    local_file_md5(file_path, md5, &md5_error);
+    ck_assert_int_eq(md5_error.code, 0);
+    ck_assert_str_eq(md5, "4efe0c1befd6f6ac4621cbdb13241246");
+
+    baton_error_t error;
+    ck_assert(local_file_unchanged(file_path, 10240,
+                                   "4EFE0C1BEFD6F6AC4621CBDB13241246",
+                                   &error));
+    ck_assert_int_eq(error.code, 0);
+
+    // A different size, a different MD5, a checksum that is not an MD5
+    // and a missing file all differ
+    ck_assert(!local_file_unchanged(file_path, 10241,
+                                    "4efe0c1befd6f6ac4621cbdb13241246",
+                                    &error));
+    ck_assert(!local_file_unchanged(file_path, 10240,
+                                    "00000000000000000000000000000000",
+                                    &error));
+    ck_assert(!local_file_unchanged(file_path, 10240,
+                                    "sha2:TvOQvsUaoUsXGmu555bhwUW8Cmk=",
+                                    &error));
+    ck_assert(!local_file_unchanged("no_such_file.txt", 10240,
+                                    "4efe0c1befd6f6ac4621cbdb13241246",
+                                    &error));
+
+    // The index supplies the MD5 of an unmodified file and is kept
+    // between runs in its file
+    char template[] = "baton_test_sync_index.XXXXXX";
+    int fd = mkstemp(template);
+    close(fd);
+    unlink(template);
+
+    ck_assert_int_eq(set_sync_index_file(template), 0);
+    local_file_md5(file_path, md5, &md5_error);
+    ck_assert_int_eq(md5_error.code, 0);
+    ck_assert_int_eq(save_sync_index(), 0);
+    ck_assert_int_eq(access(template, F_OK), 0);
+
+    ck_assert_int_eq(set_sync_index_file(template), 0);
+    local_file_md5(file_path, md5, &md5_error);
+    ck_assert_int_eq(md5_error.code, 0);
+    ck_assert_str_eq(md5, "4efe0c1befd6f6ac4621cbdb13241246");
+
+    ck_assert_int_eq(set_sync_index_file(NULL), 0);
+    unlink(template);
+}
+END_TEST
+
+// Are transfers resumed only after connection failures?
+START_TEST(test_transfer_retries) {
+    option_flags flags = 0;
+    rodsEnv env;
+    rcComm_t *conn = rods_login(&env);
+
+    ck_assert(is_connection_error(SYS_HEADER_READ_LEN_ERR));
+    ck_assert(is_connection_error(SYS_SOCK_READ_TIMEDOUT - 104));
+    ck_assert(!is_connection_error(CAT_NO_ROWS_FOUND));
+    ck_assert(!is_connection_error(0));
+
+    set_transfer_retries(RESUME_MAX_RETRIES + 1, 0);
+    ck_assert_int_eq(get_transfer_retries(), RESUME_MAX_RETRIES);
+    set_transfer_retries(2, 1);
+    ck_assert_int_eq(get_transfer_retries(), 2);
+
+    char rods_root[MAX_PATH_LEN];
+    set_current_rods_root(TEST_COLL, rods_root);
+
+    char obj_path[MAX_PATH_LEN];
+    snprintf(obj_path, MAX_PATH_LEN, "%s/lorem_10k.txt", rods_root);
+
+    rodsPath_t rods_obj_path;
+    baton_error_t resolve_error;
+    resolve_rods_path(conn, &env, &rods_obj_path, obj_path,
+                      flags, &resolve_error);
+    ck_assert_int_eq(resolve_error.code, 0);
+
+    baton_error_t open_error;
+    data_obj_file_t *obj = open_data_obj(conn, &rods_obj_path, O_RDONLY,
+                                         &open_error);
+    ck_assert_int_eq(open_error.code, 0);
+
+    // Other errors are never resumed and an uninterrupted transfer
+    // is made on the original connection
+    ck_assert(!resume_data_obj(obj, CAT_NO_ROWS_FOUND));
+    ck_assert_int_eq(obj->num_resumes, 0);
+
+    char buffer[1024];
+    size_t total = 0;
+    size_t nr;
+    while ((nr = read_chunk(conn, obj, buffer, sizeof buffer,
+                            &open_error)) > 0) {
+        total += nr;
+    }
+    ck_assert_int_eq(open_error.code, 0);
+    ck_assert_int_eq(total, 10240);
+    ck_assert_int_eq(obj->position, 10240);
+    ck_assert(data_obj_connection(conn, obj) == conn);
+
+    ck_assert_int_eq(close_data_obj(conn, obj), 0);
+    free_data_obj(obj);
+
+    // Nothing replaced the connection of an uninterrupted transfer
+    ck_assert(replace_connection(conn) == conn);
+
+    // A connection made to resume a transfer is handed over to the
+    // owner of the failed one, which is disconnected
+    rodsEnv resume_env;
+    rcComm_t *failed = rods_login(&resume_env);
+    rcComm_t *resumed = rods_login(&resume_env);
+    ck_assert_ptr_ne(failed, NULL);
+    ck_assert_ptr_ne(resumed, NULL);
+
+    hand_over_connection(failed, resumed);
+    ck_assert(live_connection(failed) == resumed);
+    ck_assert(replace_connection(failed) == resumed);
+    ck_assert(replace_connection(resumed) == resumed);
+    rcDisconnect(resumed);
+
+    set_transfer_retries(0, 0);
+    ck_assert_int_eq(get_transfer_retries(), 0);
+
+    if (conn) rcDisconnect(conn);
+}
+END_TEST
+
+// Can we choose the replicate from which to read?
+START_TEST(test_rank_replicates) {
+    option_flags flags = 0;
+    rodsEnv env;
+    rcComm_t *conn = rods_login(&env);
+
+    json_t *replicates =
+        json_pack("[{s:s, s:s, s:i, s:b}, {s:s, s:s, s:i, s:b},"
+                  " {s:s, s:s, s:i, s:b}, {s:s, s:s, s:i, s:b}]",
+                  JSON_RESOURCE_KEY,         "fast",
+                  JSON_LOCATION_KEY,         "host1",
+                  JSON_REPLICATE_NUMBER_KEY, 0,
+                  JSON_REPLICATE_STATUS_KEY, 1,
+                  JSON_RESOURCE_KEY,         "slow",
+                  JSON_LOCATION_KEY,         "host2",
+                  JSON_REPLICATE_NUMBER_KEY, 1,
+                  JSON_REPLICATE_STATUS_KEY, 1,
+                  JSON_RESOURCE_KEY,         "stale",
+                  JSON_LOCATION_KEY,         "host3",
+                  JSON_REPLICATE_NUMBER_KEY, 2,
+                  JSON_REPLICATE_STATUS_KEY, 0,
+                  JSON_RESOURCE_KEY,         "new",
+                  JSON_LOCATION_KEY,         "host4",
+                  JSON_REPLICATE_NUMBER_KEY, 3,
+                  JSON_REPLICATE_STATUS_KEY, 1);
+    ck_assert_ptr_ne(replicates, NULL);
+
+    clear_replica_throughput();
+    record_replica_throughput("fast", 1000, 1);
+    record_replica_throughput("slow", 10, 1);
+    ck_assert(get_replica_throughput("fast") > 999);
+    ck_assert(get_replica_throughput("new") < 0);
+
+    // Invalid replicates are never chosen and unmeasured resources
+    // are tried before the fastest
+    baton_error_t error;
+    set_replica_selection(1, NULL);
+    json_t *ranked = rank_replicates(replicates, &error);
+    ck_assert_int_eq(error.code, 0);
+    ck_assert_int_eq(json_array_size(ranked), 3);
+    ck_assert_str_eq(json_string_value
+                     (json_object_get(json_array_get(ranked, 0),
+                                      JSON_RESOURCE_KEY)), "new");
+    ck_assert_str_eq(json_string_value
+                     (json_object_get(json_array_get(ranked, 1),
+                                      JSON_RESOURCE_KEY)), "fast");
+    ck_assert_str_eq(json_string_value
+                     (json_object_get(json_array_get(ranked, 2),
+                                      JSON_RESOURCE_KEY)), "slow");
+    json_decref(ranked);
+
+    // Preferences, by resource or location, come before throughput
+    ck_assert_int_eq(set_replica_selection(1, "host2,new"), 0);
+    ranked = rank_replicates(replicates, &error);
+    ck_assert_int_eq(error.code, 0);
+    ck_assert_str_eq(json_string_value
+                     (json_object_get(json_array_get(ranked, 0),
+                                      JSON_RESOURCE_KEY)), "slow");
+    ck_assert_str_eq(json_string_value
+                     (json_object_get(json_array_get(ranked, 1),
+                                      JSON_RESOURCE_KEY)), "new");
+    ck_assert_str_eq(json_string_value
+                     (json_object_get(json_array_get(ranked, 2),
+                                      JSON_RESOURCE_KEY)), "fast");
+    json_decref(ranked);
+    json_decref(replicates);
+
+    ck_assert_int_ne(set_replica_selection(1, "a,b,c,d,e,f,g,h,i,j,k,l,"
+                                           "m,n,o,p,q"), 0);
+
+    // A chosen replicate is read and its throughput measured
+    set_replica_selection(1, NULL);
+    clear_replica_throughput();
+
+    char rods_root[MAX_PATH_LEN];
+    set_current_rods_root(TEST_COLL, rods_root);
+
+    char obj_path[MAX_PATH_LEN];
+    snprintf(obj_path, MAX_PATH_LEN, "%s/lorem_10k.txt", rods_root);
+
+    rodsPath_t rods_obj_path;
+    resolve_rods_path(conn, &env, &rods_obj_path, obj_path, flags, &error);
+    ck_assert_int_eq(error.code, 0);
+
+    data_obj_file_t *obj = open_data_obj(conn, &rods_obj_path, O_RDONLY,
+                                         &error);
+    ck_assert_int_eq(error.code, 0);
+    ck_assert_ptr_ne(obj->resource, NULL);
+
+    char buffer[1024];
+    size_t total = 0;
+    size_t nr;
+    while ((nr = read_chunk(conn, obj, buffer, sizeof buffer,
+                            &error)) > 0) {
+        total += nr;
+    }
+    ck_assert_int_eq(error.code, 0);
+    ck_assert_int_eq(total, 10240);
+
+    char resource[MAX_NAME_LEN];
+    snprintf(resource, sizeof resource, "%s", obj->resource);
+
+    ck_assert_int_eq(close_data_obj(conn, obj), 0);
+    free_data_obj(obj);
+    ck_assert(get_replica_throughput(resource) > 0);
+
+    set_replica_selection(0, NULL);
+    clear_replica_throughput();
+    ck_assert(!use_replica_selection());
+
+    if (conn) rcDisconnect(conn);
+}
+END_TEST
+
 START_TEST(test_put_data_obj) {
     option_flags flags = 0;
     rodsEnv env;
@@ -2191,6 +4278,160 @@ START_TEST(test_do_operation) {
 }
 END_TEST
 
+// Can we do a sequence of baton operations concurrently, using a
+// pool of workers?
+START_TEST(test_do_operation_workers) {
+    option_flags flags = PRINT_ACL | PRINT_AVU | PRESERVE_ORDER;
+
+    char rods_root[MAX_PATH_LEN];
+    set_current_rods_root(TEST_COLL, rods_root);
+
+    FILE *json_tmp     = tmpfile();
+    size_t buffer_size = 1024;
+    const char *names[] = { "f1.txt", "f2.txt", "f3.txt",
+                            "lorem_1b.txt", "lorem_1k.txt", "lorem_10k.txt" };
+    int num_names = 6;
+
+    for (int i = 0; i < num_names; i++) {
+        json_t *obj = json_pack("{s:s, s:s}",
+                                JSON_COLLECTION_KEY,  rods_root,
+                                JSON_DATA_OBJECT_KEY, names[i]);
+        json_dumpf(obj, json_tmp, 0);
+        json_decref(obj);
+    }
+
+    operation_args_t args = { .flags       = flags,
+                              .buffer_size = buffer_size,
+                              .zone_name   = NULL,
+                              .num_workers = 3 };
+
+    rewind(json_tmp);
+    int pass_status = do_operation(json_tmp, baton_json_list_op, &args);
+    ck_assert_int_eq(pass_status, 0);
+
+    args.flags = flags & ~PRESERVE_ORDER;
+    rewind(json_tmp);
+    pass_status = do_operation(json_tmp, baton_json_list_op, &args);
+    ck_assert_int_eq(pass_status, 0);
+
+    // Add JSON for a non-existent file; should fail
+    json_t *incorrect_obj = json_pack("{s:s, s:s}",
+                                      JSON_COLLECTION_KEY,  rods_root,
+                                      JSON_DATA_OBJECT_KEY, "INVALID");
+    json_dumpf(incorrect_obj, json_tmp, 0);
+
+    rewind(json_tmp);
+    int fail_status = do_operation(json_tmp, baton_json_list_op, &args);
+    ck_assert_int_ne(fail_status, 0);
+
+    fclose(json_tmp);
+    json_decref(incorrect_obj);
+}
+END_TEST
+
+typedef struct test_server {
+    char socket_path[MAX_NAME_LEN];
+    operation_args_t args;
+    baton_error_t error;
+} test_server_t;
+
+static void *run_test_server(void *arg) {
+    test_server_t *server = arg;
+    serve_operations(server->socket_path, baton_json_dispatch_op,
+                     &server->args, &server->error);
+
+    return NULL;
+}
+
+// Can a client have operations done by a server over its
+// connections?
+START_TEST(test_serve_operations) {
+    char rods_root[MAX_PATH_LEN];
+    set_current_rods_root(TEST_COLL, rods_root);
+
+    char dir_template[] = "baton_test_server.XXXXXX";
+    ck_assert_ptr_ne(mkdtemp(dir_template), NULL);
+
+    test_server_t server = { .args = { .flags       = 0,
+                                       .buffer_size = 1024,
+                                       .num_workers = 2 } };
+    snprintf(server.socket_path, sizeof server.socket_path, "%s/baton.sock",
+             dir_template);
+
+    pthread_t thread;
+    ck_assert_int_eq(pthread_create(&thread, NULL, run_test_server,
+                                    &server), 0);
+
+    baton_error_t connect_error;
+    int sock = -1;
+    for (int i = 0; i < 100 && sock < 0; i++) {
+        usleep(100000);
+        sock = connect_server(server.socket_path, &connect_error);
+    }
+    ck_assert_int_ge(sock, 0);
+
+    // A data object that exists, then one that does not
+    FILE *in = tmpfile();
+    const char *names[] = { "lorem_10k.txt", "INVALID" };
+    for (int i = 0; i < 2; i++) {
+        json_t *envelope =
+            json_pack("{s:s, s:{s:b}, s:{s:s, s:s}}",
+                      JSON_OP_KEY, JSON_LIST_OP,
+                      "arguments", "size", 1,
+                      JSON_TARGET_KEY,
+                      JSON_COLLECTION_KEY,  rods_root,
+                      JSON_DATA_OBJECT_KEY, names[i]);
+        json_dumpf(envelope, in, 0);
+        json_decref(envelope);
+    }
+    rewind(in);
+
+    FILE *out = tmpfile();
+    baton_error_t relay_error;
+    size_t num_failed;
+    relay_server(sock, fileno(in), fileno(out), &num_failed, &relay_error);
+    ck_assert_int_eq(relay_error.code, 0);
+    ck_assert_int_eq(num_failed, 1);
+    close(sock);
+
+    rewind(out);
+    json_error_t load_error;
+    json_t *first = json_loadf(out, JSON_DISABLE_EOF_CHECK, &load_error);
+    json_t *second = json_loadf(out, JSON_DISABLE_EOF_CHECK, &load_error);
+    ck_assert_ptr_ne(first, NULL);
+    ck_assert_ptr_ne(second, NULL);
+
+    json_t *result = json_object_get(first, JSON_RESULT_KEY);
+    ck_assert_int_eq(json_integer_value(json_object_get(result,
+                                                        JSON_SIZE_KEY)),
+                     10240);
+    ck_assert_ptr_ne(json_object_get(second, JSON_ERROR_KEY), NULL);
+
+    // The session status is not part of the output
+    ck_assert_ptr_eq(json_loadf(out, JSON_DISABLE_EOF_CHECK, &load_error),
+                     NULL);
+
+    json_decref(first);
+    json_decref(second);
+    fclose(in);
+    fclose(out);
+
+    // A second server may not take over the socket
+    test_server_t other = { .args = { .num_workers = 1 } };
+    snprintf(other.socket_path, sizeof other.socket_path, "%s",
+             server.socket_path);
+    run_test_server(&other);
+    ck_assert_int_ne(other.error.code, 0);
+
+    stop_server();
+    pthread_join(thread, NULL);
+    ck_assert_int_eq(server.error.code, 0);
+    ck_assert_int_ne(access(server.socket_path, F_OK), 0);
+
+    rmdir(dir_template);
+}
+END_TEST
+
 // Tests that the `irods_get_sql_for_specific_alias` method can be
 // used to get the SQL associated to a given alias.
 START_TEST(test_irods_get_sql_for_specific_alias_with_alias) {
@@ -2498,12 +4739,22 @@ Suite *baton_suite(void) {
     tcase_add_test(utilities, test_str_equals_ignore_case);
     tcase_add_test(utilities, test_str_starts_with);
     tcase_add_test(utilities, test_str_ends_with);
+    tcase_add_test(utilities, test_path_beneath);
     tcase_add_test(utilities, test_parse_base_name);
     tcase_add_test(utilities, test_maybe_stdin);
     tcase_add_test(utilities, test_format_timestamp);
     tcase_add_test(utilities, test_parse_timestamp);
     tcase_add_test(utilities, test_parse_size);
+    tcase_add_test(utilities, test_local_file_io);
+    tcase_add_test(utilities, test_stream_encoding);
     tcase_add_test(utilities, test_to_utf8);
+    tcase_add_test(utilities, test_utf8_valid_prefix);
+    tcase_add_test(utilities, test_utf8_validator);
+    tcase_add_test(utilities, test_query_page_size);
+    tcase_add_test(utilities, test_rpc_stats);
+    tcase_add_test(utilities, test_logmsg_lazy);
+    tcase_add_test(utilities, test_json_arena);
+    tcase_add_test(utilities, test_specific_cache);
 
     TCase *basic = tcase_create("basic");
     tcase_add_unchecked_fixture(basic, setup, teardown);
@@ -2514,20 +4765,29 @@ Suite *baton_suite(void) {
     tcase_add_test(basic, test_init_rods_path);
     tcase_add_test(basic, test_resolve_rods_path);
     tcase_add_test(basic, test_make_query_input);
+    tcase_add_test(basic, test_prepared_query);
 
     TCase *path = tcase_create("path");
     tcase_add_unchecked_fixture(path, setup, teardown);
     tcase_add_checked_fixture(path, basic_setup, basic_teardown);
 
+    tcase_add_test(path, test_stat_cache);
+    tcase_add_test(path, test_target_run);
     tcase_add_test(path, test_list_missing_path);
     tcase_add_test(path, test_list_obj);
     tcase_add_test(path, test_list_coll);
     tcase_add_test(path, test_list_coll_contents);
+    tcase_add_test(path, test_list_coll_contents_attrs);
+    tcase_add_test(path, test_list_coll_contents_recurse);
+    tcase_add_test(path, test_list_coll_contents_recurse_siblings);
+    tcase_add_test(path, test_list_coll_contents_page);
     tcase_add_test(path, test_list_permissions_missing_path);
     tcase_add_test(path, test_list_permissions_obj);
     tcase_add_test(path, test_list_permissions_coll);
     tcase_add_test(path, test_modify_permissions_obj);
     tcase_add_test(path, test_modify_json_permissions_obj);
+    tcase_add_test(path, test_apply_permissions);
+    tcase_add_test(path, test_apply_permissions_siblings);
     tcase_add_test(path, test_list_replicates_obj);
     tcase_add_test(path, test_list_timestamps_obj);
     tcase_add_test(path, test_list_timestamps_coll);
@@ -2539,12 +4799,19 @@ Suite *baton_suite(void) {
     tcase_add_test(metadata, test_list_metadata_obj);
     tcase_add_test(metadata, test_list_metadata_coll);
     tcase_add_test(metadata, test_contains_avu);
+    tcase_add_test(metadata, test_avu_difference);
+    tcase_add_test(metadata, test_add_avus_json_array);
     tcase_add_test(metadata, test_add_metadata_missing_path);
     tcase_add_test(metadata, test_remove_metadata_obj);
     tcase_add_test(metadata, test_add_json_metadata_obj);
     tcase_add_test(metadata, test_remove_json_metadata_obj);
+    tcase_add_test(metadata, test_supersede_json_metadata_obj);
     tcase_add_test(metadata, test_search_metadata_obj);
+    tcase_add_test(metadata, test_search_metadata_stream);
+    tcase_add_test(metadata, test_search_metadata_stream_arena);
     tcase_add_test(metadata, test_search_metadata_coll);
+    tcase_add_test(metadata, test_search_metadata_concurrent);
+    tcase_add_test(metadata, test_search_metadata_zones);
     tcase_add_test(metadata, test_search_metadata_path_obj);
     tcase_add_test(metadata, test_search_metadata_perm_obj);
     tcase_add_test(metadata, test_search_metadata_tps_obj);
@@ -2554,11 +4821,17 @@ Suite *baton_suite(void) {
     tcase_add_checked_fixture(read_write, basic_setup, basic_teardown);
 
     tcase_add_test(read_write, test_get_data_obj_stream);
+    tcase_add_test(read_write, test_checksum_validation);
     tcase_add_test(read_write, test_get_data_obj_file);
     tcase_add_test(read_write, test_slurp_data_obj);
     tcase_add_test(read_write, test_ingest_data_obj);
     tcase_add_test(read_write, test_write_data_obj);
     tcase_add_test(read_write, test_put_data_obj);
+    tcase_add_test(read_write, test_parallel_transfer);
+    tcase_add_test(read_write, test_put_get_tree);
+    tcase_add_test(read_write, test_local_file_unchanged);
+    tcase_add_test(read_write, test_transfer_retries);
+    tcase_add_test(read_write, test_rank_replicates);
 
     TCase *json = tcase_create("json");
     tcase_add_unchecked_fixture(json, setup, teardown);
@@ -2568,9 +4841,13 @@ Suite *baton_suite(void) {
     tcase_add_test(json, test_represents_data_object);
     tcase_add_test(json, test_represents_directory);
     tcase_add_test(json, test_represents_file);
+    tcase_add_test(json, test_json_output);
+    tcase_add_test(json, test_json_reader);
     tcase_add_test(json, test_json_to_path);
     tcase_add_test(json, test_json_to_local_path);
     tcase_add_test(json, test_do_operation);
+    tcase_add_test(json, test_do_operation_workers);
+    tcase_add_test(json, test_serve_operations);
 
     TCase *specific_query = tcase_create("specific_query");
     tcase_add_unchecked_fixture(specific_query, setup, teardown);
@@ -0,0 +1,124 @@
+#!/bin/bash
+#
+# This script runs end-to-end throughput benchmarks of baton-do against
+# an iRODS server, using test data staged by setup_irods.sh. It prints
+# one JSON object per benchmark to STDOUT, including the iRODS request
+# statistics reported by --stats.
+#
+# Usage: bench_irods.sh <baton bin dir> <test resource> [<iRODS path>]
+#
+# The sizes of the benchmarks may be set in the environment:
+#
+#   BENCH_LIST_OBJECTS   Objects in the listed collection (10000)
+#   BENCH_QUERY_OBJECTS  Objects matched by metaquery (100000)
+#   BENCH_FILE_SIZES     Sizes of files for get and put ("1K 1M 64M 1G")
+#   BENCH_WORKERS        The number of baton-do workers (4)
+#
+
+E_ARGS_MISSING=3
+
+bin_path=$1
+test_resc=$2
+irods_root=${3:-$(ipwd)/baton-bench.$$}
+
+if [ $# -lt 2 ]
+then
+    echo "Insufficient command line arguments; expected 2 or 3" >&2
+    exit $E_ARGS_MISSING
+fi
+
+list_objects=${BENCH_LIST_OBJECTS:-10000}
+query_objects=${BENCH_QUERY_OBJECTS:-100000}
+file_sizes=${BENCH_FILE_SIZES:-"1K 1M 64M 1G"}
+num_workers=${BENCH_WORKERS:-4}
+
+script_dir=$(cd "$(dirname "$0")" && pwd)
+work_dir=$(mktemp -d)
+trap 'rm -rf "$work_dir"' EXIT
+
+# Run baton-do on a file of JSON envelopes, printing a JSON result
+# line. Arguments: name, items, bytes, input file, then any further
+# baton-do arguments.
+run_bench() {
+    local name=$1 items=$2 bytes=$3 input=$4
+    shift 4
+
+    local start=$(date +%s.%N)
+    "$bin_path/baton-do" "$@" --silent --stats --file "$input" \
+                         >/dev/null 2>"$work_dir/stats.json"
+    local status=$?
+    local end=$(date +%s.%N)
+
+    local stats=$(tail -n 1 "$work_dir/stats.json")
+    printf '{"benchmark": "%s", "status": %d, "items": %d, "bytes": %d, ' \
+           "$name" $status $items $bytes
+    printf '"seconds": %s, "stats": %s}\n' \
+           $(awk "BEGIN { print $end - $start }") "${stats:-null}"
+}
+
+# Print a baton-do envelope. Arguments: operation, arguments, target.
+envelope() {
+    printf '{"operation": "%s", "arguments": %s, "target": %s}\n' "$1" "$2" "$3"
+}
+
+# Stage a collection of empty files using setup_irods.sh
+stage_objects() {
+    local dir=$1 num=$2
+
+    mkdir -p "$dir"
+    for ((i = 0; i < num; i++))
+    do
+        : > "$dir/f$i.txt"
+    done
+
+    "$script_dir/setup_irods.sh" "$dir" "$irods_root/$(basename "$dir")" \
+                                 $test_resc >&2
+}
+
+imkdir -p "$irods_root"
+
+# List a large collection with all flags
+stage_objects "$work_dir/list" $list_objects
+envelope list '{"acl": true, "avu": true, "checksum": true, "contents": true,
+                "replicate": true, "size": true, "timestamp": true}' \
+         "{\"collection\": \"$irods_root/list\"}" > "$work_dir/list.json"
+run_bench list_all_flags $list_objects 0 "$work_dir/list.json"
+
+# Add an AVU to many objects, serially and then with several workers
+stage_objects "$work_dir/query" $query_objects
+for attr in bench bench_workers
+do
+    for ((i = 0; i < query_objects; i++))
+    do
+        envelope metamod '{"operation": "add"}' \
+                 "{\"collection\": \"$irods_root/query\", \"data_object\": \"f$i.txt\", \"avus\": [{\"attribute\": \"$attr\", \"value\": \"hit\"}]}"
+    done > "$work_dir/metamod_$attr.json"
+done
+run_bench bulk_metamod $query_objects 0 "$work_dir/metamod_bench.json"
+run_bench bulk_metamod_workers $query_objects 0 \
+          "$work_dir/metamod_bench_workers.json" --workers $num_workers
+
+# Find all the objects having that AVU
+envelope metaquery '{"object": true}' \
+         "{\"collection\": \"$irods_root/query\", \"avus\": [{\"attribute\": \"bench\", \"value\": \"hit\"}]}" \
+         > "$work_dir/metaquery.json"
+run_bench metaquery_hits $query_objects 0 "$work_dir/metaquery.json"
+
+# Put and get files of each size
+mkdir -p "$work_dir/files" "$work_dir/saved"
+imkdir -p "$irods_root/files"
+for size in $file_sizes
+do
+    head -c $(numfmt --from=iec $size) /dev/urandom > "$work_dir/files/$size"
+    bytes=$(stat -c %s "$work_dir/files/$size")
+
+    envelope put '{}' "{\"collection\": \"$irods_root/files\", \"data_object\": \"$size\", \"directory\": \"$work_dir/files\", \"file\": \"$size\"}" \
+             > "$work_dir/put.json"
+    run_bench put_$size 1 $bytes "$work_dir/put.json"
+
+    envelope get '{"save": true}' "{\"collection\": \"$irods_root/files\", \"data_object\": \"$size\", \"directory\": \"$work_dir/saved\", \"file\": \"$size\"}" \
+             > "$work_dir/get.json"
+    run_bench get_$size 1 $bytes "$work_dir/get.json"
+done
+
+"$script_dir/teardown_irods.sh" "$irods_root"